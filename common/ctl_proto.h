@@ -15,13 +15,17 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 enum ctl_proto_type {
     ctl_proto_type_get_attr_req,
     ctl_proto_type_get_attr_cfm,
     ctl_proto_type_get_attr_rej,
     ctl_proto_type_get_all_attr_req,
-    ctl_proto_type_get_all_attr_cfm
+    ctl_proto_type_get_all_attr_cfm,
+    ctl_proto_type_dump_req,
+    ctl_proto_type_dump_cfm,
+    ctl_proto_type_get_all_attr_partial_cfm
 };
 
 #define CTL_PROTO_DEFAULT_DIR "/run/xcm/ctl"
@@ -54,6 +58,10 @@ struct ctl_proto_get_attr_cfm
     struct ctl_proto_attr attr;
 };
 
+/* The size of a message is a part of the protocol, and thus this
+   limit may not be changed. A get-all response for a socket with
+   more attributes is sent as a get_all_attr_partial_cfm, and
+   clients wanting all attributes must use a dump request. */
 #define CTL_PROTO_MAX_ATTRS (32)
 
 struct ctl_proto_get_all_attr_cfm
@@ -62,6 +70,25 @@ struct ctl_proto_get_all_attr_cfm
     size_t attrs_len;
 };
 
+/* A dump record consists of a struct ctl_proto_dump_record header,
+   followed by the attribute name (without NUL terminator), and then
+   the attribute value. Records are packed back-to-back. */
+struct ctl_proto_dump_record
+{
+    uint8_t name_len;
+    uint8_t value_type;
+    uint16_t value_len;
+};
+
+/* Unlike other messages, the dump response is not a struct
+   ctl_proto_msg, but a variable-length message, consisting of this
+   header followed by records_len bytes of records. */
+struct ctl_proto_dump_cfm
+{
+    enum ctl_proto_type type;
+    uint32_t records_len;
+};
+
 struct ctl_proto_msg {
     enum ctl_proto_type type;
     union {
@@ -72,4 +99,13 @@ struct ctl_proto_msg {
     };
 };
 
+/* a message's type, without any type-specific part */
+#define CTL_PROTO_HDR_SIZE (offsetof(struct ctl_proto_msg, get_attr_req))
+
+/* dump_req has no type-specific part */
+#define CTL_PROTO_DUMP_REQ_SIZE CTL_PROTO_HDR_SIZE
+
+#define CTL_PROTO_DUMP_CFM_SIZE(records_len)			\
+    (sizeof(struct ctl_proto_dump_cfm) + (records_len))
+
 #endif
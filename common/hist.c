@@ -0,0 +1,78 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "hist.h"
+
+#include "util.h"
+
+#include <math.h>
+#include <string.h>
+
+void hist_init(struct hist *h)
+{
+    memset(h, 0, sizeof(struct hist));
+    h->min = UINT64_MAX;
+}
+
+static int hist_index(uint64_t value)
+{
+    if (value < HIST_SUB_BUCKETS)
+	return value;
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (HIST_SUB_BUCKET_BITS - 1);
+
+    return (shift + 1) * HIST_HALF_SUB_BUCKETS + (value >> shift) -
+	HIST_HALF_SUB_BUCKETS;
+}
+
+/* the highest value which maps to a particular bucket */
+static uint64_t hist_bucket_value(int idx)
+{
+    if (idx < HIST_SUB_BUCKETS)
+	return idx;
+
+    int shift = idx / HIST_HALF_SUB_BUCKETS - 1;
+    uint64_t mantissa = idx % HIST_HALF_SUB_BUCKETS + HIST_HALF_SUB_BUCKETS;
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void hist_record(struct hist *h, uint64_t value)
+{
+    h->counts[hist_index(value)]++;
+    h->total++;
+    h->min = UT_MIN(h->min, value);
+    h->max = UT_MAX(h->max, value);
+}
+
+void hist_merge(struct hist *dst, const struct hist *src)
+{
+    int i;
+    for (i = 0; i < HIST_BUCKETS; i++)
+	dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    dst->min = UT_MIN(dst->min, src->min);
+    dst->max = UT_MAX(dst->max, src->max);
+}
+
+uint64_t hist_percentile(const struct hist *h, double percentile)
+{
+    if (h->total == 0)
+	return 0;
+
+    uint64_t target = ceil(h->total * percentile / 100);
+    target = UT_MAX(target, 1);
+
+    uint64_t count = 0;
+    int i;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	count += h->counts[i];
+	if (count >= target)
+	    return UT_MIN(hist_bucket_value(i), h->max);
+    }
+
+    return h->max;
+}
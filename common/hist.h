@@ -0,0 +1,37 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+
+/*
+ * Latency histogram with logarithmic magnitudes, each divided into
+ * linear sub-buckets (in the style of HdrHistogram). The relative
+ * error is bounded to 1/HIST_HALF_SUB_BUCKETS (~1.6%), and any 64-bit
+ * nanosecond value may be recorded.
+ */
+#define HIST_SUB_BUCKET_BITS (7)
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BUCKET_BITS)
+#define HIST_HALF_SUB_BUCKETS (HIST_SUB_BUCKETS / 2)
+#define HIST_BUCKETS ((64 - HIST_SUB_BUCKET_BITS + 2) * HIST_HALF_SUB_BUCKETS)
+
+struct hist
+{
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+};
+
+void hist_init(struct hist *h);
+void hist_record(struct hist *h, uint64_t value);
+void hist_merge(struct hist *dst, const struct hist *src);
+
+/* returns the (upper bound) value at 'percentile' (0-100) */
+uint64_t hist_percentile(const struct hist *h, double percentile);
+
+#endif
@@ -18,6 +18,7 @@
 #include <sys/stat.h>
 #include <sys/syscall.h> /* gettid */
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 void ut_mutex_init(pthread_mutex_t *m)
@@ -258,6 +259,13 @@ int ut_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
     return rc;
 }
 
+double ut_ftime(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec+((double)t.tv_nsec)/1e9;
+}
+
 void ut_die(const char *msg)
 {
     fprintf(stderr, "FATAL: %s: %s.\n", msg, strerror(errno));
@@ -46,6 +46,9 @@ int ut_self_net_ns(char *name);
 
 int ut_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 
+/* monotonic time, in seconds */
+double ut_ftime(void);
+
 void ut_die(const char *msg) __attribute__ ((__noreturn__));
 
 extern bool ut_dprint_enabled;
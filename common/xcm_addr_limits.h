@@ -26,4 +26,11 @@
 
 #define UX_NAME_MAX (UNIX_PATH_MAX-1)
 
+/* SHM names are mapped to UNIX domain socket abstract names, with a
+   transport-specific prefix */
+#define SHM_NAME_PREFIX "xcm-shm."
+#define SHM_NAME_MAX (UX_NAME_MAX-(sizeof(SHM_NAME_PREFIX)-1))
+
+#define INPROC_NAME_MAX (255)
+
 #endif
@@ -18,6 +18,14 @@
 
 #define XCM_ATTR_XCM_MAX_MSG_SIZE "xcm.max_msg_size"
 
+#define XCM_ATTR_XCM_BUSY_POLL_US "xcm.busy_poll_us"
+#define XCM_ATTR_XCM_BUSY_POLL_HITS "xcm.busy_poll_hits"
+#define XCM_ATTR_XCM_BUSY_POLL_MISSES "xcm.busy_poll_misses"
+#define XCM_ATTR_XCM_CONNECT_TIMEOUT "xcm.connect_timeout"
+#define XCM_ATTR_XCM_ACCEPT_TIMEOUT "xcm.accept_timeout"
+#define XCM_ATTR_XCM_SEND_TIMEOUT "xcm.send_timeout"
+#define XCM_ATTR_XCM_RECEIVE_TIMEOUT "xcm.receive_timeout"
+
 #define XCM_ATTR_XCM_TO_APP_MSGS "xcm.to_app_msgs"
 #define XCM_ATTR_XCM_TO_APP_BYTES "xcm.to_app_bytes"
 
@@ -44,6 +52,33 @@
 #define XCM_ATTR_TCP_KEEPALIVE_COUNT "tcp.keepalive_count"
 #define XCM_ATTR_TCP_USER_TIMEOUT "tcp.user_timeout"
 
+#define XCM_ATTR_TCP_CWND "tcp.cwnd"
+#define XCM_ATTR_TCP_PACING_RATE "tcp.pacing_rate"
+#define XCM_ATTR_TCP_DELIVERY_RATE "tcp.delivery_rate"
+#define XCM_ATTR_TCP_UNACKED "tcp.unacked"
+#define XCM_ATTR_TCP_NOTSENT_BYTES "tcp.notsent_bytes"
+
+#define XCM_ATTR_TCP_SNDBUF "tcp.sndbuf"
+#define XCM_ATTR_TCP_RCVBUF "tcp.rcvbuf"
+#define XCM_ATTR_TCP_NOTSENT_LOWAT "tcp.notsent_lowat"
+#define XCM_ATTR_TCP_QUICKACK "tcp.quickack"
+#define XCM_ATTR_TCP_CONGESTION_CONTROL "tcp.congestion_control"
+
+#define XCM_ATTR_TCP_FASTOPEN "tcp.fastopen"
+#define XCM_ATTR_TCP_FASTOPEN_USED "tcp.fastopen_used"
+
+#define XCM_ATTR_TCP_INCOMING_CPU "tcp.incoming_cpu"
+
+#define XCM_ATTR_TCP_STATE "tcp.state"
+
+#define XCM_ATTR_IP_DSCP "ip.dscp"
+
+#define XCM_ATTR_UX_READ_AHEAD "ux.read_ahead"
+
+#define XCM_ATTR_SCTP_STREAMS "sctp.streams"
+#define XCM_ATTR_SCTP_SEND_STREAM "sctp.send_stream"
+#define XCM_ATTR_SCTP_UNORDERED "sctp.unordered"
+
 #define XCM_ATTR_TLS_PEER_SUBJECT_KEY_ID "tls.peer_subject_key_id"
 
 #endif
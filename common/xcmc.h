@@ -29,7 +29,18 @@ int xcmc_attr_get(struct xcmc_session *session, const char *attr_name,
 typedef void (*xcmc_attr_cb)(const char *attr_name, enum xcm_attr_type type,
 			     void *attr_value, size_t attr_len, void *cb_data);
 
+/* Returns 0 if all attributes were retrieved, and 1 in case the
+   socket has more attributes than fit into a single response, in
+   which case the remaining attributes are left out. xcmc_dump() has
+   no such limitation. */
 int xcmc_attr_get_all(struct xcmc_session *session, xcmc_attr_cb cb,
 		      void *cb_data);
 
+typedef void (*xcmc_dump_cb)(pid_t creator_pid, int64_t sock_ref,
+			     const char *attr_name, enum xcm_attr_type type,
+			     void *attr_value, size_t attr_len,
+			     void *cb_data);
+
+int xcmc_dump(pid_t creator_pid, xcmc_dump_cb cb, void *cb_data);
+
 #endif
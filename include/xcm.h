@@ -24,7 +24,7 @@ extern "C" {
  * available in xcm_compat.h
  *
  * @author Mattias Rönnblom
- * @version 0.15 [API]
+ * @version 0.16 [API]
  * @version 1.1.0 [Implementation]
  *
  * The low API/ABI version number is purely a result of all XCM
@@ -104,6 +104,12 @@ extern "C" {
  * have the following format: @n
  * @code uxf:<file system path> @endcode
  *
+ * The SHM shared memory transport uses addresses in the form: @n
+ * @code shm:<name> @endcode
+ *
+ * The INPROC in-process transport uses addresses in the form: @n
+ * @code inproc:<name> @endcode
+ *
  * For the TCP, TLS, UTLS and SCTP transports the syntax is: @n
  * @code
  * tcp:(<DNS domain name>|<IPv4 address>|[<IPv6 address>]|[*]|*):<port>
@@ -574,6 +580,61 @@ extern "C" {
  * xcm.blocking   | All         | Boolean    | RW    | See xcm_set_blocking() and xcm_is_blocking().
  * xcm.remote_addr | Connection | String     | R    | See xcm_remote_addr().
  * xcm.max_msg_size | Connection | Integer   | R    | The maximum size of any message transported by this connection.
+ * xcm.busy_poll_us | All        | Integer    | RW   | Time (in microseconds) to spin before sleeping in a blocking operation. Default is 0 (disabled). See @ref busy_poll.
+ * xcm.busy_poll_hits | All      | Integer    | R    | Number of blocking receive operations which waited, and completed during the spin period.
+ * xcm.busy_poll_misses | All    | Integer    | R    | Number of blocking receive operations which waited past the spin period.
+ * xcm.connect_timeout | Connection | Integer  | RW   | Timeout (in milliseconds) for a blocking connect. Default is 0 (no timeout). See @ref timeouts.
+ * xcm.accept_timeout | Server     | Integer    | RW   | Timeout (in milliseconds) for a blocking accept. Default is 0 (no timeout).
+ * xcm.send_timeout | Connection   | Integer    | RW   | Timeout (in milliseconds) for a blocking send. Default is 0 (no timeout).
+ * xcm.receive_timeout | Connection | Integer  | RW   | Timeout (in milliseconds) for a blocking receive. Default is 0 (no timeout).
+ *
+ * @subsubsection timeouts Timeouts
+ *
+ * By default, API calls on a socket in blocking mode wait until the
+ * operation completes or fails. The timeout attributes allow the
+ * application to bound this wait. If the operation has not completed
+ * within the timeout, the call will fail with errno set to ETIMEDOUT.
+ *
+ * The xcm.connect_timeout covers the connection establishment, which,
+ * depending on transport, includes things like DNS resolution and
+ * the TCP and TLS handshakes, and must be supplied to
+ * xcm_connect_a() for it to have any effect. A connection socket that
+ * has timed out during establishment is closed.
+ *
+ * A send or receive timeout leaves the connection usable. The
+ * xcm.send_timeout only covers the time waiting for XCM to accept
+ * the message. A blocking xcm_send() which fails with ETIMEDOUT has
+ * not had its message accepted, and the message will not be
+ * delivered. Once accepted, XCM attempts to hand over the message to
+ * the lower layer within what remains of the timeout. If that
+ * doesn't complete in time, xcm_send() still returns success, and
+ * the hand-over is completed in the course of subsequent operations
+ * on the socket. A message in this state may be lost, in case the
+ * connection is closed before the hand-over has completed.
+ *
+ * The timeout attributes have no effect on sockets in non-blocking
+ * mode. For such sockets, xcm_await_timeout() may be used to wait
+ * for a limited time for the socket to become ready.
+ *
+ * @subsubsection busy_poll Busy Polling
+ *
+ * A socket in blocking mode normally puts the calling thread to sleep
+ * when an operation cannot be completed immediately. For
+ * latency-sensitive applications, the cost of the sleep and the
+ * subsequent wakeup may be significant. If xcm.busy_poll_us is set to
+ * a non-zero value, XCM will instead spin, retrying the operation in
+ * a non-blocking manner, for up to that many microseconds, before
+ * falling back to sleeping. Spinning consumes CPU cycles, and is
+ * only useful if the thread has a CPU core more or less to itself.
+ * Busy polling applies to blocking send, receive and connection
+ * establishment, but not to xcm_accept().
+ *
+ * For the TCP, TLS and SCTP transports, the value is also applied to
+ * the kernel connection socket's SO_BUSY_POLL option, at the time the
+ * socket is created, and whenever the attribute is changed. Setting
+ * SO_BUSY_POLL to a value higher than the net.core.busy_poll sysctl
+ * requires the CAP_NET_ADMIN capability. A failure to set the socket
+ * option is logged, but otherwise ignored.
  *
  * @subsubsection cnt_attr Generic Message Counter Attributes
  *
@@ -664,6 +725,21 @@ extern "C" {
  * ctl_api to iterate of the system's current XCM sockets, and allow
  * access (primarily for debugging purposes) to the sockets'
  * attributes.
+ *
+ * The @c xcmctl @c dump command retrieves all attributes of all
+ * sockets owned by a particular process (or all processes) in one
+ * go. The control requests are sent to many sockets concurrently, and
+ * the responses are compact, variable-length records, making it
+ * possible to take a snapshot of processes with a large number of
+ * connections in a short period of time.
+ *
+ * The @c xcmctl @c top command periodically samples the sockets'
+ * message and byte counters, and TCP round-trip time and
+ * retransmission counters (where available), and displays the sockets
+ * sorted by throughput. The per-socket transmit and receive queue
+ * occupancy is derived from the difference between the application-
+ * and lower layer-facing message counters. Connections with messages
+ * queued, but without progress, are marked as stalled.
  * 
  * @section thread_safety Thread Safety
  *
@@ -729,6 +805,28 @@ extern "C" {
  *
  * UX is the most efficient of the XCM transports.
  *
+ * xcm_send_batch() and xcm_receive_batch() map to sendmmsg() and
+ * recvmmsg(), respectively, and thus move many messages in a single
+ * system call.
+ *
+ * On connections with the @c ux.read_ahead attribute enabled,
+ * xcm_receive() will in addition read ahead a small number of
+ * messages into a per-connection buffer, in case more than one
+ * message is queued in the socket. Subsequent xcm_receive() calls are
+ * served from this buffer. Every buffer slot holds a maximum-sized
+ * message, so read-ahead costs up to a few hundred kB of memory per
+ * connection, allocated on first use. Read-ahead is disabled by
+ * default.
+ *
+ * Attribute Name     | Socket Type | Value Type | Mode | Description
+ * -------------------|-------------|------------|------|------------
+ * ux.read_ahead      | Connection  | Boolean    | RW   | Controls if xcm_receive() reads ahead messages. Default is false.
+ *
+ * UX connections may carry file descriptors (see xcm_send_fds() and
+ * xcm_receive_fds()). This in turn allows large payloads to be handed
+ * over in a sealed memory file (see xcm_send_memfd()), which the
+ * receiver maps into its address space rather than copying.
+ *
  * @subsubsection ux_naming UX Namespace
  *
  * The standard UNIX Domain Sockets as defined by POSIX uses the file
@@ -770,6 +868,63 @@ extern "C" {
  * socket. This file will prevent the creation another server socket
  * with the same name.
  *
+ * @subsection shm_transport SHM Transport
+ *
+ * The SHM transport passes messages through shared memory, and is
+ * intended for high-rate messaging between processes on the same
+ * host.
+ *
+ * Upon connection establishment, the client creates a memory area
+ * holding one ring buffer per direction, and hands it over to the
+ * server over a UX-style UNIX domain socket connection. Sending and
+ * receiving a message amounts to a copy into or out of the ring
+ * buffer. The kernel is only involved when a process needs to wait
+ * for its peer (i.e., for a message to arrive, or for space to
+ * become available in the ring), in which case an eventfd is used
+ * for wakeup. Applications that send and receive messages in
+ * batches benefit the most from this design.
+ *
+ * The SHM server socket name is kept in the UNIX domain socket
+ * abstract namespace, in a separate part from UX names. Thus, SHM
+ * and UX server sockets with the same name may co-exist. The rules
+ * of the @ref ux_naming apply, including those concerning
+ * kernel-generated names for the client-side connection socket.
+ *
+ * The UNIX domain socket is kept open throughout the life time of
+ * the XCM connection, and is used to detect that the remote peer
+ * process has terminated without closing the connection.
+ *
+ * The maximum message size is the same as for the @ref
+ * ux_transport. Each connection consumes roughly 0.5 MB of
+ * (lazily allocated) shared memory and four file descriptors per
+ * process.
+ *
+ * @subsection inproc_transport INPROC Transport
+ *
+ * The INPROC transport connects XCM sockets residing in the same
+ * process, for instance to allow two threads to communicate using
+ * the same API as they would use for communicating with other
+ * processes.
+ *
+ * INPROC server socket names are kept in a process-global registry,
+ * and are not visible outside the process. A connection is made up
+ * of two ring buffers (one per direction) in ordinary process
+ * memory. Like for the @ref shm_transport, an eventfd is used to
+ * wake up a waiting peer, and no system calls are made in case the
+ * peer is busy.
+ *
+ * The client-side connection socket is assigned a unique name,
+ * which is visible as the local address of the client socket and
+ * the remote address of the server's connection socket.
+ *
+ * The in-process registry is not shared across fork(). An INPROC
+ * socket inherited by a child process may only be cleaned up (using
+ * xcm_cleanup()) in the child.
+ *
+ * The maximum message size is 65535 bytes. Connections that have
+ * not yet been accepted are limited to 32 per server socket, beyond
+ * which xcm_connect() fails with EAGAIN.
+ *
  * @subsection tcp_transport TCP Transport
  *
  * The TCP transport uses the Transmission Control Protocol (TCP), by
@@ -798,7 +953,37 @@ extern "C" {
  * See the tcp(7) manual page for a more detailed description of these
  * attributes. The struct retrieved with @c TCP_INFO is the basis for
  * the read-only attributes. The read-write attributes are mapped to
- * @c TCP_KEEP* and @c TCP_USER_TIMEOUT.
+ * @c TCP_KEEP*, @c TCP_USER_TIMEOUT, @c SO_SNDBUF, @c SO_RCVBUF, @c
+ * TCP_NOTSENT_LOWAT, @c TCP_QUICKACK, @c TCP_CONGESTION, and @c
+ * IP_TOS (or @c IPV6_TCLASS).
+ *
+ * The kernel disables @c TCP_QUICKACK after a while. When @c
+ * tcp.quickack is enabled, XCM re-enables it after every read on the
+ * socket.
+ *
+ * For @c tcp.sndbuf, @c tcp.rcvbuf and @c tcp.notsent_lowat, zero
+ * (the default) means the system default is used. The kernel doubles
+ * the buffer size values (see socket(7)). To affect the TCP window
+ * scale, the buffer sizes should be set at socket creation time.
+ *
+ * If no congestion control algorithm has been set, @c
+ * tcp.congestion_control holds the system default (once the socket
+ * has been created).
+ *
+ * @c tcp.fastopen enables TCP Fast Open (TFO), and must be set at
+ * socket creation time. On a server socket, it's mapped to @c
+ * TCP_FASTOPEN, and on a connection socket to @c
+ * TCP_FASTOPEN_CONNECT. A client which holds a TFO cookie for the
+ * server will carry the first data (e.g., the TLS ClientHello) in
+ * the SYN, saving one round-trip. The connection request is deferred
+ * until the first data is sent, and thus the connection will not be
+ * established until the client has sent something. @c tcp.fastopen
+ * must not be used with protocols where the server speaks first
+ * (i.e., where the client waits for the server's first message), since
+ * the connection will stall. TFO must also be enabled in the
+ * kernel (see @c net.ipv4.tcp_fastopen in ip-sysctl.txt). Failing to
+ * enable TFO on a connection socket is not an error; the connection
+ * is established in the regular manner.
  *
  * Attribute Name     | Socket Type | Value Type | Mode | Description
  * -------------------|-------------|------------|------|------------
@@ -811,9 +996,25 @@ extern "C" {
  * tcp.keepalive_interval | Connection | Integer | RW   | The time (in s) between keepalive probes.
  * tcp.keepalive_count | Connection | Integer    | RW   | The number of keepalive probes sent before the connection is dropped.
  * tcp.user_timeout   | Connection  | Integer    | RW   | The time (in s) before a connection is dropped due to unacknowledged data.
+ * tcp.cwnd           | Connection  | Integer    | R    | The current congestion window (in segments).
+ * tcp.pacing_rate    | Connection  | Integer    | R    | The current pacing rate (in bytes/s), or -1 if unlimited.
+ * tcp.delivery_rate  | Connection  | Integer    | R    | The most recent delivery rate estimate (in bytes/s).
+ * tcp.unacked        | Connection  | Integer    | R    | The number of sent, but not yet acknowledged, segments.
+ * tcp.notsent_bytes  | Connection  | Integer    | R    | The number of bytes not yet sent.
+ * tcp.sndbuf         | Connection  | Integer    | RW   | The socket send buffer size (in bytes).
+ * tcp.rcvbuf         | Connection  | Integer    | RW   | The socket receive buffer size (in bytes).
+ * tcp.notsent_lowat  | Connection  | Integer    | RW   | The amount of not-yet-sent data (in bytes) below which the socket is considered writable.
+ * tcp.quickack       | Connection  | Boolean    | RW   | Controls if ACKs are sent immediately, rather than delayed. Default is false.
+ * tcp.congestion_control | Connection | String  | RW   | The congestion control algorithm (e.g. "cubic" or "bbr").
+ * ip.dscp            | Connection  | Integer    | RW   | The Differentiated Services Code Point (DSCP) used. Default is 40.
+ * tcp.fastopen       | All         | Boolean    | RW   | Controls if TCP Fast Open is enabled. Default is false. Not for server-speaks-first protocols.
+ * tcp.fastopen_used  | Connection  | Boolean    | R    | True if data was carried, and acknowledged, in the SYN.
+ * tcp.incoming_cpu   | Connection  | Integer    | R    | The CPU on which the connection's packets were most recently processed by the kernel, or -1 if not known.
+ * tcp.state          | Connection  | String     | R    | The kernel's TCP connection state (e.g. "established" or "close-wait").
  *
  * @warning @c tcp.segs_in and @c tcp.segs_out are only present when
- * running XCM on Linux kernel 4.2 or later.
+ * running XCM on Linux kernel 4.2 or later. @c tcp.notsent_bytes
+ * requires kernel 4.6, and @c tcp.delivery_rate kernel 4.9.
  *
  * @subsection tls_transport TLS Transport
  *
@@ -889,6 +1090,11 @@ extern "C" {
  * error and set errno to EPROTO. The application may choose to retry
  * at a later time.
  *
+ * OpenSSL is initialized, and the SSL contexts are created, when
+ * the first TLS socket is created in the process (or namespace). An
+ * application may use xcm_prewarm() to do this work at a time of its
+ * choosing.
+ *
  * @subsubsection tls_attr TLS Socket Attributes
  *
  * TLS has all the TCP-level attributes of the TCP transport; see
@@ -940,7 +1146,8 @@ extern "C" {
  * (SCTP). SCTP provides a reliable, message-oriented
  * service. In-order delivery is optional, but to adhere to XCM
  * semantics (and for other reasons) XCM leaves SCTP in-order delivery
- * enabled.
+ * enabled, unless the application explicitly asks otherwise (see
+ * @ref sctp_attr).
  *
  * The SCTP transport utilizes the native Linux kernel's
  * implementation of SCTP, via the BSD Socket API. The operating mode
@@ -952,6 +1159,34 @@ extern "C" {
  * To minimize latency, the SCTP transport disables the Nagle
  * algorithm.
  *
+ * @subsubsection sctp_attr SCTP Socket Attributes
+ *
+ * By default, all messages are sent in-order on stream 0, and thus a
+ * single lost packet delays the delivery of all messages sent after
+ * it. An application sending independent messages may spread them
+ * over several streams, and/or allow for unordered delivery, to avoid
+ * such head-of-line blocking. Message ordering is only maintained
+ * between messages sent, in-order, on the same stream.
+ *
+ * @c sctp.streams is the requested number of outbound streams, and
+ * is mapped to @c SCTP_INITMSG. It may only be set at socket creation
+ * time. Connections accepted by a server socket use the server
+ * socket's value. On an established connection, the attribute holds
+ * the number of outbound streams actually negotiated with the peer.
+ *
+ * @c sctp.send_stream is the stream used for subsequent messages
+ * sent, or -1 for round-robin over all outbound streams. On an
+ * established connection, only streams below the negotiated number
+ * of outbound streams may be set. A stream set before the
+ * association is established, which turns out to not be among the
+ * negotiated streams, is replaced by the highest-numbered stream.
+ *
+ * Attribute Name     | Socket Type | Value Type | Mode | Description
+ * -------------------|-------------|------------|------|------------
+ * sctp.streams       | All         | Integer    | RW   | The number of outbound streams. Default is 10.
+ * sctp.send_stream   | Connection  | Integer    | RW   | The stream to send messages on. Default is 0.
+ * sctp.unordered     | Connection  | Boolean    | RW   | Controls if messages are sent unordered. Default is false.
+ *
  * @section namespaces Linux Network and IPC Namespaces
  *
  * Namespaces is a Linux kernel facility concept for creating multiple,
@@ -991,6 +1226,7 @@ extern "C" {
 #include <errno.h>
 #include <stdbool.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <xcm_attr_map.h>
 
@@ -1049,6 +1285,7 @@ struct xcm_socket;
  * ENOPROTOOPT  | Transport protocol not available.
  * EMFILE       | The limit on the total number of open fds has been reached.
  * ENOENT       | DNS domain name resolution failed.
+ * ETIMEDOUT    | The xcm.connect_timeout expired (in blocking mode). See @ref timeouts.
  *
  * See xcm_finish() for other possible errno values.
  *
@@ -1188,6 +1425,7 @@ void xcm_cleanup(struct xcm_socket *socket);
  * errno        | Description
  * -------------|------------
  * EMFILE       | The limit on the total number of open fds has been reached.
+ * ETIMEDOUT    | The xcm.accept_timeout expired (in blocking mode). See @ref timeouts.
  *
  * See xcm_finish() for other possible errno values.
  */
@@ -1230,6 +1468,7 @@ struct xcm_socket *xcm_accept_a(struct xcm_socket *server_socket,
  * errno        | Description
  * -------------|------------
  * EMSGSIZE     | Message is too large. See also @ref xcm_attr.
+ * ETIMEDOUT    | The xcm.send_timeout expired (in blocking mode), before the message was accepted. See @ref timeouts.
  *
  * See xcm_finish() for more errno values.
  */
@@ -1260,6 +1499,184 @@ int xcm_send(struct xcm_socket *conn_socket, const void *buf, size_t len);
  */
 int xcm_receive(struct xcm_socket *conn_socket, void *buf, size_t capacity);
 
+/** Send a batch of messages on a particular connection.
+ *
+ * The xcm_send_batch() function has the same semantics as calling
+ * xcm_send() once for every message in @p msgs, in order. Transports
+ * which support it (e.g., UX and UXF) will hand over many messages
+ * to the kernel in a single system call.
+ *
+ * In non-blocking mode, the number of messages accepted by XCM may
+ * be lower than @p num_msgs (but never zero), in case the connection
+ * lacks the capacity to hold more messages. In blocking mode, the
+ * call returns when all messages have been sent. Should an error
+ * occur after some messages have been accepted, the number of
+ * accepted messages is returned, and the error is reported on the
+ * next operation on the connection.
+ *
+ * @param[in] conn_socket The connection socket the messages will be sent on.
+ * @param[in] msgs An array of message buffers.
+ * @param[in] num_msgs The number of messages in @p msgs (> 0).
+ *
+ * @return Returns the number of messages accepted (> 0), or -1 if
+ *         an error occured (in which case errno is set).
+ *
+ * See xcm_send() for possible errno values.
+ */
+int xcm_send_batch(struct xcm_socket *conn_socket, const struct iovec *msgs,
+		   size_t num_msgs);
+
+/** Receive a batch of messages on a particular connection.
+ *
+ * The xcm_receive_batch() function receives as many messages as are
+ * readily available, up to @p num_bufs, in the order they were
+ * sent. On input, the @p iov_len field of each @p bufs element holds
+ * the capacity of the buffer. On return, it holds the length of the
+ * message stored in that buffer. Messages larger than the buffer
+ * capacity are truncated, like for xcm_receive().
+ *
+ * In blocking mode, the call waits for at least one message to
+ * arrive. Should the remote end close the connection after having
+ * sent some messages, those messages are returned, and the
+ * connection close is signaled by the next call.
+ *
+ * @param[in] conn_socket The connection socket the messages will be received on.
+ * @param[in,out] bufs An array of user-supplied buffers.
+ * @param[in] num_bufs The number of buffers in @p bufs (> 0).
+ *
+ * @return Returns the number of messages received (> 0), 0 if the
+ *         remote end has closed the connection, or -1 if an error
+ *         occured (in which case errno is set).
+ *
+ * See xcm_receive() for possible errno values.
+ */
+int xcm_receive_batch(struct xcm_socket *conn_socket, struct iovec *bufs,
+		      size_t num_bufs);
+
+/** The maximum number of file descriptors which may be attached to
+    a single message. */
+#define XCM_MAX_FDS (16)
+
+/** Send a message with file descriptors attached.
+ *
+ * The xcm_send_fds() function works like xcm_send(), except that
+ * the supplied file descriptors are passed along with the message. The
+ * receiver is given duplicates of the descriptors (in the same sense
+ * as dup(2)). The caller retains ownership of @p fds.
+ *
+ * Only transports which are able to pass file descriptors (i.e., UX
+ * and UXF) support attachments.
+ *
+ * @param[in] conn_socket The connection socket the message will be sent on.
+ * @param[in] buf A pointer to the message data buffer.
+ * @param[in] len The length of the message in bytes. Zero-length messages are not allowed.
+ * @param[in] fds An array of file descriptors to attach.
+ * @param[in] num_fds The number of elements in @p fds.
+ *
+ * @return Returns 0 on success, or -1 if an error occured
+ *         (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EINVAL       | More than @ref XCM_MAX_FDS file descriptors were supplied.
+ * EOPNOTSUPP   | The transport does not support file descriptor passing.
+ *
+ * See xcm_send() for more errno values.
+ */
+int xcm_send_fds(struct xcm_socket *conn_socket, const void *buf, size_t len,
+		 const int *fds, size_t num_fds);
+
+/** Receive a message and any attached file descriptors.
+ *
+ * The xcm_receive_fds() function works like xcm_receive(), but in
+ * addition stores any file descriptors attached to the message in
+ * @p fds. On input, @p num_fds holds the capacity of the @p fds
+ * array. On return, it holds the number of file descriptors
+ * received. Descriptors in excess of the array capacity are closed.
+ *
+ * The received file descriptors have the close-on-exec flag set, and
+ * are owned by the caller.
+ *
+ * On transports lacking support for file descriptor passing, the
+ * call works like xcm_receive(), and @p num_fds is set to zero.
+ *
+ * Messages with file descriptors attached received by means of
+ * xcm_receive() or xcm_receive_batch() have their descriptors closed.
+ *
+ * @param[in] conn_socket The connection socket the message will receive be on.
+ * @param[out] buf The user-supplied buffer where the incoming message will be stored.
+ * @param[in] capacity The capacity in bytes of the buffer.
+ * @param[out] fds The user-supplied array where received file descriptors will be stored.
+ * @param[in,out] num_fds The capacity of @p fds on input, and the number of descriptors received on output.
+ *
+ * @return Returns the size (> 0 bytes) of the received message, 0 if
+ *         the remote end has closed the connection, or -1 if an error
+ *         occured (in which case errno is set).
+ *
+ * See xcm_receive() for possible errno values.
+ */
+int xcm_receive_fds(struct xcm_socket *conn_socket, void *buf,
+		    size_t capacity, int *fds, size_t *num_fds);
+
+/** Send a payload by means of a sealed memory file.
+ *
+ * The xcm_send_memfd() function copies @p len bytes from @p buf into
+ * a newly created memory file (see memfd_create(2)), seals it against
+ * further modification, and sends it as a file descriptor
+ * attachment (see xcm_send_fds()) to the remote peer. The payload
+ * is not subject to the transport's maximum message size.
+ *
+ * The receiver uses xcm_receive_memfd() to map the payload into its
+ * address space, without any copying taking place.
+ *
+ * On a non-blocking socket, the function fails with EAGAIN before
+ * any memory file is created, in case the socket isn't sendable. A
+ * send may still, occasionally, fail with EAGAIN after the payload
+ * has been copied, in which case the memory file is discarded.
+ *
+ * @param[in] conn_socket The connection socket the payload will be sent on.
+ * @param[in] buf A pointer to the payload.
+ * @param[in] len The length of the payload in bytes (> 0).
+ *
+ * @return Returns 0 on success, or -1 if an error occured
+ *         (in which case errno is set).
+ *
+ * See xcm_send_fds() for possible errno values.
+ */
+int xcm_send_memfd(struct xcm_socket *conn_socket, const void *buf,
+		   size_t len);
+
+/** Receive a payload sent with xcm_send_memfd().
+ *
+ * On success, the payload is mapped read-only into the process'
+ * address space, and a pointer to it is stored in @p data. The
+ * caller unmaps the payload with munmap(2), once done with it.
+ *
+ * The message received is consumed, even if it turns out not to be
+ * a valid memory file message (i.e., it was not sent with
+ * xcm_send_memfd()). Such a message is discarded, any file
+ * descriptors attached to it are closed, and the call fails with
+ * EBADMSG. Applications which mix memory file messages with other
+ * kinds of messages on the same connection should use
+ * xcm_receive_fds() instead.
+ *
+ * @param[in] conn_socket The connection socket the payload will be received on.
+ * @param[out] data A pointer to the mapped payload.
+ * @param[out] len The length of the payload in bytes.
+ *
+ * @return Returns 0 on success, or -1 if an error occured
+ *         (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EPIPE        | The remote end has closed the connection.
+ * EBADMSG      | The message received was not a valid memory file message, and has been discarded.
+ *
+ * See xcm_receive() for more errno values.
+ */
+int xcm_receive_memfd(struct xcm_socket *conn_socket, void **data,
+		      size_t *len);
+
 /** Flag bit denoting a socket where the application likely can
     receive a message. */
 #define XCM_SO_RECEIVABLE (1<<0)
@@ -1331,6 +1748,91 @@ int xcm_receive(struct xcm_socket *conn_socket, void *buf, size_t capacity);
 
 int xcm_await(struct xcm_socket *socket, int condition);
 
+/**
+ * Set the conditions and wait for the socket to become ready.
+ *
+ * This function is equivalent to calling xcm_await(), and then
+ * waiting for the XCM socket fd (see xcm_fd()) to become readable,
+ * for up to @p timeout_ms milliseconds. It allows an application
+ * driving a single non-blocking socket to bound the time spent
+ * waiting, without the need to set up its own poll() or epoll
+ * instance.
+ *
+ * As is the case for the socket fd, the socket being ready does not
+ * guarantee that the next API operation will succeed.
+ *
+ * @param[in] socket The XCM socket.
+ * @param[in] condition The condition the application is waiting for.
+ * @param[in] timeout_ms The maximum time to wait, in milliseconds. 0
+ *                       means return immediately, and -1 means
+ *                       wait indefinitely.
+ *
+ * @return Returns 1 if the socket is ready, 0 if the timeout expired,
+ *         or -1 if an error occured (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EINVAL       | The socket is not in non-blocking mode, the condition bits are invalid, or the timeout is invalid.
+ * EINTR        | The wait was interrupted by a signal.
+ *
+ * @see xcm_await
+ */
+
+int xcm_await_timeout(struct xcm_socket *socket, int condition,
+		      int timeout_ms);
+
+/**
+ * Wait for any of a number of sockets to become ready.
+ *
+ * The xcm_poll() function allows an application to wait for one or
+ * more sockets, without having to manage the sockets' fds, or their
+ * conditions, in a poll() or epoll instance of its own.
+ *
+ * For each socket, xcm_poll() sets the conditions as per xcm_await(),
+ * and then waits for up to @p timeout_ms milliseconds for any of
+ * the sockets to become ready.
+ *
+ * XCM does not know which of the conditions is believed to be met,
+ * and thus on return, the @p ready entry of a socket which is ready
+ * is set to its full set of conditions, and all other entries are
+ * set to zero. As is the case for xcm_fd(), a socket being ready
+ * does not guarantee that the next API operation will succeed.
+ *
+ * A socket with its condition set to 0 will never be reported as
+ * ready, but any outstanding background tasks (see @ref
+ * outstanding_tasks) will be performed by xcm_poll() on the
+ * application's behalf.
+ *
+ * Both sockets in blocking and non-blocking mode may be passed to
+ * xcm_poll().
+ *
+ * xcm_poll() uses a per-thread epoll instance, which is reused across
+ * calls. Polling the same, or a slowly changing, set of sockets is
+ * efficient, regardless of the number of sockets. The epoll instance
+ * is closed when the thread exits.
+ *
+ * @param[in] sockets The XCM sockets to wait for.
+ * @param[in] conditions The conditions the application is waiting for, for each socket.
+ * @param[out] ready The sockets' ready conditions.
+ * @param[in] num_sockets The number of sockets.
+ * @param[in] timeout_ms The maximum time to wait, in milliseconds. 0
+ *                       means return immediately, and -1 means
+ *                       wait indefinitely.
+ *
+ * @return Returns the number of sockets ready, 0 if the timeout
+ *         expired, or -1 if an error occured (in which case errno is
+ *         set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EINVAL       | No sockets were supplied, a socket is present more than once, the condition bits are invalid, or the timeout is invalid.
+ * EINTR        | The wait was interrupted by a signal.
+ * EMFILE       | The limit on the total number of open fds has been reached.
+ */
+
+int xcm_poll(struct xcm_socket **sockets, const int *conditions, int *ready,
+	     size_t num_sockets, int timeout_ms);
+
 /** Returns XCM socket fd.
  *
  * This call retrieves the XCM socket fd for a XCM socket non-blocking
@@ -1508,6 +2010,38 @@ const char *xcm_remote_addr(struct xcm_socket *conn_socket);
  */
 const char *xcm_local_addr(struct xcm_socket *socket);
 
+/** Initialize a transport ahead of its first use.
+ *
+ * Some transports defer expensive initialization until the first
+ * socket is created. For the TLS and UTLS transports, this includes
+ * initializing OpenSSL, and loading the certificate files of the
+ * caller's current network namespace into SSL contexts.
+ *
+ * A process which wants to pay these costs up front, rather than
+ * during its first xcm_connect() or xcm_server() call, may call this
+ * function. For the TLS-based transports, the SSL contexts loaded
+ * are pinned: they are kept in memory, even when not used by any
+ * socket, for the rest of the life time of the process. There is no
+ * way to release them. Pinned contexts are still reloaded in case
+ * the certificate files change. To preload SSL contexts for several network
+ * namespaces, the function may be called once from each namespace.
+ *
+ * Calling this function for a transport without any deferred
+ * initialization has no effect.
+ *
+ * @param[in] transport The transport name (e.g., "tls"), as per the
+ *                      protocol part of an XCM address.
+ *
+ * @return Returns 0 on success, or -1 if an error occured (in which
+ *         case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * ENOPROTOOPT  | Unknown or disabled transport.
+ * EPROTO       | Failed to load the certificate files, or to retrieve the current network namespace.
+ */
+int xcm_prewarm(const char *transport);
+
 #include <xcm_compat.h>
 
 #ifdef __cplusplus
@@ -35,6 +35,10 @@ extern "C" {
 /** Protocol string for the UNIX Domain socket (AF_UNIX SEQPACKET)
     transport (using file system-based naming). */
 #define XCM_UXF_PROTO "uxf"
+/** Protocol string for the shared memory transport. */
+#define XCM_SHM_PROTO "shm"
+/** Protocol string for the in-process transport. */
+#define XCM_INPROC_PROTO "inproc"
 
 enum xcm_addr_type {
     xcm_addr_type_name,
@@ -184,6 +188,39 @@ int xcm_addr_parse_ux(const char *ux_addr_s, char *ux_path, size_t capacity);
 int xcm_addr_parse_uxf(const char *uxf_addr_s, char *uxf_path,
 		       size_t capacity);
 
+/** Parses a SHM (shared memory) XCM address.
+ *
+ * @param[in] shm_addr_s The string to sparse.
+ * @param[out] shm_name The (NUL-terminated) name portion of the SHM address.
+ * @param[in] capacity The length of the user-supplied name buffer.
+ *
+ * @return Returns 0 on success, or -1 if an error occured
+ *         (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EINVAL       | Malformed address.
+ */
+int xcm_addr_parse_shm(const char *shm_addr_s, char *shm_name,
+		       size_t capacity);
+
+/** Parses an INPROC (in-process) XCM address.
+ *
+ * @param[in] inproc_addr_s The string to sparse.
+ * @param[out] inproc_name The (NUL-terminated) name portion of the
+ *                         INPROC address.
+ * @param[in] capacity The length of the user-supplied name buffer.
+ *
+ * @return Returns 0 on success, or -1 if an error occured
+ *         (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EINVAL       | Malformed address.
+ */
+int xcm_addr_parse_inproc(const char *inproc_addr_s, char *inproc_name,
+			  size_t capacity);
+
 /** Builds a UTLS XCM address string from the supplied host and port.
  *
  * @param[in] host The host (either DNS domain name or IPv4/v6 adress).
@@ -288,6 +325,40 @@ int xcm_addr_make_ux(const char *ux_name, char *ux_addr_s, size_t capacity);
  */
 int xcm_addr_make_uxf(const char *uxf_name, char *uxf_addr_s, size_t capacity);
 
+/** Builds a SHM XCM address string from the supplied name.
+ *
+ * @param[in] shm_name The shared memory transport service name.
+ * @param[out] shm_addr_s The user-supplied buffer where to store the result.
+ * @param[in] capacity The length of the buffer.
+ *
+ * @return Returns 0 on success, or -1 if an error occured
+ *         (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * ENAMETOOLONG | The user-supplied buffer is too small to fit the address.
+ * EINVAL       | Invalid format of or too long SHM name.
+ */
+int xcm_addr_make_shm(const char *shm_name, char *shm_addr_s, size_t capacity);
+
+/** Builds an INPROC XCM address string from the supplied name.
+ *
+ * @param[in] inproc_name The in-process transport service name.
+ * @param[out] inproc_addr_s The user-supplied buffer where to store
+ *                           the result.
+ * @param[in] capacity The length of the buffer.
+ *
+ * @return Returns 0 on success, or -1 if an error occured
+ *         (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * ENAMETOOLONG | The user-supplied buffer is too small to fit the address.
+ * EINVAL       | Invalid format of or too long INPROC name.
+ */
+int xcm_addr_make_inproc(const char *inproc_name, char *inproc_addr_s,
+			 size_t capacity);
+
 #include <xcm_addr_compat.h>
 
 #ifdef __cplusplus
@@ -0,0 +1,247 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef XCM_LOOP_H
+#define XCM_LOOP_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @file xcm_loop.h
+ * @brief This file contains the XCM event loop API.
+ *
+ * The XCM event loop library (libxcmloop) is an optional add-on to
+ * the core XCM library. It implements the common pattern of driving
+ * a number of non-blocking XCM sockets from a single thread; setting
+ * the appropriate conditions with xcm_await(), waiting for the XCM
+ * socket fds to become ready, and retrying operations which failed
+ * with EAGAIN. Instead, the application supplies callbacks, which
+ * are invoked when a server socket has a new connection, when a
+ * connection socket has a message, has become writable, or has been
+ * closed.
+ *
+ * An event loop instance uses one epoll instance. Ready sockets are
+ * dispatched in batches, and a connection socket with many messages
+ * available is limited to a number of messages per dispatch, so
+ * that no single connection may starve the others.
+ *
+ * The event loop also has timer support, implemented by means of a
+ * timer wheel, with millisecond resolution.
+ *
+ * An event loop instance, and the sockets and timers registered with
+ * it, may only be accessed from a single thread at a time. An
+ * application may use several event loops, e.g., one per thread.
+ */
+
+#include <xcm.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct xcm_loop;
+struct xcm_loop_sock;
+struct xcm_loop_timer;
+
+/** Callbacks invoked by the event loop for a registered socket.
+ *
+ * Any callback may be NULL. The callbacks may call any of the event
+ * loop functions, including removing the socket itself (or any other
+ * socket or timer).
+ */
+struct xcm_loop_cbs
+{
+    /** Invoked for a server socket when a new connection has been
+	accepted. The new connection socket is owned by the
+	application, and is in non-blocking mode. It may be added to
+	the event loop with xcm_loop_add(). */
+    void (*on_accept)(struct xcm_loop_sock *server_lsock,
+		      struct xcm_socket *conn_socket, void *user);
+    /** Invoked for a connection socket when a message has been
+	received. The message buffer is only valid during the
+	callback. */
+    void (*on_message)(struct xcm_loop_sock *conn_lsock,
+		       const void *msg, size_t len, void *user);
+    /** Invoked for a connection socket once, after a
+	xcm_loop_send() has failed with EAGAIN, when the connection
+	is again believed to be writable. */
+    void (*on_writable)(struct xcm_loop_sock *conn_lsock, void *user);
+    /** Invoked when the connection has been closed by the remote
+	peer (with @p reason_errno set to 0), or has failed. The
+	socket is removed from the event loop, and closed, after the
+	callback returns. For connections managed by a runtime (see
+	xcm_rt.h), @p conn_lsock may be NULL. */
+    void (*on_close)(struct xcm_loop_sock *conn_lsock, int reason_errno,
+		     void *user);
+};
+
+/** Callback for a timer.
+ *
+ * The timer is removed before the callback is invoked, and thus the
+ * timer reference may not be used after this point.
+ */
+typedef void (*xcm_loop_timer_cb)(struct xcm_loop *loop, void *user);
+
+/**
+ * Create an event loop instance.
+ *
+ * @return Returns an event loop on success, or NULL if an error
+ *         occured (in which case errno is set).
+ */
+struct xcm_loop *xcm_loop_create(void);
+
+/**
+ * Destroy an event loop instance.
+ *
+ * All sockets registered with the event loop are closed, and all
+ * timers are cancelled.
+ *
+ * @param[in] loop The event loop instance, or NULL.
+ */
+void xcm_loop_destroy(struct xcm_loop *loop);
+
+/**
+ * Add a socket to the event loop.
+ *
+ * The socket, which may be either a server or a connection socket,
+ * is put into non-blocking mode, and is from this point owned by the
+ * event loop.
+ *
+ * @param[in] loop The event loop instance.
+ * @param[in] socket The XCM socket.
+ * @param[in] cbs The callbacks, which are copied.
+ * @param[in] user An opaque pointer passed to the callbacks.
+ *
+ * @return Returns a reference to the registered socket on success,
+ *         or NULL if an error occured (in which case errno is set, and
+ *         the socket remains owned by the application).
+ */
+struct xcm_loop_sock *xcm_loop_add(struct xcm_loop *loop,
+				   struct xcm_socket *socket,
+				   const struct xcm_loop_cbs *cbs,
+				   void *user);
+
+/**
+ * Remove and close a socket.
+ *
+ * No further callbacks will be invoked for this socket. The socket
+ * reference may not be used after this call.
+ *
+ * @param[in] lsock The registered socket.
+ */
+void xcm_loop_remove(struct xcm_loop_sock *lsock);
+
+/**
+ * Remove a socket, without closing it.
+ *
+ * No further callbacks will be invoked for this socket, and the
+ * socket reference may not be used after this call. Ownership of the
+ * XCM socket is returned to the application, which may, e.g., add it
+ * to another event loop.
+ *
+ * @param[in] lsock The registered socket.
+ *
+ * @return Returns the XCM socket on success, or NULL if an error
+ *         occured (in which case errno is set).
+ */
+struct xcm_socket *xcm_loop_detach(struct xcm_loop_sock *lsock);
+
+/**
+ * Retrieve the XCM socket of a registered socket.
+ *
+ * @param[in] lsock The registered socket.
+ *
+ * @return The XCM socket.
+ */
+struct xcm_socket *xcm_loop_socket(struct xcm_loop_sock *lsock);
+
+/**
+ * Send a message on a registered connection socket.
+ *
+ * If the message cannot be accepted by XCM, this function fails with
+ * EAGAIN, and the event loop will invoke the socket's @c
+ * on_writable callback when it is believed to be possible to send
+ * again.
+ *
+ * @param[in] lsock The registered connection socket.
+ * @param[in] buf A pointer to the message data buffer.
+ * @param[in] len The length of the message in bytes.
+ *
+ * @return Returns 0 on success, or -1 if an error occured (in which
+ *         case errno is set). If the socket has been removed from
+ *         the event loop, the call fails with EBADF. See xcm_send()
+ *         for other possible errno values.
+ */
+int xcm_loop_send(struct xcm_loop_sock *lsock, const void *buf, size_t len);
+
+/**
+ * Schedule a timer.
+ *
+ * @param[in] loop The event loop instance.
+ * @param[in] timeout_ms The time until the timer fires, in milliseconds.
+ * @param[in] cb The function to call when the timer fires.
+ * @param[in] user An opaque pointer passed to the callback.
+ *
+ * @return Returns a timer reference.
+ */
+struct xcm_loop_timer *xcm_loop_timer_add(struct xcm_loop *loop,
+					  int64_t timeout_ms,
+					  xcm_loop_timer_cb cb, void *user);
+
+/**
+ * Cancel a timer which has not yet fired.
+ *
+ * @param[in] timer The timer reference.
+ */
+void xcm_loop_timer_cancel(struct xcm_loop_timer *timer);
+
+/**
+ * Run one iteration of the event loop.
+ *
+ * This function waits for up to @p timeout_ms milliseconds (or until
+ * the next timer is due, whichever comes first) for any registered
+ * socket to become ready, and then dispatches the ready sockets and
+ * any expired timers.
+ *
+ * @param[in] loop The event loop instance.
+ * @param[in] timeout_ms The maximum time to wait, in milliseconds. -1
+ *                       means wait indefinitely.
+ *
+ * @return Returns 0 on success, or -1 if an error occured (in which
+ *         case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EINTR        | The wait was interrupted by a signal.
+ */
+int xcm_loop_run_once(struct xcm_loop *loop, int timeout_ms);
+
+/**
+ * Run the event loop until stopped.
+ *
+ * This function repeatedly runs event loop iterations, until
+ * xcm_loop_stop() is called (typically from a callback).
+ *
+ * @param[in] loop The event loop instance.
+ *
+ * @return Returns 0 if the loop was stopped, or -1 if an error occured
+ *         (in which case errno is set).
+ */
+int xcm_loop_run(struct xcm_loop *loop);
+
+/**
+ * Stop the event loop.
+ *
+ * Causes xcm_loop_run() to return after the current iteration.
+ *
+ * @param[in] loop The event loop instance.
+ */
+void xcm_loop_stop(struct xcm_loop *loop);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,264 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef XCM_MUX_H
+#define XCM_MUX_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @file xcm_mux.h
+ * @brief This file contains the XCM connection multiplexing API.
+ *
+ * The XCM multiplexing layer is a part of the XCM event loop library
+ * (libxcmloop). It carries many lightweight, message-oriented,
+ * logical channels over a single XCM connection. Opening a channel
+ * costs one message, rather than the connection establishment
+ * handshake(s) of the underlying transport.
+ *
+ * Both ends of the XCM connection must use the multiplexing
+ * layer. Either end may open channels.
+ *
+ * @section mux_flow_control Flow Control and Scheduling
+ *
+ * Each channel has its own credit-based flow control. A channel may
+ * have at most 32 messages outstanding, i.e. messages sent, but not
+ * yet delivered to the receiving application. A message is
+ * considered delivered once the receiving application's @c
+ * on_message callback has returned. Sending on a channel
+ * without credit fails with EAGAIN, and the channel's @c on_writable
+ * callback is invoked when credit has been returned by the peer.
+ *
+ * Messages are queued per channel, and channels with queued messages
+ * are served in a round-robin fashion, one message at a time, so
+ * that a channel with a large backlog does not delay other channels.
+ *
+ * Should sending on the underlying connection fail, the connection
+ * is torn down, and all queued messages are dropped. The failure is
+ * reported to the application, by means of the @c on_chan_close and
+ * @c on_close callbacks, from the event loop.
+ *
+ * A multiplexed connection carries at most @ref XCM_MUX_MAX_CHANS
+ * channels. Channels opened by the remote peer beyond this limit
+ * are rejected.
+ *
+ * @section mux_pool Connection Pooling
+ *
+ * A connection pool (@ref xcm_mux_pool) keeps one multiplexed
+ * connection per remote address, which is established on demand, and
+ * shared among all channels opened to that address.
+ *
+ * As for the event loop, a multiplexed connection and its channels
+ * may only be accessed from the thread running the event loop.
+ */
+
+#include <xcm_loop.h>
+
+#include <stddef.h>
+
+struct xcm_mux;
+struct xcm_mux_chan;
+struct xcm_mux_pool;
+
+/** The maximum size of a channel message, in bytes. */
+#define XCM_MUX_MAX_MSG (65535 - 8)
+
+/** The maximum number of open channels on a multiplexed connection,
+    including channels opened by the remote peer. */
+#define XCM_MUX_MAX_CHANS (1024)
+
+/** Callbacks invoked for a multiplexed connection and its channels.
+ *
+ * Any callback may be NULL. The callbacks may call any of the event
+ * loop or multiplexing functions.
+ *
+ * The @c user pointer passed to the channel callbacks is the
+ * channel's user pointer, which initially is the same as the
+ * multiplexed connection's.
+ */
+struct xcm_mux_cbs
+{
+    /** Invoked when the remote peer has opened a new channel. If this
+	callback is NULL, all remotely-initiated channels are
+	rejected. */
+    void (*on_chan_open)(struct xcm_mux *mux, struct xcm_mux_chan *chan,
+			 void *user);
+    /** Invoked when a message has been received on a channel. The
+	message buffer is only valid during the callback. */
+    void (*on_message)(struct xcm_mux_chan *chan, const void *msg,
+		       size_t len, void *user);
+    /** Invoked once, after a xcm_mux_send() has failed with EAGAIN,
+	when the channel again has credit. */
+    void (*on_writable)(struct xcm_mux_chan *chan, void *user);
+    /** Invoked when a channel has been closed by the remote peer, or
+	because the underlying connection was closed. The channel
+	reference may not be used after the callback returns. */
+    void (*on_chan_close)(struct xcm_mux_chan *chan, void *user);
+    /** Invoked when the underlying connection has been closed by the
+	remote peer (with @p reason_errno set to 0), or has
+	failed. The @c on_chan_close callback is invoked for every
+	open channel before this callback. */
+    void (*on_close)(struct xcm_mux *mux, int reason_errno, void *user);
+};
+
+/**
+ * Create a multiplexed connection.
+ *
+ * The connection socket is added to the event loop, and is from
+ * this point owned by the multiplexed connection.
+ *
+ * @param[in] loop The event loop instance.
+ * @param[in] conn_socket The XCM connection socket.
+ * @param[in] cbs The callbacks, which are copied.
+ * @param[in] user An opaque pointer passed to the callbacks.
+ *
+ * @return Returns a multiplexed connection on success, or NULL if an
+ *         error occured (in which case errno is set, and the socket
+ *         remains owned by the application).
+ */
+struct xcm_mux *xcm_mux_create(struct xcm_loop *loop,
+			       struct xcm_socket *conn_socket,
+			       const struct xcm_mux_cbs *cbs, void *user);
+
+/**
+ * Destroy a multiplexed connection.
+ *
+ * All channels are closed, without any callbacks being invoked, and
+ * the underlying XCM connection is closed. This function may not be
+ * used for connections owned by a connection pool.
+ *
+ * @param[in] mux The multiplexed connection, or NULL.
+ */
+void xcm_mux_destroy(struct xcm_mux *mux);
+
+/**
+ * Open a channel.
+ *
+ * The channel may be used for sending immediately.
+ *
+ * @param[in] mux The multiplexed connection.
+ * @param[in] user An opaque pointer passed to the channel's callbacks.
+ *
+ * @return Returns a channel on success, or NULL if an error occured
+ *         (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EMFILE       | The connection already has @ref XCM_MUX_MAX_CHANS channels.
+ * EPIPE        | The underlying connection has been closed.
+ */
+struct xcm_mux_chan *xcm_mux_open(struct xcm_mux *mux, void *user);
+
+/**
+ * Close a channel.
+ *
+ * Messages already accepted by xcm_mux_send() are sent before the
+ * remote peer is notified. No further callbacks will be invoked for
+ * this channel, and the channel reference may not be used after
+ * this call.
+ *
+ * @param[in] chan The channel.
+ */
+void xcm_mux_close(struct xcm_mux_chan *chan);
+
+/**
+ * Send a message on a channel.
+ *
+ * @param[in] chan The channel.
+ * @param[in] buf A pointer to the message data buffer.
+ * @param[in] len The length of the message in bytes.
+ *
+ * @return Returns 0 on success, or -1 if an error occured (in which
+ *         case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EAGAIN       | The channel has no credit.
+ * EINVAL       | Zero-length message.
+ * EMSGSIZE     | Message is too large. See also @ref XCM_MUX_MAX_MSG.
+ * EPIPE        | The underlying connection has been closed.
+ */
+int xcm_mux_send(struct xcm_mux_chan *chan, const void *buf, size_t len);
+
+/**
+ * Retrieve the multiplexed connection of a channel.
+ *
+ * @param[in] chan The channel.
+ *
+ * @return The multiplexed connection.
+ */
+struct xcm_mux *xcm_mux_chan_mux(struct xcm_mux_chan *chan);
+
+/**
+ * Set the user pointer of a channel.
+ *
+ * @param[in] chan The channel.
+ * @param[in] user An opaque pointer passed to the channel's callbacks.
+ */
+void xcm_mux_chan_set_user(struct xcm_mux_chan *chan, void *user);
+
+/**
+ * Retrieve the number of open channels.
+ *
+ * @param[in] mux The multiplexed connection.
+ *
+ * @return The number of channels.
+ */
+size_t xcm_mux_num_chans(struct xcm_mux *mux);
+
+/**
+ * Create a connection pool.
+ *
+ * @param[in] loop The event loop instance.
+ * @param[in] cbs The callbacks used for the pool's multiplexed
+ *                connections, which are copied.
+ * @param[in] user An opaque pointer passed to the callbacks.
+ *
+ * @return Returns a connection pool.
+ */
+struct xcm_mux_pool *xcm_mux_pool_create(struct xcm_loop *loop,
+					 const struct xcm_mux_cbs *cbs,
+					 void *user);
+
+/**
+ * Destroy a connection pool, and all its multiplexed connections.
+ *
+ * @param[in] pool The connection pool, or NULL.
+ */
+void xcm_mux_pool_destroy(struct xcm_mux_pool *pool);
+
+/**
+ * Open a channel to a remote address.
+ *
+ * If the pool has no connection to @p remote_addr, or the connection
+ * has been closed, a new non-blocking connection is initiated. The
+ * channel may be used for sending immediately.
+ *
+ * @param[in] pool The connection pool.
+ * @param[in] remote_addr The address of the remote server socket.
+ * @param[in] user An opaque pointer passed to the channel's callbacks.
+ *
+ * @return Returns a channel on success, or NULL if an error occured
+ *         (in which case errno is set). See xcm_connect() for
+ *         possible errno values.
+ */
+struct xcm_mux_chan *xcm_mux_pool_open(struct xcm_mux_pool *pool,
+				       const char *remote_addr, void *user);
+
+/**
+ * Retrieve the number of connections in a pool.
+ *
+ * @param[in] pool The connection pool.
+ *
+ * @return The number of connections, including those not yet
+ *         established.
+ */
+size_t xcm_mux_pool_num_conns(struct xcm_mux_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,221 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef XCM_RCONN_H
+#define XCM_RCONN_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @file xcm_rconn.h
+ * @brief This file contains the XCM reconnecting client API.
+ *
+ * A reconnecting client (@ref xcm_rconn) wraps an XCM connection
+ * socket, and transparently replaces it with a new connection in case
+ * it fails, or is closed by the remote peer.
+ *
+ * @section rconn_connect Connection Establishment
+ *
+ * A reconnecting client is configured with one or more server
+ * addresses. When a connection is to be established, connection
+ * attempts are made to all addresses in parallel, and the first
+ * connection to be established is used. The others are closed.
+ *
+ * For TCP and TLS addresses with a DNS domain name, the IP address
+ * the name resolved to is cached, and is used in subsequent
+ * connection attempts, thus avoiding the name resolution
+ * latency. The cached address is discarded if a connection attempt
+ * using it fails, and the attempt is immediately retried using the
+ * domain name.
+ *
+ * If all connection attempts fail, or none succeed within the
+ * connect timeout, the client backs off and retries later. The
+ * backoff delay doubles for every failed attempt, up to a maximum,
+ * and is randomized ("jittered") to between half and the full
+ * delay. The jitter prevents a large number of clients, which lost
+ * their connections at the same time, from reconnecting in lockstep.
+ *
+ * When an established connection fails, the client also backs off
+ * before reconnecting.
+ *
+ * @section rconn_buffering Send Buffering
+ *
+ * Messages sent while there is no connection, or while the
+ * connection is not writable, are queued in a bounded buffer, and
+ * are sent in order once a connection is (again) available. Messages
+ * already accepted by the XCM connection at the time it fails may be
+ * lost.
+ *
+ * @section rconn_events Event-driven Programming
+ *
+ * A reconnecting client is always in non-blocking mode. Its fd
+ * (retrieved with xcm_rconn_fd()) becomes readable when there is a
+ * message to receive, when the connection state has changed, or
+ * when xcm_rconn_finish() needs to be called for the client to make
+ * progress with connection establishment or buffered messages. The
+ * fd remains readable until the application has retrieved the
+ * current state with xcm_rconn_state(), and has received all
+ * messages.
+ *
+ * @section rconn_attrs Attributes
+ *
+ * A reconnecting client is configured by means of an attribute map,
+ * which may include any of the below attributes. All other
+ * attributes are applied to every XCM connection created (see
+ * xcm_connect_a()).
+ *
+ * Attribute Name        | Value Type | Default | Description
+ * ----------------------|------------|---------|------------
+ * rconn.backoff_min     | Integer    | 100     | Initial backoff delay, in milliseconds.
+ * rconn.backoff_max     | Integer    | 30000   | Maximum backoff delay, in milliseconds.
+ * rconn.connect_timeout | Integer    | 10000   | Connection establishment timeout, in milliseconds.
+ * rconn.max_buffered    | Integer    | 1024    | Maximum number of buffered messages.
+ *
+ * A reconnecting client may only be accessed from one thread at a
+ * time.
+ */
+
+#include <xcm.h>
+#include <xcm_attr_map.h>
+
+#include <stddef.h>
+
+struct xcm_rconn;
+
+/** The connection state of a reconnecting client. */
+enum xcm_rconn_state {
+    /** Connection attempts are in progress. */
+    xcm_rconn_state_connecting,
+    /** A connection is established. */
+    xcm_rconn_state_connected,
+    /** Waiting before the next connection attempt. */
+    xcm_rconn_state_backoff
+};
+
+/**
+ * Create a reconnecting client.
+ *
+ * Connection establishment is initiated immediately.
+ *
+ * @param[in] remote_addrs The addresses of the server sockets.
+ * @param[in] num_addrs The number of addresses.
+ * @param[in] attrs The attribute map, or NULL.
+ *
+ * @return Returns a reconnecting client on success, or NULL if an
+ *         error occured (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EINVAL       | No addresses, or an invalid reconnecting client attribute.
+ */
+struct xcm_rconn *xcm_rconn_create(const char * const *remote_addrs,
+				   size_t num_addrs,
+				   const struct xcm_attr_map *attrs);
+
+/**
+ * Destroy a reconnecting client.
+ *
+ * The connection, and any connection attempts in progress, are
+ * closed, and any buffered messages are discarded.
+ *
+ * @param[in] rconn The reconnecting client, or NULL.
+ */
+void xcm_rconn_destroy(struct xcm_rconn *rconn);
+
+/**
+ * Retrieve the fd of a reconnecting client.
+ *
+ * @param[in] rconn The reconnecting client.
+ *
+ * @return The fd, which may be used in select(), poll() or epoll.
+ */
+int xcm_rconn_fd(struct xcm_rconn *rconn);
+
+/**
+ * Retrieve the connection state.
+ *
+ * This function also acknowledges any state change notification
+ * pending on the client's fd.
+ *
+ * @param[in] rconn The reconnecting client.
+ *
+ * @return The current connection state.
+ */
+enum xcm_rconn_state xcm_rconn_state(struct xcm_rconn *rconn);
+
+/**
+ * Send a message.
+ *
+ * The message is sent on the current connection, if possible, and
+ * otherwise buffered.
+ *
+ * @param[in] rconn The reconnecting client.
+ * @param[in] buf A pointer to the message data buffer.
+ * @param[in] len The length of the message in bytes.
+ *
+ * @return Returns 0 on success, or -1 if an error occured (in which
+ *         case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EAGAIN       | The send buffer is full.
+ * EINVAL       | Zero-length message.
+ * EMSGSIZE     | Message is too large for the current connection.
+ */
+int xcm_rconn_send(struct xcm_rconn *rconn, const void *buf, size_t len);
+
+/**
+ * Receive a message.
+ *
+ * A failed, or closed, connection is not reported to the caller,
+ * but rather results in a new connection being established (and a
+ * state change notification).
+ *
+ * @param[in] rconn The reconnecting client.
+ * @param[out] buf The user-supplied buffer where the message will be
+ *                 stored.
+ * @param[in] capacity The length of the buffer.
+ *
+ * @return Returns the length of the message, or -1 if an error
+ *         occured (in which case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EAGAIN       | No message is available.
+ */
+int xcm_rconn_receive(struct xcm_rconn *rconn, void *buf, size_t capacity);
+
+/**
+ * Make progress with any outstanding tasks.
+ *
+ * This function drives connection establishment, backoff and the
+ * sending of buffered messages. It should be called when the
+ * client's fd is readable. It is also called implicitly by
+ * xcm_rconn_receive().
+ *
+ * @param[in] rconn The reconnecting client.
+ *
+ * @return Returns 0.
+ */
+int xcm_rconn_finish(struct xcm_rconn *rconn);
+
+/**
+ * Retrieve the current XCM connection.
+ *
+ * The connection socket may be used to retrieve attributes, but may
+ * not be used for sending or receiving messages, nor be closed.
+ *
+ * @param[in] rconn The reconnecting client.
+ *
+ * @return The XCM connection socket, or NULL if the client is not
+ *         connected.
+ */
+struct xcm_socket *xcm_rconn_socket(struct xcm_rconn *rconn);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,208 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef XCM_RT_H
+#define XCM_RT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @file xcm_rt.h
+ * @brief This file contains the XCM thread-per-core runtime API.
+ *
+ * The XCM runtime is a part of the XCM event loop library
+ * (libxcmloop). It manages a pool of worker threads, each running
+ * its own event loop (see xcm_loop.h), and each pinned to a CPU core
+ * allowed for the process.
+ *
+ * A socket is owned by exactly one worker at a time, and all
+ * callbacks for that socket are invoked in that worker's thread. No
+ * locking is required for state only accessed from a particular
+ * socket's callbacks.
+ *
+ * A connection which the runtime closes before it has been added
+ * to a worker's event loop is reported by invoking the connection's
+ * @c on_close callback with a NULL socket reference, after which
+ * the connection is closed. This happens if the connection fails to
+ * be added to the worker's event loop (with the reason for the
+ * failure as the errno value), or if the connection is still in
+ * transit to a worker when the runtime is destroyed (with the
+ * reason set to ECANCELED). In the latter case, the callback is
+ * invoked in the thread calling xcm_rt_destroy().
+ *
+ * Connections accepted on a server socket added to the runtime are
+ * distributed among the workers according to the runtime's
+ * policy. Connections may later be moved to another worker with
+ * xcm_rt_migrate(). The transfer of a socket between workers is done
+ * at a message boundary; no message is split or lost in the process.
+ *
+ * The runtime is intended for servers with a large number of
+ * connections, where the cost of cross-core cache traffic would
+ * otherwise be significant.
+ */
+
+#include <xcm_loop.h>
+
+#include <stdint.h>
+
+struct xcm_rt;
+
+/** Policy for the distribution of accepted connections. */
+enum xcm_rt_policy {
+    /** Assign connections to workers in a round-robin fashion. */
+    xcm_rt_policy_round_robin,
+    /** Assign connections to the worker with the fewest
+	connections. */
+    xcm_rt_policy_least_loaded,
+    /** Assign connections to the worker pinned to the CPU core on
+	which the kernel processes the connection's incoming packets
+	(as per the "tcp.incoming_cpu" attribute). Connections for
+	which this information is not available, or which is not a
+	core used by the runtime, are assigned in a round-robin
+	fashion. */
+    xcm_rt_policy_incoming_cpu
+};
+
+/**
+ * Create a runtime and start its worker threads.
+ *
+ * Worker threads are pinned to the CPU cores in the process' CPU
+ * affinity mask, in order. If there are more workers than cores,
+ * several workers will share a core.
+ *
+ * @param[in] num_workers The number of worker threads, or 0 for one
+ *                        thread per CPU core allowed for the process.
+ * @param[in] policy The policy for distributing accepted connections.
+ *
+ * @return Returns a runtime on success, or NULL if an error occured
+ *         (in which case errno is set).
+ */
+struct xcm_rt *xcm_rt_create(int num_workers, enum xcm_rt_policy policy);
+
+/**
+ * Stop the worker threads and destroy the runtime.
+ *
+ * All sockets owned by the runtime are closed. This function may not
+ * be called from a worker thread.
+ *
+ * @param[in] rt The runtime, or NULL.
+ */
+void xcm_rt_destroy(struct xcm_rt *rt);
+
+/**
+ * Retrieve the number of worker threads.
+ *
+ * @param[in] rt The runtime.
+ *
+ * @return The number of workers.
+ */
+int xcm_rt_num_workers(struct xcm_rt *rt);
+
+/**
+ * Add a server socket to the runtime.
+ *
+ * The server socket is owned by the first worker, which accepts new
+ * connections and hands them over to the worker selected by the
+ * runtime's policy. Accepted connections are added to that worker's
+ * event loop, with the @p conn_cbs callbacks (of which @c on_accept
+ * is unused).
+ *
+ * @param[in] rt The runtime.
+ * @param[in] server_socket The XCM server socket.
+ * @param[in] conn_cbs The callbacks for accepted connections, which
+ *                     are copied.
+ * @param[in] user An opaque pointer passed to the callbacks.
+ *
+ * @return Returns 0 on success, or -1 if an error occured (in which
+ *         case errno is set).
+ */
+int xcm_rt_add_server(struct xcm_rt *rt, struct xcm_socket *server_socket,
+		      const struct xcm_loop_cbs *conn_cbs, void *user);
+
+/**
+ * Add a connection socket to the runtime.
+ *
+ * The connection is handed over to the worker selected by the
+ * runtime's policy.
+ *
+ * @param[in] rt The runtime.
+ * @param[in] conn_socket The XCM connection socket.
+ * @param[in] cbs The callbacks, which are copied.
+ * @param[in] user An opaque pointer passed to the callbacks.
+ *
+ * @return Returns 0 on success, or -1 if an error occured (in which
+ *         case errno is set).
+ */
+int xcm_rt_add_conn(struct xcm_rt *rt, struct xcm_socket *conn_socket,
+		    const struct xcm_loop_cbs *cbs, void *user);
+
+/**
+ * Move a socket to another worker.
+ *
+ * This function may only be called from a callback of the worker
+ * currently owning the socket. The socket is removed from the
+ * current worker's event loop immediately, and thus no further
+ * messages are delivered to it by this worker. It is then added to
+ * the target worker's event loop, with its callbacks and user
+ * pointer retained. Messages received, but not yet delivered, are
+ * delivered by the target worker.
+ *
+ * The socket reference may not be used after this call.
+ *
+ * @param[in] rt The runtime.
+ * @param[in] lsock The socket to migrate.
+ * @param[in] worker_idx The index of the target worker.
+ *
+ * @return Returns 0 on success, or -1 if an error occured (in which
+ *         case errno is set).
+ *
+ * errno        | Description
+ * -------------|------------
+ * EINVAL       | Invalid worker index, or not called from a worker thread.
+ */
+int xcm_rt_migrate(struct xcm_rt *rt, struct xcm_loop_sock *lsock,
+		   int worker_idx);
+
+/**
+ * Retrieve the index of the worker running the calling thread.
+ *
+ * @param[in] rt The runtime.
+ *
+ * @return Returns the worker index, or -1 if the caller is not one of
+ *         @p rt's worker threads.
+ */
+int xcm_rt_current_worker(struct xcm_rt *rt);
+
+/**
+ * Retrieve the load of a worker.
+ *
+ * The load is the number of connections owned by, or in the process
+ * of being handed over to, the worker. This function may be called
+ * from any thread.
+ *
+ * @param[in] rt The runtime.
+ * @param[in] worker_idx The index of the worker.
+ *
+ * @return Returns the number of connections, or -1 if the worker
+ *         index is invalid (in which case errno is set to EINVAL).
+ */
+int64_t xcm_rt_worker_load(struct xcm_rt *rt, int worker_idx);
+
+/**
+ * Retrieve the CPU core a worker is pinned to.
+ *
+ * @param[in] rt The runtime.
+ * @param[in] worker_idx The index of the worker.
+ *
+ * @return Returns the CPU number, or -1 if the worker index is
+ *         invalid (in which case errno is set to EINVAL).
+ */
+int xcm_rt_worker_cpu(struct xcm_rt *rt, int worker_idx);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
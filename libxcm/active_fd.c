@@ -6,47 +6,72 @@
 #include <pthread.h>
 #include <sys/eventfd.h>
 
-/* socket id, unique on a per-process basis */
+/*
+ * The reference count is manipulated with atomic operations, and the
+ * lock is only taken on the 0 -> 1 and 1 -> 0 transitions, where the
+ * event fd is created and closed, respectively. Once a thread holds a
+ * reference, the active_fd value is stable.
+ */
 static pthread_mutex_t active_fd_lock = PTHREAD_MUTEX_INITIALIZER;
 static int active_fd = -1;
 static int active_fd_ref_cnt = 0;
 
+static bool try_change_ref_cnt(int min_cnt, int delta)
+{
+    int cnt = __atomic_load_n(&active_fd_ref_cnt, __ATOMIC_ACQUIRE);
+
+    while (cnt >= min_cnt)
+	if (__atomic_compare_exchange_n(&active_fd_ref_cnt, &cnt, cnt + delta,
+					true, __ATOMIC_ACQ_REL,
+					__ATOMIC_ACQUIRE))
+	    return true;
+
+    return false;
+}
+
 int active_fd_get(void)
 {
+    if (try_change_ref_cnt(1, 1))
+	return __atomic_load_n(&active_fd, __ATOMIC_ACQUIRE);
+
     ut_mutex_lock(&active_fd_lock);
 
-    ut_assert(active_fd_ref_cnt >= 0);
+    int fd;
 
-    if (active_fd_ref_cnt == 0) {
-	active_fd = eventfd(1, EFD_NONBLOCK);
-	if (active_fd < 0) {
+    if (__atomic_load_n(&active_fd_ref_cnt, __ATOMIC_ACQUIRE) == 0) {
+	fd = eventfd(1, EFD_NONBLOCK);
+	if (fd < 0) {
 	    LOG_ACTIVE_FD_FAILED(errno);
 	    goto out;
 	}
-	LOG_ACTIVE_FD_CREATED(active_fd);
-    }
+	LOG_ACTIVE_FD_CREATED(fd);
+	__atomic_store_n(&active_fd, fd, __ATOMIC_RELEASE);
+    } else
+	fd = __atomic_load_n(&active_fd, __ATOMIC_ACQUIRE);
 
-    active_fd_ref_cnt++;
+    __atomic_add_fetch(&active_fd_ref_cnt, 1, __ATOMIC_ACQ_REL);
 
 out:
     ut_mutex_unlock(&active_fd_lock);
 
-    return active_fd;
+    return fd;
 }
 
 void active_fd_put(void)
 {
+    if (try_change_ref_cnt(2, -1))
+	return;
+
     ut_mutex_lock(&active_fd_lock);
 
-    ut_assert(active_fd_ref_cnt >= 0);
+    int cnt = __atomic_sub_fetch(&active_fd_ref_cnt, 1, __ATOMIC_ACQ_REL);
 
-    active_fd_ref_cnt--;
+    ut_assert(cnt >= 0);
 
-    if (active_fd_ref_cnt == 0) {
+    if (cnt == 0) {
 	UT_PROTECT_ERRNO(close(active_fd));
 	LOG_ACTIVE_FD_CLOSED(active_fd);
     }
 
     ut_mutex_unlock(&active_fd_lock);
 }
-
@@ -144,3 +144,26 @@ const char *tp_so_condition_name(int condition)
     else
 	return "invalid";
 }
+
+void tp_effectuate_busy_poll(struct xcm_socket *s, int fd)
+{
+    /* zero is the kernel default */
+    if (s->busy_poll_us == 0)
+	return;
+
+    tp_set_busy_poll(s, fd);
+}
+
+void tp_set_busy_poll(struct xcm_socket *s, int fd)
+{
+    int busy_poll_us = s->busy_poll_us;
+
+    UT_SAVE_ERRNO;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us,
+		   sizeof(busy_poll_us)) < 0)
+	LOG_SOCKET_OPTION_FAILED("socket", "SO_BUSY_POLL", busy_poll_us,
+				 errno);
+
+    UT_RESTORE_ERRNO_DC;
+}
@@ -8,6 +8,7 @@
 
 #include "log_tp.h"
 #include "xcm_addr.h"
+#include "xcm_tp.h"
 
 void tp_ip_to_sockaddr(const struct xcm_addr_ip *xcm_ip,
 		       uint16_t port, struct sockaddr *sockaddr);
@@ -25,6 +26,11 @@ void tp_sockaddr_to_sctp_addr(struct sockaddr_storage *sock_addr,
 void tp_sockaddr_to_tls_addr(struct sockaddr_storage *sock_addr,
 			     char *xcm_addr, size_t capacity);
 
+/* Sets SO_BUSY_POLL on 'fd', in case busy polling is enabled on the
+   XCM socket. Failure is not considered an error. */
+void tp_effectuate_busy_poll(struct xcm_socket *s, int fd);
+void tp_set_busy_poll(struct xcm_socket *s, int fd);
+
 #define TP_RET_CMP_STATE(_ts, _state, _cmp, _rc)			\
     do {								\
 	if (_ts->conn.state _cmp _state)				\
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <linux/un.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -29,6 +30,9 @@ struct client
     int fd;
     bool is_response_pending;
     struct ctl_proto_msg pending_response;
+    /* dump responses are variable-length, and allocated on demand */
+    uint8_t *pending_dump;
+    size_t pending_response_len;
 };
 
 struct ctl
@@ -36,6 +40,7 @@ struct ctl
     struct xcm_socket *socket;
 
     int server_fd;
+    char path[UNIX_PATH_MAX];
     struct client clients[MAX_CLIENTS];
     int num_clients;
 
@@ -44,7 +49,9 @@ struct ctl
     uint64_t calls_since_process;
 };
 
-static int create_ux(struct xcm_socket *s)
+#define TMP_SUFFIX ".tmp"
+
+static int create_ux(struct xcm_socket *s, char *path)
 {
     char ctl_dir[UNIX_PATH_MAX];
     ctl_get_dir(ctl_dir, sizeof(ctl_dir));
@@ -60,12 +67,20 @@ static int create_ux(struct xcm_socket *s)
 	return -1;
     }
 
+    ctl_derive_path(ctl_dir, getpid(), s->sock_id, path, UNIX_PATH_MAX);
+
     struct sockaddr_un addr = {
 	.sun_family = AF_UNIX
     };
 
-    ctl_derive_path(ctl_dir, getpid(), s->sock_id,
-		    addr.sun_path, UNIX_PATH_MAX);
+    /* the socket is bound to a temporary name, which the control
+       clients ignore, and only given its real name once listening,
+       so a client never finds a socket which refuses connections */
+    if (snprintf(addr.sun_path, UNIX_PATH_MAX, "%s%s", path,
+		 TMP_SUFFIX) >= UNIX_PATH_MAX) {
+	errno = ENAMETOOLONG;
+	goto err;
+    }
 
     unlink(addr.sun_path);
 
@@ -82,7 +97,10 @@ static int create_ux(struct xcm_socket *s)
     if (ut_set_blocking(server_fd, false) < 0)
 	goto err_unlink;
 
-    LOG_CTL_CREATED(s, addr.sun_path, server_fd);
+    if (rename(addr.sun_path, path) < 0)
+	goto err_unlink;
+
+    LOG_CTL_CREATED(s, path, server_fd);
 
     return server_fd;
  err_unlink:
@@ -90,14 +108,16 @@ static int create_ux(struct xcm_socket *s)
  err_close:
     close(server_fd);
  err:
-    LOG_CTL_CREATE_FAILED(s, addr.sun_path, errno);
+    LOG_CTL_CREATE_FAILED(s, path, errno);
     return -1;
 }
 
 struct ctl *ctl_create(struct xcm_socket *socket)
 {
+    char path[UNIX_PATH_MAX];
+
     UT_SAVE_ERRNO;
-    int server_fd = create_ux(socket);
+    int server_fd = create_ux(socket, path);
     UT_RESTORE_ERRNO_DC;
 
     if (server_fd < 0)
@@ -106,6 +126,7 @@ struct ctl *ctl_create(struct xcm_socket *socket)
     struct ctl *ctl = ut_calloc(sizeof(struct ctl));
 
     ctl->server_fd = server_fd;
+    strcpy(ctl->path, path);
     ctl->socket = socket;
 
     epoll_reg_set_init(&ctl->reg_set, socket->epoll_fd, socket);
@@ -122,6 +143,8 @@ static void remove_client(struct ctl *ctl, int client_idx)
 
     UT_PROTECT_ERRNO(close(rclient->fd));
 
+    ut_free(rclient->pending_dump);
+
     const int last_idx = ctl->num_clients-1;
 
     if (client_idx != last_idx)
@@ -142,19 +165,12 @@ void ctl_destroy(struct ctl *ctl, bool owner)
 	while (ctl->num_clients > 0)
 	    remove_client(ctl, 0);
 
-	struct sockaddr_un laddr;
-
-	socklen_t laddr_len = sizeof(struct sockaddr_un);
-
-	int rc = getsockname(ctl->server_fd, (struct sockaddr *)&laddr,
-			     &laddr_len);
-
 	epoll_reg_set_reset(&ctl->reg_set);
 
 	close(ctl->server_fd);
 
-	if (rc == 0 && owner)
-	    unlink(laddr.sun_path);
+	if (owner)
+	    unlink(ctl->path);
 
 	ut_free(ctl);
 
@@ -184,15 +200,26 @@ static void process_get_attr(struct xcm_socket *socket,
     }
 }
 
+struct get_all_result
+{
+    struct ctl_proto_get_all_attr_cfm *cfm;
+    bool truncated;
+};
+
 static void add_attr(const char *attr_name, enum xcm_attr_type type,
 		     void *value, size_t len, void *data)
 {
-    struct ctl_proto_get_all_attr_cfm *cfm = data;
+    struct get_all_result *result = data;
+    struct ctl_proto_get_all_attr_cfm *cfm = result->cfm;
+
+    if (cfm->attrs_len == CTL_PROTO_MAX_ATTRS) {
+	result->truncated = true;
+	return;
+    }
 
     struct ctl_proto_attr *attr = &cfm->attrs[cfm->attrs_len];
 
     cfm->attrs_len++;
-    ut_assert(cfm->attrs_len < CTL_PROTO_MAX_ATTRS);
 
     strcpy(attr->name, attr_name);
     attr->value_type = type;
@@ -207,19 +234,105 @@ static void process_get_all_attr(struct xcm_socket *socket,
 {
     LOG_CLIENT_GET_ALL_ATTR(socket, req->attr_name);
 
-    struct ctl_proto_get_all_attr_cfm *cfm = &response->get_all_attr_cfm;
+    struct get_all_result result = {
+	.cfm = &response->get_all_attr_cfm
+    };
 
-    cfm->attrs_len = 0;
+    result.cfm->attrs_len = 0;
 
-    xcm_attr_get_all(socket, add_attr, cfm);
+    xcm_attr_get_all(socket, add_attr, &result);
+
+    /* clients have always expected a complete response to carry the
+       get_attr_cfm type */
+    response->type = result.truncated ?
+	ctl_proto_type_get_all_attr_partial_cfm :
+	ctl_proto_type_get_attr_cfm;
+}
+
+struct dump_buf
+{
+    uint8_t *data;
+    size_t len;
+    size_t capacity;
+};
+
+#define DUMP_BUF_INITIAL_CAPACITY (2048)
+
+static void add_dump_record(const char *attr_name, enum xcm_attr_type type,
+			    void *value, size_t len, void *data)
+{
+    struct dump_buf *buf = data;
+
+    size_t name_len = strlen(attr_name);
+    struct ctl_proto_dump_record record = {
+	.name_len = name_len,
+	.value_type = type,
+	.value_len = len
+    };
+
+    size_t record_len = sizeof(record) + name_len + len;
+
+    if (buf->len + record_len > buf->capacity) {
+	buf->capacity = UT_MAX(2 * buf->capacity, buf->len + record_len);
+	buf->data = ut_realloc(buf->data, buf->capacity);
+    }
+
+    uint8_t *p = buf->data + buf->len;
+
+    memcpy(p, &record, sizeof(record));
+    p += sizeof(record);
+    memcpy(p, attr_name, name_len);
+    p += name_len;
+    memcpy(p, value, len);
+
+    buf->len += record_len;
+}
+
+static uint8_t *process_dump(struct xcm_socket *socket, size_t *len)
+{
+    LOG_CLIENT_DUMP(socket);
+
+    struct dump_buf buf = {
+	.data = ut_malloc(DUMP_BUF_INITIAL_CAPACITY),
+	.len = sizeof(struct ctl_proto_dump_cfm),
+	.capacity = DUMP_BUF_INITIAL_CAPACITY
+    };
+
+    xcm_attr_get_all(socket, add_dump_record, &buf);
+
+    struct ctl_proto_dump_cfm cfm = {
+	.type = ctl_proto_type_dump_cfm,
+	.records_len = buf.len - sizeof(struct ctl_proto_dump_cfm)
+    };
+
+    memcpy(buf.data, &cfm, sizeof(cfm));
+
+    *len = buf.len;
+
+    return buf.data;
+}
+
+static bool is_valid_req_len(const struct ctl_proto_msg *req, size_t len)
+{
+    if (len < CTL_PROTO_HDR_SIZE)
+	return false;
+
+    if (req->type == ctl_proto_type_dump_req)
+	return len == CTL_PROTO_DUMP_REQ_SIZE;
+
+    return len == sizeof(struct ctl_proto_msg);
 }
 
 static int process_client(struct client *client, struct ctl *ctl)
 {
     if (client->is_response_pending) {
+	const void *response = client->pending_dump != NULL ?
+	    (const void *)client->pending_dump :
+	    (const void *)&client->pending_response;
+
 	UT_SAVE_ERRNO;
-	int rc = send(client->fd, &client->pending_response,
-		      sizeof(client->pending_response), 0);
+	int rc = send(client->fd, response, client->pending_response_len,
+		      MSG_NOSIGNAL);
 	UT_RESTORE_ERRNO(send_errno);
 
 	if (rc < 0) {
@@ -231,6 +344,9 @@ static int process_client(struct client *client, struct ctl *ctl)
 
 	client->is_response_pending = false;
 
+	ut_free(client->pending_dump);
+	client->pending_dump = NULL;
+
 	epoll_reg_set_mod(&ctl->reg_set, client->fd, EPOLLIN);
     } else {
 	struct ctl_proto_msg req;
@@ -244,7 +360,7 @@ static int process_client(struct client *client, struct ctl *ctl)
 		return 0;
 	    LOG_CLIENT_ERROR(ctl->socket, client->fd, recv_errno);
 	    return -1;
-	} else if (rc != sizeof(req)) {
+	} else if (!is_valid_req_len(&req, rc)) {
 	    LOG_CLIENT_MSG_MALFORMED(ctl->socket);
 	    return -1;
 	}
@@ -253,6 +369,7 @@ static int process_client(struct client *client, struct ctl *ctl)
 	epoll_reg_set_mod(&ctl->reg_set, client->fd, EPOLLOUT);
 
 	struct ctl_proto_msg *res = &client->pending_response;
+	client->pending_response_len = sizeof(struct ctl_proto_msg);
 
 	switch (req.type) {
 	case ctl_proto_type_get_attr_req:
@@ -261,6 +378,10 @@ static int process_client(struct client *client, struct ctl *ctl)
 	case ctl_proto_type_get_all_attr_req:
 	    process_get_all_attr(ctl->socket, res);
 	    break;
+	case ctl_proto_type_dump_req:
+	    client->pending_dump =
+		process_dump(ctl->socket, &client->pending_response_len);
+	    break;
 	default:
 	    LOG_CLIENT_MSG_MALFORMED(ctl->socket);
 	    client->is_response_pending = false;
@@ -295,6 +416,7 @@ static void accept_client(struct ctl *ctl)
     ctl->num_clients++;
     nclient->fd = client_fd;
     nclient->is_response_pending = false;
+    nclient->pending_dump = NULL;
 
     if (ctl->num_clients == MAX_CLIENTS)
 	epoll_reg_set_del(&ctl->reg_set, ctl->server_fd);
@@ -53,6 +53,7 @@ struct cache_entry
     uint8_t cert_dir_hash[SHA256_DIGEST_LENGTH];
     SSL_CTX *ssl_ctx;
     int use_cnt;
+    bool pinned;
 
     LIST_ENTRY(cache_entry) elem;
 };
@@ -69,6 +70,7 @@ static struct cache_entry *cache_entry_create(const char *ns,
     memcpy(entry->cert_dir_hash, cert_dir_hash, SHA256_DIGEST_LENGTH);
     entry->ssl_ctx = ssl_ctx;
     entry->use_cnt = 1;
+    entry->pinned = false;
 
     return entry;
 }
@@ -159,25 +161,65 @@ static struct cache_entry *cache_find_entry(struct cache *cache,
     return NULL;
 }
 
-static bool cache_try_put(struct cache *cache, SSL_CTX *ssl_ctx)
+static void cache_entry_put(struct cache_entry *entry)
 {
-    struct cache_entry *entry = cache_find_entry(cache, ssl_ctx);
-
-    if (entry == NULL)
-	return false;
-
     entry->use_cnt--;
     if (entry->use_cnt == 0) {
 	LIST_REMOVE(entry, elem);
 	cache_entry_destroy(entry);
     }
+}
+
+static bool cache_try_put(struct cache *cache, SSL_CTX *ssl_ctx)
+{
+    cache_lock(cache);
+
+    struct cache_entry *entry = cache_find_entry(cache, ssl_ctx);
+
+    if (entry != NULL)
+	cache_entry_put(entry);
+
+    cache_unlock(cache);
+
+    return entry != NULL;
+}
+
+/* Pinned entries hold a reference of their own, which keeps the SSL
+   context loaded even when no socket uses it. The pin is moved over
+   to the entry which replaces an invalidated one. Returns true in
+   case the entry was not already pinned. */
+static bool cache_pin(struct cache_entry *entry)
+{
+    if (entry->pinned)
+	return false;
+
+    entry->pinned = true;
+    entry->use_cnt++;
+
     return true;
 }
 
-static void cache_invalidate(struct cache *cache, struct cache_entry *entry)
+static void cache_unpin(struct cache_entry *entry)
+{
+    if (entry->pinned) {
+	entry->pinned = false;
+	cache_entry_put(entry);
+    }
+}
+
+static bool cache_invalidate(struct cache *cache, struct cache_entry *entry)
 {
+    bool was_pinned = entry->pinned;
+
     LIST_REMOVE(entry, elem);
     LIST_INSERT_HEAD(&cache->old_entries, entry, elem);
+
+    if (was_pinned) {
+	entry->pinned = false;
+	cache_entry_put(entry);
+    }
+
+    return was_pinned;
 }
 
 static struct cache client_cache;
@@ -291,24 +333,31 @@ static bool hash_equal(uint8_t *hash_a, uint8_t *hash_b)
     return memcmp(hash_a, hash_b, SHA256_DIGEST_LENGTH) == 0;
 }
 
-static SSL_CTX *ctx_cache_get_ctx(struct cache *cache, const char *ns,
-				  const char *cert_dir, ctx_load_fun load_fun)
+static struct cache_entry *ctx_cache_get_entry(struct cache *cache,
+					       const char *ns,
+					       const char *cert_dir,
+					       ctx_load_fun load_fun)
 {
-    cache_lock(cache);
-
     struct cache_entry *entry = cache_get(cache, ns, cert_dir);
+    bool repin = false;
 
     if (entry) {
 	uint8_t cert_dir_hash[SHA256_DIGEST_LENGTH];
 
-	if (get_cert_dir_hash(ns, cert_dir, cert_dir_hash) < 0)
+	if (get_cert_dir_hash(ns, cert_dir, cert_dir_hash) < 0) {
+	    UT_SAVE_ERRNO;
+	    cache_entry_put(entry);
+	    UT_RESTORE_ERRNO_DC;
 	    return NULL;
+	}
 
 	LOG_TLS_CTX_HASH(ns, cert_dir, cert_dir_hash, SHA256_DIGEST_LENGTH);
 
 	if (!hash_equal(cert_dir_hash, entry->cert_dir_hash)) {
 	    LOG_TLS_CTX_FILES_CHANGED(ns, cert_dir);
-	    cache_invalidate(cache, entry);
+	    /* drop the reference taken by cache_get() */
+	    entry->use_cnt--;
+	    repin = cache_invalidate(cache, entry);
 	    entry = NULL;
 	}
     }
@@ -318,15 +367,64 @@ static SSL_CTX *ctx_cache_get_ctx(struct cache *cache, const char *ns,
     else {
 	uint8_t cert_dir_hash[SHA256_DIGEST_LENGTH];
 	SSL_CTX *ssl_ctx = load_fun(ns, cert_dir, cert_dir_hash);
-	if (ssl_ctx)
+	if (ssl_ctx) {
 	    entry = cache_install(cache, ns, cert_dir, cert_dir_hash, ssl_ctx);
+	    if (repin)
+		cache_pin(entry);
+	}
     }
 
+    return entry;
+}
+
+static SSL_CTX *ctx_cache_get_ctx(struct cache *cache, const char *ns,
+				  const char *cert_dir, ctx_load_fun load_fun)
+{
+    cache_lock(cache);
+
+    struct cache_entry *entry =
+	ctx_cache_get_entry(cache, ns, cert_dir, load_fun);
+
     cache_unlock(cache);
 
     return entry ? entry->ssl_ctx : NULL;
 }
 
+static int ctx_cache_pin(struct cache *cache, const char *ns,
+			 const char *cert_dir, ctx_load_fun load_fun,
+			 bool *newly_pinned)
+{
+    cache_lock(cache);
+
+    struct cache_entry *entry =
+	ctx_cache_get_entry(cache, ns, cert_dir, load_fun);
+
+    if (entry) {
+	*newly_pinned = cache_pin(entry);
+	cache_entry_put(entry);
+	LOG_TLS_CTX_PINNED(ns, cert_dir);
+    }
+
+    cache_unlock(cache);
+
+    return entry ? 0 : -1;
+}
+
+static void ctx_cache_unpin(struct cache *cache, const char *ns,
+			    const char *cert_dir)
+{
+    cache_lock(cache);
+
+    struct cache_entry *entry = cache_get(cache, ns, cert_dir);
+
+    if (entry) {
+	cache_unpin(entry);
+	cache_entry_put(entry);
+    }
+
+    cache_unlock(cache);
+}
+
 static bool cert_files_changed(const char *ns, const char *cert_dir,
 			       uint8_t *cert_dir_hash, const char *cert_file,
 			       const char *key_file, const char *tc_file)
@@ -506,6 +604,25 @@ SSL_CTX *ctx_store_get_server_ctx(const char *ns, const char *cert_dir)
     return ctx_cache_get_ctx(&server_cache, ns, cert_dir, load_server_ssl_ctx);
 }
 
+int ctx_store_pin(const char *ns, const char *cert_dir)
+{
+    bool client_pinned;
+    if (ctx_cache_pin(&client_cache, ns, cert_dir, load_client_ssl_ctx,
+		      &client_pinned) < 0)
+	return -1;
+
+    bool server_pinned;
+    if (ctx_cache_pin(&server_cache, ns, cert_dir, load_server_ssl_ctx,
+		      &server_pinned) < 0) {
+	/* leave the store as it was */
+	if (client_pinned)
+	    UT_PROTECT_ERRNO(ctx_cache_unpin(&client_cache, ns, cert_dir));
+	return -1;
+    }
+
+    return 0;
+}
+
 void ctx_store_put(SSL_CTX *ssl_ctx)
 {
     if (cache_try_put(&client_cache, ssl_ctx))
@@ -9,4 +9,6 @@ SSL_CTX *ctx_store_get_client_ctx(const char *ns, const char *cert_dir);
 SSL_CTX *ctx_store_get_server_ctx(const char *ns, const char *cert_dir);
 void ctx_store_put(SSL_CTX *ssl_ctx);
 
+int ctx_store_pin(const char *ns, const char *cert_dir);
+
 #endif
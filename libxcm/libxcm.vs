@@ -11,14 +11,23 @@
     xcm_accept_a;
     xcm_send;
     xcm_receive;
+    xcm_send_batch;
+    xcm_receive_batch;
+    xcm_send_fds;
+    xcm_receive_fds;
+    xcm_send_memfd;
+    xcm_receive_memfd;
     xcm_want;
     xcm_await;
+    xcm_await_timeout;
+    xcm_poll;
     xcm_fd;
     xcm_finish;
     xcm_set_blocking;
     xcm_is_blocking;
     xcm_remote_addr;
     xcm_local_addr;
+    xcm_prewarm;
     xcm_attr_set;
     xcm_attr_set_bool;
     xcm_attr_set_int64;
@@ -44,6 +53,14 @@
     xcm_attr_map_foreach;
     xcm_attr_map_equal;
     xcm_attr_map_destroy;
+    xcm_rconn_create;
+    xcm_rconn_destroy;
+    xcm_rconn_fd;
+    xcm_rconn_state;
+    xcm_rconn_send;
+    xcm_rconn_receive;
+    xcm_rconn_finish;
+    xcm_rconn_socket;
     xcm_addr_parse_proto;
     xcm_addr_parse_utls;
     xcm_addr_parse_tls;
@@ -51,12 +68,16 @@
     xcm_addr_parse_sctp;
     xcm_addr_parse_ux;
     xcm_addr_parse_uxf;
+    xcm_addr_parse_shm;
+    xcm_addr_parse_inproc;
     xcm_addr_make_utls;
     xcm_addr_make_tls;
     xcm_addr_make_tcp;
     xcm_addr_make_sctp;
     xcm_addr_make_ux;
     xcm_addr_make_uxf;
+    xcm_addr_make_shm;
+    xcm_addr_make_inproc;
 # Obsolete pre-DNS address parsing
     xcm_addr_utls6_parse;
     xcm_addr_tls6_parse;
@@ -56,4 +56,7 @@
 #define LOG_CLIENT_GET_ALL_ATTR(s, name)				\
     log_debug_sock(s, "Control client attempting retrieve all attributes.")
 
+#define LOG_CLIENT_DUMP(s)						\
+    log_debug_sock(s, "Control client requesting attribute dump.")
+
 #endif
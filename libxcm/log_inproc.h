@@ -0,0 +1,34 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef LOG_INPROC_H
+#define LOG_INPROC_H
+
+#include "log.h"
+
+#define LOG_INPROC_CONN_ESTABLISHED(s, conn_id)				\
+    log_debug_sock(s, "In-process connection %" PRIu64 " established.", \
+		   conn_id)
+
+#define LOG_INPROC_NO_SERVER(s, name)					\
+    log_debug_sock(s, "No in-process server socket named \"%s\".", name)
+
+#define LOG_INPROC_BACKLOG_FULL(s, name)				\
+    log_debug_sock(s, "Server socket \"%s\" backlog is full.", name)
+
+#define LOG_INPROC_NAME_IN_USE(s, name)					\
+    log_debug_sock(s, "In-process server socket name \"%s\" already in " \
+		   "use.", name)
+
+#define LOG_INPROC_SERVER_CREATED(s, name)				\
+    log_debug_sock(s, "In-process server socket \"%s\" created.", name)
+
+#define LOG_INPROC_PENDING_DROPPED(s, num_conns)			\
+    log_debug_sock(s, "Dropped %d not-yet-accepted connections.", num_conns)
+
+#define LOG_INPROC_PEER_CLOSED(s)				\
+    log_debug_sock(s, "Remote peer closed the connection.")
+
+#endif
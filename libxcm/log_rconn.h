@@ -0,0 +1,53 @@
+#ifndef LOG_RCONN_H
+#define LOG_RCONN_H
+
+#include "log.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#define LOG_RCONN_CREATED(rconn, num_addrs)				\
+    log_debug("Reconnecting client %p created, with %zd server "	\
+	      "address(es).", rconn, num_addrs)
+
+#define LOG_RCONN_INVALID_ATTR(attr_name)				\
+    log_debug("Invalid value for reconnecting client attribute \"%s\".", \
+	      attr_name)
+
+#define LOG_RCONN_ATTEMPT(rconn, addr)					\
+    log_debug("Reconnecting client %p initiating connection to \"%s\".", \
+	      rconn, addr)
+
+#define LOG_RCONN_ATTEMPT_FAILED(rconn, addr, reason_errno)		\
+    log_debug("Reconnecting client %p failed to connect to \"%s\"; "	\
+	      "errno %d (%s).", rconn, addr, reason_errno,		\
+	      strerror(reason_errno))
+
+#define LOG_RCONN_CACHED_ADDR(rconn, addr, cached_addr)			\
+    log_debug("Reconnecting client %p caching \"%s\" as the resolved "	\
+	      "address of \"%s\".", rconn, cached_addr, addr)
+
+#define LOG_RCONN_CONNECTED(rconn, addr)				\
+    log_debug("Reconnecting client %p connected to \"%s\".", rconn, addr)
+
+#define LOG_RCONN_CONNECT_TIMED_OUT(rconn)				\
+    log_debug("Reconnecting client %p timed out waiting for a "	\
+	      "connection to be established.", rconn)
+
+#define LOG_RCONN_CONN_FAILED(rconn, reason_errno)			\
+    log_debug("Reconnecting client %p lost its connection; errno %d "	\
+	      "(%s).", rconn, reason_errno, strerror(reason_errno))
+
+#define LOG_RCONN_BACKOFF(rconn, delay_ms, num_failures)		\
+    log_debug("Reconnecting client %p backing off for %"PRId64" ms, "	\
+	      "after %"PRId64" failure(s).", rconn, delay_ms, num_failures)
+
+#define LOG_RCONN_DROPPED(rconn, len, reason_errno)			\
+    log_debug("Reconnecting client %p dropped buffered message of "	\
+	      "%zd bytes; errno %d (%s).", rconn, len, reason_errno,	\
+	      strerror(reason_errno))
+
+#define LOG_RCONN_DESTROYED(rconn)					\
+    log_debug("Reconnecting client %p destroyed.", rconn)
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef LOG_SHM_H
+#define LOG_SHM_H
+
+#include "log.h"
+
+#define LOG_SHM_CONN_ESTABLISHED(s, fd)			\
+    LOG_CONN_ESTABLISHED("Shared memory", s, fd)
+
+#define LOG_SHM_AREA_CREATED(s, area_size)				\
+    log_debug_sock(s, "Created %zd bytes shared memory area.", area_size)
+
+#define LOG_SHM_AREA_FAILED(s, op, reason_errno)			\
+    log_debug_sock(s, "Failed to %s shared memory area; errno %d (%s).", \
+		   op, reason_errno, strerror(reason_errno))
+
+#define LOG_SHM_HELLO_SENT(s)						\
+    log_debug_sock(s, "Handshake message sent to server.")
+
+#define LOG_SHM_HELLO_PENDING(s)					\
+    log_debug_sock(s, "Handshake message not yet received from client.")
+
+#define LOG_SHM_HELLO_RECEIVED(s, ring_size)				\
+    log_debug_sock(s, "Handshake message received, with ring size %d " \
+		   "bytes.", ring_size)
+
+#define LOG_SHM_HELLO_INVALID(s)					\
+    log_debug_sock(s, "Received invalid handshake message.")
+
+#define LOG_SHM_HELLO_FAILED(s, reason_errno)				\
+    log_debug_sock(s, "Handshake failed; errno %d (%s).",		\
+		   reason_errno, strerror(reason_errno))
+
+#define LOG_SHM_INVALID_FRAME(s)				\
+    log_debug_sock(s, "Peer produced invalid ring frame.")
+
+#define LOG_SHM_PEER_CLOSED(s)				\
+    log_debug_sock(s, "Remote peer closed the connection.")
+
+#endif
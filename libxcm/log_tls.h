@@ -61,6 +61,14 @@ void ns_description(const char *ns, char *buf, size_t capacity);
 		  "directory \"%s\".", ns_desc, cert_dir);		\
     } while (0)
 
+#define LOG_TLS_CTX_PINNED(ns, cert_dir)				\
+    do {								\
+	char ns_desc[128];						\
+	ns_description(ns, ns_desc, sizeof(ns_desc));			\
+	log_debug("Keeping SSL CTX for %s and certificate directory "	\
+		  "\"%s\" loaded.", ns_desc, cert_dir);			\
+    } while (0)
+
 void hash_description(uint8_t *hash, size_t hash_len, char *buf);
 
 #define LOG_TLS_CTX_HASH_EVENT(ns, cert_dir, event, cert_dir_hash, hash_size) \
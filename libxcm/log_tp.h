@@ -133,9 +133,25 @@
 #define LOG_TCP_SOCKET_OPTION_FAILED(opt_name, opt_value, reason_errno)	\
     LOG_SOCKET_OPTION_FAILED("TCP", opt_name, opt_value, reason_errno)
 
+#define LOG_TCP_CONGESTION_CONTROL_FAILED(name, reason_errno)		\
+    log_debug("Error setting TCP congestion control algorithm to "	\
+	      "\"%s\"; errno %d (%s).", name, reason_errno,		\
+	      strerror(reason_errno))
+
 #define LOG_SCTP_SOCKET_OPTION_FAILED(opt_name, opt_value, reason_errno) \
     LOG_SOCKET_OPTION_FAILED("SCTP", opt_name, opt_value, reason_errno)
 
+#define LOG_SCTP_STATUS_FAILED(s, reason_errno)			\
+    log_debug_sock(s, "Error retrieving SCTP association status; errno %d " \
+		   "(%s).", reason_errno, strerror(reason_errno))
+
+#define LOG_SCTP_OUT_STREAMS(s, num_streams)				\
+    log_debug_sock(s, "Association has %d outbound streams.", num_streams)
+
+#define LOG_SCTP_SEND_STREAM_CLAMPED(s, requested, actual)		\
+    log_debug_sock(s, "Send stream %"PRId64" not available; using stream " \
+		   "%"PRId64" instead.", requested, actual)
+
 #define LOG_PASS_CRED_FAILED(reason_errno) \
     log_debug("Error enabling UNIX domain socket SO_PASSCRED; errno %d " \
 	     "(%s).", reason_errno, strerror(reason_errno))
@@ -248,6 +264,10 @@
 	}								\
     } while (0)
 
+#define LOG_WAIT_TIMED_OUT(s, condition)				\
+    log_debug_sock(s, "Timed out waiting for socket to become %s.",	\
+		   tp_so_condition_name(condition))
+
 #define LOG_UPDATE_REQ(s, fd)						\
     log_debug_sock(s, "Updating internal epoll fd %d.", fd)
 
@@ -16,4 +16,7 @@
 		   "errno %d (%s).", path, reason_errno,                \
 		   strerror(reason_errno))
 
+#define LOG_UX_READ_AHEAD(s, num_msgs)					\
+    log_debug_sock(s, "Read ahead %d messages.", num_msgs)
+
 #endif
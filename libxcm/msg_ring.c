@@ -0,0 +1,166 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "msg_ring.h"
+
+#include "util.h"
+
+#include <string.h>
+
+/*
+ * The ring carries frames consisting of a 32-bit length field, the
+ * message payload, and padding to the next frame alignment
+ * boundary. A frame which does not fit between the current ring
+ * position and the end of the ring buffer is preceded by a wrap
+ * marker. The 'head' and 'tail' fields are monotonically increasing
+ * byte counters.
+ */
+
+#define FRAME_HDR_SIZE (sizeof(uint32_t))
+#define FRAME_ALIGN (8)
+#define FRAME_WRAP (UINT32_MAX)
+
+void msg_ring_init(struct msg_ring *ring)
+{
+    memset(ring, 0, sizeof(struct msg_ring));
+}
+
+static size_t frame_size(size_t msg_len)
+{
+    return (FRAME_HDR_SIZE + msg_len + FRAME_ALIGN - 1) & ~(FRAME_ALIGN - 1);
+}
+
+/* In an empty ring, a frame which does not fit before the end of the
+   ring buffer needs the remaining space, plus room for the frame at
+   the start of the ring. With 8-byte aligned positions, this always
+   works out if the ring can hold two frames of the largest size,
+   minus one alignment unit. */
+bool msg_ring_is_valid_size(uint32_t ring_size, size_t max_msg)
+{
+    if (ring_size == 0 || (ring_size & (ring_size - 1)) != 0)
+	return false;
+
+    return ring_size >= 2 * frame_size(max_msg) - FRAME_ALIGN;
+}
+
+static bool fits(uint64_t head, uint64_t tail, uint32_t ring_size,
+		 size_t fsize)
+{
+    size_t offset = tail & (ring_size - 1);
+    size_t contig = ring_size - offset;
+    size_t needed = fsize <= contig ? fsize : contig + fsize;
+
+    return ring_size - (tail - head) >= needed;
+}
+
+bool msg_ring_can_write(struct msg_ring *ring, uint32_t ring_size,
+			size_t msg_len)
+{
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    return fits(head, tail, ring_size, frame_size(msg_len));
+}
+
+bool msg_ring_write(struct msg_ring *ring, uint8_t *data, uint32_t ring_size,
+		    const void *buf, uint32_t len)
+{
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t fsize = frame_size(len);
+
+    if (!fits(head, tail, ring_size, fsize))
+	return false;
+
+    size_t offset = tail & (ring_size - 1);
+
+    if (fsize > ring_size - offset) {
+	uint32_t wrap = FRAME_WRAP;
+	memcpy(data + offset, &wrap, sizeof(wrap));
+	tail += ring_size - offset;
+	offset = 0;
+    }
+
+    memcpy(data + offset, &len, sizeof(len));
+    memcpy(data + offset + FRAME_HDR_SIZE, buf, len);
+
+    __atomic_store_n(&ring->tail, tail + fsize, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+bool msg_ring_is_empty(struct msg_ring *ring)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    return head == tail;
+}
+
+int msg_ring_read(struct msg_ring *ring, const uint8_t *data,
+		  uint32_t ring_size, uint32_t max_msg, void *buf,
+		  size_t capacity)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+	return 0;
+
+    size_t offset = head & (ring_size - 1);
+    uint32_t len;
+
+    memcpy(&len, data + offset, sizeof(len));
+
+    if (len == FRAME_WRAP) {
+	head += ring_size - offset;
+	offset = 0;
+	if (head == tail)
+	    return -1;
+	memcpy(&len, data, sizeof(len));
+    }
+
+    size_t fsize = frame_size(len);
+
+    if (len == 0 || len > max_msg || fsize > tail - head ||
+	offset + fsize > ring_size)
+	return -1;
+
+    memcpy(buf, data + offset + FRAME_HDR_SIZE, UT_MIN(len, capacity));
+
+    __atomic_store_n(&ring->head, head + fsize, __ATOMIC_RELEASE);
+
+    return len;
+}
+
+void msg_ring_producer_await(struct msg_ring *ring)
+{
+    __atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void msg_ring_consumer_await(struct msg_ring *ring)
+{
+    __atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static bool wakeup(uint32_t *waiting)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(waiting, __ATOMIC_RELAXED) &&
+	__atomic_exchange_n(waiting, 0, __ATOMIC_ACQ_REL);
+}
+
+bool msg_ring_producer_wakeup(struct msg_ring *ring)
+{
+    return wakeup(&ring->producer_waiting);
+}
+
+bool msg_ring_consumer_wakeup(struct msg_ring *ring)
+{
+    return wakeup(&ring->consumer_waiting);
+}
@@ -0,0 +1,70 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef MSG_RING_H
+#define MSG_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Single-producer, single-consumer message ring, used by transports
+ * where the two ends of a connection share memory.
+ *
+ * The ring header and the ring buffer may be kept in separate
+ * memory, and the header holds no pointers, so both may reside in
+ * memory shared between processes. The ring size must be a power of
+ * two.
+ *
+ * A party about to wait for the ring to become non-empty (or
+ * non-full) raises a flag in the header, and the other party is told
+ * to wake it up when it advances its position and finds the flag
+ * raised. How the wakeup is signaled is up to the user.
+ */
+
+#define MSG_RING_CACHE_LINE_SIZE (64)
+
+struct msg_ring
+{
+    uint64_t tail __attribute__((aligned(MSG_RING_CACHE_LINE_SIZE)));
+    uint32_t producer_waiting;
+
+    uint64_t head __attribute__((aligned(MSG_RING_CACHE_LINE_SIZE)));
+    uint32_t consumer_waiting;
+};
+
+void msg_ring_init(struct msg_ring *ring);
+
+/* Returns true in case the ring size is a power of two, and large
+   enough for a message of size max_msg to always fit into an empty
+   ring, regardless of the ring position */
+bool msg_ring_is_valid_size(uint32_t ring_size, size_t max_msg);
+
+bool msg_ring_can_write(struct msg_ring *ring, uint32_t ring_size,
+			size_t msg_len);
+bool msg_ring_write(struct msg_ring *ring, uint8_t *data, uint32_t ring_size,
+		    const void *buf, uint32_t len);
+
+bool msg_ring_is_empty(struct msg_ring *ring);
+
+/* Returns the length of the message, 0 if the ring is empty, or -1
+   in case the producer has put an invalid frame onto the ring */
+int msg_ring_read(struct msg_ring *ring, const uint8_t *data,
+		  uint32_t ring_size, uint32_t max_msg, void *buf,
+		  size_t capacity);
+
+void msg_ring_producer_await(struct msg_ring *ring);
+void msg_ring_consumer_await(struct msg_ring *ring);
+
+/* Returns true in case the producer should be woken up. Must be
+   called after a successful read. */
+bool msg_ring_producer_wakeup(struct msg_ring *ring);
+
+/* Returns true in case the consumer should be woken up. Must be
+   called after a successful write. */
+bool msg_ring_consumer_wakeup(struct msg_ring *ring);
+
+#endif
@@ -25,6 +25,7 @@ void tcp_opts_init(struct tcp_opts *opts)
 	.keepalive_interval = XCM_TCP_KEEPALIVE_INTERVAL,
 	.keepalive_count = XCM_TCP_KEEPALIVE_COUNT,
 	.user_timeout = XCM_TCP_USER_TIMEOUT,
+	.dscp = XCM_IP_DSCP,
 	.fd = -1
     };
 }
@@ -39,11 +40,11 @@ static int effectuate_keepalive(int fd, bool enabled)
     return rc;
 }
 
-#define GEN_EFFECTUATE_SCALE(optname, optdef, k)			\
+#define GEN_EFFECTUATE_LEVEL_SCALE(optname, level, optdef, k)		\
     static int effectuate_ ## optname(int fd, int64_t value)		\
     {									\
 	int int_value = (int)(value * (k));				\
-	int rc = setsockopt(fd, SOL_TCP, optdef, &int_value,		\
+	int rc = setsockopt(fd, level, optdef, &int_value,		\
 			    sizeof(int_value));				\
 	if (rc < 0) {							\
 	    LOG_TCP_SOCKET_OPTION_FAILED(#optdef, int_value, errno);	\
@@ -52,13 +53,31 @@ static int effectuate_keepalive(int fd, bool enabled)
 	return 0;							\
     }
 
+#define GEN_EFFECTUATE_SCALE(optname, optdef, k)	\
+    GEN_EFFECTUATE_LEVEL_SCALE(optname, SOL_TCP, optdef, k)
+
 #define GEN_EFFECTUATE(optname, optdef) \
     GEN_EFFECTUATE_SCALE(optname, optdef, 1)
 
+#define GEN_SOCKET_EFFECTUATE(optname, optdef) \
+    GEN_EFFECTUATE_LEVEL_SCALE(optname, SOL_SOCKET, optdef, 1)
+
 GEN_EFFECTUATE(keepalive_time, TCP_KEEPIDLE)
 GEN_EFFECTUATE(keepalive_interval, TCP_KEEPINTVL)
 GEN_EFFECTUATE(keepalive_count, TCP_KEEPCNT)
 GEN_EFFECTUATE_SCALE(user_timeout, TCP_USER_TIMEOUT, 1000)
+GEN_EFFECTUATE(notsent_lowat, TCP_NOTSENT_LOWAT)
+GEN_EFFECTUATE(quickack, TCP_QUICKACK)
+GEN_SOCKET_EFFECTUATE(sndbuf, SO_SNDBUF)
+GEN_SOCKET_EFFECTUATE(rcvbuf, SO_RCVBUF)
+
+static int effectuate_congestion_control(int fd, const char *name)
+{
+    int rc = setsockopt(fd, SOL_TCP, TCP_CONGESTION, name, strlen(name));
+    if (rc < 0)
+	LOG_TCP_CONGESTION_CONTROL_FAILED(name, errno);
+    return rc;
+}
 
 static int reduce_max_syn(int fd)
 {
@@ -89,7 +108,7 @@ int tcp_opts_effectuate(struct tcp_opts *opts, int fd)
 	rc = -1;
     if (reduce_max_syn(opts->fd) < 0)
 	rc = -1;
-    if (tcp_effectuate_dscp(opts->fd) < 0)
+    if (tcp_effectuate_dscp(opts->fd, opts->dscp) < 0)
 	rc = -1;
     if (effectuate_keepalive_time(opts->fd, opts->keepalive_time) < 0)
 	rc = -1;
@@ -101,6 +120,20 @@ int tcp_opts_effectuate(struct tcp_opts *opts, int fd)
 	rc = -1;
     if (effectuate_user_timeout(opts->fd, opts->user_timeout) < 0)
 	rc = -1;
+    /* buffer sizes must be set prior to connection establishment to
+       affect the TCP window scale */
+    if (opts->sndbuf > 0 && effectuate_sndbuf(opts->fd, opts->sndbuf) < 0)
+	rc = -1;
+    if (opts->rcvbuf > 0 && effectuate_rcvbuf(opts->fd, opts->rcvbuf) < 0)
+	rc = -1;
+    if (opts->notsent_lowat > 0 &&
+	effectuate_notsent_lowat(opts->fd, opts->notsent_lowat) < 0)
+	rc = -1;
+    if (opts->quickack && effectuate_quickack(opts->fd, 1) < 0)
+	rc = -1;
+    if (strlen(opts->congestion_control) > 0 &&
+	effectuate_congestion_control(opts->fd, opts->congestion_control) < 0)
+	rc = -1;
     return rc;
 }
 
@@ -145,12 +178,112 @@ GEN_SET_OPT(keepalive_time)
 GEN_SET_OPT(keepalive_interval)
 GEN_SET_OPT(keepalive_count)
 GEN_SET_OPT_SCALE(user_timeout, 1000)
+GEN_SET_OPT(sndbuf)
+GEN_SET_OPT(rcvbuf)
+GEN_SET_OPT(notsent_lowat)
+
+int tcp_set_quickack(struct tcp_opts *opts, bool quickack)
+{
+    if (opts->quickack == quickack)
+	return 0;
+
+    opts->quickack = quickack;
+
+    if (opts->fd < 0)
+	return 0;
+
+    if (effectuate_quickack(opts->fd, quickack) < 0)
+	return -1;
+
+    return 0;
+}
+
+void tcp_opts_rearm_quickack(struct tcp_opts *opts)
+{
+    if (opts->quickack && opts->fd >= 0)
+	(void)effectuate_quickack(opts->fd, 1);
+}
+
+int tcp_set_dscp(struct tcp_opts *opts, int64_t dscp)
+{
+    if (dscp < 0 || dscp > XCM_IP_DSCP_MAX) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    if (opts->dscp == dscp)
+	return 0;
+
+    opts->dscp = dscp;
+
+    if (opts->fd < 0)
+	return 0;
+
+    if (tcp_effectuate_dscp(opts->fd, dscp) < 0)
+	return -1;
+
+    return 0;
+}
+
+int tcp_set_congestion_control(struct tcp_opts *opts, const char *name,
+			       size_t len)
+{
+    if (len <= 1 || len > sizeof(opts->congestion_control) ||
+	name[len - 1] != '\0') {
+	errno = EINVAL;
+	return -1;
+    }
+
+    if (opts->fd >= 0 && effectuate_congestion_control(opts->fd, name) < 0)
+	return -1;
+
+    strcpy(opts->congestion_control, name);
+
+    return 0;
+}
+
+int tcp_set_fastopen(struct tcp_opts *opts, bool enabled)
+{
+    /* only applicable before the connection is initiated */
+    if (opts->fd >= 0) {
+	errno = EACCES;
+	return -1;
+    }
+
+    opts->fastopen = enabled;
+
+    return 0;
+}
+
+int tcp_get_congestion_control(struct tcp_opts *opts, char *name,
+			       size_t capacity)
+{
+    char actual[XCM_TCP_CONGESTION_CONTROL_MAX] = { 0 };
+
+    if (opts->fd >= 0) {
+	socklen_t actual_len = sizeof(actual) - 1;
+	if (getsockopt(opts->fd, SOL_TCP, TCP_CONGESTION, actual,
+		       &actual_len) < 0)
+	    return -1;
+    } else
+	strcpy(actual, opts->congestion_control);
+
+    size_t len = strlen(actual);
+    if (len >= capacity) {
+	errno = EOVERFLOW;
+	return -1;
+    }
+
+    strcpy(name, actual);
 
-/* Equivalent to the tcp_info structure found in kernel 4.3's public
+    return len + 1;
+}
+
+/* Equivalent to the tcp_info structure found in kernel 4.9's public
    API. XCM carries its own copy because it wants to be prepared for a
    situation where the build-time and run-time kernel versions are
    different. */
-struct tcp_info_4_3 {
+struct tcp_info_4_9 {
     uint8_t tcpi_state;
     uint8_t tcpi_ca_state;
     uint8_t tcpi_retransmits;
@@ -195,18 +328,25 @@ struct tcp_info_4_3 {
     uint64_t tcpi_bytes_received;
     uint32_t tcpi_segs_out;
     uint32_t tcpi_segs_in;
+
+    uint32_t tcpi_notsent_bytes;
+    uint32_t tcpi_min_rtt;
+    uint32_t tcpi_data_segs_in;
+    uint32_t tcpi_data_segs_out;
+
+    uint64_t tcpi_delivery_rate;
 };
 
 #define GEN_INFO_GET(xcm_field_name, tcp_field_name)			\
     int tcp_get_ ## xcm_field_name ## _attr(int fd, int64_t *value)	\
     {									\
-	struct tcp_info_4_3 info;					\
+	struct tcp_info_4_9 info;					\
 	socklen_t len = sizeof(info);					\
 									\
 	if (getsockopt(fd, SOL_TCP, TCP_INFO, &info, &len) < 0)		\
 	    return -1;							\
 	size_t field_end =						\
-	    offsetof(struct tcp_info_4_3, tcp_field_name) +		\
+	    offsetof(struct tcp_info_4_9, tcp_field_name) +		\
 	    sizeof(info.tcp_field_name);				\
 	if (len < field_end) {						\
 	    /* field not available in this kernel */			\
@@ -225,9 +365,82 @@ GEN_INFO_GET(total_retrans, tcpi_total_retrans)
 GEN_INFO_GET(segs_in, tcpi_segs_in)
 GEN_INFO_GET(segs_out, tcpi_segs_out)
 
+GEN_INFO_GET(cwnd, tcpi_snd_cwnd)
+GEN_INFO_GET(pacing_rate, tcpi_pacing_rate)
+GEN_INFO_GET(delivery_rate, tcpi_delivery_rate)
+GEN_INFO_GET(unacked, tcpi_unacked)
+GEN_INFO_GET(notsent_bytes, tcpi_notsent_bytes)
+
+int tcp_get_fastopen_used_attr(int fd, bool *value)
+{
+    struct tcp_info_4_9 info;
+    socklen_t len = sizeof(info);
+
+    if (getsockopt(fd, SOL_TCP, TCP_INFO, &info, &len) < 0)
+	return -1;
+
+    bool used = info.tcpi_options & TCPI_OPT_SYN_DATA;
+    memcpy(value, &used, sizeof(bool));
+
+    return sizeof(bool);
+}
+
+static const char *tcp_state_name(uint8_t state)
+{
+    switch (state) {
+    case TCP_ESTABLISHED: return "established";
+    case TCP_SYN_SENT: return "syn-sent";
+    case TCP_SYN_RECV: return "syn-recv";
+    case TCP_FIN_WAIT1: return "fin-wait-1";
+    case TCP_FIN_WAIT2: return "fin-wait-2";
+    case TCP_TIME_WAIT: return "time-wait";
+    case TCP_CLOSE: return "closed";
+    case TCP_CLOSE_WAIT: return "close-wait";
+    case TCP_LAST_ACK: return "last-ack";
+    case TCP_LISTEN: return "listen";
+    case TCP_CLOSING: return "closing";
+    default: return "unknown";
+    }
+}
+
+int tcp_get_state_attr(int fd, char *value, size_t capacity)
+{
+    struct tcp_info_4_9 info;
+    socklen_t len = sizeof(info);
+
+    if (getsockopt(fd, SOL_TCP, TCP_INFO, &info, &len) < 0)
+	return -1;
+
+    const char *name = tcp_state_name(info.tcpi_state);
+    size_t name_len = strlen(name);
+
+    if (name_len >= capacity) {
+	errno = EOVERFLOW;
+	return -1;
+    }
+
+    strcpy(value, name);
+
+    return name_len + 1;
+}
+
+int tcp_get_incoming_cpu_attr(int fd, int64_t *value)
+{
+    int cpu;
+    socklen_t len = sizeof(cpu);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0)
+	return -1;
+
+    int64_t cpu64 = cpu;
+    memcpy(value, &cpu64, sizeof(int64_t));
+
+    return sizeof(int64_t);
+}
+
 #define DSCP_TO_TOS(dscp) ((dscp)<<2)
 
-int tcp_effectuate_dscp(int fd)
+int tcp_effectuate_dscp(int fd, int dscp)
 {
     struct sockaddr_storage addr;
     socklen_t addr_len = sizeof(addr);
@@ -238,7 +451,7 @@ int tcp_effectuate_dscp(int fd)
     /* the kernel ignores the ECN part of the TOS, so effectivily
        setting IP_TOS is only about setting the DSCP part of the
        field */
-    int tos = DSCP_TO_TOS(XCM_IP_DSCP);
+    int tos = DSCP_TO_TOS(dscp);
     if (addr.ss_family == AF_INET) {
 	return setsockopt(fd, SOL_IP, IP_TOS,  &tos, sizeof(tos));
     } else {
@@ -252,3 +465,26 @@ int tcp_effectuate_reuse_addr(int fd)
     int reuse = 1;
     return setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 }
+
+int tcp_effectuate_fastopen_server(int fd)
+{
+    int qlen = XCM_TCP_FASTOPEN_QLEN;
+    int rc = setsockopt(fd, SOL_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen));
+    if (rc < 0)
+	LOG_TCP_SOCKET_OPTION_FAILED("TCP_FASTOPEN", qlen, errno);
+    return rc;
+}
+
+/* TCP Fast Open is an optimization, and failing to enable it (e.g.,
+   because it's disabled in the kernel) should not fail the connection
+   attempt */
+void tcp_effectuate_fastopen_connect(struct tcp_opts *opts)
+{
+    if (!opts->fastopen)
+	return;
+
+    int enabled = 1;
+    if (setsockopt(opts->fd, SOL_TCP, TCP_FASTOPEN_CONNECT, &enabled,
+		   sizeof(enabled)) < 0)
+	LOG_TCP_SOCKET_OPTION_FAILED("TCP_FASTOPEN_CONNECT", enabled, errno);
+}
@@ -19,9 +19,15 @@
     (XCM_TCP_KEEPALIVE_INTERVAL * XCM_TCP_KEEPALIVE_COUNT)
 
 #define XCM_IP_DSCP (40)
+#define XCM_IP_DSCP_MAX (63)
+
+/* Same as TCP_CA_NAME_MAX in the Linux kernel */
+#define XCM_TCP_CONGESTION_CONTROL_MAX (16)
 
 #define XCM_TCP_MAX_SYN_RETRANSMITS (3)
 
+#define XCM_TCP_FASTOPEN_QLEN (32)
+
 struct tcp_opts
 {
     bool keepalive;
@@ -30,6 +36,18 @@ struct tcp_opts
     int64_t keepalive_count;
     int64_t user_timeout;
 
+    /* zero means the system default */
+    int64_t sndbuf;
+    int64_t rcvbuf;
+    int64_t notsent_lowat;
+
+    bool quickack;
+    int64_t dscp;
+    char congestion_control[XCM_TCP_CONGESTION_CONTROL_MAX];
+
+    /* only used on the client side */
+    bool fastopen;
+
     int fd;
 };
 
@@ -41,13 +59,37 @@ int tcp_set_keepalive_time(struct tcp_opts *opts, int64_t time);
 int tcp_set_keepalive_interval(struct tcp_opts *opts, int64_t time);
 int tcp_set_keepalive_count(struct tcp_opts *opts, int64_t count);
 int tcp_set_user_timeout(struct tcp_opts *opts, int64_t tmo);
+int tcp_set_sndbuf(struct tcp_opts *opts, int64_t size);
+int tcp_set_rcvbuf(struct tcp_opts *opts, int64_t size);
+int tcp_set_notsent_lowat(struct tcp_opts *opts, int64_t lowat);
+int tcp_set_quickack(struct tcp_opts *opts, bool enabled);
+int tcp_set_dscp(struct tcp_opts *opts, int64_t dscp);
+int tcp_set_congestion_control(struct tcp_opts *opts, const char *name,
+			       size_t len);
+int tcp_get_congestion_control(struct tcp_opts *opts, char *name,
+			       size_t capacity);
+int tcp_set_fastopen(struct tcp_opts *opts, bool enabled);
+
+/* TCP_QUICKACK is not permanent, and must be re-enabled after each
+   read on the socket */
+void tcp_opts_rearm_quickack(struct tcp_opts *opts);
 
 int tcp_get_rtt_attr(int fd, int64_t *value);
 int tcp_get_total_retrans_attr(int fd, int64_t *value);
 int tcp_get_segs_in_attr(int fd, int64_t *value);
 int tcp_get_segs_out_attr(int fd, int64_t *value);
+int tcp_get_cwnd_attr(int fd, int64_t *value);
+int tcp_get_pacing_rate_attr(int fd, int64_t *value);
+int tcp_get_delivery_rate_attr(int fd, int64_t *value);
+int tcp_get_unacked_attr(int fd, int64_t *value);
+int tcp_get_notsent_bytes_attr(int fd, int64_t *value);
+int tcp_get_fastopen_used_attr(int fd, bool *value);
+int tcp_get_incoming_cpu_attr(int fd, int64_t *value);
+int tcp_get_state_attr(int fd, char *value, size_t capacity);
 
-int tcp_effectuate_dscp(int fd);
+int tcp_effectuate_dscp(int fd, int dscp);
 int tcp_effectuate_reuse_addr(int fd);
+int tcp_effectuate_fastopen_server(int fd);
+void tcp_effectuate_fastopen_connect(struct tcp_opts *opts);
 
 #endif
@@ -15,6 +15,7 @@
 #include "ctl.h"
 #endif
 
+#include <limits.h>
 #include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,8 +38,94 @@ static void await(struct xcm_socket *s, int condition)
     xcm_tp_socket_update(s);
 }
 
-static int socket_wait(struct xcm_socket *conn_s, int condition)
+/* deadlines are in seconds of monotonic time, as per ut_ftime() */
+#define NO_DEADLINE (-1)
+
+static double deadline_from_timeout(int64_t timeout_ms)
+{
+    if (timeout_ms == 0)
+	return NO_DEADLINE;
+
+    return ut_ftime() + timeout_ms / 1e3;
+}
+
+static int deadline_to_poll_timeout(double deadline)
 {
+    if (deadline == NO_DEADLINE)
+	return -1;
+
+    double left = deadline - ut_ftime();
+
+    if (left <= 0)
+	return 0;
+
+    double left_ms = left * 1e3;
+
+    /* a timeout too large for poll() is shortened, and the wait
+       restarted in case it expires */
+    if (left_ms >= INT_MAX)
+	return INT_MAX;
+
+    /* round up, to avoid waking up just before the deadline */
+    return (int)left_ms + 1;
+}
+
+/* Spinning avoids the sleep and wakeup cost of a blocking poll(),
+   at the cost of burning CPU cycles. The spinning is done by having
+   the caller retry the (non-blocking) transport operation, which
+   avoids any system calls for transports (e.g., SHM) which may
+   complete the operation without them. */
+struct spin
+{
+    double deadline;
+    bool expired;
+};
+
+#define SPIN_INIT { .deadline = NO_DEADLINE }
+
+static bool keep_spinning(struct xcm_socket *s, struct spin *spin,
+			  double deadline)
+{
+    if (s->busy_poll_us == 0 || spin->expired)
+	return false;
+
+    double now = ut_ftime();
+
+    if (spin->deadline == NO_DEADLINE) {
+	spin->deadline = now + s->busy_poll_us / 1e6;
+
+	if (deadline != NO_DEADLINE && deadline < spin->deadline)
+	    spin->deadline = deadline;
+    }
+
+    if (now < spin->deadline)
+	return true;
+
+    spin->expired = true;
+
+    return false;
+}
+
+/* Only receive operations are accounted for, since those are what
+   busy polling is meant to speed up */
+static void count_spin(struct xcm_socket *s, const struct spin *spin)
+{
+    if (spin->deadline == NO_DEADLINE)
+	return;
+
+    if (spin->expired)
+	s->busy_poll_misses++;
+    else
+	s->busy_poll_hits++;
+}
+
+/* A NULL 'sp' means the thread is put to sleep without spinning */
+static int socket_wait(struct xcm_socket *conn_s, int condition,
+		       double deadline, struct spin *sp)
+{
+    if (sp != NULL && keep_spinning(conn_s, sp, deadline))
+	return 0;
+
     await(conn_s, condition);
 
     struct pollfd pfd = {
@@ -46,22 +133,44 @@ static int socket_wait(struct xcm_socket *conn_s, int condition)
 	.events = POLLIN
     };
 
-    int rc = poll(&pfd, 1, -1);
+    int rc;
+    do
+	rc = poll(&pfd, 1, deadline_to_poll_timeout(deadline));
+    while (rc == 0 && deadline_to_poll_timeout(deadline) > 0);
+
+    if (rc == 0) {
+	LOG_WAIT_TIMED_OUT(conn_s, condition);
+	errno = ETIMEDOUT;
+    }
 
     return rc > 0 ? 0 : -1;
 }
 
-static int socket_finish(struct xcm_socket *s)
+static int socket_finish(struct xcm_socket *s, double deadline)
 {
+    struct spin spin = SPIN_INIT;
+
     int f_rc;
     while ((f_rc = xcm_tp_socket_finish(s)) < 0 &&
 	   (errno == EAGAIN || errno == EINPROGRESS)) {
-	if (socket_wait(s, 0) < 0)
+	if (socket_wait(s, 0, deadline, &spin) < 0)
 	    return -1;
     }
     return f_rc;
 }
 
+/* The send timeout only covers the wait for the transport to accept
+   the message. Once accepted, the message is handed over to the
+   lower layer within what remains of the timeout, or else in the
+   course of subsequent operations on the socket. */
+static int send_finish(struct xcm_socket *conn_s, double deadline)
+{
+    if (socket_finish(conn_s, deadline) < 0 && errno != ETIMEDOUT)
+	return -1;
+
+    return 0;
+}
+
 struct xcm_socket *xcm_connect(const char *remote_addr, int flags)
 {
     struct xcm_attr_map *attrs = NULL;
@@ -162,10 +271,12 @@ struct xcm_socket *xcm_connect_a(const char *remote_addr,
     if (attrs && set_attrs(s, attrs) < 0)
 	goto err_close;
 
+    double deadline = deadline_from_timeout(s->connect_timeout);
+
     if (xcm_tp_socket_connect(s, remote_addr) < 0)
 	goto err_destroy;
 
-    if (s->is_blocking && socket_finish(s) < 0) {
+    if (s->is_blocking && socket_finish(s, deadline) < 0) {
 	LOG_CONN_FAILED(s, errno);
 	goto err_close;
     }
@@ -249,6 +360,7 @@ struct xcm_socket *xcm_accept_a(struct xcm_socket *server_s,
     TP_RET_ERR_RC_UNLESS_TYPE(server_s, xcm_socket_type_server, NULL);
 
     bool is_blocking = server_s->is_blocking;
+    double deadline = deadline_from_timeout(server_s->accept_timeout);
     struct xcm_socket *conn_s;
 
 restart:
@@ -257,7 +369,8 @@ restart:
     if (!conn_s)
 	goto err;
 
-    if (is_blocking && socket_wait(server_s, XCM_SO_ACCEPTABLE) < 0)
+    if (is_blocking &&
+	socket_wait(server_s, XCM_SO_ACCEPTABLE, deadline, NULL) < 0)
 	goto err_destroy;
 
     if (xcm_tp_socket_init(conn_s) < 0)
@@ -274,7 +387,7 @@ restart:
 	goto err_destroy;
     }
 
-    if (is_blocking && socket_finish(conn_s) < 0)
+    if (is_blocking && socket_finish(conn_s, deadline) < 0)
 	goto err_close;
 
     xcm_tp_socket_enable_ctl(conn_s);
@@ -294,18 +407,21 @@ int xcm_send(struct xcm_socket *conn_s, const void *buf, size_t len)
     TP_RET_ERR_UNLESS_TYPE(conn_s, xcm_socket_type_conn);
 
     if (conn_s->is_blocking) {
+	double deadline = deadline_from_timeout(conn_s->send_timeout);
+	struct spin spin = SPIN_INIT;
+
 	int s_rc;
 	do {
 	    s_rc = xcm_tp_socket_send(conn_s, buf, len);
 	    if (s_rc < 0) {
 		if (errno != EAGAIN)
 		    return s_rc;
-		if (socket_wait(conn_s, XCM_SO_SENDABLE) < 0)
+		if (socket_wait(conn_s, XCM_SO_SENDABLE, deadline, &spin) < 0)
 		    return -1;
 	    }
 	} while (s_rc < 0);
 
-	return socket_finish(conn_s);
+	return send_finish(conn_s, deadline);
     } else
 	return xcm_tp_socket_send(conn_s, buf, len);
 }
@@ -315,18 +431,143 @@ int xcm_receive(struct xcm_socket *conn_s, void *buf, size_t capacity)
     TP_RET_ERR_UNLESS_TYPE(conn_s, xcm_socket_type_conn);
 
     if (conn_s->is_blocking) {
+	double deadline = deadline_from_timeout(conn_s->receive_timeout);
+	struct spin spin = SPIN_INIT;
+	bool retried = false;
+
 	for (;;) {
-	    if (socket_wait(conn_s, XCM_SO_RECEIVABLE) < 0)
+	    if (socket_wait(conn_s, XCM_SO_RECEIVABLE, deadline, &spin) < 0) {
+		count_spin(conn_s, &spin);
 		return -1;
+	    }
+
 	    int s_rc = xcm_tp_socket_receive(conn_s, buf, capacity);
 
-	    if (s_rc != -1 || errno != EAGAIN)
+	    if (s_rc != -1 || errno != EAGAIN) {
+		/* when spinning, the first wait returns immediately,
+		   so only a receive which had to be retried has
+		   actually waited */
+		if (retried)
+		    count_spin(conn_s, &spin);
 		return s_rc;
+	    }
+
+	    retried = true;
 	}
     } else
 	return xcm_tp_socket_receive(conn_s, buf, capacity);
 }
 
+int xcm_send_batch(struct xcm_socket *conn_s, const struct iovec *msgs,
+		   size_t num_msgs)
+{
+    TP_RET_ERR_UNLESS_TYPE(conn_s, xcm_socket_type_conn);
+    TP_RET_ERR_IF(num_msgs == 0, EINVAL);
+
+    if (conn_s->is_blocking) {
+	double deadline = deadline_from_timeout(conn_s->send_timeout);
+	struct spin spin = SPIN_INIT;
+
+	size_t num_sent = 0;
+	while (num_sent < num_msgs) {
+	    int s_rc = xcm_tp_socket_send_batch(conn_s, msgs + num_sent,
+						num_msgs - num_sent);
+	    if (s_rc < 0) {
+		if (errno != EAGAIN ||
+		    socket_wait(conn_s, XCM_SO_SENDABLE, deadline, &spin) < 0)
+		    return num_sent > 0 ? (int)num_sent : -1;
+	    } else
+		num_sent += s_rc;
+	}
+
+	if (send_finish(conn_s, deadline) < 0)
+	    return -1;
+
+	return num_sent;
+    } else
+	return xcm_tp_socket_send_batch(conn_s, msgs, num_msgs);
+}
+
+int xcm_receive_batch(struct xcm_socket *conn_s, struct iovec *bufs,
+		      size_t num_bufs)
+{
+    TP_RET_ERR_UNLESS_TYPE(conn_s, xcm_socket_type_conn);
+    TP_RET_ERR_IF(num_bufs == 0, EINVAL);
+
+    if (conn_s->is_blocking) {
+	double deadline = deadline_from_timeout(conn_s->receive_timeout);
+	struct spin spin = SPIN_INIT;
+
+	for (;;) {
+	    int s_rc = xcm_tp_socket_receive_batch(conn_s, bufs, num_bufs);
+
+	    if (s_rc != -1 || errno != EAGAIN) {
+		count_spin(conn_s, &spin);
+		return s_rc;
+	    }
+
+	    if (socket_wait(conn_s, XCM_SO_RECEIVABLE, deadline, &spin) < 0) {
+		count_spin(conn_s, &spin);
+		return -1;
+	    }
+	}
+    } else
+	return xcm_tp_socket_receive_batch(conn_s, bufs, num_bufs);
+}
+
+int xcm_send_fds(struct xcm_socket *conn_s, const void *buf, size_t len,
+		 const int *fds, size_t num_fds)
+{
+    TP_RET_ERR_UNLESS_TYPE(conn_s, xcm_socket_type_conn);
+    TP_RET_ERR_IF(num_fds > XCM_MAX_FDS, EINVAL);
+
+    if (conn_s->is_blocking) {
+	double deadline = deadline_from_timeout(conn_s->send_timeout);
+	struct spin spin = SPIN_INIT;
+
+	int s_rc;
+	do {
+	    s_rc = xcm_tp_socket_send_fds(conn_s, buf, len, fds, num_fds);
+	    if (s_rc < 0) {
+		if (errno != EAGAIN)
+		    return s_rc;
+		if (socket_wait(conn_s, XCM_SO_SENDABLE, deadline, &spin) < 0)
+		    return -1;
+	    }
+	} while (s_rc < 0);
+
+	return send_finish(conn_s, deadline);
+    } else
+	return xcm_tp_socket_send_fds(conn_s, buf, len, fds, num_fds);
+}
+
+int xcm_receive_fds(struct xcm_socket *conn_s, void *buf, size_t capacity,
+		    int *fds, size_t *num_fds)
+{
+    TP_RET_ERR_UNLESS_TYPE(conn_s, xcm_socket_type_conn);
+
+    if (conn_s->is_blocking) {
+	double deadline = deadline_from_timeout(conn_s->receive_timeout);
+	struct spin spin = SPIN_INIT;
+
+	for (;;) {
+	    int s_rc = xcm_tp_socket_receive_fds(conn_s, buf, capacity,
+						 fds, num_fds);
+
+	    if (s_rc != -1 || errno != EAGAIN) {
+		count_spin(conn_s, &spin);
+		return s_rc;
+	    }
+
+	    if (socket_wait(conn_s, XCM_SO_RECEIVABLE, deadline, &spin) < 0) {
+		count_spin(conn_s, &spin);
+		return -1;
+	    }
+	}
+    } else
+	return xcm_tp_socket_receive_fds(conn_s, buf, capacity, fds, num_fds);
+}
+
 int xcm_await(struct xcm_socket *s, int condition)
 {
     TP_RET_ERR_IF(s->is_blocking, EINVAL);
@@ -339,6 +580,23 @@ int xcm_await(struct xcm_socket *s, int condition)
     return 0;
 }
 
+int xcm_await_timeout(struct xcm_socket *s, int condition, int timeout_ms)
+{
+    TP_RET_ERR_IF(timeout_ms < -1, EINVAL);
+
+    if (xcm_await(s, condition) < 0)
+	return -1;
+
+    struct pollfd pfd = {
+	.fd = s->epoll_fd,
+	.events = POLLIN
+    };
+
+    int rc = poll(&pfd, 1, timeout_ms);
+
+    return rc > 0 ? 1 : rc;
+}
+
 int xcm_fd(struct xcm_socket *s)
 {
     TP_RET_ERR_IF(s->is_blocking, EINVAL);
@@ -370,7 +628,7 @@ int xcm_set_blocking(struct xcm_socket *s, bool should_block)
        switching from non-blocking to blocking */
     if (!s->is_blocking) {
 	LOG_BLOCKING_FINISHING_WORK(s);
-	if (socket_finish(s) < 0)
+	if (socket_finish(s, NO_DEADLINE) < 0)
 	    return -1;
     }
 
@@ -398,15 +656,19 @@ const char *xcm_local_addr(struct xcm_socket *s)
     return xcm_tp_socket_get_local_addr(s, false);
 }
 
-static const struct xcm_tp_attr *attr_lookup(const char *name,
-					     const struct xcm_tp_attr *attrs,
-					     size_t attrs_len)
+int xcm_prewarm(const char *transport)
 {
-    size_t i;
-    for (i=0; i<attrs_len; i++)
-	if (strcmp(attrs[i].name, name) == 0)
-	    return &attrs[i];
-    return NULL;
+    const struct xcm_tp_proto *proto = xcm_tp_proto_by_name(transport);
+
+    if (proto == NULL) {
+	errno = ENOPROTOOPT;
+	return -1;
+    }
+
+    if (proto->ops->prewarm == NULL)
+	return 0;
+
+    return proto->ops->prewarm();
 }
 
 static const struct xcm_tp_attr *socket_attr_lookup(struct xcm_socket *s,
@@ -419,13 +681,13 @@ static const struct xcm_tp_attr *socket_attr_lookup(struct xcm_socket *s,
 
     const struct xcm_tp_attr *attr;
 
-    attr = attr_lookup(name, attrs, attrs_len);
+    attr = xcm_tp_attrs_lookup(name, attrs, attrs_len);
     if (attr)
 	return attr;
 
     xcm_tp_socket_get_attrs(s, &attrs, &attrs_len);
 
-    attr = attr_lookup(name, attrs, attrs_len);
+    attr = xcm_tp_attrs_lookup(name, attrs, attrs_len);
 
     return attr;
 }
@@ -509,10 +771,6 @@ int xcm_attr_get(struct xcm_socket *s, const char *name,
 {
     LOG_GET_ATTR_REQ(s, name);
 
-    const struct xcm_tp_attr *attrs;
-    size_t attrs_len;
-    xcm_tp_get_attrs(s->type, &attrs, &attrs_len);
-
     const struct xcm_tp_attr *attr = socket_attr_lookup(s, name);
     if (!attr) {
 	errno = ENOENT;
@@ -571,8 +829,37 @@ int xcm_attr_get_bool(struct xcm_socket *s, const char *name,
 int xcm_attr_get_int64(struct xcm_socket *s, const char *name,
 		       int64_t *value)
 {
-    return attr_get_with_type(s, name, xcm_attr_type_int64,
-			      value, sizeof(int64_t));
+    /* Integer attributes are mostly counters, which may be polled
+       frequently. The type is checked before the getter is invoked,
+       and the value is written straight into the caller's buffer. */
+
+    LOG_GET_ATTR_REQ(s, name);
+
+    const struct xcm_tp_attr *attr = socket_attr_lookup(s, name);
+    if (!attr || attr->type != xcm_attr_type_int64) {
+	errno = ENOENT;
+	goto err;
+    }
+
+    if (!attr->get_fun) {
+	errno = EACCES;
+	goto err;
+    }
+
+    int rc = attr->get_fun(s, attr, value, sizeof(int64_t));
+    if (rc < 0) {
+	if (errno == EOVERFLOW)
+	    errno = ENOENT;
+	goto err;
+    }
+
+    LOG_GET_ATTR_RESULT(s, name, attr->type, value, rc);
+
+    return rc;
+
+ err:
+    LOG_GET_ATTR_FAILED(s, errno);
+    return -1;
 }
 
 int xcm_attr_get_str(struct xcm_socket *s, const char *name,
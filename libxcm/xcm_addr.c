@@ -87,8 +87,8 @@ int xcm_addr_parse_proto(const char *addr_s, char *proto, size_t capacity)
 			    proto_addr, sizeof(proto_addr));
 }
 
-static int addr_parse_ux_uxf(const char *ux_proto, const char *ux_addr_s,
-			     char *ux_name, size_t capacity)
+static int addr_parse_name(const char *ux_proto, const char *ux_addr_s,
+			   size_t name_max, char *ux_name, size_t capacity)
 {
     char proto[XCM_ADDR_MAX_PROTO_LEN+1];
     char name[XCM_ADDR_MAX+1];
@@ -97,7 +97,7 @@ static int addr_parse_ux_uxf(const char *ux_proto, const char *ux_addr_s,
 			 name, sizeof(name)) < 0)
 	return -1;
 
-    if (strcmp(proto, ux_proto) != 0 || strlen(name) > UX_NAME_MAX ||
+    if (strcmp(proto, ux_proto) != 0 || strlen(name) > name_max ||
 	strlen(name) == 0) {
 	errno = EINVAL;
 	return -1;
@@ -115,13 +115,29 @@ static int addr_parse_ux_uxf(const char *ux_proto, const char *ux_addr_s,
 
 int xcm_addr_parse_ux(const char *ux_addr_s, char *ux_name, size_t capacity)
 {
-    return addr_parse_ux_uxf(XCM_UX_PROTO, ux_addr_s, ux_name, capacity);
+    return addr_parse_name(XCM_UX_PROTO, ux_addr_s, UX_NAME_MAX,
+			   ux_name, capacity);
 }
 
 int xcm_addr_parse_uxf(const char *uxf_addr_s, char *uxf_name,
 		       size_t capacity)
 {
-    return addr_parse_ux_uxf(XCM_UXF_PROTO, uxf_addr_s, uxf_name, capacity);
+    return addr_parse_name(XCM_UXF_PROTO, uxf_addr_s, UX_NAME_MAX,
+			   uxf_name, capacity);
+}
+
+int xcm_addr_parse_shm(const char *shm_addr_s, char *shm_name,
+		       size_t capacity)
+{
+    return addr_parse_name(XCM_SHM_PROTO, shm_addr_s, SHM_NAME_MAX,
+			   shm_name, capacity);
+}
+
+int xcm_addr_parse_inproc(const char *inproc_addr_s, char *inproc_name,
+			  size_t capacity)
+{
+    return addr_parse_name(XCM_INPROC_PROTO, inproc_addr_s, INPROC_NAME_MAX,
+			   inproc_name, capacity);
 }
 
 #define DNS_MAX_LEN (253)
@@ -362,10 +378,10 @@ int xcm_addr_make_sctp(const struct xcm_addr_host *host, uint16_t port,
     return host_port_make(XCM_SCTP_PROTO, host, port, sctp_addr_s, capacity);
 }
 
-static int addr_make_ux_uxf(const char *ux_proto, const char *ux_name,
-			    char *ux_addr_s, size_t capacity)
+static int addr_make_name(const char *ux_proto, const char *ux_name,
+			  size_t name_max, char *ux_addr_s, size_t capacity)
 {
-    if (strlen(ux_name) > (UNIX_PATH_MAX-1)) {
+    if (strlen(ux_name) > name_max) {
 	errno = EINVAL;
 	return -1;
     }
@@ -380,10 +396,25 @@ static int addr_make_ux_uxf(const char *ux_proto, const char *ux_name,
 
 int xcm_addr_make_ux(const char *ux_name, char *ux_addr_s, size_t capacity)
 {
-    return addr_make_ux_uxf(XCM_UX_PROTO, ux_name, ux_addr_s, capacity);
+    return addr_make_name(XCM_UX_PROTO, ux_name, UX_NAME_MAX,
+			  ux_addr_s, capacity);
 }
 
 int xcm_addr_make_uxf(const char *uxf_name, char *uxf_addr_s, size_t capacity)
 {
-    return addr_make_ux_uxf(XCM_UXF_PROTO, uxf_name, uxf_addr_s, capacity);
+    return addr_make_name(XCM_UXF_PROTO, uxf_name, UX_NAME_MAX,
+			  uxf_addr_s, capacity);
+}
+
+int xcm_addr_make_shm(const char *shm_name, char *shm_addr_s, size_t capacity)
+{
+    return addr_make_name(XCM_SHM_PROTO, shm_name, SHM_NAME_MAX,
+			  shm_addr_s, capacity);
+}
+
+int xcm_addr_make_inproc(const char *inproc_name, char *inproc_addr_s,
+			 size_t capacity)
+{
+    return addr_make_name(XCM_INPROC_PROTO, inproc_name, INPROC_NAME_MAX,
+			  inproc_addr_s, capacity);
 }
@@ -2,7 +2,20 @@
 
 #include "util.h"
 
-#include <sys/queue.h>
+/*
+ * The attribute map is an open-addressing hash table (with linear
+ * probing) of pointers to attribute entries. The entries themselves
+ * are stored in fixed-size chunks, which are never moved, since the
+ * API guarantees the value pointers stay valid even when other
+ * attributes are added or removed. Short names and small values
+ * (e.g., all booleans and integers) are kept inline in the entry. The
+ * first chunk and the initial index are embedded into the map
+ * object, so the common case small map requires only a single
+ * allocation.
+ */
+
+#define ATTR_INLINE_NAME_MAX (32)
+#define ATTR_INLINE_VALUE_MAX (32)
 
 struct attr
 {
@@ -10,11 +23,39 @@ struct attr
     enum xcm_attr_type type;
     void *value;
     size_t value_len;
+    uint32_t hash;
 
-    LIST_ENTRY(attr) entry;
+    char inline_name[ATTR_INLINE_NAME_MAX];
+    union {
+	int64_t align;
+	uint8_t inline_value[ATTR_INLINE_VALUE_MAX];
+    };
+
+    struct attr *next_free;
+};
+
+#define ATTRS_PER_CHUNK (8)
+
+struct attr_chunk
+{
+    struct attr attrs[ATTRS_PER_CHUNK];
+    struct attr_chunk *next;
 };
 
-LIST_HEAD(attr_list, attr);
+#define INITIAL_NUM_SLOTS (16)
+
+struct xcm_attr_map
+{
+    struct attr **slots;
+    size_t num_slots;
+    size_t size;
+
+    struct attr *free_attrs;
+    struct attr_chunk *last_chunk;
+
+    struct attr *initial_slots[INITIAL_NUM_SLOTS];
+    struct attr_chunk first_chunk;
+};
 
 static void assert_valid_len(enum xcm_attr_type type, size_t value_len)
 {
@@ -31,92 +72,236 @@ static void assert_valid_len(enum xcm_attr_type type, size_t value_len)
     }
 }
 
-struct attr *attr_create(const char *name, enum xcm_attr_type type,
-			 const void *value, size_t value_len)
+/* 32-bit FNV-1a */
+static uint32_t name_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *name != '\0'; name++) {
+	hash ^= (uint8_t)*name;
+	hash *= 16777619u;
+    }
 
+    return hash;
+}
+
+static void add_chunk(struct xcm_attr_map *attr_map, struct attr_chunk *chunk)
 {
-    assert_valid_len(type, value_len);
+    /* push in reverse, so that iteration order follows insertion
+       order, at least as long as no attributes are removed */
+    int i;
+    for (i = ATTRS_PER_CHUNK - 1; i >= 0; i--) {
+	struct attr *attr = &chunk->attrs[i];
+	attr->name = NULL;
+	attr->next_free = attr_map->free_attrs;
+	attr_map->free_attrs = attr;
+    }
 
-    struct attr *attr = ut_malloc(sizeof(struct attr));
-    *attr = (struct attr) {
-	.name = ut_strdup(name),
-	.type = type,
-	.value = ut_memdup(value, value_len),
-	.value_len = value_len
-    };
+    chunk->next = NULL;
+
+    if (attr_map->last_chunk)
+	attr_map->last_chunk->next = chunk;
+    attr_map->last_chunk = chunk;
+}
+
+static struct attr *alloc_attr(struct xcm_attr_map *attr_map)
+{
+    if (!attr_map->free_attrs)
+	add_chunk(attr_map, ut_malloc(sizeof(struct attr_chunk)));
+
+    struct attr *attr = attr_map->free_attrs;
+    attr_map->free_attrs = attr->next_free;
 
     return attr;
 }
 
-void attr_destroy(struct attr *attr)
+static void attr_set_value(struct attr *attr, enum xcm_attr_type type,
+			   const void *value, size_t value_len)
 {
-    if (attr) {
+    assert_valid_len(type, value_len);
+
+    /* the new value may point into the old one */
+    void *old_heap_value =
+	attr->value != attr->inline_value ? attr->value : NULL;
+
+    if (value_len <= ATTR_INLINE_VALUE_MAX) {
+	memmove(attr->inline_value, value, value_len);
+	attr->value = attr->inline_value;
+    } else
+	attr->value = ut_memdup(value, value_len);
+
+    attr->type = type;
+    attr->value_len = value_len;
+
+    ut_free(old_heap_value);
+}
+
+static void attr_init(struct attr *attr, const char *name, size_t name_len,
+		      uint32_t hash, enum xcm_attr_type type,
+		      const void *value, size_t value_len)
+{
+    if (name_len < ATTR_INLINE_NAME_MAX) {
+	attr->name = attr->inline_name;
+	memcpy(attr->name, name, name_len + 1);
+    } else
+	attr->name = ut_strdup(name);
+
+    attr->hash = hash;
+
+    /* prevent attr_set_value() from freeing a stale value */
+    attr->value = attr->inline_value;
+    attr_set_value(attr, type, value, value_len);
+}
+
+static void attr_deinit(struct attr *attr)
+{
+    if (attr->name != attr->inline_name)
 	ut_free(attr->name);
+    if (attr->value != attr->inline_value)
 	ut_free(attr->value);
-	ut_free(attr);
-    }
+    attr->name = NULL;
 }
 
-struct xcm_attr_map
+static void free_attr(struct xcm_attr_map *attr_map, struct attr *attr)
 {
-    struct attr_list attrs;
-};
+    attr_deinit(attr);
+    attr->next_free = attr_map->free_attrs;
+    attr_map->free_attrs = attr;
+}
 
 struct xcm_attr_map *xcm_attr_map_create(void)
 {
     struct xcm_attr_map *attr_map = ut_malloc(sizeof(struct xcm_attr_map));
 
-    LIST_INIT(&attr_map->attrs);
+    attr_map->slots = attr_map->initial_slots;
+    attr_map->num_slots = INITIAL_NUM_SLOTS;
+    attr_map->size = 0;
+    attr_map->free_attrs = NULL;
+    attr_map->last_chunk = NULL;
+
+    memset(attr_map->initial_slots, 0, sizeof(attr_map->initial_slots));
+
+    add_chunk(attr_map, &attr_map->first_chunk);
 
     return attr_map;
 }
 
-static void copy_attr_cb(const char *attr_name, enum xcm_attr_type attr_type,
-			 const void *attr_value, size_t attr_value_len,
-			 void *user)
+static size_t slot_mask(const struct xcm_attr_map *attr_map)
 {
-    struct xcm_attr_map *copy = user;
-    xcm_attr_map_add(copy, attr_name, attr_type, attr_value, attr_value_len);
+    return attr_map->num_slots - 1;
 }
 
+static size_t lookup_slot(const struct xcm_attr_map *attr_map,
+			  const char *attr_name, uint32_t hash)
+{
+    size_t mask = slot_mask(attr_map);
+    size_t idx;
+
+    for (idx = hash & mask; attr_map->slots[idx] != NULL;
+	 idx = (idx + 1) & mask) {
+	const struct attr *attr = attr_map->slots[idx];
+	if (attr->hash == hash && strcmp(attr->name, attr_name) == 0)
+	    break;
+    }
+
+    return idx;
+}
+
+static void insert_slot(struct attr **slots, size_t num_slots,
+			struct attr *attr)
+{
+    size_t mask = num_slots - 1;
+    size_t idx;
+
+    for (idx = attr->hash & mask; slots[idx] != NULL; idx = (idx + 1) & mask)
+	;
+
+    slots[idx] = attr;
+}
+
+static void grow_slots(struct xcm_attr_map *attr_map)
+{
+    size_t num_slots = 2 * attr_map->num_slots;
+    struct attr **slots = ut_calloc(num_slots * sizeof(struct attr *));
+
+    size_t i;
+    for (i = 0; i < attr_map->num_slots; i++)
+	if (attr_map->slots[i] != NULL)
+	    insert_slot(slots, num_slots, attr_map->slots[i]);
+
+    if (attr_map->slots != attr_map->initial_slots)
+	ut_free(attr_map->slots);
+
+    attr_map->slots = slots;
+    attr_map->num_slots = num_slots;
+}
+
+static void insert_attr(struct xcm_attr_map *attr_map, const char *attr_name,
+			size_t name_len, uint32_t hash,
+			enum xcm_attr_type attr_type, const void *attr_value,
+			size_t attr_value_len)
+{
+    size_t idx = lookup_slot(attr_map, attr_name, hash);
+
+    struct attr *attr = attr_map->slots[idx];
+
+    if (attr) {
+	attr_set_value(attr, attr_type, attr_value, attr_value_len);
+	return;
+    }
+
+    attr = alloc_attr(attr_map);
+    attr_init(attr, attr_name, name_len, hash, attr_type, attr_value,
+	      attr_value_len);
+
+    attr_map->size++;
+
+    /* keep the load factor at or below 0.5 */
+    if (2 * attr_map->size > attr_map->num_slots)
+	grow_slots(attr_map);
+
+    insert_slot(attr_map->slots, attr_map->num_slots, attr);
+}
+
+#define FOREACH_ATTR(attr_map, chunk, attr)				\
+    for (chunk = &(attr_map)->first_chunk; chunk != NULL;		\
+	 chunk = chunk->next)						\
+	for (attr = chunk->attrs; attr < chunk->attrs + ATTRS_PER_CHUNK; \
+	     attr++)							\
+	    if (attr->name != NULL)
+
 struct xcm_attr_map *xcm_attr_map_clone(const struct xcm_attr_map *original)
 {
     struct xcm_attr_map *copy = xcm_attr_map_create();
 
-    xcm_attr_map_foreach(original, copy_attr_cb, copy);
+    const struct attr_chunk *chunk;
+    const struct attr *attr;
+    FOREACH_ATTR(original, chunk, attr)
+	insert_attr(copy, attr->name, strlen(attr->name), attr->hash,
+		    attr->type, attr->value, attr->value_len);
 
     return copy;
 }
 
-struct attr *lookup_attr(const struct xcm_attr_map *attr_map,
-			 const char *attr_name)
+static struct attr *lookup_attr_hash(const struct xcm_attr_map *attr_map,
+				     const char *attr_name, uint32_t hash)
 {
-    struct attr *attr;
-    LIST_FOREACH(attr, &attr_map->attrs, entry)
-	if (strcmp(attr->name, attr_name) == 0)
-	    return attr;
-    return NULL;
+    return attr_map->slots[lookup_slot(attr_map, attr_name, hash)];
 }
 
-const struct attr *lookup_attr_with_type(const struct xcm_attr_map *attr_map,
-					 const char *attr_name,
-					 enum xcm_attr_type type)
+static struct attr *lookup_attr(const struct xcm_attr_map *attr_map,
+				const char *attr_name)
 {
-    struct attr *attr;
-    LIST_FOREACH(attr, &attr_map->attrs, entry)
-	if (strcmp(attr->name, attr_name) == 0)
-	    return attr->type == type ? attr : NULL;
-    return NULL;
+    return lookup_attr_hash(attr_map, attr_name, name_hash(attr_name));
 }
 
-const void *lookup_value_with_type(const struct xcm_attr_map *attr_map,
-				   const char *attr_name,
-				   enum xcm_attr_type type)
+static const void *lookup_value_with_type(const struct xcm_attr_map *attr_map,
+					  const char *attr_name,
+					  enum xcm_attr_type type)
 {
-    const struct attr *attr =
-	lookup_attr_with_type(attr_map, attr_name, type);
+    const struct attr *attr = lookup_attr(attr_map, attr_name);
 
-    if (!attr)
+    if (!attr || attr->type != type)
 	return NULL;
 
     return attr->value;
@@ -128,12 +313,8 @@ void xcm_attr_map_add(struct xcm_attr_map *attr_map, const char *attr_name,
 {
     ut_assert(attr_name && attr_value);
 
-    xcm_attr_map_del(attr_map, attr_name);
-
-    struct attr *attr =
-	attr_create(attr_name, attr_type, attr_value, attr_value_len);
-
-    LIST_INSERT_HEAD(&attr_map->attrs, attr, entry);
+    insert_attr(attr_map, attr_name, strlen(attr_name), name_hash(attr_name),
+		attr_type, attr_value, attr_value_len);
 }
 
 void xcm_attr_map_add_bool(struct xcm_attr_map *attr_map,
@@ -143,7 +324,7 @@ void xcm_attr_map_add_bool(struct xcm_attr_map *attr_map,
     xcm_attr_map_add(attr_map, attr_name, xcm_attr_type_bool, &attr_value,
 		     sizeof(bool));
 }
-    
+
 void xcm_attr_map_add_int64(struct xcm_attr_map *attr_map,
 			   const char *attr_name,
 			   int64_t attr_value)
@@ -151,7 +332,7 @@ void xcm_attr_map_add_int64(struct xcm_attr_map *attr_map,
     xcm_attr_map_add(attr_map, attr_name, xcm_attr_type_int64, &attr_value,
 		     sizeof(int64_t));
 }
-    
+
 void xcm_attr_map_add_str(struct xcm_attr_map *attr_map,
 			  const char *attr_name,
 			  const char *attr_value)
@@ -205,46 +386,67 @@ bool xcm_attr_map_exists(const struct xcm_attr_map *attr_map,
 
 void xcm_attr_map_del(struct xcm_attr_map *attr_map, const char *attr_name)
 {
-    struct attr *attr = lookup_attr(attr_map, attr_name);
+    size_t idx = lookup_slot(attr_map, attr_name, name_hash(attr_name));
+    struct attr *attr = attr_map->slots[idx];
 
-    if (attr) {
-	LIST_REMOVE(attr, entry);
-	attr_destroy(attr);
+    if (!attr)
+	return;
+
+    attr_map->slots[idx] = NULL;
+
+    /* backward-shift deletion, to avoid the need for tombstones */
+    size_t mask = slot_mask(attr_map);
+    size_t next_idx;
+    for (next_idx = (idx + 1) & mask; attr_map->slots[next_idx] != NULL;
+	 next_idx = (next_idx + 1) & mask) {
+	size_t home_idx = attr_map->slots[next_idx]->hash & mask;
+
+	/* may the entry at next_idx be moved to the hole at idx? */
+	bool movable = next_idx > idx ?
+	    (home_idx <= idx || home_idx > next_idx) :
+	    (home_idx <= idx && home_idx > next_idx);
+
+	if (movable) {
+	    attr_map->slots[idx] = attr_map->slots[next_idx];
+	    attr_map->slots[next_idx] = NULL;
+	    idx = next_idx;
+	}
     }
+
+    free_attr(attr_map, attr);
+
+    attr_map->size--;
 }
 
 size_t xcm_attr_map_size(const struct xcm_attr_map *attr_map)
 {
-    size_t count = 0;
-    struct attr *attr;
-    LIST_FOREACH(attr, &attr_map->attrs, entry)
-	count++;
-    return count;
+    return attr_map->size;
 }
 
 void xcm_attr_map_foreach(const struct xcm_attr_map *attr_map,
 			  xcm_attr_map_foreach_cb cb, void *user)
 {
-    struct attr *attr;
-    LIST_FOREACH(attr, &attr_map->attrs, entry)
+    const struct attr_chunk *chunk;
+    const struct attr *attr;
+    FOREACH_ATTR(attr_map, chunk, attr)
 	cb(attr->name, attr->type, attr->value, attr->value_len, user);
 }
 
 bool xcm_attr_map_equal(const struct xcm_attr_map *attr_map_a,
 			const struct xcm_attr_map *attr_map_b)
 {
-    size_t size_a = xcm_attr_map_size(attr_map_a);
-    size_t size_b = xcm_attr_map_size(attr_map_b);
-
-    if (size_a != size_b)
+    if (attr_map_a->size != attr_map_b->size)
 	return false;
 
-    struct attr *attr_a;
-    LIST_FOREACH(attr_a, &attr_map_a->attrs, entry) {
+    const struct attr_chunk *chunk;
+    const struct attr *attr_a;
+    FOREACH_ATTR(attr_map_a, chunk, attr_a) {
 	const struct attr *attr_b =
-	    lookup_attr_with_type(attr_map_b, attr_a->name, attr_a->type);
+	    lookup_attr_hash(attr_map_b, attr_a->name, attr_a->hash);
 	if (!attr_b)
 	    return false;
+	if (attr_a->type != attr_b->type)
+	    return false;
 	if (attr_a->value_len != attr_b->value_len)
 	    return false;
 	if (memcmp(attr_a->value, attr_b->value, attr_a->value_len) != 0)
@@ -257,11 +459,21 @@ bool xcm_attr_map_equal(const struct xcm_attr_map *attr_map_a,
 void xcm_attr_map_destroy(struct xcm_attr_map *attr_map)
 {
     if (attr_map) {
+	struct attr_chunk *chunk;
 	struct attr *attr;
-	while ((attr = LIST_FIRST(&attr_map->attrs)) != NULL) {
-	    LIST_REMOVE(attr, entry);
-	    attr_destroy(attr);
+	FOREACH_ATTR(attr_map, chunk, attr)
+	    attr_deinit(attr);
+
+	chunk = attr_map->first_chunk.next;
+	while (chunk != NULL) {
+	    struct attr_chunk *next = chunk->next;
+	    ut_free(chunk);
+	    chunk = next;
 	}
+
+	if (attr_map->slots != attr_map->initial_slots)
+	    ut_free(attr_map->slots);
+
 	ut_free(attr_map);
     }
 }
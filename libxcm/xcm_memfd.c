@@ -0,0 +1,179 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "xcm.h"
+
+#include "util.h"
+#include "xcm_tp.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Memory file payload hand-off, on top of xcm_send_fds() and
+ * xcm_receive_fds(). The inline part of the message carries a small
+ * header, and the payload is in the (single) attached memory file.
+ */
+
+#define MEMFD_MSG_MAGIC (0x584d4644) /* "XMFD" */
+
+#define MEMFD_NAME "xcm-memfd"
+
+#define MEMFD_REQUIRED_SEALS (F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_WRITE)
+
+struct memfd_msg
+{
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t len;
+};
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    while (len > 0) {
+	ssize_t rc = write(fd, p, len);
+	if (rc < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += rc;
+	len -= rc;
+    }
+
+    return 0;
+}
+
+static int create_sealed(const void *buf, size_t len)
+{
+    int fd = memfd_create(MEMFD_NAME, MFD_CLOEXEC|MFD_ALLOW_SEALING);
+    if (fd < 0)
+	return -1;
+
+    if (write_all(fd, buf, len) < 0)
+	goto err_close;
+
+    if (fcntl(fd, F_ADD_SEALS, MEMFD_REQUIRED_SEALS|F_SEAL_SEAL) < 0)
+	goto err_close;
+
+    return fd;
+
+err_close:
+    UT_PROTECT_ERRNO(close(fd));
+    return -1;
+}
+
+/* On a non-blocking socket, check that the send is likely to
+   succeed before going through the trouble of creating the memory
+   file and copying the payload, only to fail with EAGAIN. */
+static int check_sendable(struct xcm_socket *conn_s)
+{
+    if (conn_s->type != xcm_socket_type_conn || conn_s->is_blocking)
+	return 0;
+
+    int condition = conn_s->condition;
+
+    int rc = xcm_await_timeout(conn_s, XCM_SO_SENDABLE, 0);
+
+    UT_PROTECT_ERRNO(xcm_await(conn_s, condition));
+
+    if (rc == 0) {
+	errno = EAGAIN;
+	return -1;
+    }
+
+    return rc < 0 ? -1 : 0;
+}
+
+int xcm_send_memfd(struct xcm_socket *conn_s, const void *buf, size_t len)
+{
+    if (len == 0) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    if (check_sendable(conn_s) < 0)
+	return -1;
+
+    int fd = create_sealed(buf, len);
+    if (fd < 0)
+	return -1;
+
+    struct memfd_msg msg = {
+	.magic = MEMFD_MSG_MAGIC,
+	.len = len
+    };
+
+    int rc = xcm_send_fds(conn_s, &msg, sizeof(msg), &fd, 1);
+
+    UT_PROTECT_ERRNO(close(fd));
+
+    return rc;
+}
+
+static void close_fds(const int *fds, size_t num_fds)
+{
+    size_t i;
+    for (i = 0; i < num_fds; i++)
+	UT_PROTECT_ERRNO(close(fds[i]));
+}
+
+static bool is_valid(const struct memfd_msg *msg, int fd)
+{
+    if (msg->magic != MEMFD_MSG_MAGIC || msg->len == 0 ||
+	msg->len > SIZE_MAX)
+	return false;
+
+    /* the payload must not change, or shrink, under our feet */
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & MEMFD_REQUIRED_SEALS) != MEMFD_REQUIRED_SEALS)
+	return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < msg->len)
+	return false;
+
+    return true;
+}
+
+int xcm_receive_memfd(struct xcm_socket *conn_s, void **data, size_t *len)
+{
+    struct memfd_msg msg;
+    int fds[XCM_MAX_FDS];
+    size_t num_fds = XCM_MAX_FDS;
+
+    int rc = xcm_receive_fds(conn_s, &msg, sizeof(msg), fds, &num_fds);
+
+    if (rc < 0)
+	return -1;
+
+    if (rc == 0) {
+	errno = EPIPE;
+	return -1;
+    }
+
+    if (rc != sizeof(msg) || num_fds != 1 || !is_valid(&msg, fds[0])) {
+	close_fds(fds, num_fds);
+	errno = EBADMSG;
+	return -1;
+    }
+
+    void *addr = mmap(NULL, msg.len, PROT_READ, MAP_SHARED, fds[0], 0);
+
+    close_fds(fds, num_fds);
+
+    if (addr == MAP_FAILED)
+	return -1;
+
+    *data = addr;
+    *len = msg.len;
+
+    return 0;
+}
@@ -0,0 +1,257 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "xcm.h"
+
+#include "common_tp.h"
+#include "log_epoll.h"
+#include "util.h"
+#include "xcm_tp.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+/*
+ * xcm_poll() uses a per-thread epoll instance, in which the XCM
+ * sockets' own epoll fds are registered. Registrations are kept
+ * across calls, so an application which repeatedly polls the same
+ * set of sockets only pays for the epoll_wait() call.
+ */
+
+#define MAX_EVENTS (64)
+
+#define NO_DEADLINE (-1)
+
+struct poll_reg
+{
+    bool registered;
+    int64_t sock_id;
+    uint64_t gen;
+    size_t idx;
+};
+
+struct poll_state
+{
+    int epoll_fd;
+
+    /* indexed by the XCM sockets' epoll fds */
+    struct poll_reg *regs;
+    int regs_len;
+
+    /* fds registered in the most recent call */
+    int *reg_fds;
+    size_t num_reg_fds;
+
+    uint64_t gen;
+};
+
+static pthread_key_t state_key;
+static pthread_once_t state_key_once = PTHREAD_ONCE_INIT;
+
+static void state_destroy(void *ptr)
+{
+    struct poll_state *ps = ptr;
+
+    UT_PROTECT_ERRNO(close(ps->epoll_fd));
+    ut_free(ps->regs);
+    ut_free(ps->reg_fds);
+    ut_free(ps);
+}
+
+static void create_state_key(void)
+{
+    int rc = pthread_key_create(&state_key, state_destroy);
+    ut_assert(rc == 0);
+}
+
+static struct poll_state *get_state(void)
+{
+    pthread_once(&state_key_once, create_state_key);
+
+    struct poll_state *ps = pthread_getspecific(state_key);
+
+    if (ps)
+	return ps;
+
+    int epoll_fd = epoll_create1(0);
+
+    if (epoll_fd < 0) {
+	LOG_EPOLL_FD_FAILED(errno);
+	return NULL;
+    }
+
+    LOG_EPOLL_FD_CREATED(epoll_fd);
+
+    ps = ut_calloc(sizeof(struct poll_state));
+    ps->epoll_fd = epoll_fd;
+
+    pthread_setspecific(state_key, ps);
+
+    return ps;
+}
+
+static void ensure_regs_len(struct poll_state *ps, int fd)
+{
+    if (fd < ps->regs_len)
+	return;
+
+    int new_len = UT_MAX(fd + 1, 2 * ps->regs_len);
+
+    ps->regs = ut_realloc(ps->regs, new_len * sizeof(struct poll_reg));
+    memset(ps->regs + ps->regs_len, 0,
+	   (new_len - ps->regs_len) * sizeof(struct poll_reg));
+    ps->regs_len = new_len;
+}
+
+static void unregister(struct poll_state *ps, int fd)
+{
+    /* the fd may already have been closed, and thus removed from
+       the epoll instance by the kernel */
+    epoll_ctl(ps->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    ps->regs[fd].registered = false;
+}
+
+static int register_socket(struct poll_state *ps, struct xcm_socket *s,
+			   size_t idx)
+{
+    int fd = s->epoll_fd;
+
+    ensure_regs_len(ps, fd);
+
+    struct poll_reg *reg = &ps->regs[fd];
+
+    /* the same socket may not be present twice */
+    TP_RET_ERR_IF(reg->gen == ps->gen, EINVAL);
+
+    /* the fd number may have been reused by a newer socket */
+    if (!reg->registered || reg->sock_id != s->sock_id) {
+	struct epoll_event event = {
+	    .events = EPOLLIN,
+	    .data.fd = fd
+	};
+
+	if (epoll_ctl(ps->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0 &&
+	    (errno != EEXIST ||
+	     epoll_ctl(ps->epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0)) {
+	    LOG_EPOLL_ADD_FAILED(s, ps->epoll_fd, fd, errno);
+	    return -1;
+	}
+
+	reg->registered = true;
+	reg->sock_id = s->sock_id;
+    }
+
+    reg->gen = ps->gen;
+    reg->idx = idx;
+
+    return 0;
+}
+
+static int register_sockets(struct poll_state *ps,
+			    struct xcm_socket **sockets,
+			    const int *conditions, size_t num_sockets)
+{
+    size_t i;
+
+    for (i = 0; i < num_sockets; i++)
+	TP_RET_ERR_IF_INVALID_COND(sockets[i], conditions[i]);
+
+    ps->gen++;
+
+    for (i = 0; i < num_sockets; i++)
+	if (register_socket(ps, sockets[i], i) < 0)
+	    return -1;
+
+    for (i = 0; i < ps->num_reg_fds; i++) {
+	int fd = ps->reg_fds[i];
+	if (ps->regs[fd].registered && ps->regs[fd].gen != ps->gen)
+	    unregister(ps, fd);
+    }
+
+    ps->reg_fds = ut_realloc(ps->reg_fds, num_sockets * sizeof(int));
+    for (i = 0; i < num_sockets; i++)
+	ps->reg_fds[i] = sockets[i]->epoll_fd;
+    ps->num_reg_fds = num_sockets;
+
+    for (i = 0; i < num_sockets; i++) {
+	sockets[i]->condition = conditions[i];
+	xcm_tp_socket_update(sockets[i]);
+    }
+
+    return 0;
+}
+
+static int remaining_ms(double deadline)
+{
+    if (deadline == NO_DEADLINE)
+	return -1;
+
+    double left = deadline - ut_ftime();
+
+    return left > 0 ? (int)(left * 1e3) + 1 : 0;
+}
+
+int xcm_poll(struct xcm_socket **sockets, const int *conditions, int *ready,
+	     size_t num_sockets, int timeout_ms)
+{
+    TP_RET_ERR_IF(num_sockets == 0 || timeout_ms < -1, EINVAL);
+
+    struct poll_state *ps = get_state();
+
+    if (!ps)
+	return -1;
+
+    if (register_sockets(ps, sockets, conditions, num_sockets) < 0)
+	return -1;
+
+    memset(ready, 0, num_sockets * sizeof(int));
+
+    double deadline = timeout_ms >= 0 ?
+	ut_ftime() + timeout_ms / 1e3 : NO_DEADLINE;
+
+    for (;;) {
+	struct epoll_event events[MAX_EVENTS];
+
+	int rc = epoll_wait(ps->epoll_fd, events, MAX_EVENTS,
+			    remaining_ms(deadline));
+
+	if (rc <= 0)
+	    return rc;
+
+	int num_ready = 0;
+	int i;
+	for (i = 0; i < rc; i++) {
+	    int fd = events[i].data.fd;
+	    struct poll_reg *reg = &ps->regs[fd];
+
+	    /* left over from a failed call */
+	    if (reg->gen != ps->gen) {
+		unregister(ps, fd);
+		continue;
+	    }
+
+	    struct xcm_socket *s = sockets[reg->idx];
+
+	    if (conditions[reg->idx] != 0) {
+		ready[reg->idx] = conditions[reg->idx];
+		num_ready++;
+	    } else {
+		/* the socket has background tasks to perform, which
+		   are taken care of here, on the application's
+		   behalf */
+		xcm_tp_socket_finish(s);
+		xcm_tp_socket_update(s);
+	    }
+	}
+
+	if (num_ready > 0)
+	    return num_ready;
+
+	if (remaining_ms(deadline) == 0)
+	    return 0;
+    }
+}
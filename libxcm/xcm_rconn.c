@@ -0,0 +1,634 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "xcm_rconn.h"
+
+#include "log_rconn.h"
+#include "util.h"
+#include "xcm_addr.h"
+#include "xcm_attr_names.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/queue.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/*
+ * The reconnecting client's fd is an epoll instance, in which the
+ * XCM sockets' fds (for the established connection, or for all
+ * connection attempts in progress), a timerfd (used for the connect
+ * timeout and the backoff delay), and an eventfd (signaling state
+ * changes) are registered.
+ */
+
+#define ATTR_BACKOFF_MIN "rconn.backoff_min"
+#define ATTR_BACKOFF_MAX "rconn.backoff_max"
+#define ATTR_CONNECT_TIMEOUT "rconn.connect_timeout"
+#define ATTR_MAX_BUFFERED "rconn.max_buffered"
+
+#define DEFAULT_BACKOFF_MIN (100)
+#define DEFAULT_BACKOFF_MAX (30000)
+#define DEFAULT_CONNECT_TIMEOUT (10000)
+#define DEFAULT_MAX_BUFFERED (1024)
+
+struct rconn_addr
+{
+    char *addr;
+    /* the address, with the domain name resolved */
+    char *cached_addr;
+
+    struct xcm_socket *attempt;
+    bool attempt_cached;
+};
+
+struct rconn_msg
+{
+    size_t len;
+    TAILQ_ENTRY(rconn_msg) elem;
+    char data[];
+};
+
+TAILQ_HEAD(rconn_msg_queue, rconn_msg);
+
+struct xcm_rconn
+{
+    struct rconn_addr *addrs;
+    size_t num_addrs;
+
+    struct xcm_attr_map *conn_attrs;
+
+    int64_t backoff_min;
+    int64_t backoff_max;
+    int64_t connect_timeout;
+    int64_t max_buffered;
+
+    enum xcm_rconn_state state;
+    struct xcm_socket *conn;
+
+    int epoll_fd;
+    int timer_fd;
+    int notify_fd;
+
+    int64_t num_failures;
+    unsigned int seed;
+
+    struct rconn_msg_queue buffered;
+    int64_t num_buffered;
+};
+
+static int get_attr(const struct xcm_attr_map *attrs, const char *attr_name,
+		    int64_t min, int64_t *value)
+{
+    if (attrs == NULL || !xcm_attr_map_exists(attrs, attr_name))
+	return 0;
+
+    const int64_t *attr_value = xcm_attr_map_get_int64(attrs, attr_name);
+
+    if (attr_value == NULL || *attr_value < min) {
+	LOG_RCONN_INVALID_ATTR(attr_name);
+	errno = EINVAL;
+	return -1;
+    }
+
+    *value = *attr_value;
+
+    return 0;
+}
+
+static int parse_attrs(struct xcm_rconn *rconn,
+		       const struct xcm_attr_map *attrs)
+{
+    rconn->backoff_min = DEFAULT_BACKOFF_MIN;
+    rconn->backoff_max = DEFAULT_BACKOFF_MAX;
+    rconn->connect_timeout = DEFAULT_CONNECT_TIMEOUT;
+    rconn->max_buffered = DEFAULT_MAX_BUFFERED;
+
+    if (get_attr(attrs, ATTR_BACKOFF_MIN, 1, &rconn->backoff_min) < 0 ||
+	get_attr(attrs, ATTR_BACKOFF_MAX, 1, &rconn->backoff_max) < 0 ||
+	get_attr(attrs, ATTR_CONNECT_TIMEOUT, 1,
+		 &rconn->connect_timeout) < 0 ||
+	get_attr(attrs, ATTR_MAX_BUFFERED, 0, &rconn->max_buffered) < 0)
+	return -1;
+
+    if (rconn->backoff_max < rconn->backoff_min) {
+	LOG_RCONN_INVALID_ATTR(ATTR_BACKOFF_MAX);
+	errno = EINVAL;
+	return -1;
+    }
+
+    rconn->conn_attrs =
+	attrs != NULL ? xcm_attr_map_clone(attrs) : xcm_attr_map_create();
+
+    xcm_attr_map_del(rconn->conn_attrs, ATTR_BACKOFF_MIN);
+    xcm_attr_map_del(rconn->conn_attrs, ATTR_BACKOFF_MAX);
+    xcm_attr_map_del(rconn->conn_attrs, ATTR_CONNECT_TIMEOUT);
+    xcm_attr_map_del(rconn->conn_attrs, ATTR_MAX_BUFFERED);
+
+    xcm_attr_map_add_bool(rconn->conn_attrs, XCM_ATTR_XCM_BLOCKING, false);
+
+    return 0;
+}
+
+static int epoll_add(struct xcm_rconn *rconn, int fd)
+{
+    struct epoll_event event = {
+	.events = EPOLLIN
+    };
+
+    return epoll_ctl(rconn->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void close_socket(struct xcm_rconn *rconn, struct xcm_socket *s)
+{
+    UT_PROTECT_ERRNO(epoll_ctl(rconn->epoll_fd, EPOLL_CTL_DEL, xcm_fd(s),
+			       NULL));
+    UT_PROTECT_ERRNO(xcm_close(s));
+}
+
+static void notify(struct xcm_rconn *rconn)
+{
+    uint64_t one = 1;
+
+    UT_PROTECT_ERRNO(write(rconn->notify_fd, &one, sizeof(one)));
+}
+
+static void set_state(struct xcm_rconn *rconn, enum xcm_rconn_state state)
+{
+    if (rconn->state != state) {
+	rconn->state = state;
+	notify(rconn);
+    }
+}
+
+static void arm_timer(struct xcm_rconn *rconn, int64_t timeout_ms)
+{
+    /* a zero timeout would disarm the timer */
+    timeout_ms = UT_MAX(timeout_ms, 1);
+
+    struct itimerspec ts = {
+	.it_value = {
+	    .tv_sec = timeout_ms / 1000,
+	    .tv_nsec = (timeout_ms % 1000) * 1000000
+	}
+    };
+
+    UT_PROTECT_ERRNO(timerfd_settime(rconn->timer_fd, 0, &ts, NULL));
+}
+
+static void disarm_timer(struct xcm_rconn *rconn)
+{
+    struct itimerspec ts = { 0 };
+
+    UT_PROTECT_ERRNO(timerfd_settime(rconn->timer_fd, 0, &ts, NULL));
+}
+
+static bool timer_expired(struct xcm_rconn *rconn)
+{
+    uint64_t expirations;
+
+    return read(rconn->timer_fd, &expirations, sizeof(expirations)) ==
+	sizeof(expirations);
+}
+
+static bool is_resolvable(const char *addr)
+{
+    char proto[16];
+    struct xcm_addr_host host;
+    uint16_t port;
+
+    if (xcm_addr_parse_proto(addr, proto, sizeof(proto)) < 0)
+	return false;
+
+    if (strcmp(proto, XCM_TCP_PROTO) == 0)
+	return xcm_addr_parse_tcp(addr, &host, &port) == 0 &&
+	    host.type == xcm_addr_type_name;
+
+    if (strcmp(proto, XCM_TLS_PROTO) == 0)
+	return xcm_addr_parse_tls(addr, &host, &port) == 0 &&
+	    host.type == xcm_addr_type_name;
+
+    return false;
+}
+
+static void close_attempt(struct xcm_rconn *rconn, struct rconn_addr *addr)
+{
+    if (addr->attempt != NULL) {
+	close_socket(rconn, addr->attempt);
+	addr->attempt = NULL;
+    }
+}
+
+static void close_attempts(struct xcm_rconn *rconn)
+{
+    size_t i;
+    for (i = 0; i < rconn->num_addrs; i++)
+	close_attempt(rconn, &rconn->addrs[i]);
+}
+
+static void start_attempt(struct xcm_rconn *rconn, struct rconn_addr *addr)
+{
+    for (;;) {
+	const char *remote_addr =
+	    addr->cached_addr != NULL ? addr->cached_addr : addr->addr;
+
+	LOG_RCONN_ATTEMPT(rconn, remote_addr);
+
+	addr->attempt_cached = addr->cached_addr != NULL;
+	addr->attempt = xcm_connect_a(remote_addr, rconn->conn_attrs);
+
+	if (addr->attempt != NULL) {
+	    if (epoll_add(rconn, xcm_fd(addr->attempt)) == 0)
+		return;
+	    UT_PROTECT_ERRNO(xcm_close(addr->attempt));
+	    addr->attempt = NULL;
+	}
+
+	LOG_RCONN_ATTEMPT_FAILED(rconn, remote_addr, errno);
+
+	if (!addr->attempt_cached)
+	    return;
+
+	/* retry using the domain name */
+	ut_free(addr->cached_addr);
+	addr->cached_addr = NULL;
+    }
+}
+
+static bool has_attempts(struct xcm_rconn *rconn)
+{
+    size_t i;
+    for (i = 0; i < rconn->num_addrs; i++)
+	if (rconn->addrs[i].attempt != NULL)
+	    return true;
+
+    return false;
+}
+
+static int64_t backoff_delay(struct xcm_rconn *rconn)
+{
+    int64_t delay = rconn->backoff_min;
+    int64_t i;
+
+    for (i = 1; i < rconn->num_failures && delay < rconn->backoff_max; i++)
+	delay *= 2;
+
+    delay = UT_MIN(delay, rconn->backoff_max);
+
+    /* pick a delay in the range [delay/2, delay] */
+    int64_t half = delay / 2;
+
+    return delay - half + rand_r(&rconn->seed) % (half + 1);
+}
+
+static void enter_backoff(struct xcm_rconn *rconn)
+{
+    close_attempts(rconn);
+
+    rconn->num_failures++;
+
+    int64_t delay = backoff_delay(rconn);
+
+    LOG_RCONN_BACKOFF(rconn, delay, rconn->num_failures);
+
+    arm_timer(rconn, delay);
+
+    set_state(rconn, xcm_rconn_state_backoff);
+}
+
+static void start_connecting(struct xcm_rconn *rconn)
+{
+    size_t i;
+    for (i = 0; i < rconn->num_addrs; i++)
+	start_attempt(rconn, &rconn->addrs[i]);
+
+    if (!has_attempts(rconn)) {
+	enter_backoff(rconn);
+	return;
+    }
+
+    arm_timer(rconn, rconn->connect_timeout);
+
+    set_state(rconn, xcm_rconn_state_connecting);
+}
+
+static void established(struct xcm_rconn *rconn, struct rconn_addr *addr)
+{
+    rconn->conn = addr->attempt;
+    addr->attempt = NULL;
+
+    const char *remote_addr = xcm_remote_addr(rconn->conn);
+
+    LOG_RCONN_CONNECTED(rconn, remote_addr != NULL ? remote_addr :
+			addr->addr);
+
+    if (!addr->attempt_cached && remote_addr != NULL &&
+	is_resolvable(addr->addr)) {
+	LOG_RCONN_CACHED_ADDR(rconn, addr->addr, remote_addr);
+	addr->cached_addr = ut_strdup(remote_addr);
+    }
+
+    close_attempts(rconn);
+    disarm_timer(rconn);
+
+    rconn->num_failures = 0;
+
+    set_state(rconn, xcm_rconn_state_connected);
+}
+
+static void conn_failed(struct xcm_rconn *rconn, int reason_errno)
+{
+    LOG_RCONN_CONN_FAILED(rconn, reason_errno);
+
+    close_socket(rconn, rconn->conn);
+    rconn->conn = NULL;
+
+    enter_backoff(rconn);
+}
+
+static void process_connecting(struct xcm_rconn *rconn)
+{
+    if (timer_expired(rconn)) {
+	LOG_RCONN_CONNECT_TIMED_OUT(rconn);
+	enter_backoff(rconn);
+	return;
+    }
+
+    size_t i;
+    for (i = 0; i < rconn->num_addrs; i++) {
+	struct rconn_addr *addr = &rconn->addrs[i];
+
+	if (addr->attempt == NULL)
+	    continue;
+
+	if (xcm_finish(addr->attempt) == 0) {
+	    established(rconn, addr);
+	    return;
+	}
+
+	if (errno == EAGAIN)
+	    continue;
+
+	LOG_RCONN_ATTEMPT_FAILED(rconn, addr->attempt_cached ?
+				 addr->cached_addr : addr->addr, errno);
+
+	close_attempt(rconn, addr);
+
+	if (addr->attempt_cached) {
+	    ut_free(addr->cached_addr);
+	    addr->cached_addr = NULL;
+	    start_attempt(rconn, addr);
+	}
+    }
+
+    if (!has_attempts(rconn))
+	enter_backoff(rconn);
+}
+
+static void process_backoff(struct xcm_rconn *rconn)
+{
+    if (timer_expired(rconn))
+	start_connecting(rconn);
+}
+
+static void msg_free(struct xcm_rconn *rconn, struct rconn_msg *msg)
+{
+    TAILQ_REMOVE(&rconn->buffered, msg, elem);
+    rconn->num_buffered--;
+    ut_free(msg);
+}
+
+static bool is_msg_error(int err)
+{
+    return err == EMSGSIZE || err == EINVAL;
+}
+
+static void process_connected(struct xcm_rconn *rconn)
+{
+    struct rconn_msg *msg;
+
+    while ((msg = TAILQ_FIRST(&rconn->buffered)) != NULL) {
+	if (xcm_send(rconn->conn, msg->data, msg->len) < 0) {
+	    if (errno == EAGAIN)
+		break;
+
+	    if (!is_msg_error(errno)) {
+		conn_failed(rconn, errno);
+		return;
+	    }
+
+	    LOG_RCONN_DROPPED(rconn, msg->len, errno);
+	}
+
+	msg_free(rconn, msg);
+    }
+
+    if (xcm_finish(rconn->conn) < 0 && errno != EAGAIN)
+	conn_failed(rconn, errno);
+}
+
+static void update_condition(struct xcm_rconn *rconn)
+{
+    if (rconn->conn == NULL)
+	return;
+
+    int condition = XCM_SO_RECEIVABLE;
+
+    if (rconn->num_buffered > 0)
+	condition |= XCM_SO_SENDABLE;
+
+    UT_PROTECT_ERRNO(xcm_await(rconn->conn, condition));
+}
+
+struct xcm_rconn *xcm_rconn_create(const char * const *remote_addrs,
+				   size_t num_addrs,
+				   const struct xcm_attr_map *attrs)
+{
+    if (num_addrs == 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    struct xcm_rconn *rconn = ut_calloc(sizeof(struct xcm_rconn));
+
+    if (parse_attrs(rconn, attrs) < 0)
+	goto err_free;
+
+    rconn->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (rconn->epoll_fd < 0)
+	goto err_free_attrs;
+
+    rconn->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+				     TFD_NONBLOCK|TFD_CLOEXEC);
+    if (rconn->timer_fd < 0)
+	goto err_close_epoll;
+
+    rconn->notify_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (rconn->notify_fd < 0)
+	goto err_close_timer;
+
+    if (epoll_add(rconn, rconn->timer_fd) < 0 ||
+	epoll_add(rconn, rconn->notify_fd) < 0)
+	goto err_close_notify;
+
+    rconn->addrs = ut_calloc(num_addrs * sizeof(struct rconn_addr));
+    rconn->num_addrs = num_addrs;
+
+    size_t i;
+    for (i = 0; i < num_addrs; i++)
+	rconn->addrs[i].addr = ut_strdup(remote_addrs[i]);
+
+    rconn->seed = (unsigned int)(ut_ftime() * 1e6) ^ (uintptr_t)rconn;
+
+    TAILQ_INIT(&rconn->buffered);
+
+    LOG_RCONN_CREATED(rconn, num_addrs);
+
+    rconn->state = xcm_rconn_state_connecting;
+    start_connecting(rconn);
+
+    return rconn;
+
+err_close_notify:
+    UT_PROTECT_ERRNO(close(rconn->notify_fd));
+err_close_timer:
+    UT_PROTECT_ERRNO(close(rconn->timer_fd));
+err_close_epoll:
+    UT_PROTECT_ERRNO(close(rconn->epoll_fd));
+err_free_attrs:
+    xcm_attr_map_destroy(rconn->conn_attrs);
+err_free:
+    ut_free(rconn);
+    return NULL;
+}
+
+void xcm_rconn_destroy(struct xcm_rconn *rconn)
+{
+    if (rconn == NULL)
+	return;
+
+    close_attempts(rconn);
+
+    if (rconn->conn != NULL)
+	close_socket(rconn, rconn->conn);
+
+    struct rconn_msg *msg;
+    while ((msg = TAILQ_FIRST(&rconn->buffered)) != NULL)
+	msg_free(rconn, msg);
+
+    size_t i;
+    for (i = 0; i < rconn->num_addrs; i++) {
+	ut_free(rconn->addrs[i].addr);
+	ut_free(rconn->addrs[i].cached_addr);
+    }
+    ut_free(rconn->addrs);
+
+    UT_PROTECT_ERRNO(close(rconn->notify_fd));
+    UT_PROTECT_ERRNO(close(rconn->timer_fd));
+    UT_PROTECT_ERRNO(close(rconn->epoll_fd));
+
+    xcm_attr_map_destroy(rconn->conn_attrs);
+
+    LOG_RCONN_DESTROYED(rconn);
+
+    ut_free(rconn);
+}
+
+int xcm_rconn_fd(struct xcm_rconn *rconn)
+{
+    return rconn->epoll_fd;
+}
+
+enum xcm_rconn_state xcm_rconn_state(struct xcm_rconn *rconn)
+{
+    uint64_t value;
+
+    UT_PROTECT_ERRNO(read(rconn->notify_fd, &value, sizeof(value)));
+
+    return rconn->state;
+}
+
+int xcm_rconn_send(struct xcm_rconn *rconn, const void *buf, size_t len)
+{
+    if (len == 0) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    if (rconn->conn != NULL && rconn->num_buffered == 0) {
+	if (xcm_send(rconn->conn, buf, len) == 0)
+	    return 0;
+
+	if (is_msg_error(errno))
+	    return -1;
+
+	if (errno != EAGAIN)
+	    conn_failed(rconn, errno);
+    }
+
+    if (rconn->num_buffered >= rconn->max_buffered) {
+	errno = EAGAIN;
+	return -1;
+    }
+
+    struct rconn_msg *msg = ut_malloc(sizeof(struct rconn_msg) + len);
+
+    msg->len = len;
+    memcpy(msg->data, buf, len);
+
+    TAILQ_INSERT_TAIL(&rconn->buffered, msg, elem);
+    rconn->num_buffered++;
+
+    update_condition(rconn);
+
+    return 0;
+}
+
+int xcm_rconn_receive(struct xcm_rconn *rconn, void *buf, size_t capacity)
+{
+    xcm_rconn_finish(rconn);
+
+    if (rconn->conn == NULL) {
+	errno = EAGAIN;
+	return -1;
+    }
+
+    int rc = xcm_receive(rconn->conn, buf, capacity);
+
+    if (rc > 0)
+	return rc;
+
+    if (rc < 0 && errno == EAGAIN)
+	return -1;
+
+    conn_failed(rconn, rc == 0 ? 0 : errno);
+
+    errno = EAGAIN;
+    return -1;
+}
+
+int xcm_rconn_finish(struct xcm_rconn *rconn)
+{
+    if (rconn->state == xcm_rconn_state_connecting)
+	process_connecting(rconn);
+    else if (rconn->state == xcm_rconn_state_backoff)
+	process_backoff(rconn);
+
+    /* a new connection is put to use immediately */
+    if (rconn->state == xcm_rconn_state_connected)
+	process_connected(rconn);
+
+    update_condition(rconn);
+
+    return 0;
+}
+
+struct xcm_socket *xcm_rconn_socket(struct xcm_rconn *rconn)
+{
+    return rconn->conn;
+}
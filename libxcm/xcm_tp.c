@@ -13,6 +13,8 @@
 #include "ctl.h"
 #endif
 
+#include <limits.h>
+
 const char *xcm_tp_socket_type_name(struct xcm_socket *s)
 {
     switch (s->type) {
@@ -26,16 +28,11 @@ const char *xcm_tp_socket_type_name(struct xcm_socket *s)
 }
 
 /* socket id, unique on a per-process basis */
-static pthread_mutex_t next_id_lock = PTHREAD_MUTEX_INITIALIZER;
 static int64_t next_id = 0;
 
 static int64_t get_next_sock_id(void)
 {
-    int64_t nid;
-    ut_mutex_lock(&next_id_lock);
-    nid = next_id++;
-    ut_mutex_unlock(&next_id_lock);
-    return nid;
+    return __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
 }
 
 struct xcm_socket *xcm_tp_socket_create(const struct xcm_tp_proto *proto,
@@ -147,6 +144,97 @@ int xcm_tp_socket_receive(struct xcm_socket *s, void *buf, size_t capacity)
     return rc;
 }
 
+static int send_batch_fallback(struct xcm_socket *s, const struct iovec *msgs,
+			       size_t num_msgs)
+{
+    size_t i;
+    for (i = 0; i < num_msgs; i++)
+	if (XCM_TP_CALL(send, s, msgs[i].iov_base, msgs[i].iov_len) < 0)
+	    break;
+
+    return i > 0 ? (int)i : -1;
+}
+
+int xcm_tp_socket_send_batch(struct xcm_socket *s, const struct iovec *msgs,
+			     size_t num_msgs)
+{
+    do_ctl(s);
+
+    int rc;
+    if (XCM_TP_GETOPS(s)->send_batch)
+	rc = XCM_TP_CALL(send_batch, s, msgs, num_msgs);
+    else
+	rc = send_batch_fallback(s, msgs, num_msgs);
+
+    xcm_tp_socket_update(s);
+    return rc;
+}
+
+static int receive_batch_fallback(struct xcm_socket *s, struct iovec *bufs,
+				  size_t num_bufs)
+{
+    size_t i;
+    for (i = 0; i < num_bufs; i++) {
+	int rc = XCM_TP_CALL(receive, s, bufs[i].iov_base, bufs[i].iov_len);
+	if (rc <= 0)
+	    return i > 0 ? (int)i : rc;
+	bufs[i].iov_len = rc;
+    }
+
+    return num_bufs;
+}
+
+int xcm_tp_socket_receive_batch(struct xcm_socket *s, struct iovec *bufs,
+				size_t num_bufs)
+{
+    do_ctl(s);
+
+    int rc;
+    if (XCM_TP_GETOPS(s)->receive_batch)
+	rc = XCM_TP_CALL(receive_batch, s, bufs, num_bufs);
+    else
+	rc = receive_batch_fallback(s, bufs, num_bufs);
+
+    xcm_tp_socket_update(s);
+    return rc;
+}
+
+int xcm_tp_socket_send_fds(struct xcm_socket *s, const void *buf, size_t len,
+			   const int *fds, size_t num_fds)
+{
+    do_ctl(s);
+
+    int rc;
+    if (XCM_TP_GETOPS(s)->send_fds)
+	rc = XCM_TP_CALL(send_fds, s, buf, len, fds, num_fds);
+    else if (num_fds == 0)
+	rc = XCM_TP_CALL(send, s, buf, len);
+    else {
+	errno = EOPNOTSUPP;
+	rc = -1;
+    }
+
+    xcm_tp_socket_update(s);
+    return rc;
+}
+
+int xcm_tp_socket_receive_fds(struct xcm_socket *s, void *buf,
+			      size_t capacity, int *fds, size_t *num_fds)
+{
+    do_ctl(s);
+
+    int rc;
+    if (XCM_TP_GETOPS(s)->receive_fds)
+	rc = XCM_TP_CALL(receive_fds, s, buf, capacity, fds, num_fds);
+    else {
+	rc = XCM_TP_CALL(receive, s, buf, capacity);
+	*num_fds = 0;
+    }
+
+    xcm_tp_socket_update(s);
+    return rc;
+}
+
 void xcm_tp_socket_update(struct xcm_socket *s)
 {
     XCM_TP_CALL(update, s);
@@ -326,6 +414,107 @@ static int get_blocking_attr(struct xcm_socket *s,
     return get_bool_attr(s->is_blocking, value, capacity);
 }
 
+static int get_int64_attr(int64_t value, void *buf, size_t capacity)
+{
+    if (sizeof(int64_t) > capacity) {
+	errno = EOVERFLOW;
+	return -1;
+    }
+
+    memcpy(buf, &value, sizeof(int64_t));
+
+    return sizeof(int64_t);
+}
+
+static int set_busy_poll_us_attr(struct xcm_socket *s,
+				 const struct xcm_tp_attr *attr,
+				 const void *value, size_t len)
+{
+    int64_t busy_poll_us;
+
+    if (len != sizeof(int64_t)) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    memcpy(&busy_poll_us, value, sizeof(int64_t));
+
+    /* the value is also used for SO_BUSY_POLL, which is an int */
+    if (busy_poll_us < 0 || busy_poll_us > INT_MAX) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    s->busy_poll_us = busy_poll_us;
+
+    if (XCM_TP_GETOPS(s)->set_busy_poll)
+	XCM_TP_CALL(set_busy_poll, s);
+
+    return 0;
+}
+
+static int get_busy_poll_us_attr(struct xcm_socket *s,
+				 const struct xcm_tp_attr *attr,
+				 void *value, size_t capacity)
+{
+    return get_int64_attr(s->busy_poll_us, value, capacity);
+}
+
+static int get_busy_poll_hits_attr(struct xcm_socket *s,
+				   const struct xcm_tp_attr *attr,
+				   void *value, size_t capacity)
+{
+    return get_int64_attr(s->busy_poll_hits, value, capacity);
+}
+
+static int get_busy_poll_misses_attr(struct xcm_socket *s,
+				     const struct xcm_tp_attr *attr,
+				     void *value, size_t capacity)
+{
+    return get_int64_attr(s->busy_poll_misses, value, capacity);
+}
+
+static int set_timeout_attr(int64_t *timeout, const void *value, size_t len)
+{
+    int64_t new_timeout;
+
+    if (len != sizeof(int64_t)) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    memcpy(&new_timeout, value, sizeof(int64_t));
+
+    if (new_timeout < 0) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    *timeout = new_timeout;
+
+    return 0;
+}
+
+#define GEN_TIMEOUT_ATTR_ACCESS(op)					\
+    static int set_ ## op ## _timeout_attr(struct xcm_socket *s,	\
+					   const struct xcm_tp_attr *attr, \
+					   const void *value, size_t len) \
+    {									\
+	return set_timeout_attr(&s->op ## _timeout, value, len);	\
+    }									\
+									\
+    static int get_ ## op ## _timeout_attr(struct xcm_socket *s,	\
+					   const struct xcm_tp_attr *attr, \
+					   void *value, size_t capacity) \
+    {									\
+	return get_int64_attr(s->op ## _timeout, value, capacity);	\
+    }
+
+GEN_TIMEOUT_ATTR_ACCESS(connect)
+GEN_TIMEOUT_ATTR_ACCESS(accept)
+GEN_TIMEOUT_ATTR_ACCESS(send)
+GEN_TIMEOUT_ATTR_ACCESS(receive)
+
 static int get_max_msg_attr(struct xcm_socket *s,
 			    const struct xcm_tp_attr *attr,
 			    void *value, size_t capacity)
@@ -374,6 +563,12 @@ GEN_CNT_ATTR_GETTER(from_lower, bytes)
 #define COMMON_ATTRS							\
     XCM_TP_DECL_RW_ATTR(XCM_ATTR_XCM_BLOCKING, xcm_attr_type_bool,	\
 			set_blocking_attr, get_blocking_attr),		\
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_XCM_BUSY_POLL_US, xcm_attr_type_int64,	\
+			set_busy_poll_us_attr, get_busy_poll_us_attr),	\
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_XCM_BUSY_POLL_HITS, xcm_attr_type_int64, \
+			get_busy_poll_hits_attr),			\
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_XCM_BUSY_POLL_MISSES, xcm_attr_type_int64, \
+			get_busy_poll_misses_attr),			\
     XCM_TP_DECL_RO_ATTR(XCM_ATTR_XCM_TYPE, xcm_attr_type_str,	        \
 			get_type_attr),					\
     XCM_TP_DECL_RO_ATTR(XCM_ATTR_XCM_TRANSPORT, xcm_attr_type_str,	\
@@ -387,6 +582,12 @@ static struct xcm_tp_attr conn_attrs[] = {
 			get_remote_attr),
     XCM_TP_DECL_RO_ATTR(XCM_ATTR_XCM_MAX_MSG_SIZE, xcm_attr_type_int64,
 			get_max_msg_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_XCM_CONNECT_TIMEOUT, xcm_attr_type_int64,
+			set_connect_timeout_attr, get_connect_timeout_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_XCM_SEND_TIMEOUT, xcm_attr_type_int64,
+			set_send_timeout_attr, get_send_timeout_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_XCM_RECEIVE_TIMEOUT, xcm_attr_type_int64,
+			set_receive_timeout_attr, get_receive_timeout_attr),
     XCM_TP_DECL_RO_ATTR(XCM_ATTR_XCM_TO_APP_MSGS, xcm_attr_type_int64,
 			get_to_app_msgs_attr),
     XCM_TP_DECL_RO_ATTR(XCM_ATTR_XCM_TO_APP_BYTES, xcm_attr_type_int64,
@@ -406,9 +607,46 @@ static struct xcm_tp_attr conn_attrs[] = {
 };
 
 static struct xcm_tp_attr server_attrs[] = {
-    COMMON_ATTRS
+    COMMON_ATTRS,
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_XCM_ACCEPT_TIMEOUT, xcm_attr_type_int64,
+			set_accept_timeout_attr, get_accept_timeout_attr)
 };
 
+static int attr_name_cmp(const void *a, const void *b)
+{
+    const struct xcm_tp_attr *attr_a = a;
+    const struct xcm_tp_attr *attr_b = b;
+
+    return strcmp(attr_a->name, attr_b->name);
+}
+
+void xcm_tp_attrs_sort(struct xcm_tp_attr *attrs, size_t attrs_len)
+{
+    qsort(attrs, attrs_len, sizeof(struct xcm_tp_attr), attr_name_cmp);
+}
+
+static int attr_key_cmp(const void *key, const void *elem)
+{
+    const struct xcm_tp_attr *attr = elem;
+
+    return strcmp(key, attr->name);
+}
+
+const struct xcm_tp_attr *xcm_tp_attrs_lookup(const char *name,
+					      const struct xcm_tp_attr *attrs,
+					      size_t attrs_len)
+{
+    return bsearch(name, attrs, attrs_len, sizeof(struct xcm_tp_attr),
+		   attr_key_cmp);
+}
+
+static void sort_attrs(void) __attribute__((constructor));
+static void sort_attrs(void)
+{
+    xcm_tp_attrs_sort(conn_attrs, UT_ARRAY_LEN(conn_attrs));
+    xcm_tp_attrs_sort(server_attrs, UT_ARRAY_LEN(server_attrs));
+}
+
 void xcm_tp_get_attrs(enum xcm_socket_type type,
 		      const struct xcm_tp_attr **attr_list,
 		      size_t *attr_list_len)
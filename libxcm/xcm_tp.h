@@ -7,6 +7,7 @@
 #define XCM_TP_H
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "cnt.h"
 #include "config.h"
@@ -38,6 +39,14 @@ struct xcm_tp_attr
 #define XCM_TP_DECL_RO_ATTR(attr_name, attr_type, attr_get_fun)		\
     XCM_TP_DECL_RW_ATTR(attr_name, attr_type, NULL, attr_get_fun)
 
+/* Attribute lists returned by the 'get_attrs' transport operation
+   must be sorted by name, to allow for binary search lookup. Static
+   attribute arrays are sorted once, at library load time. */
+void xcm_tp_attrs_sort(struct xcm_tp_attr *attrs, size_t attrs_len);
+const struct xcm_tp_attr *xcm_tp_attrs_lookup(const char *name,
+					      const struct xcm_tp_attr *attrs,
+					      size_t attrs_len);
+
 struct xcm_tp_ops {
     /* The 'init' function is called by the framework prior to any
        'connect', 'server' or 'accept'. After 'init', the socket must
@@ -58,6 +67,18 @@ struct xcm_tp_ops {
     int (*accept)(struct xcm_socket *conn_s, struct xcm_socket *server_s);
     int (*send)(struct xcm_socket *s, const void *buf, size_t len);
     int (*receive)(struct xcm_socket *s, void *buf, size_t capacity);
+    /* The batch operations are optional. Transports not implementing
+       them will have 'send' and 'receive' called repeatedly. */
+    int (*send_batch)(struct xcm_socket *s, const struct iovec *msgs,
+		      size_t num_msgs);
+    int (*receive_batch)(struct xcm_socket *s, struct iovec *bufs,
+			 size_t num_bufs);
+    /* Optional operations for transports capable of passing file
+       descriptors. */
+    int (*send_fds)(struct xcm_socket *s, const void *buf, size_t len,
+		    const int *fds, size_t num_fds);
+    int (*receive_fds)(struct xcm_socket *s, void *buf, size_t capacity,
+		       int *fds, size_t *num_fds);
     void (*update)(struct xcm_socket *s);
     int (*finish)(struct xcm_socket *s);
     const char *(*get_transport)(struct xcm_socket *s);
@@ -72,6 +93,13 @@ struct xcm_tp_ops {
 		      const struct xcm_tp_attr **attr_list,
 		      size_t *attr_list_len);
     size_t (*priv_size)(enum xcm_socket_type type);
+    /* Optional operation for transports with initialization (or
+       caches) expensive enough to be deferred until first use. */
+    int (*prewarm)(void);
+    /* Optional operation for transports with kernel sockets
+       supporting SO_BUSY_POLL, called when the socket's
+       'busy_poll_us' field has changed. */
+    void (*set_busy_poll)(struct xcm_socket *s);
 };
 
 #ifdef XCM_CTL
@@ -91,6 +119,13 @@ struct xcm_socket {
     bool is_blocking;
     int epoll_fd;
     int condition;
+    int64_t busy_poll_us;
+    int64_t busy_poll_hits;
+    int64_t busy_poll_misses;
+    int64_t connect_timeout;
+    int64_t accept_timeout;
+    int64_t send_timeout;
+    int64_t receive_timeout;
 #ifdef XCM_CTL
     struct ctl *ctl;
 #endif
@@ -121,6 +156,14 @@ int xcm_tp_socket_accept(struct xcm_socket *conn_s,
 			 struct xcm_socket *server_s);
 int xcm_tp_socket_send(struct xcm_socket *s, const void *buf, size_t len);
 int xcm_tp_socket_receive(struct xcm_socket *s, void *buf, size_t capacity);
+int xcm_tp_socket_send_batch(struct xcm_socket *s, const struct iovec *msgs,
+			     size_t num_msgs);
+int xcm_tp_socket_receive_batch(struct xcm_socket *s, struct iovec *bufs,
+				size_t num_bufs);
+int xcm_tp_socket_send_fds(struct xcm_socket *s, const void *buf, size_t len,
+			   const int *fds, size_t num_fds);
+int xcm_tp_socket_receive_fds(struct xcm_socket *s, void *buf,
+			      size_t capacity, int *fds, size_t *num_fds);
 void xcm_tp_socket_update(struct xcm_socket *s);
 int xcm_tp_socket_finish(struct xcm_socket *s);
 const char *xcm_tp_socket_get_transport(struct xcm_socket *s);
@@ -0,0 +1,773 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "active_fd.h"
+#include "common_tp.h"
+#include "epoll_reg.h"
+#include "log_inproc.h"
+#include "log_tp.h"
+#include "msg_ring.h"
+#include "util.h"
+#include "xcm.h"
+#include "xcm_addr.h"
+#include "xcm_addr_limits.h"
+#include "xcm_tp.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/queue.h>
+#include <unistd.h>
+
+/*
+ * INPROC In-process Transport
+ *
+ * Server sockets are kept in a process-global registry, indexed by
+ * name. A connection consists of a pair of single-producer,
+ * single-consumer message rings, shared between the client and the
+ * server connection sockets, and two eventfds used for wakeups. As
+ * for the SHM transport, an eventfd is only signaled in case the
+ * peer has announced it is about to wait, so no system calls are made
+ * in the common case.
+ */
+
+#define INPROC_MAX_MSG (65535)
+
+#define INPROC_RING_SIZE (256*1024)
+
+#define INPROC_CONN_BACKLOG (32)
+
+enum inproc_side {
+    inproc_side_client = 0,
+    inproc_side_server = 1
+};
+
+#define PEER_SIDE(_side) (1 - (_side))
+
+/* State shared between the two ends of a connection. The ring
+   produced to by a particular side is at the index of that side. */
+struct inproc_conn
+{
+    struct msg_ring rings[2];
+    uint8_t *ring_data[2];
+
+    uint32_t closed[2];
+
+    /* indexed by side */
+    int wake_fds[2];
+
+    int ref_cnt;
+
+    uint64_t id;
+    char server_name[INPROC_NAME_MAX+1];
+
+    TAILQ_ENTRY(inproc_conn) pending_elem;
+};
+
+TAILQ_HEAD(inproc_conn_queue, inproc_conn);
+
+struct inproc_server
+{
+    char name[INPROC_NAME_MAX+1];
+
+    struct inproc_conn_queue pending;
+    int num_pending;
+
+    /* signaled when a connection is added to the pending queue */
+    int accept_fd;
+
+    LIST_ENTRY(inproc_server) elem;
+};
+
+LIST_HEAD(inproc_server_list, inproc_server);
+
+static struct inproc_server_list servers =
+    LIST_HEAD_INITIALIZER(servers);
+static uint64_t next_conn_id = 0;
+static pthread_mutex_t servers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct inproc_socket
+{
+    struct epoll_reg active_fd_reg;
+
+    char laddr[XCM_ADDR_MAX+1];
+
+    union {
+	struct {
+	    struct inproc_server *server;
+	    struct epoll_reg accept_reg;
+	} server;
+	struct {
+	    struct inproc_conn *conn;
+	    enum inproc_side side;
+
+	    struct msg_ring *tx_ring;
+	    uint8_t *tx_data;
+	    struct msg_ring *rx_ring;
+	    uint8_t *rx_data;
+
+	    bool peer_closed;
+
+	    struct epoll_reg wake_reg;
+
+	    char raddr[XCM_ADDR_MAX+1];
+	} conn;
+    };
+};
+
+#define TOINPROC(s) XCM_TP_GETPRIV(s, struct inproc_socket)
+
+static int inproc_init(struct xcm_socket *s);
+static int inproc_connect(struct xcm_socket *s, const char *remote_addr);
+static int inproc_server(struct xcm_socket *s, const char *local_addr);
+static int inproc_close(struct xcm_socket *s);
+static void inproc_cleanup(struct xcm_socket *s);
+static int inproc_accept(struct xcm_socket *conn_s,
+			 struct xcm_socket *server_s);
+static int inproc_send(struct xcm_socket *s, const void *buf, size_t len);
+static int inproc_receive(struct xcm_socket *s, void *buf, size_t capacity);
+static void inproc_update(struct xcm_socket *s);
+static int inproc_finish(struct xcm_socket *s);
+static const char *inproc_get_remote_addr(struct xcm_socket *conn_s,
+					  bool suppress_tracing);
+static const char *inproc_get_local_addr(struct xcm_socket *s,
+					 bool suppress_tracing);
+static size_t inproc_max_msg(struct xcm_socket *conn_s);
+static void inproc_get_attrs(struct xcm_socket *s,
+			     const struct xcm_tp_attr **attr_list,
+			     size_t *attr_list_len);
+static size_t inproc_priv_size(enum xcm_socket_type type);
+
+static struct xcm_tp_ops inproc_ops = {
+    .init = inproc_init,
+    .connect = inproc_connect,
+    .server = inproc_server,
+    .close = inproc_close,
+    .cleanup = inproc_cleanup,
+    .accept = inproc_accept,
+    .send = inproc_send,
+    .receive = inproc_receive,
+    .update = inproc_update,
+    .finish = inproc_finish,
+    .get_remote_addr = inproc_get_remote_addr,
+    .get_local_addr = inproc_get_local_addr,
+    .max_msg = inproc_max_msg,
+    .get_attrs = inproc_get_attrs,
+    .priv_size = inproc_priv_size
+};
+
+static void reg(void) __attribute__((constructor));
+static void reg(void)
+{
+    xcm_tp_register(XCM_INPROC_PROTO, &inproc_ops);
+}
+
+static size_t inproc_priv_size(enum xcm_socket_type type)
+{
+    return sizeof(struct inproc_socket);
+}
+
+static void wake(int fd)
+{
+    uint64_t value = 1;
+    UT_PROTECT_ERRNO(write(fd, &value, sizeof(value)));
+}
+
+static void drain(int fd)
+{
+    uint64_t value;
+    UT_PROTECT_ERRNO(read(fd, &value, sizeof(value)));
+}
+
+static struct inproc_conn *conn_create(const char *server_name, uint64_t id)
+{
+    struct inproc_conn *conn;
+
+    /* the rings are cache line aligned */
+    if (posix_memalign((void **)&conn, MSG_RING_CACHE_LINE_SIZE,
+		       sizeof(struct inproc_conn)) != 0)
+	ut_die("Unable to allocate connection state");
+
+    memset(conn, 0, sizeof(struct inproc_conn));
+
+    int i;
+    for (i = 0; i < 2; i++) {
+	msg_ring_init(&conn->rings[i]);
+	conn->ring_data[i] = ut_malloc(INPROC_RING_SIZE);
+	conn->wake_fds[i] = -1;
+    }
+
+    for (i = 0; i < 2; i++) {
+	conn->wake_fds[i] = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (conn->wake_fds[i] < 0)
+	    goto err_free;
+    }
+
+    conn->ref_cnt = 2;
+    conn->id = id;
+    strcpy(conn->server_name, server_name);
+
+    return conn;
+
+err_free:
+    for (i = 0; i < 2; i++) {
+	if (conn->wake_fds[i] >= 0)
+	    UT_PROTECT_ERRNO(close(conn->wake_fds[i]));
+	ut_free(conn->ring_data[i]);
+    }
+    free(conn);
+    return NULL;
+}
+
+static void conn_put(struct inproc_conn *conn)
+{
+    if (__atomic_sub_fetch(&conn->ref_cnt, 1, __ATOMIC_ACQ_REL) > 0)
+	return;
+
+    int i;
+    for (i = 0; i < 2; i++) {
+	UT_PROTECT_ERRNO(close(conn->wake_fds[i]));
+	ut_free(conn->ring_data[i]);
+    }
+    free(conn);
+}
+
+static void conn_close(struct inproc_conn *conn, enum inproc_side side)
+{
+    __atomic_store_n(&conn->closed[side], 1, __ATOMIC_RELEASE);
+    wake(conn->wake_fds[PEER_SIDE(side)]);
+}
+
+static struct inproc_server *servers_find(const char *name)
+{
+    struct inproc_server *server;
+    LIST_FOREACH(server, &servers, elem)
+	if (strcmp(server->name, name) == 0)
+	    return server;
+    return NULL;
+}
+
+static int inproc_init(struct xcm_socket *s)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    int active_fd = active_fd_get();
+    if (active_fd < 0)
+	return -1;
+
+    epoll_reg_init(&is->active_fd_reg, s->epoll_fd, active_fd, s);
+
+    if (s->type == xcm_socket_type_server)
+	epoll_reg_init(&is->server.accept_reg, s->epoll_fd, -1, s);
+    else
+	epoll_reg_init(&is->conn.wake_reg, s->epoll_fd, -1, s);
+
+    return 0;
+}
+
+static void deinit(struct xcm_socket *s)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    epoll_reg_reset(&is->active_fd_reg);
+    active_fd_put();
+
+    if (s->type == xcm_socket_type_server)
+	epoll_reg_reset(&is->server.accept_reg);
+    else
+	epoll_reg_reset(&is->conn.wake_reg);
+}
+
+static void attach_conn(struct xcm_socket *s, struct inproc_conn *conn,
+			enum inproc_side side)
+{
+    struct inproc_socket *is = TOINPROC(s);
+    enum inproc_side peer_side = PEER_SIDE(side);
+
+    is->conn.conn = conn;
+    is->conn.side = side;
+
+    is->conn.tx_ring = &conn->rings[side];
+    is->conn.tx_data = conn->ring_data[side];
+    is->conn.rx_ring = &conn->rings[peer_side];
+    is->conn.rx_data = conn->ring_data[peer_side];
+
+    epoll_reg_set_fd(&is->conn.wake_reg, conn->wake_fds[side]);
+
+    LOG_INPROC_CONN_ESTABLISHED(s, conn->id);
+}
+
+static int inproc_connect(struct xcm_socket *s, const char *remote_addr)
+{
+    LOG_CONN_REQ(remote_addr);
+
+    char name[INPROC_NAME_MAX+1];
+
+    if (xcm_addr_parse_inproc(remote_addr, name, sizeof(name)) < 0) {
+	LOG_ADDR_PARSE_ERR(remote_addr, errno);
+	errno = EINVAL;
+	goto err_deinit;
+    }
+
+    ut_mutex_lock(&servers_lock);
+
+    struct inproc_server *server = servers_find(name);
+
+    if (server == NULL) {
+	LOG_INPROC_NO_SERVER(s, name);
+	errno = ECONNREFUSED;
+	goto err_unlock;
+    }
+
+    if (server->num_pending >= INPROC_CONN_BACKLOG) {
+	LOG_INPROC_BACKLOG_FULL(s, name);
+	errno = EAGAIN;
+	goto err_unlock;
+    }
+
+    struct inproc_conn *conn = conn_create(name, next_conn_id);
+    if (conn == NULL)
+	goto err_unlock;
+
+    next_conn_id++;
+
+    TAILQ_INSERT_TAIL(&server->pending, conn, pending_elem);
+    server->num_pending++;
+
+    wake(server->accept_fd);
+
+    ut_mutex_unlock(&servers_lock);
+
+    attach_conn(s, conn, inproc_side_client);
+
+    return 0;
+
+err_unlock:
+    ut_mutex_unlock(&servers_lock);
+err_deinit:
+    LOG_CONN_FAILED(s, errno);
+    UT_PROTECT_ERRNO(deinit(s));
+    return -1;
+}
+
+static int inproc_server(struct xcm_socket *s, const char *local_addr)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    LOG_SERVER_REQ(local_addr);
+
+    char name[INPROC_NAME_MAX+1];
+
+    if (xcm_addr_parse_inproc(local_addr, name, sizeof(name)) < 0) {
+	LOG_ADDR_PARSE_ERR(local_addr, errno);
+	errno = EINVAL;
+	goto err_deinit;
+    }
+
+    struct inproc_server *server = ut_calloc(sizeof(struct inproc_server));
+
+    strcpy(server->name, name);
+    TAILQ_INIT(&server->pending);
+
+    server->accept_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (server->accept_fd < 0)
+	goto err_free;
+
+    ut_mutex_lock(&servers_lock);
+
+    if (servers_find(name) != NULL) {
+	ut_mutex_unlock(&servers_lock);
+	LOG_INPROC_NAME_IN_USE(s, name);
+	errno = EADDRINUSE;
+	goto err_close;
+    }
+
+    LIST_INSERT_HEAD(&servers, server, elem);
+
+    ut_mutex_unlock(&servers_lock);
+
+    is->server.server = server;
+    epoll_reg_set_fd(&is->server.accept_reg, server->accept_fd);
+
+    LOG_INPROC_SERVER_CREATED(s, name);
+
+    return 0;
+
+err_close:
+    UT_PROTECT_ERRNO(close(server->accept_fd));
+err_free:
+    ut_free(server);
+err_deinit:
+    UT_PROTECT_ERRNO(deinit(s));
+    return -1;
+}
+
+static void server_close(struct xcm_socket *s)
+{
+    struct inproc_socket *is = TOINPROC(s);
+    struct inproc_server *server = is->server.server;
+
+    ut_mutex_lock(&servers_lock);
+
+    LIST_REMOVE(server, elem);
+
+    LOG_INPROC_PENDING_DROPPED(s, server->num_pending);
+
+    struct inproc_conn *conn;
+    while ((conn = TAILQ_FIRST(&server->pending)) != NULL) {
+	TAILQ_REMOVE(&server->pending, conn, pending_elem);
+	conn_close(conn, inproc_side_server);
+	conn_put(conn);
+    }
+
+    ut_mutex_unlock(&servers_lock);
+
+    UT_PROTECT_ERRNO(close(server->accept_fd));
+    ut_free(server);
+}
+
+static void do_close(struct xcm_socket *s, bool owner)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    deinit(s);
+
+    if (s->type == xcm_socket_type_server) {
+	/* a forked child process has no business touching the
+	   registry of its parent */
+	if (owner)
+	    server_close(s);
+    } else {
+	if (owner)
+	    conn_close(is->conn.conn, is->conn.side);
+	conn_put(is->conn.conn);
+    }
+}
+
+static int inproc_close(struct xcm_socket *s)
+{
+    LOG_CLOSING(s);
+    do_close(s, true);
+    return 0;
+}
+
+static void inproc_cleanup(struct xcm_socket *s)
+{
+    LOG_CLEANING_UP(s);
+    do_close(s, false);
+}
+
+static int inproc_accept(struct xcm_socket *conn_s,
+			 struct xcm_socket *server_s)
+{
+    struct inproc_socket *server_is = TOINPROC(server_s);
+    struct inproc_server *server = server_is->server.server;
+
+    LOG_ACCEPT_REQ(server_s);
+
+    ut_mutex_lock(&servers_lock);
+
+    struct inproc_conn *conn = TAILQ_FIRST(&server->pending);
+
+    if (conn != NULL) {
+	TAILQ_REMOVE(&server->pending, conn, pending_elem);
+	server->num_pending--;
+    }
+
+    ut_mutex_unlock(&servers_lock);
+
+    if (conn == NULL) {
+	errno = EAGAIN;
+	LOG_ACCEPT_FAILED(server_s, errno);
+	deinit(conn_s);
+	return -1;
+    }
+
+    attach_conn(conn_s, conn, inproc_side_server);
+
+    return 0;
+}
+
+static bool is_peer_closed(struct xcm_socket *s)
+{
+    struct inproc_socket *is = TOINPROC(s);
+    struct inproc_conn *conn = is->conn.conn;
+
+    if (!is->conn.peer_closed &&
+	__atomic_load_n(&conn->closed[PEER_SIDE(is->conn.side)],
+			__ATOMIC_ACQUIRE))
+	is->conn.peer_closed = true;
+
+    return is->conn.peer_closed;
+}
+
+static void wake_peer(struct xcm_socket *s)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    wake(is->conn.conn->wake_fds[PEER_SIDE(is->conn.side)]);
+}
+
+static int inproc_send(struct xcm_socket *s, const void *buf, size_t len)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    LOG_SEND_REQ(s, buf, len);
+
+    TP_GOTO_ON_INVALID_MSG_SIZE(len, INPROC_MAX_MSG, err);
+
+    if (is_peer_closed(s)) {
+	errno = EPIPE;
+	goto err;
+    }
+
+    if (!msg_ring_write(is->conn.tx_ring, is->conn.tx_data, INPROC_RING_SIZE,
+			buf, len)) {
+	errno = EAGAIN;
+	goto err;
+    }
+
+    if (msg_ring_consumer_wakeup(is->conn.tx_ring))
+	wake_peer(s);
+
+    LOG_SEND_ACCEPTED(s, buf, len);
+    CNT_MSG_INC(&s->cnt, from_app, len);
+    LOG_LOWER_DELIVERED_COMPL(s, buf, len);
+    CNT_MSG_INC(&s->cnt, to_lower, len);
+
+    return 0;
+
+err:
+    LOG_SEND_FAILED(s, errno);
+    return -1;
+}
+
+static int try_receive(struct xcm_socket *s, void *buf, size_t capacity)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    int rc = msg_ring_read(is->conn.rx_ring, is->conn.rx_data,
+			   INPROC_RING_SIZE, INPROC_MAX_MSG, buf, capacity);
+
+    /* the peer is in the same process, and can't produce invalid
+       frames */
+    ut_assert(rc >= 0);
+
+    if (rc > 0 && msg_ring_producer_wakeup(is->conn.rx_ring))
+	wake_peer(s);
+
+    return rc;
+}
+
+static int inproc_receive(struct xcm_socket *s, void *buf, size_t capacity)
+{
+    LOG_RCV_REQ(s, buf, capacity);
+
+    int rc = try_receive(s, buf, capacity);
+
+    /* the peer marks the connection closed only after having
+       produced its last message, so the ring needs to be checked
+       again */
+    if (rc == 0 && is_peer_closed(s))
+	rc = try_receive(s, buf, capacity);
+
+    if (rc > 0) {
+	LOG_RCV_MSG(s, buf, rc);
+	CNT_MSG_INC(&s->cnt, from_lower, rc);
+	LOG_APP_DELIVERED(s, buf, rc);
+	CNT_MSG_INC(&s->cnt, to_app, rc);
+	return UT_MIN(rc, capacity);
+    }
+
+    if (is_peer_closed(s)) {
+	LOG_INPROC_PEER_CLOSED(s);
+	LOG_RCV_EOF(s);
+	return 0;
+    }
+
+    errno = EAGAIN;
+    LOG_RCV_FAILED(s, errno);
+    return -1;
+}
+
+static bool is_conn_ready(struct xcm_socket *s, int condition)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    if (is_peer_closed(s))
+	return true;
+
+    if (condition & XCM_SO_RECEIVABLE && !msg_ring_is_empty(is->conn.rx_ring))
+	return true;
+
+    if (condition & XCM_SO_SENDABLE &&
+	msg_ring_can_write(is->conn.tx_ring, INPROC_RING_SIZE, INPROC_MAX_MSG))
+	return true;
+
+    return false;
+}
+
+static void set_waiting(struct xcm_socket *s, int condition)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    if (condition & XCM_SO_RECEIVABLE)
+	msg_ring_consumer_await(is->conn.rx_ring);
+    if (condition & XCM_SO_SENDABLE)
+	msg_ring_producer_await(is->conn.tx_ring);
+}
+
+static void update_conn(struct xcm_socket *s)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    if (s->condition == 0) {
+	epoll_reg_reset(&is->active_fd_reg);
+	epoll_reg_reset(&is->conn.wake_reg);
+	return;
+    }
+
+    if (!is_conn_ready(s, s->condition)) {
+	/* any wakeup left over is consumed before the flags are
+	   raised, so a wakeup caused by the peer seeing the flags is
+	   never lost */
+	drain(is->conn.conn->wake_fds[is->conn.side]);
+
+	set_waiting(s, s->condition);
+
+	if (!is_conn_ready(s, s->condition)) {
+	    epoll_reg_reset(&is->active_fd_reg);
+	    epoll_reg_ensure(&is->conn.wake_reg, EPOLLIN);
+	    return;
+	}
+    }
+
+    epoll_reg_ensure(&is->active_fd_reg, EPOLLIN);
+}
+
+static void update_server(struct xcm_socket *s)
+{
+    struct inproc_socket *is = TOINPROC(s);
+    struct inproc_server *server = is->server.server;
+
+    if (!(s->condition & XCM_SO_ACCEPTABLE)) {
+	epoll_reg_reset(&is->active_fd_reg);
+	epoll_reg_reset(&is->server.accept_reg);
+	return;
+    }
+
+    /* connecting sockets enqueue and signal the eventfd with the
+       lock held */
+    ut_mutex_lock(&servers_lock);
+
+    bool acceptable = server->num_pending > 0;
+
+    if (!acceptable)
+	drain(server->accept_fd);
+
+    ut_mutex_unlock(&servers_lock);
+
+    if (acceptable) {
+	epoll_reg_ensure(&is->active_fd_reg, EPOLLIN);
+	epoll_reg_reset(&is->server.accept_reg);
+    } else {
+	epoll_reg_reset(&is->active_fd_reg);
+	epoll_reg_ensure(&is->server.accept_reg, EPOLLIN);
+    }
+}
+
+static void inproc_update(struct xcm_socket *s)
+{
+    LOG_UPDATE_REQ(s, s->epoll_fd);
+
+    switch (s->type) {
+    case xcm_socket_type_conn:
+	update_conn(s);
+	break;
+    case xcm_socket_type_server:
+	update_server(s);
+	break;
+    default:
+	ut_assert(0);
+    }
+}
+
+static int inproc_finish(struct xcm_socket *s)
+{
+    LOG_FINISH_REQ(s);
+    return 0;
+}
+
+static int make_client_addr(uint64_t conn_id, char *buf, size_t capacity)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%05" PRIx64, conn_id);
+
+    return xcm_addr_make_inproc(name, buf, capacity);
+}
+
+static const char *inproc_get_remote_addr(struct xcm_socket *conn_s,
+					  bool suppress_tracing)
+{
+    struct inproc_socket *is = TOINPROC(conn_s);
+    struct inproc_conn *conn = is->conn.conn;
+
+    int rc;
+    if (is->conn.side == inproc_side_client)
+	rc = xcm_addr_make_inproc(conn->server_name, is->conn.raddr,
+				  sizeof(is->conn.raddr));
+    else
+	rc = make_client_addr(conn->id, is->conn.raddr,
+			      sizeof(is->conn.raddr));
+
+    if (rc < 0) {
+	if (!suppress_tracing)
+	    LOG_REMOTE_SOCKET_NAME_FAILED(conn_s, errno);
+	return NULL;
+    }
+
+    return is->conn.raddr;
+}
+
+static const char *inproc_get_local_addr(struct xcm_socket *s,
+					 bool suppress_tracing)
+{
+    struct inproc_socket *is = TOINPROC(s);
+
+    int rc;
+    if (s->type == xcm_socket_type_server)
+	rc = xcm_addr_make_inproc(is->server.server->name, is->laddr,
+				  sizeof(is->laddr));
+    else if (is->conn.side == inproc_side_client)
+	rc = make_client_addr(is->conn.conn->id, is->laddr,
+			      sizeof(is->laddr));
+    else
+	rc = xcm_addr_make_inproc(is->conn.conn->server_name, is->laddr,
+				  sizeof(is->laddr));
+
+    if (rc < 0) {
+	if (!suppress_tracing)
+	    LOG_LOCAL_SOCKET_NAME_FAILED(s, errno);
+	return NULL;
+    }
+
+    return is->laddr;
+}
+
+static size_t inproc_max_msg(struct xcm_socket *conn_s)
+{
+    return INPROC_MAX_MSG;
+}
+
+static void inproc_get_attrs(struct xcm_socket *s,
+			     const struct xcm_tp_attr **attr_list,
+			     size_t *attr_list_len)
+{
+    *attr_list_len = 0;
+}
@@ -29,6 +29,12 @@
 
 #define SCTP_MAX_MSG (65535)
 
+/* Same as the Linux kernel's default */
+#define SCTP_DEFAULT_STREAMS (10)
+#define SCTP_MAX_STREAMS (65535)
+
+#define SCTP_ROUND_ROBIN_STREAM (-1)
+
 enum conn_state {
     conn_state_none,
     conn_state_initialized,
@@ -46,12 +52,22 @@ struct sctp_socket
 
     char laddr[XCM_ADDR_MAX+1];
 
+    /* requested number of outbound streams */
+    int64_t streams;
+
     union {
 	struct {
 	    enum conn_state state;
 
 	    int badness_reason;
 
+	    /* negotiated number of outbound streams */
+	    uint16_t out_streams;
+
+	    int64_t send_stream;
+	    bool unordered;
+	    uint16_t next_stream;
+
 	    struct epoll_reg active_fd_reg;
 
 	    /* for conn_state_resolving */
@@ -88,6 +104,7 @@ static void sctp_get_attrs(struct xcm_socket *s,
 			   const struct xcm_tp_attr **attr_list,
 			   size_t *attr_list_len);
 static size_t sctp_priv_size(enum xcm_socket_type type);
+static void sctp_set_busy_poll(struct xcm_socket *s);
 
 static struct xcm_tp_ops sctp_ops = {
     .init = sctp_init,
@@ -104,7 +121,8 @@ static struct xcm_tp_ops sctp_ops = {
     .get_local_addr = sctp_get_local_addr,
     .max_msg = sctp_max_msg,
     .get_attrs = sctp_get_attrs,
-    .priv_size = sctp_priv_size
+    .priv_size = sctp_priv_size,
+    .set_busy_poll = sctp_set_busy_poll
 };
 
 static void reg(void) __attribute__((constructor));
@@ -182,8 +200,11 @@ static int sctp_init(struct xcm_socket *s)
     ss->fd = -1;
     epoll_reg_init(&ss->fd_reg, s->epoll_fd, -1, s);
 
+    ss->streams = SCTP_DEFAULT_STREAMS;
+
     if (s->type == xcm_socket_type_conn) {
 	ss->conn.state = conn_state_initialized;
+	ss->conn.out_streams = 1;
 
 	int active_fd = active_fd_get();
 	if (active_fd < 0)
@@ -297,6 +318,57 @@ static int set_sctp_conn_opts(int fd)
     return 0;
 }
 
+static int set_init_msg(int fd, int64_t streams)
+{
+    /* zero-valued fields retain their current values */
+    struct sctp_initmsg init = {
+	.sinit_num_ostreams = streams
+    };
+
+    int rc = setsockopt(fd, SOL_SCTP, SCTP_INITMSG, &init, sizeof(init));
+
+    if (rc < 0)
+	LOG_SCTP_SOCKET_OPTION_FAILED("SCTP_INITMSG", init.sinit_num_ostreams,
+				      errno);
+    return rc;
+}
+
+/* A send stream set before the association was established may
+   not exist, in which case the highest-numbered stream is used */
+static void clamp_send_stream(struct xcm_socket *s)
+{
+    struct sctp_socket *ss = TOSCTP(s);
+
+    if (ss->conn.send_stream < ss->conn.out_streams)
+	return;
+
+    int64_t stream = ss->conn.out_streams - 1;
+
+    LOG_SCTP_SEND_STREAM_CLAMPED(s, ss->conn.send_stream, stream);
+
+    ss->conn.send_stream = stream;
+}
+
+/* The peer may grant fewer outbound streams than requested */
+static void retrieve_out_streams(struct xcm_socket *s)
+{
+    struct sctp_socket *ss = TOSCTP(s);
+
+    struct sctp_status status;
+    socklen_t status_len = sizeof(status);
+
+    if (getsockopt(ss->fd, SOL_SCTP, SCTP_STATUS, &status,
+		   &status_len) < 0) {
+	LOG_SCTP_STATUS_FAILED(s, errno);
+	ss->conn.out_streams = 1;
+    } else {
+	ss->conn.out_streams = UT_MAX(status.sstat_outstrms, 1);
+	LOG_SCTP_OUT_STREAMS(s, ss->conn.out_streams);
+    }
+
+    clamp_send_stream(s);
+}
+
 static void begin_connect(struct xcm_socket *s)
 {
     struct sctp_socket *ss = TOSCTP(s);
@@ -311,6 +383,11 @@ static void begin_connect(struct xcm_socket *s)
     if (set_sctp_conn_opts(ss->fd) < 0)
 	goto err;
 
+    if (set_init_msg(ss->fd, ss->streams) < 0)
+	goto err;
+
+    tp_effectuate_busy_poll(s, ss->fd);
+
     epoll_reg_set_fd(&ss->fd_reg, ss->fd);
 
     struct sockaddr_storage servaddr;
@@ -326,6 +403,7 @@ static void begin_connect(struct xcm_socket *s)
     } else {
 	SCTP_SET_STATE(s, conn_state_ready);
 	LOG_SCTP_CONN_ESTABLISHED(s, ss->fd);
+	retrieve_out_streams(s);
     }
 
     UT_RESTORE_ERRNO_DC;
@@ -400,6 +478,7 @@ static void try_finish_connect(struct xcm_socket *s)
 	} else {
 	    LOG_SCTP_CONN_ESTABLISHED(s, ss->fd);
 	    SCTP_SET_STATE(s, conn_state_ready);
+	    retrieve_out_streams(s);
 	}
 	break;
     default:
@@ -476,6 +555,10 @@ static int sctp_server(struct xcm_socket *s, const char *local_addr)
 	goto err_close;
     }
 
+    /* inherited by accepted connections */
+    if (set_init_msg(ss->fd, ss->streams) < 0)
+	goto err_close;
+
     struct sockaddr_storage addr;
     tp_ip_to_sockaddr(&host.ip, port, (struct sockaddr*)&addr);
 
@@ -560,6 +643,8 @@ static int sctp_accept(struct xcm_socket *conn_s, struct xcm_socket *server_s)
     if (set_sctp_conn_opts(conn_fd) < 0)
 	goto err_close;
 
+    tp_effectuate_busy_poll(conn_s, conn_fd);
+
     if (ut_set_blocking(conn_fd, false) < 0) {
 	LOG_SET_BLOCKING_FAILED_FD(NULL, errno);
 	goto err_close;
@@ -572,6 +657,8 @@ static int sctp_accept(struct xcm_socket *conn_s, struct xcm_socket *server_s)
 
     LOG_CONN_ACCEPTED(conn_s, conn_ss->fd);
 
+    retrieve_out_streams(conn_s);
+
     assert_socket(conn_s);
 
     return 0;
@@ -584,6 +671,54 @@ static int sctp_accept(struct xcm_socket *conn_s, struct xcm_socket *server_s)
     return -1;
 }
 
+static int select_stream(struct xcm_socket *s)
+{
+    struct sctp_socket *ss = TOSCTP(s);
+
+    if (ss->conn.send_stream != SCTP_ROUND_ROBIN_STREAM)
+	return ss->conn.send_stream;
+
+    int stream = ss->conn.next_stream;
+
+    ss->conn.next_stream = (stream + 1) % ss->conn.out_streams;
+
+    return stream;
+}
+
+static int send_on_stream(int fd, const void *buf, size_t len,
+			  uint16_t stream, bool unordered)
+{
+    /* the default send info is stream 0, in-order delivery */
+    if (stream == 0 && !unordered)
+	return send(fd, buf, len, MSG_NOSIGNAL|MSG_EOR);
+
+    struct iovec iov = {
+	.iov_base = (void *)buf,
+	.iov_len = len
+    };
+
+    char ctrl[CMSG_SPACE(sizeof(struct sctp_sndinfo))];
+    memset(ctrl, 0, sizeof(ctrl));
+
+    struct msghdr msg = {
+	.msg_iov = &iov,
+	.msg_iovlen = 1,
+	.msg_control = ctrl,
+	.msg_controllen = sizeof(ctrl)
+    };
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_SCTP;
+    cmsg->cmsg_type = SCTP_SNDINFO;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(struct sctp_sndinfo));
+
+    struct sctp_sndinfo *info = (struct sctp_sndinfo *)CMSG_DATA(cmsg);
+    info->snd_sid = stream;
+    info->snd_flags = unordered ? SCTP_UNORDERED : 0;
+
+    return sendmsg(fd, &msg, MSG_NOSIGNAL|MSG_EOR);
+}
+
 static int xsctp_send(struct xcm_socket *s, const void *buf, size_t len)
 {
     struct sctp_socket *ss = TOSCTP(s);
@@ -598,7 +733,8 @@ static int xsctp_send(struct xcm_socket *s, const void *buf, size_t len)
 
     TP_RET_ERR_IF_STATE(s, ss, conn_state_closed, EPIPE);
 
-    int rc = send(ss->fd, buf, len, MSG_NOSIGNAL|MSG_EOR);
+    int rc = send_on_stream(ss->fd, buf, len, select_stream(s),
+			    ss->conn.unordered);
 
     ut_assert(rc > 0 ? rc == len : true);
 
@@ -805,9 +941,136 @@ static size_t sctp_max_msg(struct xcm_socket *s)
     return SCTP_MAX_MSG;
 }
 
+static void sctp_set_busy_poll(struct xcm_socket *s)
+{
+    struct sctp_socket *ss = TOSCTP(s);
+
+    if (s->type == xcm_socket_type_conn && ss->fd >= 0)
+	tp_set_busy_poll(s, ss->fd);
+}
+
+static int set_streams_attr(struct xcm_socket *s,
+			    const struct xcm_tp_attr *attr,
+			    const void *value, size_t len)
+{
+    struct sctp_socket *ss = TOSCTP(s);
+
+    /* only applicable before the association is initiated */
+    if (ss->fd >= 0) {
+	errno = EACCES;
+	return -1;
+    }
+
+    int64_t streams = *((const int64_t *)value);
+
+    if (streams < 1 || streams > SCTP_MAX_STREAMS) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    ss->streams = streams;
+
+    return 0;
+}
+
+static int get_streams_attr(struct xcm_socket *s,
+			    const struct xcm_tp_attr *attr,
+			    void *value, size_t capacity)
+{
+    struct sctp_socket *ss = TOSCTP(s);
+
+    int64_t streams = ss->streams;
+
+    if (s->type == xcm_socket_type_conn &&
+	ss->conn.state == conn_state_ready)
+	streams = ss->conn.out_streams;
+
+    memcpy(value, &streams, sizeof(int64_t));
+
+    return sizeof(int64_t);
+}
+
+static int set_send_stream_attr(struct xcm_socket *s,
+				const struct xcm_tp_attr *attr,
+				const void *value, size_t len)
+{
+    struct sctp_socket *ss = TOSCTP(s);
+
+    int64_t stream = *((const int64_t *)value);
+
+    if (stream < SCTP_ROUND_ROBIN_STREAM || stream >= SCTP_MAX_STREAMS ||
+	(ss->conn.state == conn_state_ready &&
+	 stream >= ss->conn.out_streams)) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    ss->conn.send_stream = stream;
+
+    return 0;
+}
+
+static int get_send_stream_attr(struct xcm_socket *s,
+				const struct xcm_tp_attr *attr,
+				void *value, size_t capacity)
+{
+    memcpy(value, &TOSCTP(s)->conn.send_stream, sizeof(int64_t));
+
+    return sizeof(int64_t);
+}
+
+static int set_unordered_attr(struct xcm_socket *s,
+			      const struct xcm_tp_attr *attr,
+			      const void *value, size_t len)
+{
+    TOSCTP(s)->conn.unordered = *((const bool *)value);
+
+    return 0;
+}
+
+static int get_unordered_attr(struct xcm_socket *s,
+			      const struct xcm_tp_attr *attr,
+			      void *value, size_t capacity)
+{
+    memcpy(value, &TOSCTP(s)->conn.unordered, sizeof(bool));
+
+    return sizeof(bool);
+}
+
+static struct xcm_tp_attr conn_attrs[] = {
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_SCTP_STREAMS, xcm_attr_type_int64,
+			set_streams_attr, get_streams_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_SCTP_SEND_STREAM, xcm_attr_type_int64,
+			set_send_stream_attr, get_send_stream_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_SCTP_UNORDERED, xcm_attr_type_bool,
+			set_unordered_attr, get_unordered_attr)
+};
+
+static struct xcm_tp_attr server_attrs[] = {
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_SCTP_STREAMS, xcm_attr_type_int64,
+			set_streams_attr, get_streams_attr)
+};
+
+static void sort_attrs(void) __attribute__((constructor));
+static void sort_attrs(void)
+{
+    xcm_tp_attrs_sort(conn_attrs, UT_ARRAY_LEN(conn_attrs));
+}
+
 static void sctp_get_attrs(struct xcm_socket *s,
 			   const struct xcm_tp_attr **attr_list,
 			   size_t *attr_list_len)
 {
-    *attr_list_len = 0;
+    switch (s->type) {
+    case xcm_socket_type_conn:
+	*attr_list = conn_attrs;
+	*attr_list_len = UT_ARRAY_LEN(conn_attrs);
+	break;
+    case xcm_socket_type_server:
+	*attr_list = server_attrs;
+	*attr_list_len = UT_ARRAY_LEN(server_attrs);
+	break;
+    default:
+	ut_assert(0);
+    }
 }
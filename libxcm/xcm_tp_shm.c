@@ -0,0 +1,1125 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "active_fd.h"
+#include "common_tp.h"
+#include "epoll_reg.h"
+#include "log_shm.h"
+#include "log_tp.h"
+#include "msg_ring.h"
+#include "util.h"
+#include "xcm.h"
+#include "xcm_addr.h"
+#include "xcm_addr_limits.h"
+#include "xcm_tp.h"
+
+#include <linux/un.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * SHM Shared Memory Transport
+ *
+ * The client creates a memory area with one single-producer,
+ * single-consumer ring per direction, and two eventfds used for
+ * wakeups, and passes them to the server over a UNIX domain socket
+ * connection. The socket is kept open for the lifetime of the XCM
+ * connection, and is used to detect that the remote peer has died.
+ *
+ * The eventfds are only signaled in case the peer has announced it
+ * is about to wait for the ring to become non-empty (or non-full). In
+ * the common case, no system calls are made in the data path.
+ */
+
+#define SHM_MAX_MSG (65535)
+
+#define SHM_RING_SIZE (256*1024)
+#define SHM_CTL_SIZE (4096)
+
+#define SHM_HELLO_MAGIC (0x58434d53)
+#define SHM_HELLO_VERSION (1)
+#define SHM_HELLO_NUM_FDS (3)
+
+#define SHM_CONN_BACKLOG (32)
+
+enum shm_side {
+    shm_side_client = 0,
+    shm_side_server = 1
+};
+
+#define PEER_SIDE(_side) (1 - (_side))
+
+/* The ring produced to by a particular side is at the index of
+   that side. */
+struct shm_ctl
+{
+    uint32_t closed[2];
+    struct msg_ring rings[2];
+};
+
+struct shm_hello
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+};
+
+enum conn_state {
+    conn_state_none,
+    conn_state_initialized,
+    conn_state_handshaking,
+    conn_state_ready,
+    conn_state_bad
+};
+
+struct shm_socket
+{
+    int fd;
+    struct epoll_reg fd_reg;
+
+    char laddr[XCM_ADDR_MAX+1];
+
+    struct {
+	enum conn_state state;
+
+	int badness_reason;
+
+	enum shm_side side;
+
+	void *area;
+	size_t area_size;
+	uint32_t ring_size;
+
+	struct shm_ctl *ctl;
+	struct msg_ring *tx_ring;
+	uint8_t *tx_data;
+	struct msg_ring *rx_ring;
+	uint8_t *rx_data;
+
+	bool peer_closed;
+
+	/* indexed by side */
+	int wake_fds[2];
+
+	struct epoll_reg wake_reg;
+	struct epoll_reg active_fd_reg;
+
+	char raddr[XCM_ADDR_MAX+1];
+    } conn;
+};
+
+#define TOSHM(s) XCM_TP_GETPRIV(s, struct shm_socket)
+
+#define SHM_SET_STATE(_s, _state)		\
+    TP_SET_STATE(_s, TOSHM(_s), _state)
+
+static int shm_init(struct xcm_socket *s);
+static int shm_connect(struct xcm_socket *s, const char *remote_addr);
+static int shm_server(struct xcm_socket *s, const char *local_addr);
+static int shm_close(struct xcm_socket *s);
+static void shm_cleanup(struct xcm_socket *s);
+static int shm_accept(struct xcm_socket *conn_s, struct xcm_socket *server_s);
+static int shm_send(struct xcm_socket *s, const void *buf, size_t len);
+static int shm_receive(struct xcm_socket *s, void *buf, size_t capacity);
+static void shm_update(struct xcm_socket *s);
+static int shm_finish(struct xcm_socket *s);
+static const char *shm_get_remote_addr(struct xcm_socket *conn_s,
+				       bool suppress_tracing);
+static const char *shm_get_local_addr(struct xcm_socket *s,
+				      bool suppress_tracing);
+static size_t shm_max_msg(struct xcm_socket *conn_s);
+static void shm_get_attrs(struct xcm_socket *s,
+			  const struct xcm_tp_attr **attr_list,
+			  size_t *attr_list_len);
+static size_t shm_priv_size(enum xcm_socket_type type);
+
+static struct xcm_tp_ops shm_ops = {
+    .init = shm_init,
+    .connect = shm_connect,
+    .server = shm_server,
+    .close = shm_close,
+    .cleanup = shm_cleanup,
+    .accept = shm_accept,
+    .send = shm_send,
+    .receive = shm_receive,
+    .update = shm_update,
+    .finish = shm_finish,
+    .get_remote_addr = shm_get_remote_addr,
+    .get_local_addr = shm_get_local_addr,
+    .max_msg = shm_max_msg,
+    .get_attrs = shm_get_attrs,
+    .priv_size = shm_priv_size
+};
+
+static void reg(void) __attribute__((constructor));
+static void reg(void)
+{
+    xcm_tp_register(XCM_SHM_PROTO, &shm_ops);
+}
+
+static size_t shm_priv_size(enum xcm_socket_type type)
+{
+    return sizeof(struct shm_socket);
+}
+
+static const char *state_name(enum conn_state state)
+{
+    switch (state)
+    {
+    case conn_state_none: return "none";
+    case conn_state_initialized: return "initialized";
+    case conn_state_handshaking: return "handshaking";
+    case conn_state_ready: return "ready";
+    case conn_state_bad: return "bad";
+    default: return "unknown";
+    }
+}
+
+static void wake(int fd)
+{
+    uint64_t value = 1;
+    UT_PROTECT_ERRNO(write(fd, &value, sizeof(value)));
+}
+
+static void drain(int fd)
+{
+    uint64_t value;
+    UT_PROTECT_ERRNO(read(fd, &value, sizeof(value)));
+}
+
+static void wake_peer(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    wake(ss->conn.wake_fds[PEER_SIDE(ss->conn.side)]);
+}
+
+static bool is_peer_closed(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    if (ss->conn.peer_closed)
+	return true;
+
+    if (__atomic_load_n(&ss->conn.ctl->closed[PEER_SIDE(ss->conn.side)],
+			__ATOMIC_ACQUIRE))
+	ss->conn.peer_closed = true;
+
+    return ss->conn.peer_closed;
+}
+
+/* The UNIX domain socket only carries the handshake, so if it becomes
+   readable after the handshake has completed, the peer process has
+   gone away without closing the XCM connection. Its readiness is
+   checked in the same system call as is used to find out if there is
+   any wakeup to consume, so peer liveness checking adds no overhead
+   to the data path. */
+static void drain_and_check_peer(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    struct pollfd pfds[] = {
+	{ .fd = ss->conn.wake_fds[ss->conn.side], .events = POLLIN },
+	{ .fd = ss->fd, .events = POLLIN }
+    };
+
+    int rc;
+    UT_PROTECT_ERRNO(rc = poll(pfds, UT_ARRAY_LEN(pfds), 0));
+
+    if (rc <= 0)
+	return;
+
+    if (pfds[0].revents)
+	drain(ss->conn.wake_fds[ss->conn.side]);
+
+    if (pfds[1].revents)
+	ss->conn.peer_closed = true;
+}
+
+/* Used by the data path, which otherwise wouldn't notice a dead peer
+   until the next update. Only called in case the ring is empty (or
+   full), so a connection with traffic flowing isn't burdened with
+   any extra system call. */
+static bool is_peer_gone(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    struct pollfd pfd = {
+	.fd = ss->fd,
+	.events = POLLIN
+    };
+
+    int rc;
+    UT_PROTECT_ERRNO(rc = poll(&pfd, 1, 0));
+
+    if (rc > 0)
+	ss->conn.peer_closed = true;
+
+    return ss->conn.peer_closed;
+}
+
+static int shm_init(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    ss->fd = -1;
+    epoll_reg_init(&ss->fd_reg, s->epoll_fd, -1, s);
+
+    if (s->type == xcm_socket_type_conn) {
+	ss->conn.state = conn_state_initialized;
+
+	ss->conn.wake_fds[shm_side_client] = -1;
+	ss->conn.wake_fds[shm_side_server] = -1;
+
+	int active_fd = active_fd_get();
+	if (active_fd < 0)
+	    return -1;
+
+	epoll_reg_init(&ss->conn.active_fd_reg, s->epoll_fd, active_fd, s);
+	epoll_reg_init(&ss->conn.wake_reg, s->epoll_fd, -1, s);
+    }
+
+    return 0;
+}
+
+static void set_fd(struct xcm_socket *s, int fd)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    ut_assert(ss->fd == -1);
+
+    ss->fd = fd;
+
+    epoll_reg_set_fd(&ss->fd_reg, fd);
+}
+
+static int create_socket(struct xcm_socket *s)
+{
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+
+    if (fd < 0) {
+	LOG_SOCKET_CREATION_FAILED(errno);
+	return -1;
+    }
+
+    set_fd(s, fd);
+
+    return 0;
+}
+
+static socklen_t set_abstract_addr(struct sockaddr_un *addr, const char *name)
+{
+    size_t name_len = strlen(SHM_NAME_PREFIX) + strlen(name);
+
+    addr->sun_path[0] = '\0';
+    memcpy(addr->sun_path + 1, SHM_NAME_PREFIX, strlen(SHM_NAME_PREFIX));
+    memcpy(addr->sun_path + 1 + strlen(SHM_NAME_PREFIX), name, strlen(name));
+
+    return offsetof(struct sockaddr_un, sun_path) + 1 + name_len;
+}
+
+static void map_rings(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+    enum shm_side side = ss->conn.side;
+    enum shm_side peer_side = PEER_SIDE(side);
+    uint8_t *rings_data = (uint8_t *)ss->conn.area + SHM_CTL_SIZE;
+
+    ss->conn.ctl = ss->conn.area;
+
+    ss->conn.tx_ring = &ss->conn.ctl->rings[side];
+    ss->conn.tx_data = rings_data + side * ss->conn.ring_size;
+
+    ss->conn.rx_ring = &ss->conn.ctl->rings[peer_side];
+    ss->conn.rx_data = rings_data + peer_side * ss->conn.ring_size;
+
+    epoll_reg_set_fd(&ss->conn.wake_reg, ss->conn.wake_fds[side]);
+}
+
+static size_t area_size(uint32_t ring_size)
+{
+    return SHM_CTL_SIZE + 2 * (size_t)ring_size;
+}
+
+static int area_create(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    ss->conn.ring_size = SHM_RING_SIZE;
+    ss->conn.area_size = area_size(ss->conn.ring_size);
+
+    int mem_fd = memfd_create("xcm-shm", MFD_CLOEXEC);
+    if (mem_fd < 0) {
+	LOG_SHM_AREA_FAILED(s, "create", errno);
+	return -1;
+    }
+
+    if (ftruncate(mem_fd, ss->conn.area_size) < 0) {
+	LOG_SHM_AREA_FAILED(s, "resize", errno);
+	goto err_close;
+    }
+
+    ss->conn.area = mmap(NULL, ss->conn.area_size, PROT_READ|PROT_WRITE,
+			 MAP_SHARED, mem_fd, 0);
+    if (ss->conn.area == MAP_FAILED) {
+	ss->conn.area = NULL;
+	LOG_SHM_AREA_FAILED(s, "map", errno);
+	goto err_close;
+    }
+
+    int i;
+    for (i = 0; i < 2; i++) {
+	ss->conn.wake_fds[i] = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (ss->conn.wake_fds[i] < 0)
+	    goto err_close;
+    }
+
+    LOG_SHM_AREA_CREATED(s, ss->conn.area_size);
+
+    return mem_fd;
+
+err_close:
+    UT_PROTECT_ERRNO(close(mem_fd));
+    return -1;
+}
+
+static int send_hello(struct xcm_socket *s, int mem_fd)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    struct shm_hello hello = {
+	.magic = SHM_HELLO_MAGIC,
+	.version = SHM_HELLO_VERSION,
+	.ring_size = ss->conn.ring_size
+    };
+
+    struct iovec iov = {
+	.iov_base = &hello,
+	.iov_len = sizeof(hello)
+    };
+
+    union {
+	char buf[CMSG_SPACE(sizeof(int) * SHM_HELLO_NUM_FDS)];
+	struct cmsghdr align;
+    } control = {};
+
+    struct msghdr msg = {
+	.msg_iov = &iov,
+	.msg_iovlen = 1,
+	.msg_control = control.buf,
+	.msg_controllen = sizeof(control.buf)
+    };
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * SHM_HELLO_NUM_FDS);
+
+    int fds[SHM_HELLO_NUM_FDS] = {
+	mem_fd,
+	ss->conn.wake_fds[shm_side_client],
+	ss->conn.wake_fds[shm_side_server]
+    };
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(ss->fd, &msg, MSG_NOSIGNAL|MSG_DONTWAIT) < 0) {
+	LOG_SHM_HELLO_FAILED(s, errno);
+	return -1;
+    }
+
+    LOG_SHM_HELLO_SENT(s);
+
+    return 0;
+}
+
+static void close_fds(int *fds, int num_fds)
+{
+    int i;
+    for (i = 0; i < num_fds; i++)
+	UT_PROTECT_ERRNO(close(fds[i]));
+}
+
+static int receive_hello(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    struct shm_hello hello;
+
+    struct iovec iov = {
+	.iov_base = &hello,
+	.iov_len = sizeof(hello)
+    };
+
+    union {
+	char buf[CMSG_SPACE(sizeof(int) * SHM_HELLO_NUM_FDS)];
+	struct cmsghdr align;
+    } control;
+
+    struct msghdr msg = {
+	.msg_iov = &iov,
+	.msg_iovlen = 1,
+	.msg_control = control.buf,
+	.msg_controllen = sizeof(control.buf)
+    };
+
+    int rc = recvmsg(ss->fd, &msg, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+
+    if (rc < 0) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+	    LOG_SHM_HELLO_PENDING(s);
+	    errno = EAGAIN;
+	}
+	return -1;
+    } else if (rc == 0) {
+	errno = ECONNRESET;
+	return -1;
+    }
+
+    int fds[SHM_HELLO_NUM_FDS];
+    int num_fds = 0;
+    bool excess_fds = false;
+
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+	 cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+	if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+	    continue;
+
+	size_t cmsg_num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	size_t i;
+	for (i = 0; i < cmsg_num_fds; i++) {
+	    int fd;
+	    memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+
+	    if (num_fds < SHM_HELLO_NUM_FDS)
+		fds[num_fds++] = fd;
+	    else {
+		UT_PROTECT_ERRNO(close(fd));
+		excess_fds = true;
+	    }
+	}
+    }
+
+    if (rc != sizeof(hello) || (msg.msg_flags & (MSG_TRUNC|MSG_CTRUNC)) ||
+	num_fds != SHM_HELLO_NUM_FDS || excess_fds ||
+	hello.magic != SHM_HELLO_MAGIC ||
+	hello.version != SHM_HELLO_VERSION ||
+	!msg_ring_is_valid_size(hello.ring_size, SHM_MAX_MSG))
+	goto err_invalid;
+
+    int mem_fd = fds[0];
+    size_t expected_size = area_size(hello.ring_size);
+
+    struct stat st;
+    if (fstat(mem_fd, &st) < 0 || st.st_size != expected_size)
+	goto err_invalid;
+
+    ss->conn.area = mmap(NULL, expected_size, PROT_READ|PROT_WRITE,
+			 MAP_SHARED, mem_fd, 0);
+    if (ss->conn.area == MAP_FAILED) {
+	ss->conn.area = NULL;
+	LOG_SHM_AREA_FAILED(s, "map", errno);
+	UT_PROTECT_ERRNO(close_fds(fds, num_fds));
+	return -1;
+    }
+
+    close(mem_fd);
+
+    ss->conn.area_size = expected_size;
+    ss->conn.ring_size = hello.ring_size;
+    ss->conn.wake_fds[shm_side_client] = fds[1];
+    ss->conn.wake_fds[shm_side_server] = fds[2];
+
+    LOG_SHM_HELLO_RECEIVED(s, hello.ring_size);
+
+    return 0;
+
+err_invalid:
+    LOG_SHM_HELLO_INVALID(s);
+    close_fds(fds, num_fds);
+    errno = EPROTO;
+    return -1;
+}
+
+static void try_finish_handshake(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    if (receive_hello(s) < 0) {
+	if (errno != EAGAIN) {
+	    LOG_SHM_HELLO_FAILED(s, errno);
+	    ss->conn.badness_reason = errno;
+	    SHM_SET_STATE(s, conn_state_bad);
+	}
+	return;
+    }
+
+    map_rings(s);
+
+    SHM_SET_STATE(s, conn_state_ready);
+
+    LOG_SHM_CONN_ESTABLISHED(s, ss->fd);
+}
+
+static void deinit(struct xcm_socket *s, bool owner)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    epoll_reg_reset(&ss->fd_reg);
+
+    if (s->type == xcm_socket_type_conn) {
+	epoll_reg_reset(&ss->conn.wake_reg);
+	epoll_reg_reset(&ss->conn.active_fd_reg);
+	active_fd_put();
+
+	if (ss->conn.area != NULL) {
+	    if (owner && ss->conn.state == conn_state_ready) {
+		__atomic_store_n(&ss->conn.ctl->closed[ss->conn.side], 1,
+				 __ATOMIC_RELEASE);
+		wake_peer(s);
+	    }
+	    munmap(ss->conn.area, ss->conn.area_size);
+	    ss->conn.area = NULL;
+	}
+
+	int i;
+	for (i = 0; i < 2; i++)
+	    if (ss->conn.wake_fds[i] >= 0) {
+		UT_PROTECT_ERRNO(close(ss->conn.wake_fds[i]));
+		ss->conn.wake_fds[i] = -1;
+	    }
+    }
+}
+
+static int do_close(struct xcm_socket *s, bool owner)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    deinit(s, owner);
+
+    if (ss->fd < 0)
+	return 0;
+
+    return close(ss->fd);
+}
+
+static int shm_connect(struct xcm_socket *s, const char *remote_addr)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    LOG_CONN_REQ(remote_addr);
+
+    char name[SHM_NAME_MAX+1];
+
+    if (xcm_addr_parse_shm(remote_addr, name, sizeof(name)) < 0) {
+	LOG_ADDR_PARSE_ERR(remote_addr, errno);
+	errno = EINVAL;
+	goto err_deinit;
+    }
+
+    if (create_socket(s) < 0)
+	goto err_deinit;
+
+    if (ut_set_blocking(ss->fd, false) < 0) {
+	LOG_SET_BLOCKING_FAILED_FD(s, errno);
+	goto err_close;
+    }
+
+    /* autobind, to give the connection a local address */
+    struct sockaddr_un laddr = {
+	.sun_family = AF_UNIX
+    };
+    if (bind(ss->fd, (struct sockaddr *)&laddr, sizeof(sa_family_t)) < 0) {
+	LOG_CLIENT_BIND_FAILED(s, "<autobind>", ss->fd, errno);
+	goto err_close;
+    }
+
+    struct sockaddr_un servaddr = {
+	.sun_family = AF_UNIX
+    };
+    socklen_t servaddr_len = set_abstract_addr(&servaddr, name);
+
+    if (connect(ss->fd, (struct sockaddr *)&servaddr, servaddr_len) < 0) {
+	if (errno == ENOENT)
+	    errno = ECONNREFUSED;
+	LOG_CONN_FAILED(s, errno);
+	goto err_close;
+    }
+
+    ss->conn.side = shm_side_client;
+
+    int mem_fd = area_create(s);
+    if (mem_fd < 0)
+	goto err_close;
+
+    int rc = send_hello(s, mem_fd);
+
+    UT_PROTECT_ERRNO(close(mem_fd));
+
+    if (rc < 0)
+	goto err_close;
+
+    map_rings(s);
+
+    SHM_SET_STATE(s, conn_state_ready);
+
+    LOG_SHM_CONN_ESTABLISHED(s, ss->fd);
+
+    return 0;
+
+err_close:
+    UT_PROTECT_ERRNO(do_close(s, false));
+    return -1;
+err_deinit:
+    deinit(s, false);
+    return -1;
+}
+
+static int shm_server(struct xcm_socket *s, const char *local_addr)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    LOG_SERVER_REQ(local_addr);
+
+    char name[SHM_NAME_MAX+1];
+
+    if (xcm_addr_parse_shm(local_addr, name, sizeof(name)) < 0) {
+	LOG_ADDR_PARSE_ERR(local_addr, errno);
+	errno = EINVAL;
+	goto err_deinit;
+    }
+
+    if (create_socket(s) < 0)
+	goto err_deinit;
+
+    struct sockaddr_un addr = {
+	.sun_family = AF_UNIX
+    };
+    socklen_t addr_len = set_abstract_addr(&addr, name);
+
+    if (bind(ss->fd, (struct sockaddr *)&addr, addr_len) < 0) {
+	LOG_SERVER_BIND_FAILED(errno);
+	goto err_close;
+    }
+
+    if (listen(ss->fd, SHM_CONN_BACKLOG) < 0) {
+	LOG_SERVER_LISTEN_FAILED(errno);
+	goto err_close;
+    }
+
+    if (ut_set_blocking(ss->fd, false) < 0) {
+	LOG_SET_BLOCKING_FAILED_FD(s, errno);
+	goto err_close;
+    }
+
+    LOG_SERVER_CREATED_FD(s, ss->fd);
+
+    return 0;
+
+err_close:
+    UT_PROTECT_ERRNO(do_close(s, false));
+    return -1;
+err_deinit:
+    deinit(s, false);
+    return -1;
+}
+
+static int shm_close(struct xcm_socket *s)
+{
+    LOG_CLOSING(s);
+    return do_close(s, true);
+}
+
+static void shm_cleanup(struct xcm_socket *s)
+{
+    LOG_CLEANING_UP(s);
+    (void)do_close(s, false);
+}
+
+static int shm_accept(struct xcm_socket *conn_s, struct xcm_socket *server_s)
+{
+    struct shm_socket *server_ss = TOSHM(server_s);
+    struct shm_socket *conn_ss = TOSHM(conn_s);
+
+    LOG_ACCEPT_REQ(server_s);
+
+    int conn_fd = ut_accept(server_ss->fd, NULL, NULL);
+    if (conn_fd < 0) {
+	LOG_ACCEPT_FAILED(server_s, errno);
+	goto err_deinit;
+    }
+
+    if (ut_set_blocking(conn_fd, false) < 0) {
+	LOG_SET_BLOCKING_FAILED_FD(server_s, errno);
+	UT_PROTECT_ERRNO(close(conn_fd));
+	goto err_deinit;
+    }
+
+    set_fd(conn_s, conn_fd);
+
+    conn_ss->conn.side = shm_side_server;
+
+    LOG_CONN_ACCEPTED(conn_s, conn_fd);
+
+    /* the client sends the handshake message immediately after
+       connecting, so it is likely already available */
+    SHM_SET_STATE(conn_s, conn_state_handshaking);
+
+    try_finish_handshake(conn_s);
+
+    if (conn_ss->conn.state == conn_state_bad) {
+	errno = conn_ss->conn.badness_reason;
+	goto err_close;
+    }
+
+    return 0;
+
+err_close:
+    UT_PROTECT_ERRNO(do_close(conn_s, false));
+    return -1;
+err_deinit:
+    deinit(conn_s, false);
+    return -1;
+}
+
+static int shm_send(struct xcm_socket *s, const void *buf, size_t len)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    LOG_SEND_REQ(s, buf, len);
+
+    TP_GOTO_ON_INVALID_MSG_SIZE(len, SHM_MAX_MSG, err);
+
+    if (ss->conn.state == conn_state_handshaking)
+	try_finish_handshake(s);
+
+    if (ss->conn.state == conn_state_bad) {
+	errno = ss->conn.badness_reason;
+	goto err;
+    }
+
+    if (ss->conn.state == conn_state_handshaking) {
+	errno = EAGAIN;
+	goto err;
+    }
+
+    if (is_peer_closed(s)) {
+	errno = EPIPE;
+	goto err;
+    }
+
+    if (!msg_ring_write(ss->conn.tx_ring, ss->conn.tx_data,
+			ss->conn.ring_size, buf, len)) {
+	errno = is_peer_gone(s) ? EPIPE : EAGAIN;
+	goto err;
+    }
+
+    if (msg_ring_consumer_wakeup(ss->conn.tx_ring))
+	wake_peer(s);
+
+    LOG_SEND_ACCEPTED(s, buf, len);
+    CNT_MSG_INC(&s->cnt, from_app, len);
+    LOG_LOWER_DELIVERED_COMPL(s, buf, len);
+    CNT_MSG_INC(&s->cnt, to_lower, len);
+
+    return 0;
+
+err:
+    LOG_SEND_FAILED(s, errno);
+    return -1;
+}
+
+static int try_receive(struct xcm_socket *s, void *buf, size_t capacity)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    int rc = msg_ring_read(ss->conn.rx_ring, ss->conn.rx_data,
+			   ss->conn.ring_size, SHM_MAX_MSG, buf, capacity);
+
+    if (rc < 0) {
+	LOG_SHM_INVALID_FRAME(s);
+	ss->conn.badness_reason = EPROTO;
+	SHM_SET_STATE(s, conn_state_bad);
+	errno = EPROTO;
+    } else if (rc > 0 && msg_ring_producer_wakeup(ss->conn.rx_ring))
+	wake_peer(s);
+
+    return rc;
+}
+
+static int shm_receive(struct xcm_socket *s, void *buf, size_t capacity)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    LOG_RCV_REQ(s, buf, capacity);
+
+    if (ss->conn.state == conn_state_handshaking)
+	try_finish_handshake(s);
+
+    if (ss->conn.state == conn_state_bad) {
+	errno = ss->conn.badness_reason;
+	goto err;
+    }
+
+    if (ss->conn.state == conn_state_handshaking) {
+	errno = EAGAIN;
+	goto err;
+    }
+
+    int rc = try_receive(s, buf, capacity);
+
+    /* the peer marks the connection closed only after having
+       produced its last message, so the ring needs to be checked
+       again */
+    if (rc == 0 && (is_peer_closed(s) || is_peer_gone(s)))
+	rc = try_receive(s, buf, capacity);
+
+    if (rc > 0) {
+	LOG_RCV_MSG(s, buf, rc);
+	CNT_MSG_INC(&s->cnt, from_lower, rc);
+	LOG_APP_DELIVERED(s, buf, rc);
+	CNT_MSG_INC(&s->cnt, to_app, rc);
+	return UT_MIN(rc, capacity);
+    } else if (rc == 0) {
+	if (ss->conn.peer_closed) {
+	    LOG_SHM_PEER_CLOSED(s);
+	    LOG_RCV_EOF(s);
+	    return 0;
+	}
+	errno = EAGAIN;
+    }
+
+err:
+    LOG_RCV_FAILED(s, errno);
+    return -1;
+}
+
+static bool is_conn_ready(struct xcm_socket *s, int condition)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    if (is_peer_closed(s))
+	return true;
+
+    if (condition & XCM_SO_RECEIVABLE && !msg_ring_is_empty(ss->conn.rx_ring))
+	return true;
+
+    if (condition & XCM_SO_SENDABLE &&
+	msg_ring_can_write(ss->conn.tx_ring, ss->conn.ring_size,
+			   SHM_MAX_MSG))
+	return true;
+
+    return false;
+}
+
+static void set_waiting(struct xcm_socket *s, int condition)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    if (condition & XCM_SO_RECEIVABLE)
+	msg_ring_consumer_await(ss->conn.rx_ring);
+    if (condition & XCM_SO_SENDABLE)
+	msg_ring_producer_await(ss->conn.tx_ring);
+}
+
+static void update_ready_conn(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    if (s->condition == 0) {
+	epoll_reg_reset(&ss->conn.active_fd_reg);
+	epoll_reg_reset(&ss->conn.wake_reg);
+	epoll_reg_reset(&ss->fd_reg);
+	return;
+    }
+
+    if (!is_conn_ready(s, s->condition)) {
+	/* any wakeup left over is consumed before the flags are
+	   raised, so a wakeup caused by the peer seeing the flags is
+	   never lost */
+	drain_and_check_peer(s);
+
+	set_waiting(s, s->condition);
+
+	if (!is_conn_ready(s, s->condition)) {
+	    epoll_reg_reset(&ss->conn.active_fd_reg);
+	    epoll_reg_ensure(&ss->conn.wake_reg, EPOLLIN);
+	    epoll_reg_ensure(&ss->fd_reg, EPOLLIN);
+	    return;
+	}
+    }
+
+    /* the eventfd and socket registrations are left in place, to
+       avoid epoll_ctl() calls when going back and forth between the
+       ready and non-ready states */
+    epoll_reg_ensure(&ss->conn.active_fd_reg, EPOLLIN);
+}
+
+static void update_conn(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    switch (ss->conn.state) {
+    case conn_state_handshaking:
+	epoll_reg_ensure(&ss->fd_reg, EPOLLIN);
+	break;
+    case conn_state_ready:
+	update_ready_conn(s);
+	break;
+    case conn_state_bad:
+	epoll_reg_ensure(&ss->conn.active_fd_reg, EPOLLIN);
+	epoll_reg_reset(&ss->conn.wake_reg);
+	epoll_reg_reset(&ss->fd_reg);
+	break;
+    default:
+	ut_assert(0);
+    }
+}
+
+static void update_server(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    if (s->condition & XCM_SO_ACCEPTABLE)
+	epoll_reg_ensure(&ss->fd_reg, EPOLLIN);
+    else
+	epoll_reg_reset(&ss->fd_reg);
+}
+
+static void shm_update(struct xcm_socket *s)
+{
+    LOG_UPDATE_REQ(s, s->epoll_fd);
+
+    switch (s->type) {
+    case xcm_socket_type_conn:
+	update_conn(s);
+	break;
+    case xcm_socket_type_server:
+	update_server(s);
+	break;
+    default:
+	ut_assert(0);
+    }
+}
+
+static int shm_finish(struct xcm_socket *s)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    LOG_FINISH_REQ(s);
+
+    if (s->type == xcm_socket_type_server)
+	return 0;
+
+    if (ss->conn.state == conn_state_handshaking)
+	try_finish_handshake(s);
+
+    switch (ss->conn.state) {
+    case conn_state_handshaking:
+	LOG_FINISH_SAY_BUSY(s, state_name(ss->conn.state));
+	errno = EAGAIN;
+	return -1;
+    case conn_state_ready:
+	LOG_FINISH_SAY_FREE(s);
+	return 0;
+    case conn_state_bad:
+	errno = ss->conn.badness_reason;
+	return -1;
+    default:
+	ut_assert(0);
+	return -1;
+    }
+}
+
+static int retrieve_addr(int fd,
+			 int (*socknamefn)(int, struct sockaddr *, socklen_t *),
+			 char *buf, size_t buf_len)
+{
+    struct sockaddr_un addr;
+    socklen_t addr_len = sizeof(addr);
+
+    if (socknamefn(fd, (struct sockaddr *)&addr, &addr_len) < 0)
+	return -1;
+
+    /* skip the leading NUL of the abstract namespace */
+    ssize_t name_len = (ssize_t)addr_len -
+	(ssize_t)offsetof(struct sockaddr_un, sun_path) - 1;
+    if (name_len < 0) {
+	errno = ENOTCONN;
+	return -1;
+    }
+
+    const char *name = addr.sun_path + 1;
+    size_t prefix_len = strlen(SHM_NAME_PREFIX);
+
+    if (name_len >= prefix_len &&
+	memcmp(name, SHM_NAME_PREFIX, prefix_len) == 0) {
+	name += prefix_len;
+	name_len -= prefix_len;
+    }
+
+    char shm_name[UX_NAME_MAX+1];
+    memcpy(shm_name, name, name_len);
+    shm_name[name_len] = '\0';
+
+    return xcm_addr_make_shm(shm_name, buf, buf_len);
+}
+
+static const char *shm_get_remote_addr(struct xcm_socket *conn_s,
+				       bool suppress_tracing)
+{
+    struct shm_socket *ss = TOSHM(conn_s);
+
+    if (ss->fd < 0)
+	return NULL;
+
+    if (retrieve_addr(ss->fd, getpeername, ss->conn.raddr,
+		      sizeof(ss->conn.raddr)) < 0) {
+	if (!suppress_tracing)
+	    LOG_REMOTE_SOCKET_NAME_FAILED(conn_s, errno);
+	return NULL;
+    }
+
+    return ss->conn.raddr;
+}
+
+static const char *shm_get_local_addr(struct xcm_socket *s,
+				      bool suppress_tracing)
+{
+    struct shm_socket *ss = TOSHM(s);
+
+    if (ss->fd < 0)
+	return NULL;
+
+    if (retrieve_addr(ss->fd, getsockname, ss->laddr,
+		      sizeof(ss->laddr)) < 0) {
+	if (!suppress_tracing)
+	    LOG_LOCAL_SOCKET_NAME_FAILED(s, errno);
+	return NULL;
+    }
+
+    return ss->laddr;
+}
+
+static size_t shm_max_msg(struct xcm_socket *conn_s)
+{
+    return SHM_MAX_MSG;
+}
+
+static void shm_get_attrs(struct xcm_socket *s,
+			  const struct xcm_tp_attr **attr_list,
+			  size_t *attr_list_len)
+{
+    *attr_list_len = 0;
+}
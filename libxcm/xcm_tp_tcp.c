@@ -68,6 +68,9 @@ struct tcp_socket
 
 	    char raddr[XCM_ADDR_MAX+1];
 	} conn;
+	struct {
+	    bool fastopen;
+	} server;
     };
 };
 
@@ -96,6 +99,7 @@ static void tcp_get_attrs(struct xcm_socket *s,
 			  const struct xcm_tp_attr **attr_list,
 			  size_t *attr_list_len);
 static size_t tcp_priv_size(enum xcm_socket_type type);
+static void tcp_set_busy_poll(struct xcm_socket *s);
 
 static void try_finish_in_progress(struct xcm_socket *s);
 
@@ -115,7 +119,8 @@ static struct xcm_tp_ops tcp_ops = {
     .get_local_addr = tcp_get_local_addr,
     .max_msg = tcp_max_msg,
     .get_attrs = tcp_get_attrs,
-    .priv_size = tcp_priv_size
+    .priv_size = tcp_priv_size,
+    .set_busy_poll = tcp_set_busy_poll
 };
 
 static void reg(void) __attribute__((constructor));
@@ -237,12 +242,14 @@ static int create_socket(struct xcm_socket *s, sa_family_t family)
     struct tcp_socket *ts = TOTCP(s);
 
     if (s->type == xcm_socket_type_server &&
-	tcp_effectuate_dscp(fd) < 0)
+	tcp_effectuate_dscp(fd, XCM_IP_DSCP) < 0)
 	goto err_close;
 
-    if (s->type == xcm_socket_type_conn &&
-	tcp_opts_effectuate(&ts->conn.tcp_opts, fd) <  0)
-	goto err_close;
+    if (s->type == xcm_socket_type_conn) {
+	if (tcp_opts_effectuate(&ts->conn.tcp_opts, fd) <  0)
+	    goto err_close;
+	tp_effectuate_busy_poll(s, fd);
+    }
 
     if (ut_set_blocking(fd, false) < 0) {
 	LOG_SET_BLOCKING_FAILED_FD(s, errno);
@@ -297,6 +304,8 @@ static void begin_connect(struct xcm_socket *s)
     if (bind_local_addr(s) < 0)
 	goto err;
 
+    tcp_effectuate_fastopen_connect(&ts->conn.tcp_opts);
+
     epoll_reg_set_fd(&ts->fd_reg, ts->fd);
 
     struct sockaddr_storage servaddr;
@@ -467,6 +476,9 @@ static int tcp_server(struct xcm_socket *s, const char *local_addr)
 	goto err_close;
     }
 
+    if (ts->server.fastopen && tcp_effectuate_fastopen_server(ts->fd) < 0)
+	goto err_close;
+
     if (listen(ts->fd, TCP_CONN_BACKLOG) < 0) {
 	LOG_SERVER_LISTEN_FAILED(errno);
 	goto err_close;
@@ -542,6 +554,8 @@ static int tcp_accept(struct xcm_socket *conn_s, struct xcm_socket *server_s)
     if (tcp_opts_effectuate(&conn_ts->conn.tcp_opts, conn_fd) < 0)
 	goto err_close;
 
+    tp_effectuate_busy_poll(conn_s, conn_fd);
+
     if (ut_set_blocking(conn_fd, false) < 0) {
 	LOG_SET_BLOCKING_FAILED_FD(NULL, errno);
 	goto err_close;
@@ -586,7 +600,9 @@ static void try_send(struct xcm_socket *s)
 
 	if (rc < 0) {
 	    LOG_SEND_FAILED(s, send_errno);
-	    if (send_errno != EAGAIN) {
+	    /* EINPROGRESS means a TCP Fast Open SYN was sent, without
+	       any data */
+	    if (send_errno != EAGAIN && send_errno != EINPROGRESS) {
 		if (send_errno == EPIPE)
 		    TCP_SET_STATE(s, conn_state_closed);
 		else {
@@ -683,6 +699,7 @@ static void buffer_read(struct xcm_socket *s, int len)
     } else {
 	LOG_BUFFERED(s, rc);
 	mbuf_wire_appended(&ts->conn.receive_mbuf, rc);
+	tcp_opts_rearm_quickack(&ts->conn.tcp_opts);
     }
 }
 
@@ -956,6 +973,14 @@ static size_t tcp_max_msg(struct xcm_socket *conn_s)
     return MBUF_MSG_MAX;
 }
 
+static void tcp_set_busy_poll(struct xcm_socket *s)
+{
+    struct tcp_socket *ts = TOTCP(s);
+
+    if (s->type == xcm_socket_type_conn && ts->fd >= 0)
+	tp_set_busy_poll(s, ts->fd);
+}
+
 #define GEN_TCP_FIELD_GET(field_name)					\
     static int get_ ## field_name ## _attr(struct xcm_socket *s,	\
 					   const struct xcm_tp_attr *attr, \
@@ -969,6 +994,11 @@ GEN_TCP_FIELD_GET(rtt)
 GEN_TCP_FIELD_GET(total_retrans)
 GEN_TCP_FIELD_GET(segs_in)
 GEN_TCP_FIELD_GET(segs_out)
+GEN_TCP_FIELD_GET(cwnd)
+GEN_TCP_FIELD_GET(pacing_rate)
+GEN_TCP_FIELD_GET(delivery_rate)
+GEN_TCP_FIELD_GET(unacked)
+GEN_TCP_FIELD_GET(notsent_bytes)
 
 #define GEN_TCP_SET(attr_name, attr_type)				\
     static int set_ ## attr_name ## _attr(struct xcm_socket *s,		\
@@ -1003,8 +1033,76 @@ GEN_TCP_ACCESS(keepalive_time, int64_t)
 GEN_TCP_ACCESS(keepalive_interval, int64_t)
 GEN_TCP_ACCESS(keepalive_count, int64_t)
 GEN_TCP_ACCESS(user_timeout, int64_t)
+GEN_TCP_ACCESS(sndbuf, int64_t)
+GEN_TCP_ACCESS(rcvbuf, int64_t)
+GEN_TCP_ACCESS(notsent_lowat, int64_t)
+GEN_TCP_ACCESS(quickack, bool)
+GEN_TCP_ACCESS(dscp, int64_t)
+GEN_TCP_ACCESS(fastopen, bool)
+
+static int get_fastopen_used_attr(struct xcm_socket *s,
+				  const struct xcm_tp_attr *attr,
+				  void *value, size_t capacity)
+{
+    return tcp_get_fastopen_used_attr(TOTCP(s)->fd, value);
+}
+
+static int get_incoming_cpu_attr(struct xcm_socket *s,
+				 const struct xcm_tp_attr *attr,
+				 void *value, size_t capacity)
+{
+    return tcp_get_incoming_cpu_attr(TOTCP(s)->fd, value);
+}
+
+static int get_state_attr(struct xcm_socket *s,
+			  const struct xcm_tp_attr *attr,
+			  void *value, size_t capacity)
+{
+    return tcp_get_state_attr(TOTCP(s)->fd, value, capacity);
+}
+
+static int set_server_fastopen_attr(struct xcm_socket *s,
+				    const struct xcm_tp_attr *attr,
+				    const void *value, size_t len)
+{
+    struct tcp_socket *ts = TOTCP(s);
 
-const static struct xcm_tp_attr conn_attrs[] = {
+    /* only applicable before the socket is listening */
+    if (ts->fd >= 0) {
+	errno = EACCES;
+	return -1;
+    }
+
+    ts->server.fastopen = *((const bool *)value);
+
+    return 0;
+}
+
+static int get_server_fastopen_attr(struct xcm_socket *s,
+				    const struct xcm_tp_attr *attr,
+				    void *value, size_t capacity)
+{
+    memcpy(value, &TOTCP(s)->server.fastopen, sizeof(bool));
+
+    return sizeof(bool);
+}
+
+static int set_congestion_control_attr(struct xcm_socket *s,
+				       const struct xcm_tp_attr *attr,
+				       const void *value, size_t len)
+{
+    return tcp_set_congestion_control(&TOTCP(s)->conn.tcp_opts, value, len);
+}
+
+static int get_congestion_control_attr(struct xcm_socket *s,
+				       const struct xcm_tp_attr *attr,
+				       void *value, size_t capacity)
+{
+    return tcp_get_congestion_control(&TOTCP(s)->conn.tcp_opts, value,
+				      capacity);
+}
+
+static struct xcm_tp_attr conn_attrs[] = {
     XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_RTT, xcm_attr_type_int64,
 			get_rtt_attr),
     XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_TOTAL_RETRANS, xcm_attr_type_int64,
@@ -1023,9 +1121,51 @@ const static struct xcm_tp_attr conn_attrs[] = {
     XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_KEEPALIVE_COUNT, xcm_attr_type_int64,
 			set_keepalive_count_attr, get_keepalive_count_attr),
     XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_USER_TIMEOUT, xcm_attr_type_int64,
-			set_user_timeout_attr, get_user_timeout_attr)
+			set_user_timeout_attr, get_user_timeout_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_CWND, xcm_attr_type_int64,
+			get_cwnd_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_PACING_RATE, xcm_attr_type_int64,
+			get_pacing_rate_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_DELIVERY_RATE, xcm_attr_type_int64,
+			get_delivery_rate_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_UNACKED, xcm_attr_type_int64,
+			get_unacked_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_NOTSENT_BYTES, xcm_attr_type_int64,
+			get_notsent_bytes_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_SNDBUF, xcm_attr_type_int64,
+			set_sndbuf_attr, get_sndbuf_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_RCVBUF, xcm_attr_type_int64,
+			set_rcvbuf_attr, get_rcvbuf_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_NOTSENT_LOWAT, xcm_attr_type_int64,
+			set_notsent_lowat_attr, get_notsent_lowat_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_QUICKACK, xcm_attr_type_bool,
+			set_quickack_attr, get_quickack_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_CONGESTION_CONTROL, xcm_attr_type_str,
+			set_congestion_control_attr,
+			get_congestion_control_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_IP_DSCP, xcm_attr_type_int64,
+			set_dscp_attr, get_dscp_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_FASTOPEN, xcm_attr_type_bool,
+			set_fastopen_attr, get_fastopen_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_FASTOPEN_USED, xcm_attr_type_bool,
+			get_fastopen_used_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_INCOMING_CPU, xcm_attr_type_int64,
+			get_incoming_cpu_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_STATE, xcm_attr_type_str,
+			get_state_attr)
 };
 
+static struct xcm_tp_attr server_attrs[] = {
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_FASTOPEN, xcm_attr_type_bool,
+			set_server_fastopen_attr, get_server_fastopen_attr)
+};
+
+static void sort_attrs(void) __attribute__((constructor));
+static void sort_attrs(void)
+{
+    xcm_tp_attrs_sort(conn_attrs, UT_ARRAY_LEN(conn_attrs));
+}
+
 static void tcp_get_attrs(struct xcm_socket *s,
 			  const struct xcm_tp_attr **attr_list,
 			  size_t *attr_list_len)
@@ -1036,7 +1176,8 @@ static void tcp_get_attrs(struct xcm_socket *s,
 	*attr_list_len = UT_ARRAY_LEN(conn_attrs);
 	break;
     case xcm_socket_type_server:
-	*attr_list_len = 0;
+	*attr_list = server_attrs;
+	*attr_list_len = UT_ARRAY_LEN(server_attrs);
 	break;
     default:
 	ut_assert(0);
@@ -23,6 +23,7 @@
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -81,6 +82,7 @@ struct tls_socket
 	} conn;
 	struct {
 	    int fd;
+	    bool fastopen;
 	} server;
     };
 };
@@ -110,6 +112,8 @@ static void tls_get_attrs(struct xcm_socket* s,
 			  const struct xcm_tp_attr **attr_list,
 			  size_t *attr_list_len);
 static size_t tls_priv_size(enum xcm_socket_type type);
+static int tls_prewarm(void);
+static void tls_set_busy_poll(struct xcm_socket *s);
 
 static void try_finish_in_progress(struct xcm_socket *s);
 
@@ -129,7 +133,9 @@ const static struct xcm_tp_ops tls_ops = {
     .get_local_addr = tls_get_local_addr,
     .max_msg = tls_max_msg,
     .get_attrs = tls_get_attrs,
-    .priv_size = tls_priv_size
+    .priv_size = tls_priv_size,
+    .prewarm = tls_prewarm,
+    .set_busy_poll = tls_set_busy_poll
 };
 
 static size_t tls_priv_size(enum xcm_socket_type type)
@@ -144,21 +150,30 @@ static void init_ssl(void)
     (void)SSL_library_init();
 
     SSL_load_error_strings();
+}
 
-    /* OpenSSL BIO doesn't use MSG_NOSIGNAL when sending to sockets,
-       so to avoid having the client die from SIGPIPE on sending to
-       closed connection, we have to have to ignore on an application
-       level */
-    signal(SIGPIPE, SIG_IGN);
+/* OpenSSL is initialized on first use of the transport, rather than
+   at library load time, to spare processes never using TLS the
+   cost. Ignoring SIGPIPE is not deferred, since applications may
+   rely on it regardless of which transports they use. */
+static void lazy_init_ssl(void)
+{
+    static pthread_once_t ssl_once = PTHREAD_ONCE_INIT;
 
+    int rc = pthread_once(&ssl_once, init_ssl);
+    ut_assert(rc == 0);
 }
 
 static void reg(void) __attribute__((constructor));
 static void reg(void)
 {
-    xcm_tp_register(XCM_TLS_PROTO, &tls_ops);
+    /* OpenSSL BIO doesn't use MSG_NOSIGNAL when sending to sockets,
+       so to avoid having the client die from SIGPIPE on sending to
+       closed connection, we have to have to ignore on an application
+       level */
+    signal(SIGPIPE, SIG_IGN);
 
-    init_ssl();
+    xcm_tp_register(XCM_TLS_PROTO, &tls_ops);
 }
 
 static void assert_conn_socket(struct xcm_socket *s)
@@ -218,6 +233,8 @@ static int tls_init(struct xcm_socket *s)
 {
     struct tls_socket *ts = TOTLS(s);
 
+    lazy_init_ssl();
+
     switch (s->type) {
     case xcm_socket_type_server:
 	ts->server.fd = -1;
@@ -485,6 +502,12 @@ static void begin_connect(struct xcm_socket *s)
     if (tcp_opts_effectuate(&ts->conn.tcp_opts, conn_fd) <  0)
 	goto err;
 
+    tp_effectuate_busy_poll(s, conn_fd);
+
+    /* with a Fast Open cookie present, the connect() call completes
+       immediately, and the ClientHello is carried by the SYN */
+    tcp_effectuate_fastopen_connect(&ts->conn.tcp_opts);
+
     struct sockaddr_storage servaddr;
     tp_ip_to_sockaddr(&ts->conn.remote_host.ip, ts->conn.remote_port,
 		      (struct sockaddr*)&servaddr);
@@ -623,6 +646,20 @@ static int get_self_net_ns(struct xcm_socket *s)
     return rc;
 }
 
+static int tls_prewarm(void)
+{
+    lazy_init_ssl();
+
+    char ns[NAME_MAX];
+    if (ut_self_net_ns(ns) < 0) {
+	LOG_TLS_NET_NS_LOOKUP_FAILED(NULL, errno);
+	errno = EPROTO;
+	return -1;
+    }
+
+    return ctx_store_pin(ns, get_cert_dir());
+}
+
 static int tls_connect(struct xcm_socket *s, const char *remote_addr)
 {
     struct tls_socket *ts = TOTLS(s);
@@ -723,7 +760,7 @@ static int tls_server(struct xcm_socket *s, const char *local_addr)
 	goto err_deinit;
     }
 
-    if (tcp_effectuate_dscp(ts->server.fd) < 0)
+    if (tcp_effectuate_dscp(ts->server.fd, XCM_IP_DSCP) < 0)
 	goto err_deinit;
 
     struct sockaddr_storage addr;
@@ -734,6 +771,10 @@ static int tls_server(struct xcm_socket *s, const char *local_addr)
 	goto err_deinit;
     }
 
+    if (ts->server.fastopen &&
+	tcp_effectuate_fastopen_server(ts->server.fd) < 0)
+	goto err_deinit;
+
     if (listen(ts->server.fd, TCP_CONN_BACKLOG) < 0) {
 	LOG_SERVER_LISTEN_FAILED(errno);
 	goto err_deinit;
@@ -818,6 +859,8 @@ static int tls_accept(struct xcm_socket *conn_s, struct xcm_socket *server_s)
     if (tcp_opts_effectuate(&conn_ts->conn.tcp_opts, conn_fd) <  0)
 	goto err_close;
 
+    tp_effectuate_busy_poll(conn_s, conn_fd);
+
     if (ut_set_blocking(conn_fd, false) < 0)
 	goto err_close;
 
@@ -958,6 +1001,7 @@ static void buffer_read(struct xcm_socket *s, int len)
 	if (rc > 0) {
 	    LOG_BUFFERED(s, rc);
 	    mbuf_wire_appended(&ts->conn.receive_mbuf, rc);
+	    tcp_opts_rearm_quickack(&ts->conn.tcp_opts);
 	    len -= rc;
 	} else {
 	    handle_ssl_error(s, rc, read_errno);
@@ -1288,6 +1332,17 @@ static size_t tls_max_msg(struct xcm_socket *conn_s)
     return MBUF_MSG_MAX;
 }
 
+static void tls_set_busy_poll(struct xcm_socket *s)
+{
+    if (s->type != xcm_socket_type_conn)
+	return;
+
+    int fd = socket_fd(s);
+
+    if (fd >= 0)
+	tp_set_busy_poll(s, fd);
+}
+
 static void try_finish_in_progress(struct xcm_socket *s)
 {
     struct tls_socket *ts = TOTLS(s);
@@ -1315,6 +1370,11 @@ GEN_TCP_FIELD_GET(rtt)
 GEN_TCP_FIELD_GET(total_retrans)
 GEN_TCP_FIELD_GET(segs_in)
 GEN_TCP_FIELD_GET(segs_out)
+GEN_TCP_FIELD_GET(cwnd)
+GEN_TCP_FIELD_GET(pacing_rate)
+GEN_TCP_FIELD_GET(delivery_rate)
+GEN_TCP_FIELD_GET(unacked)
+GEN_TCP_FIELD_GET(notsent_bytes)
 
 #define GEN_TCP_SET(attr_name, attr_type)				\
     static int set_ ## attr_name ## _attr(struct xcm_socket *s,		\
@@ -1349,6 +1409,74 @@ GEN_TCP_ACCESS(keepalive_time, int64_t)
 GEN_TCP_ACCESS(keepalive_interval, int64_t)
 GEN_TCP_ACCESS(keepalive_count, int64_t)
 GEN_TCP_ACCESS(user_timeout, int64_t)
+GEN_TCP_ACCESS(sndbuf, int64_t)
+GEN_TCP_ACCESS(rcvbuf, int64_t)
+GEN_TCP_ACCESS(notsent_lowat, int64_t)
+GEN_TCP_ACCESS(quickack, bool)
+GEN_TCP_ACCESS(dscp, int64_t)
+GEN_TCP_ACCESS(fastopen, bool)
+
+static int get_fastopen_used_attr(struct xcm_socket *s,
+				  const struct xcm_tp_attr *attr,
+				  void *value, size_t capacity)
+{
+    return tcp_get_fastopen_used_attr(socket_fd(s), value);
+}
+
+static int get_incoming_cpu_attr(struct xcm_socket *s,
+				 const struct xcm_tp_attr *attr,
+				 void *value, size_t capacity)
+{
+    return tcp_get_incoming_cpu_attr(socket_fd(s), value);
+}
+
+static int get_state_attr(struct xcm_socket *s,
+			  const struct xcm_tp_attr *attr,
+			  void *value, size_t capacity)
+{
+    return tcp_get_state_attr(socket_fd(s), value, capacity);
+}
+
+static int set_server_fastopen_attr(struct xcm_socket *s,
+				    const struct xcm_tp_attr *attr,
+				    const void *value, size_t len)
+{
+    struct tls_socket *ts = TOTLS(s);
+
+    /* only applicable before the socket is listening */
+    if (ts->server.fd >= 0) {
+	errno = EACCES;
+	return -1;
+    }
+
+    ts->server.fastopen = *((const bool *)value);
+
+    return 0;
+}
+
+static int get_server_fastopen_attr(struct xcm_socket *s,
+				    const struct xcm_tp_attr *attr,
+				    void *value, size_t capacity)
+{
+    memcpy(value, &TOTLS(s)->server.fastopen, sizeof(bool));
+
+    return sizeof(bool);
+}
+
+static int set_congestion_control_attr(struct xcm_socket *s,
+				       const struct xcm_tp_attr *attr,
+				       const void *value, size_t len)
+{
+    return tcp_set_congestion_control(&TOTLS(s)->conn.tcp_opts, value, len);
+}
+
+static int get_congestion_control_attr(struct xcm_socket *s,
+				       const struct xcm_tp_attr *attr,
+				       void *value, size_t capacity)
+{
+    return tcp_get_congestion_control(&TOTLS(s)->conn.tcp_opts, value,
+				      capacity);
+}
 
 static int get_peer_subject_key_id(struct xcm_socket *s,
 				   const struct xcm_tp_attr *attr,
@@ -1405,9 +1533,51 @@ static struct xcm_tp_attr conn_attrs[] = {
     XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_KEEPALIVE_COUNT, xcm_attr_type_int64,
 			set_keepalive_count_attr, get_keepalive_count_attr),
     XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_USER_TIMEOUT, xcm_attr_type_int64,
-			set_user_timeout_attr, get_user_timeout_attr)
+			set_user_timeout_attr, get_user_timeout_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_CWND, xcm_attr_type_int64,
+			get_cwnd_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_PACING_RATE, xcm_attr_type_int64,
+			get_pacing_rate_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_DELIVERY_RATE, xcm_attr_type_int64,
+			get_delivery_rate_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_UNACKED, xcm_attr_type_int64,
+			get_unacked_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_NOTSENT_BYTES, xcm_attr_type_int64,
+			get_notsent_bytes_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_SNDBUF, xcm_attr_type_int64,
+			set_sndbuf_attr, get_sndbuf_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_RCVBUF, xcm_attr_type_int64,
+			set_rcvbuf_attr, get_rcvbuf_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_NOTSENT_LOWAT, xcm_attr_type_int64,
+			set_notsent_lowat_attr, get_notsent_lowat_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_QUICKACK, xcm_attr_type_bool,
+			set_quickack_attr, get_quickack_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_CONGESTION_CONTROL, xcm_attr_type_str,
+			set_congestion_control_attr,
+			get_congestion_control_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_IP_DSCP, xcm_attr_type_int64,
+			set_dscp_attr, get_dscp_attr),
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_FASTOPEN, xcm_attr_type_bool,
+			set_fastopen_attr, get_fastopen_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_FASTOPEN_USED, xcm_attr_type_bool,
+			get_fastopen_used_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_INCOMING_CPU, xcm_attr_type_int64,
+			get_incoming_cpu_attr),
+    XCM_TP_DECL_RO_ATTR(XCM_ATTR_TCP_STATE, xcm_attr_type_str,
+			get_state_attr)
+};
+
+static struct xcm_tp_attr server_attrs[] = {
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_TCP_FASTOPEN, xcm_attr_type_bool,
+			set_server_fastopen_attr, get_server_fastopen_attr)
 };
 
+static void sort_attrs(void) __attribute__((constructor));
+static void sort_attrs(void)
+{
+    xcm_tp_attrs_sort(conn_attrs, UT_ARRAY_LEN(conn_attrs));
+}
+
 static void tls_get_attrs(struct xcm_socket* s,
 			  const struct xcm_tp_attr **attr_list,
 			  size_t *attr_list_len)
@@ -1418,7 +1588,8 @@ static void tls_get_attrs(struct xcm_socket* s,
 	*attr_list_len = UT_ARRAY_LEN(conn_attrs);
 	break;
     case xcm_socket_type_server:
-	*attr_list_len = 0;
+	*attr_list = server_attrs;
+	*attr_list_len = UT_ARRAY_LEN(server_attrs);
 	break;
     default:
 	ut_assert(0);
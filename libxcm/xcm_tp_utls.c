@@ -72,6 +72,7 @@ static void utls_get_attrs(struct xcm_socket* s,
 			   const struct xcm_tp_attr **attr_list,
 			   size_t *attr_list_len);
 static size_t utls_priv_size(enum xcm_socket_type type);
+static int utls_prewarm(void);
 
 static struct xcm_tp_ops utls_ops = {
     .init = utls_init,
@@ -92,7 +93,8 @@ static struct xcm_tp_ops utls_ops = {
     .get_cnt = utls_get_cnt,
     .enable_ctl = utls_enable_ctl,
     .get_attrs = utls_get_attrs,
-    .priv_size = utls_priv_size
+    .priv_size = utls_priv_size,
+    .prewarm = utls_prewarm
 };
 
 static void reg(void) __attribute__((constructor));
@@ -180,6 +182,11 @@ static size_t utls_priv_size(enum xcm_socket_type type)
     return sizeof(struct utls_socket);
 }
 
+static int utls_prewarm(void)
+{
+    return tls_proto()->ops->prewarm();
+}
+
 #define PROTO_SEP_LEN (1)
 
 static void map_tls_to_ux(const char *tls_addr, char *ux_addr, size_t capacity)
@@ -619,12 +626,18 @@ static void update_attrs(struct xcm_socket *s)
 	ut_realloc(us->real_sockets, sizeof(struct xcm_socket *) * attrs_len);
     us->attrs_len = 0;
 
-    size_t i;
-    for (i = 0; i < ux_attrs_len; i++)
-	add_attr(us, &ux_attrs[i], us->ux_socket);
-
-    for (i = 0; i < tls_attrs_len; i++)
-	add_attr(us, &tls_attrs[i], us->tls_socket);
+    /* merge the sub sockets' attribute lists, which are sorted, to
+       keep the resulting list sorted as well */
+    size_t ux_idx = 0;
+    size_t tls_idx = 0;
+    while (ux_idx < ux_attrs_len || tls_idx < tls_attrs_len) {
+	if (tls_idx == tls_attrs_len ||
+	    (ux_idx < ux_attrs_len &&
+	     strcmp(ux_attrs[ux_idx].name, tls_attrs[tls_idx].name) < 0))
+	    add_attr(us, &ux_attrs[ux_idx++], us->ux_socket);
+	else
+	    add_attr(us, &tls_attrs[tls_idx++], us->tls_socket);
+    }
 }
 
 static void utls_get_attrs(struct xcm_socket *s,
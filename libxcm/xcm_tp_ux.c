@@ -3,6 +3,7 @@
  * Copyright(c) 2020 Ericsson AB
  */
 
+#include "active_fd.h"
 #include "common_tp.h"
 #include "epoll_reg.h"
 #include "log_tp.h"
@@ -11,6 +12,7 @@
 #include "xcm.h"
 #include "xcm_addr.h"
 #include "xcm_addr_limits.h"
+#include "xcm_attr_names.h"
 #include "xcm_tp.h"
 
 #include <ctype.h>
@@ -28,11 +30,48 @@
 
 #define UX_MAX_MSG (65535)
 
+/* the maximum number of messages moved in a single sendmmsg() or
+   recvmmsg() call, kept low since the message and control headers
+   are on the stack */
+#define UX_MAX_BATCH (16)
+
+/* the maximum number of messages read ahead by xcm_receive(), in
+   addition to the one asked for, on connections with the
+   "ux.read_ahead" attribute enabled */
+#define UX_READ_AHEAD_MSGS (4)
+
+/* with SO_PASSCRED enabled, every message carries credentials, in
+   addition to any file descriptors */
+#define UX_CTRL_SIZE \
+    (CMSG_SPACE(sizeof(int) * XCM_MAX_FDS) + CMSG_SPACE(sizeof(struct ucred)))
+
+union ux_ctrl
+{
+    uint8_t buf[UX_CTRL_SIZE];
+    struct cmsghdr align;
+};
+
+struct ux_read_ahead
+{
+    int lens[UX_READ_AHEAD_MSGS];
+    int fds[UX_READ_AHEAD_MSGS][XCM_MAX_FDS];
+    size_t num_fds[UX_READ_AHEAD_MSGS];
+    int next;
+    int num;
+    bool eof;
+    struct epoll_reg active_fd_reg;
+    int num_slots;
+    uint8_t msgs[][UX_MAX_MSG];
+};
+
 struct ux_socket
 {
     int fd;
     struct epoll_reg reg;
 
+    bool read_ahead_enabled;
+    struct ux_read_ahead *read_ahead;
+
     char raddr[UX_NAME_MAX+16];
     char laddr[UX_NAME_MAX+16];
 
@@ -49,6 +88,14 @@ static void ux_cleanup(struct xcm_socket *s);
 static int ux_accept(struct xcm_socket *conn_s, struct xcm_socket *server_s);
 static int ux_send(struct xcm_socket *s, const void *buf, size_t len);
 static int ux_receive(struct xcm_socket *s, void *buf, size_t capacity);
+static int ux_send_batch(struct xcm_socket *s, const struct iovec *msgs,
+			 size_t num_msgs);
+static int ux_receive_batch(struct xcm_socket *s, struct iovec *bufs,
+			    size_t num_bufs);
+static int ux_send_fds(struct xcm_socket *s, const void *buf, size_t len,
+		       const int *fds, size_t num_fds);
+static int ux_receive_fds(struct xcm_socket *s, void *buf, size_t capacity,
+			  int *fds, size_t *num_fds);
 static void ux_update(struct xcm_socket *s);
 static int ux_finish(struct xcm_socket *s);
 static const char *ux_get_remote_addr(struct xcm_socket *conn_s,
@@ -74,6 +121,10 @@ static struct xcm_tp_ops ux_ops = {
     .accept = ux_accept,
     .send = ux_send,
     .receive = ux_receive,
+    .send_batch = ux_send_batch,
+    .receive_batch = ux_receive_batch,
+    .send_fds = ux_send_fds,
+    .receive_fds = ux_receive_fds,
     .update = ux_update,
     .finish = ux_finish,
     .get_remote_addr = ux_get_remote_addr,
@@ -92,6 +143,10 @@ static struct xcm_tp_ops uxf_ops = {
     .accept = ux_accept,
     .send = ux_send,
     .receive = ux_receive,
+    .send_batch = ux_send_batch,
+    .receive_batch = ux_receive_batch,
+    .send_fds = ux_send_fds,
+    .receive_fds = ux_receive_fds,
     .update = ux_update,
     .finish = ux_finish,
     .get_remote_addr = uxf_get_remote_addr,
@@ -177,6 +232,8 @@ static int ux_init(struct xcm_socket *s)
     struct ux_socket *us = TOUX(s);
 
     us->fd = -1;
+    us->read_ahead_enabled = false;
+    us->read_ahead = NULL;
 
     return 0;
 }
@@ -242,10 +299,34 @@ static int ux_connect(struct xcm_socket *s, const char *remote_addr)
 
 #define UX_CONN_BACKLOG (32)
 
+static void close_fds(const int *fds, size_t num_fds)
+{
+    size_t i;
+    for (i = 0; i < num_fds; i++)
+	UT_PROTECT_ERRNO(close(fds[i]));
+}
+
+static void read_ahead_destroy(struct ux_socket *us)
+{
+    if (us->read_ahead != NULL) {
+	struct ux_read_ahead *ra = us->read_ahead;
+	int i;
+	for (i = ra->next; i < ra->next + ra->num; i++)
+	    close_fds(ra->fds[i], ra->num_fds[i]);
+
+	epoll_reg_reset(&us->read_ahead->active_fd_reg);
+	active_fd_put();
+	ut_free(us->read_ahead);
+	us->read_ahead = NULL;
+    }
+}
+
 static int do_close(struct xcm_socket *s, bool owner)
 {
     struct ux_socket *us = TOUX(s);
 
+    read_ahead_destroy(us);
+
     if (us->fd < 0)
 	return 0;
 
@@ -367,6 +448,14 @@ static int ux_accept(struct xcm_socket *conn_s, struct xcm_socket *server_s)
     return 0;
 }
 
+static void count_sent(struct xcm_socket *s, const void *buf, size_t len)
+{
+    LOG_SEND_ACCEPTED(s, buf, len);
+    CNT_MSG_INC(&s->cnt, from_app, len);
+    LOG_LOWER_DELIVERED_COMPL(s, buf, len);
+    CNT_MSG_INC(&s->cnt, to_lower, len);
+}
+
 static int ux_send(struct xcm_socket *s, const void *buf, size_t len)
 {
     struct ux_socket *us = TOUX(s);
@@ -382,10 +471,7 @@ static int ux_send(struct xcm_socket *s, const void *buf, size_t len)
     if (rc < 0)
 	goto err;
 
-    LOG_SEND_ACCEPTED(s, buf, len);
-    CNT_MSG_INC(&s->cnt, from_app, len);
-    LOG_LOWER_DELIVERED_COMPL(s, buf, len);
-    CNT_MSG_INC(&s->cnt, to_lower, len);
+    count_sent(s, buf, len);
 
     return 0;
 
@@ -394,19 +480,448 @@ static int ux_send(struct xcm_socket *s, const void *buf, size_t len)
     return -1;
 }
 
+static int ux_send_batch(struct xcm_socket *s, const struct iovec *msgs,
+			 size_t num_msgs)
+{
+    struct ux_socket *us = TOUX(s);
+    struct mmsghdr hdrs[UX_MAX_BATCH];
+
+    num_msgs = UT_MIN(num_msgs, UX_MAX_BATCH);
+
+    size_t i;
+    for (i = 0; i < num_msgs; i++) {
+	size_t len = msgs[i].iov_len;
+
+	LOG_SEND_REQ(s, msgs[i].iov_base, len);
+
+	TP_GOTO_ON_INVALID_MSG_SIZE(len, UX_MAX_MSG, err);
+
+	hdrs[i] = (struct mmsghdr) {
+	    .msg_hdr = {
+		.msg_iov = (struct iovec *)&msgs[i],
+		.msg_iovlen = 1
+	    }
+	};
+    }
+
+    int rc = sendmmsg(us->fd, hdrs, num_msgs, MSG_NOSIGNAL|MSG_EOR);
+
+    if (rc < 0)
+	goto err;
+
+    int j;
+    for (j = 0; j < rc; j++) {
+	ut_assert(hdrs[j].msg_len == msgs[j].iov_len);
+	count_sent(s, msgs[j].iov_base, msgs[j].iov_len);
+    }
+
+    return rc;
+
+ err:
+    LOG_SEND_FAILED(s, errno);
+    return -1;
+}
+
+static void count_received(struct xcm_socket *s, const void *buf, size_t len)
+{
+    LOG_RCV_MSG(s, buf, len);
+    CNT_MSG_INC(&s->cnt, from_lower, len);
+}
+
+static void count_delivered(struct xcm_socket *s, const void *buf, size_t len)
+{
+    LOG_APP_DELIVERED(s, buf, len);
+    CNT_MSG_INC(&s->cnt, to_app, len);
+}
+
+/* Every read-ahead slot must be able to hold a maximum-sized
+   message, so the read-ahead buffer is sized after the socket receive
+   buffer, rather than being allocated at its maximum size for every
+   connection. A socket with a receive buffer smaller than a
+   maximum-sized message gets no slots, and so no read-ahead. */
+static int read_ahead_num_slots(int fd)
+{
+    int rcvbuf;
+    socklen_t len = sizeof(rcvbuf);
+
+    int rc;
+    UT_PROTECT_ERRNO(rc = getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+				     &len));
+    if (rc < 0)
+	return 0;
+
+    return UT_MIN(rcvbuf / UX_MAX_MSG, UX_READ_AHEAD_MSGS);
+}
+
+static struct ux_read_ahead *read_ahead_get(struct xcm_socket *s)
+{
+    struct ux_socket *us = TOUX(s);
+
+    if (us->read_ahead == NULL) {
+	int active_fd = active_fd_get();
+	if (active_fd < 0)
+	    return NULL;
+
+	int num_slots = read_ahead_num_slots(us->fd);
+
+	us->read_ahead = ut_malloc(sizeof(struct ux_read_ahead) +
+				   num_slots * UX_MAX_MSG);
+	us->read_ahead->num_slots = num_slots;
+	us->read_ahead->next = 0;
+	us->read_ahead->num = 0;
+	us->read_ahead->eof = false;
+
+	epoll_reg_init(&us->read_ahead->active_fd_reg, s->epoll_fd,
+		       active_fd, s);
+    }
+
+    return us->read_ahead;
+}
+
+static bool has_read_ahead(struct ux_socket *us)
+{
+    return us->read_ahead != NULL && us->read_ahead->num > 0;
+}
+
+/* Moves the file descriptors of a received message into the
+   caller's array, closing those that don't fit. A NULL 'fds' means
+   the caller isn't interested in any descriptors. */
+static void deliver_fds(const int *msg_fds, size_t msg_num_fds,
+			int *fds, size_t *num_fds)
+{
+    size_t num_delivered = fds != NULL ? UT_MIN(msg_num_fds, *num_fds) : 0;
+
+    if (num_delivered > 0)
+	memcpy(fds, msg_fds, num_delivered * sizeof(int));
+
+    close_fds(msg_fds + num_delivered, msg_num_fds - num_delivered);
+
+    if (fds != NULL)
+	*num_fds = num_delivered;
+}
+
+static size_t extract_fds(struct msghdr *hdr, int *fds)
+{
+    size_t num_fds = 0;
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL;
+	 cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+	    continue;
+
+	size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	size_t fit = UT_MIN(n, XCM_MAX_FDS - num_fds);
+
+	memcpy(fds + num_fds, CMSG_DATA(cmsg), fit * sizeof(int));
+	num_fds += fit;
+
+	close_fds((int *)CMSG_DATA(cmsg) + fit, n - fit);
+    }
+
+    return num_fds;
+}
+
+/* Returns the (non-truncated) message length, or 0 in case the
+   remote peer closed the connection. */
+static int read_ahead_deliver(struct ux_read_ahead *ra, void *buf,
+			      size_t capacity, int *fds, size_t *num_fds)
+{
+    if (ra->num == 0) {
+	ut_assert(ra->eof);
+	if (fds != NULL)
+	    *num_fds = 0;
+	return 0;
+    }
+
+    int len = ra->lens[ra->next];
+
+    memcpy(buf, ra->msgs[ra->next], UT_MIN(len, capacity));
+
+    deliver_fds(ra->fds[ra->next], ra->num_fds[ra->next], fds, num_fds);
+
+    ra->next++;
+    ra->num--;
+
+    return len;
+}
+
+/* Receive the message asked for by the application into the
+   application buffer, and any additional messages queued in the
+   socket into the read-ahead buffer. */
+static int receive_read_ahead(struct xcm_socket *s, void *buf,
+			      size_t capacity)
+{
+    struct ux_socket *us = TOUX(s);
+
+    if (!us->read_ahead_enabled)
+	return recv(us->fd, buf, capacity, MSG_TRUNC);
+
+    struct ux_read_ahead *ra = read_ahead_get(s);
+
+    if (ra == NULL)
+	return recv(us->fd, buf, capacity, MSG_TRUNC);
+
+    struct iovec iovs[1 + UX_READ_AHEAD_MSGS];
+    struct mmsghdr hdrs[1 + UX_READ_AHEAD_MSGS];
+    union ux_ctrl ctrls[UX_READ_AHEAD_MSGS];
+
+    iovs[0] = (struct iovec) {
+	.iov_base = buf,
+	.iov_len = capacity
+    };
+
+    int i;
+    for (i = 0; i < ra->num_slots; i++)
+	iovs[1 + i] = (struct iovec) {
+	    .iov_base = ra->msgs[i],
+	    .iov_len = UX_MAX_MSG
+	};
+
+    /* any file descriptors attached to the first message are
+       discarded by the kernel, since the application asked for
+       none */
+    hdrs[0] = (struct mmsghdr) {
+	.msg_hdr = {
+	    .msg_iov = &iovs[0],
+	    .msg_iovlen = 1
+	}
+    };
+
+    for (i = 0; i < ra->num_slots; i++)
+	hdrs[1 + i] = (struct mmsghdr) {
+	    .msg_hdr = {
+		.msg_iov = &iovs[1 + i],
+		.msg_iovlen = 1,
+		.msg_control = ctrls[i].buf,
+		.msg_controllen = sizeof(ctrls[i].buf)
+	    }
+	};
+
+    int rc = recvmmsg(us->fd, hdrs, 1 + ra->num_slots,
+		      MSG_TRUNC|MSG_CMSG_CLOEXEC, NULL);
+
+    if (rc <= 0)
+	return rc;
+
+    ra->next = 0;
+    ra->num = 0;
+
+    for (i = 1; i < rc; i++) {
+	int len = hdrs[i].msg_len;
+
+	/* XCM does not allow zero-length messages, so this is the
+	   remote peer closing the connection */
+	if (len == 0) {
+	    ra->eof = true;
+	    break;
+	}
+
+	count_received(s, ra->msgs[ra->num], len);
+	ra->lens[ra->num] = len;
+	ra->num_fds[ra->num] = extract_fds(&hdrs[i].msg_hdr,
+					   ra->fds[ra->num]);
+	ra->num++;
+    }
+
+    if (ra->num > 0)
+	LOG_UX_READ_AHEAD(s, ra->num);
+
+    return hdrs[0].msg_len;
+}
+
 static int ux_receive(struct xcm_socket *s, void *buf, size_t capacity)
 {
     struct ux_socket *us = TOUX(s);
 
     LOG_RCV_REQ(s, buf, capacity);
 
-    int rc = recv(us->fd, buf, capacity, MSG_TRUNC);
+    int rc;
+
+    if (us->read_ahead != NULL &&
+	(us->read_ahead->num > 0 || us->read_ahead->eof))
+	rc = read_ahead_deliver(us->read_ahead, buf, capacity, NULL, NULL);
+    else {
+	rc = receive_read_ahead(s, buf, capacity);
+	if (rc > 0)
+	    count_received(s, buf, rc);
+    }
+
+    if (rc > 0) {
+	count_delivered(s, buf, rc);
+	return UT_MIN(rc, capacity);
+    } else if (rc == 0) {
+	LOG_RCV_EOF(s);
+	return 0;
+    } else {
+	LOG_RCV_FAILED(s, errno);
+	return -1;
+    }
+}
+
+static int ux_receive_batch(struct xcm_socket *s, struct iovec *bufs,
+			    size_t num_bufs)
+{
+    struct ux_socket *us = TOUX(s);
+
+    num_bufs = UT_MIN(num_bufs, UX_MAX_BATCH);
+
+    /* messages already read ahead must be delivered first */
+    if (has_read_ahead(us)) {
+	size_t i;
+	for (i = 0; i < num_bufs && has_read_ahead(us); i++) {
+	    int len = read_ahead_deliver(us->read_ahead, bufs[i].iov_base,
+					 bufs[i].iov_len, NULL, NULL);
+	    count_delivered(s, bufs[i].iov_base, len);
+	    bufs[i].iov_len = UT_MIN(len, bufs[i].iov_len);
+	}
+	return i;
+    }
+
+    if (us->read_ahead != NULL && us->read_ahead->eof) {
+	LOG_RCV_EOF(s);
+	return 0;
+    }
+
+    struct mmsghdr hdrs[UX_MAX_BATCH];
+    union ux_ctrl ctrls[UX_MAX_BATCH];
+
+    size_t i;
+    for (i = 0; i < num_bufs; i++) {
+	LOG_RCV_REQ(s, bufs[i].iov_base, bufs[i].iov_len);
+	hdrs[i] = (struct mmsghdr) {
+	    .msg_hdr = {
+		.msg_iov = &bufs[i],
+		.msg_iovlen = 1,
+		.msg_control = ctrls[i].buf,
+		.msg_controllen = sizeof(ctrls[i].buf)
+	    }
+	};
+    }
+
+    int rc = recvmmsg(us->fd, hdrs, num_bufs, MSG_CMSG_CLOEXEC, NULL);
+
+    if (rc < 0) {
+	LOG_RCV_FAILED(s, errno);
+	return -1;
+    }
+
+    int num_msgs;
+    for (num_msgs = 0; num_msgs < rc; num_msgs++) {
+	size_t len = hdrs[num_msgs].msg_len;
+
+	if (len == 0)
+	    break;
+
+	bufs[num_msgs].iov_len = len;
+
+	/* the batch API has no way to hand over file descriptors, so
+	   any attached to the message are closed */
+	int msg_fds[XCM_MAX_FDS];
+	size_t msg_num_fds = extract_fds(&hdrs[num_msgs].msg_hdr, msg_fds);
+	deliver_fds(msg_fds, msg_num_fds, NULL, NULL);
+
+	count_received(s, bufs[num_msgs].iov_base, len);
+	count_delivered(s, bufs[num_msgs].iov_base, len);
+    }
+
+    /* an end-of-file following some messages will be reported on
+       the next call */
+    if (num_msgs == 0)
+	LOG_RCV_EOF(s);
+
+    return num_msgs;
+}
+
+static int ux_send_fds(struct xcm_socket *s, const void *buf, size_t len,
+		       const int *fds, size_t num_fds)
+{
+    struct ux_socket *us = TOUX(s);
+
+    if (num_fds == 0)
+	return ux_send(s, buf, len);
+
+    LOG_SEND_REQ(s, buf, len);
+
+    TP_GOTO_ON_INVALID_MSG_SIZE(len, UX_MAX_MSG, err);
+
+    struct iovec iov = {
+	.iov_base = (void *)buf,
+	.iov_len = len
+    };
+
+    union ux_ctrl ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+
+    struct msghdr hdr = {
+	.msg_iov = &iov,
+	.msg_iovlen = 1,
+	.msg_control = ctrl.buf,
+	.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds)
+    };
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * num_fds);
+
+    int rc = sendmsg(us->fd, &hdr, MSG_NOSIGNAL|MSG_EOR);
+
+    if (rc < 0)
+	goto err;
+
+    ut_assert(rc == len);
+
+    count_sent(s, buf, len);
+
+    return 0;
+
+ err:
+    LOG_SEND_FAILED(s, errno);
+    return -1;
+}
+
+static int ux_receive_fds(struct xcm_socket *s, void *buf, size_t capacity,
+			  int *fds, size_t *num_fds)
+{
+    struct ux_socket *us = TOUX(s);
+
+    LOG_RCV_REQ(s, buf, capacity);
+
+    int rc;
+
+    if (us->read_ahead != NULL &&
+	(us->read_ahead->num > 0 || us->read_ahead->eof))
+	rc = read_ahead_deliver(us->read_ahead, buf, capacity, fds, num_fds);
+    else {
+	struct iovec iov = {
+	    .iov_base = buf,
+	    .iov_len = capacity
+	};
+
+	union ux_ctrl ctrl;
+
+	struct msghdr hdr = {
+	    .msg_iov = &iov,
+	    .msg_iovlen = 1,
+	    .msg_control = ctrl.buf,
+	    .msg_controllen = sizeof(ctrl.buf)
+	};
+
+	rc = recvmsg(us->fd, &hdr, MSG_TRUNC|MSG_CMSG_CLOEXEC);
+
+	if (rc > 0) {
+	    int msg_fds[XCM_MAX_FDS];
+	    size_t msg_num_fds = extract_fds(&hdr, msg_fds);
+	    deliver_fds(msg_fds, msg_num_fds, fds, num_fds);
+	    count_received(s, buf, rc);
+	} else
+	    *num_fds = 0;
+    }
 
     if (rc > 0) {
-	LOG_RCV_MSG(s, buf, rc);
-	CNT_MSG_INC(&s->cnt, from_lower, rc);
-	LOG_APP_DELIVERED(s, buf, rc);
-	CNT_MSG_INC(&s->cnt, to_app, rc);
+	count_delivered(s, buf, rc);
 	return UT_MIN(rc, capacity);
     } else if (rc == 0) {
 	LOG_RCV_EOF(s);
@@ -455,6 +970,16 @@ static void ux_update(struct xcm_socket *s)
 	epoll_reg_ensure(&us->reg, event);
     else
 	epoll_reg_reset(&us->reg);
+
+    /* messages held in the read-ahead buffer won't show up as socket
+       fd events */
+    if (us->read_ahead != NULL) {
+	struct ux_read_ahead *ra = us->read_ahead;
+	if (s->condition & XCM_SO_RECEIVABLE && (ra->num > 0 || ra->eof))
+	    epoll_reg_ensure(&ra->active_fd_reg, EPOLLIN);
+	else
+	    epoll_reg_reset(&ra->active_fd_reg);
+    }
 }
 
 static int ux_finish(struct xcm_socket *s)
@@ -564,9 +1089,44 @@ static size_t ux_max_msg(struct xcm_socket *conn_s)
     return UX_MAX_MSG;
 }
 
+static int set_read_ahead_attr(struct xcm_socket *s,
+			       const struct xcm_tp_attr *attr,
+			       const void *value, size_t len)
+{
+    struct ux_socket *us = TOUX(s);
+
+    us->read_ahead_enabled = *((const bool *)value);
+
+    /* messages already read ahead are still delivered, but an
+       empty buffer is released right away */
+    if (!us->read_ahead_enabled && us->read_ahead != NULL &&
+	us->read_ahead->num == 0 && !us->read_ahead->eof)
+	read_ahead_destroy(us);
+
+    return 0;
+}
+
+static int get_read_ahead_attr(struct xcm_socket *s,
+			       const struct xcm_tp_attr *attr,
+			       void *value, size_t capacity)
+{
+    memcpy(value, &TOUX(s)->read_ahead_enabled, sizeof(bool));
+
+    return sizeof(bool);
+}
+
+static struct xcm_tp_attr conn_attrs[] = {
+    XCM_TP_DECL_RW_ATTR(XCM_ATTR_UX_READ_AHEAD, xcm_attr_type_bool,
+			set_read_ahead_attr, get_read_ahead_attr)
+};
+
 static void ux_get_attrs(struct xcm_socket *s,
 			 const struct xcm_tp_attr **attr_list,
 			 size_t *attr_list_len)
 {
-    *attr_list_len = 0;
+    if (s->type == xcm_socket_type_conn) {
+	*attr_list = conn_attrs;
+	*attr_list_len = UT_ARRAY_LEN(conn_attrs);
+    } else
+	*attr_list_len = 0;
 }
@@ -6,6 +6,7 @@
     xcmc_list;
     xcmc_attr_get;
     xcmc_attr_get_all;
+    xcmc_dump;
 local:
     *;
 };
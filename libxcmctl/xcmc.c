@@ -12,10 +12,13 @@
 #include <dirent.h>
 #include <limits.h>
 #include <linux/un.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
 
 struct xcmc_session
 {
@@ -167,12 +170,18 @@ int xcmc_attr_get_all(struct xcmc_session *session, xcmc_attr_cb cb,
     if (recv(session->fd, &res, sizeof(res), 0) != sizeof(res))
 	return -1;
 
-    if (res.type != ctl_proto_type_get_attr_cfm) {
+    if (res.type != ctl_proto_type_get_attr_cfm &&
+	res.type != ctl_proto_type_get_all_attr_partial_cfm) {
 	errno = EPROTO;
 	return -1;
     }
     struct ctl_proto_get_all_attr_cfm *cfm = &res.get_all_attr_cfm;
 
+    if (cfm->attrs_len > CTL_PROTO_MAX_ATTRS) {
+	errno = EPROTO;
+	return -1;
+    }
+
     size_t i;
     for (i=0; i<cfm->attrs_len; i++) {
 	struct ctl_proto_attr *attr = &cfm->attrs[i];
@@ -180,5 +189,237 @@ int xcmc_attr_get_all(struct xcmc_session *session, xcmc_attr_cb cb,
 	   cb_data);
     }
 
+    return res.type == ctl_proto_type_get_all_attr_partial_cfm ? 1 : 0;
+}
+
+struct dump_target
+{
+    pid_t creator_pid;
+    int64_t sock_ref;
+};
+
+struct dump_targets
+{
+    pid_t creator_pid;
+    struct dump_target *targets;
+    size_t len;
+    size_t capacity;
+};
+
+static void add_target_cb(pid_t creator_pid, int64_t sock_ref, void *cb_data)
+{
+    struct dump_targets *t = cb_data;
+
+    if (t->creator_pid != -1 && t->creator_pid != creator_pid)
+	return;
+
+    if (t->len == t->capacity) {
+	t->capacity = t->capacity == 0 ? 64 : 2 * t->capacity;
+	t->targets = ut_realloc(t->targets,
+				t->capacity * sizeof(struct dump_target));
+    }
+
+    t->targets[t->len] = (struct dump_target) {
+	.creator_pid = creator_pid,
+	.sock_ref = sock_ref
+    };
+    t->len++;
+}
+
+#define XCMC_DUMP_MAX_INFLIGHT (64)
+
+struct dump_session
+{
+    const struct dump_target *target;
+    double deadline;
+};
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int dump_start(const struct dump_target *target)
+{
+    char ctl_dir[PATH_MAX];
+    ctl_get_dir(ctl_dir, sizeof(ctl_dir));
+
+    struct sockaddr_un addr = {
+	.sun_family = AF_UNIX
+    };
+
+    ctl_derive_path(ctl_dir, target->creator_pid, target->sock_ref,
+		    addr.sun_path, sizeof(addr.sun_path));
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_NONBLOCK, 0);
+    if (fd < 0)
+	return -1;
+
+    struct ctl_proto_msg req = {
+	.type = ctl_proto_type_dump_req
+    };
+
+    /* a UNIX domain socket connect() either completes immediately, or
+       fails (e.g., with EAGAIN in case the server backlog is full) */
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+	send(fd, &req, CTL_PROTO_DUMP_REQ_SIZE, 0) !=
+	CTL_PROTO_DUMP_REQ_SIZE) {
+	UT_PROTECT_ERRNO(close(fd));
+	return -1;
+    }
+
+    return fd;
+}
+
+static int dump_finish(int fd, const struct dump_target *target,
+		       xcmc_dump_cb cb, void *cb_data)
+{
+    /* the response is variable-length, and its size is learned by
+       peeking at it */
+    ssize_t len = recv(fd, NULL, 0, MSG_PEEK|MSG_TRUNC);
+
+    if (len < 0)
+	return -1;
+
+    uint8_t *res = ut_malloc(UT_MAX(len, 1));
+
+    if (recv(fd, res, len, 0) != len)
+	goto err;
+
+    struct ctl_proto_dump_cfm cfm;
+
+    if ((size_t)len < sizeof(cfm))
+	goto err_proto;
+
+    memcpy(&cfm, res, sizeof(cfm));
+
+    if (cfm.type != ctl_proto_type_dump_cfm ||
+	(size_t)len != CTL_PROTO_DUMP_CFM_SIZE(cfm.records_len))
+	goto err_proto;
+
+    const uint8_t *records = res + sizeof(cfm);
+
+    size_t offset = 0;
+    while (offset < cfm.records_len) {
+	struct ctl_proto_dump_record record;
+
+	if (offset + sizeof(record) > cfm.records_len)
+	    goto err_proto;
+
+	memcpy(&record, records + offset, sizeof(record));
+	offset += sizeof(record);
+
+	if (record.name_len >= XCM_ATTR_NAME_MAX ||
+	    record.value_len > XCM_ATTR_VALUE_MAX ||
+	    offset + record.name_len + record.value_len > cfm.records_len)
+	    goto err_proto;
+
+	char name[XCM_ATTR_NAME_MAX];
+	memcpy(name, records + offset, record.name_len);
+	name[record.name_len] = '\0';
+	offset += record.name_len;
+
+	/* copy to get a properly aligned value */
+	uint8_t value[XCM_ATTR_VALUE_MAX];
+	memcpy(value, records + offset, record.value_len);
+	offset += record.value_len;
+
+	cb(target->creator_pid, target->sock_ref, name, record.value_type,
+	   value, record.value_len, cb_data);
+    }
+
+    ut_free(res);
+
     return 0;
+
+ err_proto:
+    errno = EPROTO;
+ err:
+    ut_free(res);
+    return -1;
+}
+
+int xcmc_dump(pid_t creator_pid, xcmc_dump_cb cb, void *cb_data)
+{
+    struct dump_targets t = {
+	.creator_pid = creator_pid
+    };
+
+    if (xcmc_list(add_target_cb, &t) < 0)
+	return -1;
+
+    struct pollfd pfds[XCMC_DUMP_MAX_INFLIGHT];
+    struct dump_session sessions[XCMC_DUMP_MAX_INFLIGHT];
+    size_t num_inflight = 0;
+    size_t next_target = 0;
+    int num_dumped = 0;
+
+    while (next_target < t.len || num_inflight > 0) {
+	while (next_target < t.len &&
+	       num_inflight < XCMC_DUMP_MAX_INFLIGHT) {
+	    const struct dump_target *target = &t.targets[next_target++];
+
+	    /* sockets may be closed at any time, and processes may have
+	       crashed, so failure to reach a socket is not an error */
+	    int fd = dump_start(target);
+	    if (fd < 0)
+		continue;
+
+	    pfds[num_inflight] = (struct pollfd) {
+		.fd = fd,
+		.events = POLLIN
+	    };
+	    sessions[num_inflight] = (struct dump_session) {
+		.target = target,
+		.deadline = get_time() + XCMC_TMO_US / 1e6
+	    };
+	    num_inflight++;
+	}
+
+	if (num_inflight == 0)
+	    break;
+
+	double now = get_time();
+	double first_deadline = sessions[0].deadline;
+	size_t i;
+	for (i = 1; i < num_inflight; i++)
+	    first_deadline = UT_MIN(first_deadline, sessions[i].deadline);
+
+	int tmo = first_deadline > now ? (first_deadline - now) * 1e3 + 1 : 0;
+
+	if (poll(pfds, num_inflight, tmo) < 0 && errno != EINTR) {
+	    UT_SAVE_ERRNO;
+	    for (i = 0; i < num_inflight; i++)
+		close(pfds[i].fd);
+	    ut_free(t.targets);
+	    UT_RESTORE_ERRNO_DC;
+	    return -1;
+	}
+
+	now = get_time();
+	for (i = 0; i < num_inflight; ) {
+	    bool done;
+	    if (pfds[i].revents != 0) {
+		if (dump_finish(pfds[i].fd, sessions[i].target, cb,
+				cb_data) == 0)
+		    num_dumped++;
+		done = true;
+	    } else
+		done = now >= sessions[i].deadline;
+
+	    if (done) {
+		close(pfds[i].fd);
+		num_inflight--;
+		pfds[i] = pfds[num_inflight];
+		sessions[i] = sessions[num_inflight];
+	    } else
+		i++;
+	}
+    }
+
+    ut_free(t.targets);
+
+    return num_dumped;
 }
@@ -0,0 +1,39 @@
+# This file holds a list of symbols to be exported in the shared library
+{
+ global:
+    xcm_loop_create;
+    xcm_loop_destroy;
+    xcm_loop_add;
+    xcm_loop_remove;
+    xcm_loop_detach;
+    xcm_loop_socket;
+    xcm_loop_send;
+    xcm_loop_timer_add;
+    xcm_loop_timer_cancel;
+    xcm_loop_run_once;
+    xcm_loop_run;
+    xcm_loop_stop;
+    xcm_rt_create;
+    xcm_rt_destroy;
+    xcm_rt_num_workers;
+    xcm_rt_add_server;
+    xcm_rt_add_conn;
+    xcm_rt_migrate;
+    xcm_rt_current_worker;
+    xcm_rt_worker_load;
+    xcm_rt_worker_cpu;
+    xcm_mux_create;
+    xcm_mux_destroy;
+    xcm_mux_open;
+    xcm_mux_close;
+    xcm_mux_send;
+    xcm_mux_chan_mux;
+    xcm_mux_chan_set_user;
+    xcm_mux_num_chans;
+    xcm_mux_pool_create;
+    xcm_mux_pool_destroy;
+    xcm_mux_pool_open;
+    xcm_mux_pool_num_conns;
+local:
+    *;
+};
@@ -0,0 +1,28 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef LOOP_INT_H
+#define LOOP_INT_H
+
+#include "xcm_loop.h"
+
+/* Event loop functionality internal to libxcmloop */
+
+typedef void (*loop_fd_cb)(struct xcm_loop *loop, int fd, void *user);
+
+/* Watch a plain, non-XCM, fd for readability. The fd remains owned
+   by the caller, also after the registration is removed with
+   xcm_loop_remove(). */
+struct xcm_loop_sock *loop_add_fd(struct xcm_loop *loop, int fd,
+				  loop_fd_cb cb, void *user);
+
+/* The number of connection sockets registered. May be called from
+   any thread. */
+size_t loop_num_conns(struct xcm_loop *loop);
+
+const struct xcm_loop_cbs *loop_sock_cbs(struct xcm_loop_sock *lsock);
+void *loop_sock_user(struct xcm_loop_sock *lsock);
+
+#endif
@@ -0,0 +1,576 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "xcm_loop.h"
+
+#include "loop_int.h"
+#include "util.h"
+#include "xcm_attr.h"
+#include "xcm_attr_names.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/queue.h>
+#include <unistd.h>
+
+#define MAX_EVENTS (64)
+
+/* limits the number of accepted connections, or received messages,
+   per socket and dispatch, to prevent a single busy socket from
+   starving the others */
+#define MAX_OPS_PER_DISPATCH (16)
+
+#define DEFAULT_MSG_BUF_SIZE (65535)
+
+/* one millisecond ticks */
+#define WHEEL_SLOTS (512)
+
+enum lsock_type {
+    lsock_type_server,
+    lsock_type_conn,
+    lsock_type_fd
+};
+
+struct xcm_loop_sock
+{
+    struct xcm_loop *loop;
+    enum lsock_type type;
+    struct xcm_socket *socket;
+    int fd;
+    loop_fd_cb fd_cb;
+    struct xcm_loop_cbs cbs;
+    void *user;
+    bool want_writable;
+    int condition;
+    bool removed;
+    LIST_ENTRY(xcm_loop_sock) elem;
+};
+
+LIST_HEAD(lsock_list, xcm_loop_sock);
+
+struct xcm_loop_timer
+{
+    int64_t expiry;
+    xcm_loop_timer_cb cb;
+    void *user;
+    struct xcm_loop *loop;
+    LIST_ENTRY(xcm_loop_timer) elem;
+};
+
+LIST_HEAD(timer_list, xcm_loop_timer);
+
+struct xcm_loop
+{
+    int epoll_fd;
+
+    struct lsock_list lsocks;
+    /* removed sockets are kept until the end of the current
+       iteration, since they may still be referenced by pending
+       epoll events */
+    struct lsock_list removed_lsocks;
+
+    /* read by other threads, see loop_num_conns() */
+    size_t num_conns;
+
+    double start_time;
+    int64_t tick;
+    struct timer_list wheel[WHEEL_SLOTS];
+    size_t num_timers;
+
+    uint8_t *msg_buf;
+    size_t msg_buf_size;
+
+    bool stopped;
+};
+
+static int64_t current_tick(struct xcm_loop *loop)
+{
+    return (ut_ftime() - loop->start_time) * 1e3;
+}
+
+struct xcm_loop *xcm_loop_create(void)
+{
+    int epoll_fd = epoll_create1(0);
+
+    if (epoll_fd < 0)
+	return NULL;
+
+    struct xcm_loop *loop = ut_calloc(sizeof(struct xcm_loop));
+
+    loop->epoll_fd = epoll_fd;
+
+    LIST_INIT(&loop->lsocks);
+    LIST_INIT(&loop->removed_lsocks);
+
+    loop->start_time = ut_ftime();
+
+    size_t i;
+    for (i = 0; i < WHEEL_SLOTS; i++)
+	LIST_INIT(&loop->wheel[i]);
+
+    loop->msg_buf_size = DEFAULT_MSG_BUF_SIZE;
+    loop->msg_buf = ut_malloc(loop->msg_buf_size);
+
+    return loop;
+}
+
+static void purge_removed(struct xcm_loop *loop)
+{
+    struct xcm_loop_sock *lsock;
+
+    while ((lsock = LIST_FIRST(&loop->removed_lsocks)) != NULL) {
+	LIST_REMOVE(lsock, elem);
+	ut_free(lsock);
+    }
+}
+
+void xcm_loop_destroy(struct xcm_loop *loop)
+{
+    if (loop == NULL)
+	return;
+
+    struct xcm_loop_sock *lsock;
+    while ((lsock = LIST_FIRST(&loop->lsocks)) != NULL)
+	xcm_loop_remove(lsock);
+
+    purge_removed(loop);
+
+    size_t i;
+    for (i = 0; i < WHEEL_SLOTS; i++) {
+	struct xcm_loop_timer *timer;
+	while ((timer = LIST_FIRST(&loop->wheel[i])) != NULL)
+	    xcm_loop_timer_cancel(timer);
+    }
+
+    UT_PROTECT_ERRNO(close(loop->epoll_fd));
+    ut_free(loop->msg_buf);
+    ut_free(loop);
+}
+
+static void update_condition(struct xcm_loop_sock *lsock)
+{
+    int condition;
+
+    if (lsock->type == lsock_type_server)
+	condition = XCM_SO_ACCEPTABLE;
+    else {
+	condition = XCM_SO_RECEIVABLE;
+	if (lsock->want_writable)
+	    condition |= XCM_SO_SENDABLE;
+    }
+
+    if (condition != lsock->condition) {
+	UT_PROTECT_ERRNO(xcm_await(lsock->socket, condition));
+	lsock->condition = condition;
+    }
+}
+
+static void ensure_msg_buf_size(struct xcm_loop *loop,
+				struct xcm_socket *conn_socket)
+{
+    int64_t max_msg_size;
+
+    if (xcm_attr_get_int64(conn_socket, XCM_ATTR_XCM_MAX_MSG_SIZE,
+			   &max_msg_size) < 0 ||
+	max_msg_size <= (int64_t)loop->msg_buf_size)
+	return;
+
+    ut_free(loop->msg_buf);
+    loop->msg_buf_size = max_msg_size;
+    loop->msg_buf = ut_malloc(loop->msg_buf_size);
+}
+
+struct xcm_loop_sock *xcm_loop_add(struct xcm_loop *loop,
+				   struct xcm_socket *socket,
+				   const struct xcm_loop_cbs *cbs,
+				   void *user)
+{
+    char type[16];
+
+    if (xcm_attr_get_str(socket, XCM_ATTR_XCM_TYPE, type,
+			 sizeof(type)) < 0)
+	return NULL;
+
+    if (xcm_set_blocking(socket, false) < 0)
+	return NULL;
+
+    int fd = xcm_fd(socket);
+    if (fd < 0)
+	return NULL;
+
+    struct xcm_loop_sock *lsock = ut_calloc(sizeof(struct xcm_loop_sock));
+
+    struct epoll_event event = {
+	.events = EPOLLIN,
+	.data.ptr = lsock
+    };
+
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+	UT_PROTECT_ERRNO(ut_free(lsock));
+	return NULL;
+    }
+
+    lsock->loop = loop;
+    lsock->type = strcmp(type, "server") == 0 ?
+	lsock_type_server : lsock_type_conn;
+    lsock->socket = socket;
+    lsock->fd = fd;
+    lsock->cbs = *cbs;
+    lsock->user = user;
+
+    if (lsock->type == lsock_type_conn) {
+	ensure_msg_buf_size(loop, socket);
+	__atomic_store_n(&loop->num_conns, loop->num_conns + 1,
+			 __ATOMIC_RELAXED);
+    }
+
+    update_condition(lsock);
+
+    LIST_INSERT_HEAD(&loop->lsocks, lsock, elem);
+
+    return lsock;
+}
+
+struct xcm_loop_sock *loop_add_fd(struct xcm_loop *loop, int fd,
+				  loop_fd_cb cb, void *user)
+{
+    struct xcm_loop_sock *lsock = ut_calloc(sizeof(struct xcm_loop_sock));
+
+    struct epoll_event event = {
+	.events = EPOLLIN,
+	.data.ptr = lsock
+    };
+
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+	UT_PROTECT_ERRNO(ut_free(lsock));
+	return NULL;
+    }
+
+    lsock->loop = loop;
+    lsock->type = lsock_type_fd;
+    lsock->fd = fd;
+    lsock->fd_cb = cb;
+    lsock->user = user;
+
+    LIST_INSERT_HEAD(&loop->lsocks, lsock, elem);
+
+    return lsock;
+}
+
+static struct xcm_socket *unregister(struct xcm_loop_sock *lsock)
+{
+    struct xcm_loop *loop = lsock->loop;
+    struct xcm_socket *socket = lsock->socket;
+
+    UT_PROTECT_ERRNO(epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, lsock->fd,
+			       NULL));
+
+    if (lsock->type == lsock_type_conn)
+	__atomic_store_n(&loop->num_conns, loop->num_conns - 1,
+			 __ATOMIC_RELAXED);
+
+    lsock->socket = NULL;
+    lsock->removed = true;
+
+    LIST_REMOVE(lsock, elem);
+    LIST_INSERT_HEAD(&loop->removed_lsocks, lsock, elem);
+
+    return socket;
+}
+
+void xcm_loop_remove(struct xcm_loop_sock *lsock)
+{
+    if (lsock->removed)
+	return;
+
+    struct xcm_socket *socket = unregister(lsock);
+
+    /* for plain fds, the fd is owned by the caller */
+    if (socket != NULL)
+	UT_PROTECT_ERRNO(xcm_close(socket));
+}
+
+struct xcm_socket *xcm_loop_detach(struct xcm_loop_sock *lsock)
+{
+    if (lsock->removed) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    return unregister(lsock);
+}
+
+size_t loop_num_conns(struct xcm_loop *loop)
+{
+    return __atomic_load_n(&loop->num_conns, __ATOMIC_RELAXED);
+}
+
+const struct xcm_loop_cbs *loop_sock_cbs(struct xcm_loop_sock *lsock)
+{
+    return &lsock->cbs;
+}
+
+void *loop_sock_user(struct xcm_loop_sock *lsock)
+{
+    return lsock->user;
+}
+
+struct xcm_socket *xcm_loop_socket(struct xcm_loop_sock *lsock)
+{
+    return lsock->socket;
+}
+
+int xcm_loop_send(struct xcm_loop_sock *lsock, const void *buf, size_t len)
+{
+    if (lsock->removed) {
+	errno = EBADF;
+	return -1;
+    }
+
+    int rc = xcm_send(lsock->socket, buf, len);
+
+    if (rc < 0 && errno == EAGAIN) {
+	lsock->want_writable = true;
+	update_condition(lsock);
+    }
+
+    return rc;
+}
+
+struct xcm_loop_timer *xcm_loop_timer_add(struct xcm_loop *loop,
+					  int64_t timeout_ms,
+					  xcm_loop_timer_cb cb, void *user)
+{
+    struct xcm_loop_timer *timer = ut_malloc(sizeof(struct xcm_loop_timer));
+
+    /* the current tick is partly over, and so the timer is rounded
+       up to the next tick, to avoid firing early */
+    int64_t expiry =
+	current_tick(loop) + 1 + UT_MAX(timeout_ms, (int64_t)0);
+
+    /* ticks up to and including loop->tick have already been
+       processed */
+    *timer = (struct xcm_loop_timer) {
+	.expiry = UT_MAX(expiry, loop->tick + 1),
+	.cb = cb,
+	.user = user,
+	.loop = loop
+    };
+
+    LIST_INSERT_HEAD(&loop->wheel[timer->expiry % WHEEL_SLOTS], timer, elem);
+    loop->num_timers++;
+
+    return timer;
+}
+
+void xcm_loop_timer_cancel(struct xcm_loop_timer *timer)
+{
+    LIST_REMOVE(timer, elem);
+    timer->loop->num_timers--;
+    ut_free(timer);
+}
+
+static int next_timer_timeout(struct xcm_loop *loop)
+{
+    if (loop->num_timers == 0)
+	return -1;
+
+    int64_t now = current_tick(loop);
+    int64_t t;
+
+    for (t = loop->tick + 1; t <= loop->tick + WHEEL_SLOTS; t++) {
+	struct xcm_loop_timer *timer;
+	LIST_FOREACH(timer, &loop->wheel[t % WHEEL_SLOTS], elem)
+	    if (timer->expiry == t)
+		return UT_MAX(t - now, (int64_t)0);
+    }
+
+    /* all timers are more than one wheel revolution away */
+    return WHEEL_SLOTS;
+}
+
+static void expire_slot(struct timer_list *slot, int64_t now,
+			struct timer_list *expired)
+{
+    struct xcm_loop_timer *timer = LIST_FIRST(slot);
+
+    while (timer != NULL) {
+	struct xcm_loop_timer *next = LIST_NEXT(timer, elem);
+
+	if (timer->expiry <= now) {
+	    LIST_REMOVE(timer, elem);
+	    LIST_INSERT_HEAD(expired, timer, elem);
+	}
+
+	timer = next;
+    }
+}
+
+static void process_timers(struct xcm_loop *loop)
+{
+    int64_t now = current_tick(loop);
+
+    if (now <= loop->tick)
+	return;
+
+    struct timer_list expired;
+    LIST_INIT(&expired);
+
+    int64_t num_ticks = UT_MIN(now - loop->tick, (int64_t)WHEEL_SLOTS);
+    int64_t t;
+    for (t = now - num_ticks + 1; t <= now; t++)
+	expire_slot(&loop->wheel[t % WHEEL_SLOTS], now, &expired);
+
+    loop->tick = now;
+
+    /* a callback may cancel another expired timer, so the list is
+       consumed one timer at a time */
+    struct xcm_loop_timer *timer;
+    while ((timer = LIST_FIRST(&expired)) != NULL) {
+	xcm_loop_timer_cb cb = timer->cb;
+	void *user = timer->user;
+
+	xcm_loop_timer_cancel(timer);
+
+	cb(loop, user);
+    }
+}
+
+static void close_conn(struct xcm_loop_sock *lsock, int reason_errno)
+{
+    if (lsock->cbs.on_close != NULL)
+	lsock->cbs.on_close(lsock, reason_errno, lsock->user);
+
+    xcm_loop_remove(lsock);
+}
+
+static void dispatch_server(struct xcm_loop_sock *lsock)
+{
+    int i;
+
+    for (i = 0; i < MAX_OPS_PER_DISPATCH && !lsock->removed; i++) {
+	struct xcm_socket *conn_socket = xcm_accept(lsock->socket);
+
+	if (conn_socket == NULL) {
+	    if (errno == EAGAIN)
+		break;
+	    /* a failed incoming connection doesn't affect the server
+	       socket */
+	    continue;
+	}
+
+	if (lsock->cbs.on_accept != NULL)
+	    lsock->cbs.on_accept(lsock, conn_socket, lsock->user);
+	else
+	    xcm_close(conn_socket);
+    }
+}
+
+/* the event may well have been caused by the socket being
+   receivable, and so the socket is probed with only the sendable
+   condition set, before the application is told it may send again */
+static bool is_writable(struct xcm_loop_sock *lsock)
+{
+    int rc;
+
+    UT_PROTECT_ERRNO(rc = xcm_await_timeout(lsock->socket,
+					    XCM_SO_SENDABLE, 0));
+    lsock->condition = XCM_SO_SENDABLE;
+
+    return rc > 0;
+}
+
+static void dispatch_conn(struct xcm_loop_sock *lsock)
+{
+    struct xcm_loop *loop = lsock->loop;
+
+    if (lsock->want_writable) {
+	bool writable = is_writable(lsock);
+
+	if (writable)
+	    lsock->want_writable = false;
+
+	update_condition(lsock);
+
+	if (writable && lsock->cbs.on_writable != NULL)
+	    lsock->cbs.on_writable(lsock, lsock->user);
+    }
+
+    int i;
+    for (i = 0; i < MAX_OPS_PER_DISPATCH && !lsock->removed; i++) {
+	int rc = xcm_receive(lsock->socket, loop->msg_buf,
+			     loop->msg_buf_size);
+
+	if (rc > 0) {
+	    if (lsock->cbs.on_message != NULL)
+		lsock->cbs.on_message(lsock, loop->msg_buf, rc, lsock->user);
+	} else if (rc == 0) {
+	    close_conn(lsock, 0);
+	} else if (errno == EAGAIN)
+	    break;
+	else
+	    close_conn(lsock, errno);
+    }
+}
+
+int xcm_loop_run_once(struct xcm_loop *loop, int timeout_ms)
+{
+    int timer_timeout = next_timer_timeout(loop);
+
+    if (timeout_ms < 0 || (timer_timeout >= 0 && timer_timeout < timeout_ms))
+	timeout_ms = timer_timeout;
+
+    struct epoll_event events[MAX_EVENTS];
+
+    int num_events = epoll_wait(loop->epoll_fd, events, MAX_EVENTS,
+				timeout_ms);
+
+    if (num_events < 0)
+	return -1;
+
+    int i;
+    for (i = 0; i < num_events; i++) {
+	struct xcm_loop_sock *lsock = events[i].data.ptr;
+
+	/* removed by a callback earlier in this batch */
+	if (lsock->removed)
+	    continue;
+
+	switch (lsock->type) {
+	case lsock_type_server:
+	    dispatch_server(lsock);
+	    break;
+	case lsock_type_conn:
+	    dispatch_conn(lsock);
+	    break;
+	case lsock_type_fd:
+	    lsock->fd_cb(loop, lsock->fd, lsock->user);
+	    break;
+	}
+    }
+
+    process_timers(loop);
+
+    purge_removed(loop);
+
+    return 0;
+}
+
+int xcm_loop_run(struct xcm_loop *loop)
+{
+    loop->stopped = false;
+
+    while (!loop->stopped)
+	if (xcm_loop_run_once(loop, -1) < 0)
+	    return -1;
+
+    return 0;
+}
+
+void xcm_loop_stop(struct xcm_loop *loop)
+{
+    loop->stopped = true;
+}
@@ -0,0 +1,821 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "xcm_mux.h"
+
+#include "util.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/queue.h>
+
+/*
+ * Every XCM message on a multiplexed connection starts with an
+ * eight-byte header:
+ *
+ * | type (1) | flags (1) | reserved (2) | channel id (4) |
+ *
+ * The channel id is in network byte order. Channel ids are
+ * allocated independently by the two ends, and a channel is
+ * identified by its id in combination with which end opened it, as
+ * signaled by the SENDER_OPENED flag.
+ *
+ * The credit message carries a four-byte payload, holding the number
+ * of messages delivered to the application since the last credit
+ * message. A message counts as delivered once the application's
+ * message callback has returned.
+ */
+
+#define HDR_SIZE (8)
+
+#define MUX_FLAG_SENDER_OPENED (1 << 0)
+
+#define MUX_WINDOW (32)
+
+#define NUM_BUCKETS (1024)
+
+enum mux_msg_type {
+    mux_msg_type_open = 1,
+    mux_msg_type_data,
+    mux_msg_type_credit,
+    mux_msg_type_close
+};
+
+struct mux_msg
+{
+    size_t len;
+    TAILQ_ENTRY(mux_msg) elem;
+    uint8_t data[];
+};
+
+TAILQ_HEAD(mux_msg_queue, mux_msg);
+
+struct xcm_mux_chan
+{
+    struct xcm_mux *mux;
+    uint32_t id;
+    bool local;
+    void *user;
+
+    int64_t send_credit;
+    int64_t num_consumed;
+    bool want_writable;
+
+    struct mux_msg_queue out;
+    bool scheduled;
+
+    /* the application has let go of the channel, but it may still
+       have messages to send */
+    bool closed;
+
+    LIST_ENTRY(xcm_mux_chan) elem;
+    LIST_ENTRY(xcm_mux_chan) bucket_elem;
+    TAILQ_ENTRY(xcm_mux_chan) sched_elem;
+};
+
+LIST_HEAD(chan_list, xcm_mux_chan);
+TAILQ_HEAD(chan_queue, xcm_mux_chan);
+
+struct xcm_mux
+{
+    struct xcm_loop *loop;
+    struct xcm_loop_sock *lsock;
+    struct xcm_mux_cbs cbs;
+    void *user;
+
+    struct xcm_mux_pool *pool;
+    char *remote_addr;
+
+    bool dead;
+    bool destroyed;
+    int depth;
+
+    /* a send failure is reported from the event loop, rather than
+       from within the API call that happened to flush */
+    struct xcm_loop_timer *fail_timer;
+    int fail_errno;
+
+    uint32_t next_chan_id;
+    size_t num_chans;
+
+    struct chan_list chans;
+    struct chan_list buckets[NUM_BUCKETS];
+
+    /* control messages are sent before any channel data */
+    struct mux_msg_queue ctl_out;
+    /* channels with messages to send */
+    struct chan_queue sched;
+
+    LIST_ENTRY(xcm_mux) pool_elem;
+};
+
+LIST_HEAD(mux_list, xcm_mux);
+
+struct xcm_mux_pool
+{
+    struct xcm_loop *loop;
+    struct xcm_mux_cbs cbs;
+    void *user;
+    struct mux_list muxes;
+};
+
+static struct mux_msg *msg_create(enum mux_msg_type type, uint8_t flags,
+				  uint32_t chan_id, const void *payload,
+				  size_t payload_len)
+{
+    struct mux_msg *msg =
+	ut_malloc(sizeof(struct mux_msg) + HDR_SIZE + payload_len);
+
+    msg->len = HDR_SIZE + payload_len;
+
+    uint32_t nchan_id = htonl(chan_id);
+
+    msg->data[0] = type;
+    msg->data[1] = flags;
+    msg->data[2] = 0;
+    msg->data[3] = 0;
+    memcpy(msg->data + 4, &nchan_id, sizeof(nchan_id));
+
+    if (payload_len > 0)
+	memcpy(msg->data + HDR_SIZE, payload, payload_len);
+
+    return msg;
+}
+
+static void msg_queue_clear(struct mux_msg_queue *queue)
+{
+    struct mux_msg *msg;
+
+    while ((msg = TAILQ_FIRST(queue)) != NULL) {
+	TAILQ_REMOVE(queue, msg, elem);
+	ut_free(msg);
+    }
+}
+
+static struct chan_list *bucket(struct xcm_mux *mux, uint32_t chan_id)
+{
+    return &mux->buckets[chan_id % NUM_BUCKETS];
+}
+
+static struct xcm_mux_chan *chan_lookup(struct xcm_mux *mux,
+					uint32_t chan_id, bool local)
+{
+    struct xcm_mux_chan *chan;
+
+    LIST_FOREACH(chan, bucket(mux, chan_id), bucket_elem)
+	if (chan->id == chan_id && chan->local == local)
+	    return chan;
+
+    return NULL;
+}
+
+static struct xcm_mux_chan *chan_create(struct xcm_mux *mux,
+					uint32_t chan_id, bool local,
+					void *user)
+{
+    struct xcm_mux_chan *chan = ut_calloc(sizeof(struct xcm_mux_chan));
+
+    chan->mux = mux;
+    chan->id = chan_id;
+    chan->local = local;
+    chan->user = user;
+    chan->send_credit = MUX_WINDOW;
+    TAILQ_INIT(&chan->out);
+
+    LIST_INSERT_HEAD(&mux->chans, chan, elem);
+    LIST_INSERT_HEAD(bucket(mux, chan_id), chan, bucket_elem);
+
+    return chan;
+}
+
+static void chan_unschedule(struct xcm_mux_chan *chan)
+{
+    if (chan->scheduled) {
+	TAILQ_REMOVE(&chan->mux->sched, chan, sched_elem);
+	chan->scheduled = false;
+    }
+
+    msg_queue_clear(&chan->out);
+}
+
+static void chan_free(struct xcm_mux_chan *chan)
+{
+    chan_unschedule(chan);
+
+    LIST_REMOVE(chan, elem);
+    LIST_REMOVE(chan, bucket_elem);
+
+    ut_free(chan);
+}
+
+static uint8_t chan_flags(struct xcm_mux_chan *chan)
+{
+    return chan->local ? MUX_FLAG_SENDER_OPENED : 0;
+}
+
+static void chan_enqueue(struct xcm_mux_chan *chan, struct mux_msg *msg)
+{
+    TAILQ_INSERT_TAIL(&chan->out, msg, elem);
+
+    if (!chan->scheduled) {
+	TAILQ_INSERT_TAIL(&chan->mux->sched, chan, sched_elem);
+	chan->scheduled = true;
+    }
+}
+
+static void ctl_enqueue(struct xcm_mux *mux, struct mux_msg *msg)
+{
+    TAILQ_INSERT_TAIL(&mux->ctl_out, msg, elem);
+}
+
+static void fail_cb(struct xcm_loop *loop, void *user);
+
+static void fail(struct xcm_mux *mux, int reason_errno)
+{
+    mux->dead = true;
+
+    if (mux->fail_timer == NULL) {
+	mux->fail_errno = reason_errno;
+	mux->fail_timer = xcm_loop_timer_add(mux->loop, 0, fail_cb, mux);
+    }
+}
+
+static void cancel_fail(struct xcm_mux *mux)
+{
+    if (mux->fail_timer != NULL) {
+	xcm_loop_timer_cancel(mux->fail_timer);
+	mux->fail_timer = NULL;
+    }
+}
+
+static void flush(struct xcm_mux *mux)
+{
+    if (mux->lsock == NULL || mux->dead)
+	return;
+
+    for (;;) {
+	struct xcm_mux_chan *chan = NULL;
+	struct mux_msg *msg = TAILQ_FIRST(&mux->ctl_out);
+
+	if (msg == NULL) {
+	    chan = TAILQ_FIRST(&mux->sched);
+
+	    if (chan == NULL)
+		break;
+
+	    msg = TAILQ_FIRST(&chan->out);
+	}
+
+	/* on EAGAIN, the event loop invokes mux_writable_cb() once
+	   the connection is writable again. Any other error is fatal
+	   to the connection, and the remaining messages are dropped
+	   when it is torn down by fail_cb(). */
+	if (xcm_loop_send(mux->lsock, msg->data, msg->len) < 0) {
+	    if (errno != EAGAIN)
+		fail(mux, errno);
+	    break;
+	}
+
+	if (chan == NULL)
+	    TAILQ_REMOVE(&mux->ctl_out, msg, elem);
+	else {
+	    TAILQ_REMOVE(&chan->out, msg, elem);
+
+	    /* round-robin among the channels */
+	    TAILQ_REMOVE(&mux->sched, chan, sched_elem);
+
+	    if (!TAILQ_EMPTY(&chan->out))
+		TAILQ_INSERT_TAIL(&mux->sched, chan, sched_elem);
+	    else {
+		chan->scheduled = false;
+
+		/* the close message has been sent */
+		if (chan->closed)
+		    chan_free(chan);
+	    }
+	}
+
+	ut_free(msg);
+    }
+}
+
+static void mux_free(struct xcm_mux *mux)
+{
+    struct xcm_mux_chan *chan;
+    while ((chan = LIST_FIRST(&mux->chans)) != NULL)
+	chan_free(chan);
+
+    msg_queue_clear(&mux->ctl_out);
+
+    ut_free(mux->remote_addr);
+    ut_free(mux);
+}
+
+static void enter(struct xcm_mux *mux)
+{
+    mux->depth++;
+}
+
+/* the multiplexed connection may be destroyed by the application
+   from within a callback, in which case it is freed when control is
+   returned to the outermost mux function on the stack */
+static void leave(struct xcm_mux *mux)
+{
+    mux->depth--;
+
+    if (mux->depth == 0 && mux->destroyed)
+	mux_free(mux);
+}
+
+static void mux_destroy(struct xcm_mux *mux)
+{
+    if (mux->destroyed)
+	return;
+
+    mux->dead = true;
+    mux->destroyed = true;
+
+    cancel_fail(mux);
+
+    if (mux->pool != NULL)
+	LIST_REMOVE(mux, pool_elem);
+
+    if (mux->lsock != NULL) {
+	xcm_loop_remove(mux->lsock);
+	mux->lsock = NULL;
+    }
+
+    if (mux->depth == 0)
+	mux_free(mux);
+}
+
+static void mux_closed(struct xcm_mux *mux, int reason_errno)
+{
+    mux->dead = true;
+
+    cancel_fail(mux);
+
+    /* channels closed by the application, with messages still
+       queued */
+    struct xcm_mux_chan *chan = LIST_FIRST(&mux->chans);
+    while (chan != NULL) {
+	struct xcm_mux_chan *next = LIST_NEXT(chan, elem);
+	if (chan->closed)
+	    chan_free(chan);
+	chan = next;
+    }
+
+    msg_queue_clear(&mux->ctl_out);
+
+    /* the application may destroy the multiplexed connection from
+       within any of the callbacks */
+    while ((chan = LIST_FIRST(&mux->chans)) != NULL && !mux->destroyed) {
+	chan->closed = true;
+	chan_unschedule(chan);
+	mux->num_chans--;
+
+	if (mux->cbs.on_chan_close != NULL)
+	    mux->cbs.on_chan_close(chan, chan->user);
+
+	chan_free(chan);
+    }
+
+    if (mux->cbs.on_close != NULL && !mux->destroyed)
+	mux->cbs.on_close(mux, reason_errno, mux->user);
+}
+
+static void teardown(struct xcm_mux *mux, int reason_errno)
+{
+    xcm_loop_remove(mux->lsock);
+    mux->lsock = NULL;
+
+    mux_closed(mux, reason_errno);
+}
+
+static void fail_cb(struct xcm_loop *loop, void *user)
+{
+    struct xcm_mux *mux = user;
+
+    mux->fail_timer = NULL;
+
+    enter(mux);
+    teardown(mux, mux->fail_errno);
+    leave(mux);
+}
+
+static void protocol_error(struct xcm_mux *mux)
+{
+    teardown(mux, EPROTO);
+}
+
+static void handle_open(struct xcm_mux *mux, uint32_t chan_id,
+			uint8_t flags)
+{
+    if (!(flags & MUX_FLAG_SENDER_OPENED) ||
+	chan_lookup(mux, chan_id, false) != NULL) {
+	protocol_error(mux);
+	return;
+    }
+
+    if (mux->cbs.on_chan_open == NULL ||
+	mux->num_chans >= XCM_MUX_MAX_CHANS) {
+	ctl_enqueue(mux, msg_create(mux_msg_type_close, 0, chan_id, NULL, 0));
+	flush(mux);
+	return;
+    }
+
+    struct xcm_mux_chan *chan = chan_create(mux, chan_id, false, mux->user);
+
+    mux->num_chans++;
+
+    mux->cbs.on_chan_open(mux, chan, mux->user);
+}
+
+static void handle_data(struct xcm_mux_chan *chan, const uint8_t *payload,
+			size_t len)
+{
+    struct xcm_mux *mux = chan->mux;
+    uint32_t chan_id = chan->id;
+    bool local = chan->local;
+
+    if (mux->cbs.on_message != NULL)
+	mux->cbs.on_message(chan, payload, len, chan->user);
+
+    /* the application may have closed the channel, or destroyed the
+       multiplexed connection, from within the callback */
+    chan = chan_lookup(mux, chan_id, local);
+
+    if (mux->dead || chan == NULL || chan->closed)
+	return;
+
+    if (++chan->num_consumed >= MUX_WINDOW / 2) {
+	uint32_t ncredit = htonl(chan->num_consumed);
+
+	ctl_enqueue(mux, msg_create(mux_msg_type_credit, chan_flags(chan),
+				    chan->id, &ncredit, sizeof(ncredit)));
+	chan->num_consumed = 0;
+
+	flush(mux);
+    }
+}
+
+static void handle_credit(struct xcm_mux_chan *chan, const uint8_t *payload,
+			  size_t len)
+{
+    struct xcm_mux *mux = chan->mux;
+
+    if (len != sizeof(uint32_t)) {
+	protocol_error(mux);
+	return;
+    }
+
+    uint32_t ncredit;
+    memcpy(&ncredit, payload, sizeof(ncredit));
+
+    chan->send_credit += ntohl(ncredit);
+
+    if (chan->want_writable && chan->send_credit > 0) {
+	chan->want_writable = false;
+
+	if (mux->cbs.on_writable != NULL)
+	    mux->cbs.on_writable(chan, chan->user);
+    }
+}
+
+static void handle_close(struct xcm_mux_chan *chan)
+{
+    struct xcm_mux *mux = chan->mux;
+
+    chan->closed = true;
+    chan_unschedule(chan);
+    mux->num_chans--;
+
+    if (mux->cbs.on_chan_close != NULL)
+	mux->cbs.on_chan_close(chan, chan->user);
+
+    chan_free(chan);
+}
+
+static void mux_message_cb(struct xcm_loop_sock *conn_lsock,
+			   const void *msg, size_t len, void *user)
+{
+    struct xcm_mux *mux = user;
+
+    enter(mux);
+
+    /* the connection has failed, and is about to be torn down */
+    if (mux->dead)
+	goto out;
+
+    if (len < HDR_SIZE) {
+	protocol_error(mux);
+	goto out;
+    }
+
+    const uint8_t *data = msg;
+    uint8_t type = data[0];
+    uint8_t flags = data[1];
+
+    uint32_t nchan_id;
+    memcpy(&nchan_id, data + 4, sizeof(nchan_id));
+    uint32_t chan_id = ntohl(nchan_id);
+
+    if (type == mux_msg_type_open) {
+	handle_open(mux, chan_id, flags);
+	goto out;
+    }
+
+    bool local = !(flags & MUX_FLAG_SENDER_OPENED);
+    struct xcm_mux_chan *chan = chan_lookup(mux, chan_id, local);
+
+    /* messages for channels closed by the application are
+       discarded */
+    if (chan == NULL || chan->closed)
+	goto out;
+
+    switch (type) {
+    case mux_msg_type_data:
+	handle_data(chan, data + HDR_SIZE, len - HDR_SIZE);
+	break;
+    case mux_msg_type_credit:
+	handle_credit(chan, data + HDR_SIZE, len - HDR_SIZE);
+	break;
+    case mux_msg_type_close:
+	handle_close(chan);
+	break;
+    default:
+	protocol_error(mux);
+	break;
+    }
+
+out:
+    leave(mux);
+}
+
+static void mux_writable_cb(struct xcm_loop_sock *conn_lsock, void *user)
+{
+    struct xcm_mux *mux = user;
+
+    enter(mux);
+    flush(mux);
+    leave(mux);
+}
+
+static void mux_close_cb(struct xcm_loop_sock *conn_lsock, int reason_errno,
+			 void *user)
+{
+    struct xcm_mux *mux = user;
+
+    enter(mux);
+
+    /* the socket is removed by the event loop */
+    mux->lsock = NULL;
+
+    mux_closed(mux, reason_errno);
+
+    leave(mux);
+}
+
+struct xcm_mux *xcm_mux_create(struct xcm_loop *loop,
+			       struct xcm_socket *conn_socket,
+			       const struct xcm_mux_cbs *cbs, void *user)
+{
+    struct xcm_mux *mux = ut_calloc(sizeof(struct xcm_mux));
+
+    const struct xcm_loop_cbs lcbs = {
+	.on_message = mux_message_cb,
+	.on_writable = mux_writable_cb,
+	.on_close = mux_close_cb
+    };
+
+    mux->loop = loop;
+    mux->lsock = xcm_loop_add(loop, conn_socket, &lcbs, mux);
+
+    if (mux->lsock == NULL) {
+	UT_PROTECT_ERRNO(ut_free(mux));
+	return NULL;
+    }
+
+    mux->cbs = *cbs;
+    mux->user = user;
+
+    LIST_INIT(&mux->chans);
+
+    size_t i;
+    for (i = 0; i < NUM_BUCKETS; i++)
+	LIST_INIT(&mux->buckets[i]);
+
+    TAILQ_INIT(&mux->ctl_out);
+    TAILQ_INIT(&mux->sched);
+
+    return mux;
+}
+
+void xcm_mux_destroy(struct xcm_mux *mux)
+{
+    if (mux == NULL)
+	return;
+
+    mux_destroy(mux);
+}
+
+struct xcm_mux_chan *xcm_mux_open(struct xcm_mux *mux, void *user)
+{
+    if (mux->dead) {
+	errno = EPIPE;
+	return NULL;
+    }
+
+    if (mux->num_chans >= XCM_MUX_MAX_CHANS) {
+	errno = EMFILE;
+	return NULL;
+    }
+
+    /* skip ids still in use after a wrap-around */
+    while (chan_lookup(mux, mux->next_chan_id, true) != NULL)
+	mux->next_chan_id++;
+
+    struct xcm_mux_chan *chan =
+	chan_create(mux, mux->next_chan_id++, true, user);
+
+    mux->num_chans++;
+
+    ctl_enqueue(mux, msg_create(mux_msg_type_open, chan_flags(chan),
+				chan->id, NULL, 0));
+
+    flush(mux);
+
+    return chan;
+}
+
+void xcm_mux_close(struct xcm_mux_chan *chan)
+{
+    /* closed by the remote peer, from within the callback */
+    if (chan->closed)
+	return;
+
+    struct xcm_mux *mux = chan->mux;
+
+    chan->closed = true;
+    mux->num_chans--;
+
+    if (mux->dead) {
+	chan_free(chan);
+	return;
+    }
+
+    chan_enqueue(chan, msg_create(mux_msg_type_close, chan_flags(chan),
+				  chan->id, NULL, 0));
+
+    flush(mux);
+}
+
+int xcm_mux_send(struct xcm_mux_chan *chan, const void *buf, size_t len)
+{
+    if (len == 0) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    if (len > XCM_MUX_MAX_MSG) {
+	errno = EMSGSIZE;
+	return -1;
+    }
+
+    struct xcm_mux *mux = chan->mux;
+
+    if (chan->closed || mux->dead) {
+	errno = EPIPE;
+	return -1;
+    }
+
+    if (chan->send_credit == 0) {
+	chan->want_writable = true;
+	errno = EAGAIN;
+	return -1;
+    }
+
+    chan->send_credit--;
+
+    chan_enqueue(chan, msg_create(mux_msg_type_data, chan_flags(chan),
+				  chan->id, buf, len));
+
+    flush(mux);
+
+    return 0;
+}
+
+struct xcm_mux *xcm_mux_chan_mux(struct xcm_mux_chan *chan)
+{
+    return chan->mux;
+}
+
+void xcm_mux_chan_set_user(struct xcm_mux_chan *chan, void *user)
+{
+    chan->user = user;
+}
+
+size_t xcm_mux_num_chans(struct xcm_mux *mux)
+{
+    return mux->num_chans;
+}
+
+struct xcm_mux_pool *xcm_mux_pool_create(struct xcm_loop *loop,
+					 const struct xcm_mux_cbs *cbs,
+					 void *user)
+{
+    struct xcm_mux_pool *pool = ut_malloc(sizeof(struct xcm_mux_pool));
+
+    pool->loop = loop;
+    pool->cbs = *cbs;
+    pool->user = user;
+    LIST_INIT(&pool->muxes);
+
+    return pool;
+}
+
+void xcm_mux_pool_destroy(struct xcm_mux_pool *pool)
+{
+    if (pool == NULL)
+	return;
+
+    struct xcm_mux *mux;
+    while ((mux = LIST_FIRST(&pool->muxes)) != NULL)
+	mux_destroy(mux);
+
+    ut_free(pool);
+}
+
+static void pool_purge_dead(struct xcm_mux_pool *pool)
+{
+    struct xcm_mux *mux = LIST_FIRST(&pool->muxes);
+
+    while (mux != NULL) {
+	struct xcm_mux *next = LIST_NEXT(mux, pool_elem);
+	/* a failed connection is kept until the application has been
+	   notified */
+	if (mux->dead && mux->fail_timer == NULL)
+	    mux_destroy(mux);
+	mux = next;
+    }
+}
+
+static struct xcm_mux *pool_connect(struct xcm_mux_pool *pool,
+				    const char *remote_addr)
+{
+    struct xcm_socket *conn = xcm_connect(remote_addr, XCM_NONBLOCK);
+
+    if (conn == NULL)
+	return NULL;
+
+    struct xcm_mux *mux = xcm_mux_create(pool->loop, conn, &pool->cbs,
+					 pool->user);
+
+    if (mux == NULL) {
+	UT_PROTECT_ERRNO(xcm_close(conn));
+	return NULL;
+    }
+
+    mux->pool = pool;
+    mux->remote_addr = ut_strdup(remote_addr);
+
+    LIST_INSERT_HEAD(&pool->muxes, mux, pool_elem);
+
+    return mux;
+}
+
+struct xcm_mux_chan *xcm_mux_pool_open(struct xcm_mux_pool *pool,
+				       const char *remote_addr, void *user)
+{
+    pool_purge_dead(pool);
+
+    struct xcm_mux *mux;
+    LIST_FOREACH(mux, &pool->muxes, pool_elem)
+	if (!mux->dead && strcmp(mux->remote_addr, remote_addr) == 0)
+	    break;
+
+    if (mux == NULL) {
+	mux = pool_connect(pool, remote_addr);
+
+	if (mux == NULL)
+	    return NULL;
+    }
+
+    return xcm_mux_open(mux, user);
+}
+
+size_t xcm_mux_pool_num_conns(struct xcm_mux_pool *pool)
+{
+    size_t num_conns = 0;
+    struct xcm_mux *mux;
+
+    LIST_FOREACH(mux, &pool->muxes, pool_elem)
+	if (!mux->dead)
+	    num_conns++;
+
+    return num_conns;
+}
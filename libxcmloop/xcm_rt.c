@@ -0,0 +1,508 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "xcm_rt.h"
+
+#include "loop_int.h"
+#include "util.h"
+#include "xcm_attr.h"
+#include "xcm_attr_names.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/queue.h>
+#include <unistd.h>
+
+/*
+ * Each worker runs an event loop in a thread of its own. Sockets are
+ * transferred between threads by means of a per-worker handoff
+ * queue, protected by a mutex, and an eventfd used to wake the
+ * receiving worker up. A socket is always detached from the sending
+ * worker's event loop before it is put on the queue, and thus is
+ * never accessed from two threads concurrently.
+ */
+
+struct handoff
+{
+    struct xcm_socket *socket;
+    struct xcm_loop_cbs cbs;
+    void *user;
+    bool is_conn;
+    TAILQ_ENTRY(handoff) elem;
+};
+
+TAILQ_HEAD(handoff_queue, handoff);
+
+struct worker
+{
+    struct xcm_rt *rt;
+    int idx;
+    int cpu;
+
+    struct xcm_loop *loop;
+    int wakeup_fd;
+
+    pthread_t thread;
+    bool started;
+
+    pthread_mutex_t lock;
+    struct handoff_queue handoffs;
+    bool stopping;
+
+    /* connections queued for, but not yet added to, the worker */
+    int64_t num_pending;
+};
+
+struct rt_server
+{
+    struct xcm_rt *rt;
+    struct xcm_loop_cbs conn_cbs;
+    void *user;
+    LIST_ENTRY(rt_server) elem;
+};
+
+LIST_HEAD(rt_server_list, rt_server);
+
+struct xcm_rt
+{
+    enum xcm_rt_policy policy;
+
+    struct worker *workers;
+    int num_workers;
+
+    unsigned int next_worker;
+
+    pthread_mutex_t servers_lock;
+    struct rt_server_list servers;
+};
+
+/* the worker running in the calling thread, if any */
+static __thread struct worker *current_worker;
+
+static void post(struct worker *worker, struct handoff *handoff)
+{
+    if (handoff->is_conn)
+	__atomic_add_fetch(&worker->num_pending, 1, __ATOMIC_RELAXED);
+
+    ut_mutex_lock(&worker->lock);
+    TAILQ_INSERT_TAIL(&worker->handoffs, handoff, elem);
+    ut_mutex_unlock(&worker->lock);
+
+    uint64_t one = 1;
+    UT_PROTECT_ERRNO(write(worker->wakeup_fd, &one, sizeof(one)));
+}
+
+static int post_socket(struct worker *worker, struct xcm_socket *socket,
+		       const struct xcm_loop_cbs *cbs, void *user)
+{
+    char type[16];
+
+    if (xcm_attr_get_str(socket, XCM_ATTR_XCM_TYPE, type,
+			 sizeof(type)) < 0)
+	return -1;
+
+    struct handoff *handoff = ut_malloc(sizeof(struct handoff));
+
+    *handoff = (struct handoff) {
+	.socket = socket,
+	.cbs = *cbs,
+	.user = user,
+	.is_conn = strcmp(type, "connection") == 0
+    };
+
+    post(worker, handoff);
+
+    return 0;
+}
+
+/* A connection which is closed without ever having been added to
+   its worker's event loop is reported to the application by means
+   of the close callback, since the application may hold state for
+   the connection (e.g., from a migration). */
+static void discard_handoff(struct handoff *handoff, int reason_errno)
+{
+    if (handoff->is_conn && handoff->cbs.on_close != NULL)
+	handoff->cbs.on_close(NULL, reason_errno, handoff->user);
+
+    UT_PROTECT_ERRNO(xcm_close(handoff->socket));
+}
+
+static void wakeup_cb(struct xcm_loop *loop, int fd, void *user)
+{
+    struct worker *worker = user;
+
+    uint64_t value;
+    UT_PROTECT_ERRNO(read(fd, &value, sizeof(value)));
+
+    struct handoff_queue handoffs = TAILQ_HEAD_INITIALIZER(handoffs);
+
+    ut_mutex_lock(&worker->lock);
+    TAILQ_CONCAT(&handoffs, &worker->handoffs, elem);
+    bool stopping = worker->stopping;
+    ut_mutex_unlock(&worker->lock);
+
+    struct handoff *handoff;
+    while ((handoff = TAILQ_FIRST(&handoffs)) != NULL) {
+	TAILQ_REMOVE(&handoffs, handoff, elem);
+
+	if (xcm_loop_add(loop, handoff->socket, &handoff->cbs,
+			 handoff->user) == NULL)
+	    discard_handoff(handoff, errno);
+
+	if (handoff->is_conn)
+	    __atomic_sub_fetch(&worker->num_pending, 1, __ATOMIC_RELAXED);
+
+	ut_free(handoff);
+    }
+
+    if (stopping)
+	xcm_loop_stop(loop);
+}
+
+static void *worker_run(void *arg)
+{
+    struct worker *worker = arg;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(worker->cpu, &cpus);
+
+    /* pinning is an optimization, and failure is not fatal */
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    current_worker = worker;
+
+    xcm_loop_run(worker->loop);
+
+    return NULL;
+}
+
+static int worker_init(struct worker *worker, struct xcm_rt *rt, int idx,
+		       int cpu)
+{
+    worker->rt = rt;
+    worker->idx = idx;
+    worker->cpu = cpu;
+
+    ut_mutex_init(&worker->lock);
+    TAILQ_INIT(&worker->handoffs);
+
+    worker->wakeup_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+
+    if (worker->wakeup_fd < 0)
+	return -1;
+
+    worker->loop = xcm_loop_create();
+
+    if (worker->loop == NULL)
+	goto err_close;
+
+    if (loop_add_fd(worker->loop, worker->wakeup_fd, wakeup_cb,
+		    worker) == NULL)
+	goto err_destroy;
+
+    int rc = pthread_create(&worker->thread, NULL, worker_run, worker);
+    if (rc != 0) {
+	errno = rc;
+	goto err_destroy;
+    }
+
+    worker->started = true;
+
+    return 0;
+
+err_destroy:
+    UT_PROTECT_ERRNO(xcm_loop_destroy(worker->loop));
+err_close:
+    UT_PROTECT_ERRNO(close(worker->wakeup_fd));
+    return -1;
+}
+
+static void worker_stop(struct worker *worker)
+{
+    if (!worker->started)
+	return;
+
+    ut_mutex_lock(&worker->lock);
+    worker->stopping = true;
+    ut_mutex_unlock(&worker->lock);
+
+    uint64_t one = 1;
+    UT_PROTECT_ERRNO(write(worker->wakeup_fd, &one, sizeof(one)));
+
+    pthread_join(worker->thread, NULL);
+}
+
+static void worker_deinit(struct worker *worker)
+{
+    if (!worker->started)
+	return;
+
+    /* sockets handed over after the worker stopped */
+    struct handoff *handoff;
+    while ((handoff = TAILQ_FIRST(&worker->handoffs)) != NULL) {
+	TAILQ_REMOVE(&worker->handoffs, handoff, elem);
+	discard_handoff(handoff, ECANCELED);
+	ut_free(handoff);
+    }
+
+    xcm_loop_destroy(worker->loop);
+    UT_PROTECT_ERRNO(close(worker->wakeup_fd));
+}
+
+static int allowed_cpus(int *cpus, int capacity)
+{
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) < 0)
+	return -1;
+
+    int num_cpus = 0;
+    int cpu;
+    for (cpu = 0; cpu < CPU_SETSIZE && num_cpus < capacity; cpu++)
+	if (CPU_ISSET(cpu, &set))
+	    cpus[num_cpus++] = cpu;
+
+    return num_cpus;
+}
+
+struct xcm_rt *xcm_rt_create(int num_workers, enum xcm_rt_policy policy)
+{
+    if (num_workers < 0 || policy < xcm_rt_policy_round_robin ||
+	policy > xcm_rt_policy_incoming_cpu) {
+	errno = EINVAL;
+	return NULL;
+    }
+
+    int cpus[CPU_SETSIZE];
+    int num_cpus = allowed_cpus(cpus, CPU_SETSIZE);
+
+    if (num_cpus <= 0)
+	return NULL;
+
+    if (num_workers == 0)
+	num_workers = num_cpus;
+
+    struct xcm_rt *rt = ut_calloc(sizeof(struct xcm_rt));
+
+    rt->policy = policy;
+    rt->workers = ut_calloc(num_workers * sizeof(struct worker));
+    rt->num_workers = num_workers;
+
+    ut_mutex_init(&rt->servers_lock);
+    LIST_INIT(&rt->servers);
+
+    int i;
+    for (i = 0; i < num_workers; i++)
+	if (worker_init(&rt->workers[i], rt, i, cpus[i % num_cpus]) < 0) {
+	    UT_PROTECT_ERRNO(xcm_rt_destroy(rt));
+	    return NULL;
+	}
+
+    return rt;
+}
+
+void xcm_rt_destroy(struct xcm_rt *rt)
+{
+    if (rt == NULL)
+	return;
+
+    /* all workers must be stopped before any is torn down, since a
+       running worker may hand sockets over to any other */
+    int i;
+    for (i = 0; i < rt->num_workers; i++)
+	worker_stop(&rt->workers[i]);
+
+    for (i = 0; i < rt->num_workers; i++)
+	worker_deinit(&rt->workers[i]);
+
+    struct rt_server *server;
+    while ((server = LIST_FIRST(&rt->servers)) != NULL) {
+	LIST_REMOVE(server, elem);
+	ut_free(server);
+    }
+
+    ut_free(rt->workers);
+    ut_free(rt);
+}
+
+int xcm_rt_num_workers(struct xcm_rt *rt)
+{
+    return rt->num_workers;
+}
+
+static int64_t worker_load(struct worker *worker)
+{
+    return loop_num_conns(worker->loop) +
+	__atomic_load_n(&worker->num_pending, __ATOMIC_RELAXED);
+}
+
+static struct worker *round_robin_worker(struct xcm_rt *rt)
+{
+    unsigned int n = __atomic_fetch_add(&rt->next_worker, 1,
+					__ATOMIC_RELAXED);
+
+    return &rt->workers[n % rt->num_workers];
+}
+
+static struct worker *least_loaded_worker(struct xcm_rt *rt)
+{
+    struct worker *candidate = &rt->workers[0];
+    int64_t candidate_load = worker_load(candidate);
+
+    int i;
+    for (i = 1; i < rt->num_workers; i++) {
+	struct worker *worker = &rt->workers[i];
+	int64_t load = worker_load(worker);
+
+	if (load < candidate_load) {
+	    candidate = worker;
+	    candidate_load = load;
+	}
+    }
+
+    return candidate;
+}
+
+static struct worker *incoming_cpu_worker(struct xcm_rt *rt,
+					  struct xcm_socket *conn_socket)
+{
+    int64_t cpu;
+
+    if (xcm_attr_get_int64(conn_socket, XCM_ATTR_TCP_INCOMING_CPU,
+			   &cpu) == 0) {
+	int i;
+	for (i = 0; i < rt->num_workers; i++)
+	    if (rt->workers[i].cpu == cpu)
+		return &rt->workers[i];
+    }
+
+    return round_robin_worker(rt);
+}
+
+static struct worker *select_worker(struct xcm_rt *rt,
+				    struct xcm_socket *conn_socket)
+{
+    switch (rt->policy) {
+    case xcm_rt_policy_least_loaded:
+	return least_loaded_worker(rt);
+    case xcm_rt_policy_incoming_cpu:
+	return incoming_cpu_worker(rt, conn_socket);
+    default:
+	return round_robin_worker(rt);
+    }
+}
+
+int xcm_rt_add_conn(struct xcm_rt *rt, struct xcm_socket *conn_socket,
+		    const struct xcm_loop_cbs *cbs, void *user)
+{
+    struct worker *worker = select_worker(rt, conn_socket);
+
+    return post_socket(worker, conn_socket, cbs, user);
+}
+
+static void server_accept_cb(struct xcm_loop_sock *server_lsock,
+			     struct xcm_socket *conn_socket, void *user)
+{
+    struct rt_server *server = user;
+
+    if (xcm_rt_add_conn(server->rt, conn_socket, &server->conn_cbs,
+			server->user) < 0)
+	UT_PROTECT_ERRNO(xcm_close(conn_socket));
+}
+
+int xcm_rt_add_server(struct xcm_rt *rt, struct xcm_socket *server_socket,
+		      const struct xcm_loop_cbs *conn_cbs, void *user)
+{
+    struct rt_server *server = ut_malloc(sizeof(struct rt_server));
+
+    *server = (struct rt_server) {
+	.rt = rt,
+	.conn_cbs = *conn_cbs,
+	.user = user
+    };
+
+    const struct xcm_loop_cbs server_cbs = {
+	.on_accept = server_accept_cb
+    };
+
+    if (post_socket(&rt->workers[0], server_socket, &server_cbs,
+		    server) < 0) {
+	UT_PROTECT_ERRNO(ut_free(server));
+	return -1;
+    }
+
+    ut_mutex_lock(&rt->servers_lock);
+    LIST_INSERT_HEAD(&rt->servers, server, elem);
+    ut_mutex_unlock(&rt->servers_lock);
+
+    return 0;
+}
+
+int xcm_rt_current_worker(struct xcm_rt *rt)
+{
+    if (current_worker == NULL || current_worker->rt != rt)
+	return -1;
+
+    return current_worker->idx;
+}
+
+static bool is_valid_worker(struct xcm_rt *rt, int worker_idx)
+{
+    return worker_idx >= 0 && worker_idx < rt->num_workers;
+}
+
+int xcm_rt_migrate(struct xcm_rt *rt, struct xcm_loop_sock *lsock,
+		   int worker_idx)
+{
+    int current_idx = xcm_rt_current_worker(rt);
+
+    if (current_idx < 0 || !is_valid_worker(rt, worker_idx)) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    if (current_idx == worker_idx)
+	return 0;
+
+    struct xcm_loop_cbs cbs = *loop_sock_cbs(lsock);
+    void *user = loop_sock_user(lsock);
+
+    struct xcm_socket *socket = xcm_loop_detach(lsock);
+
+    if (socket == NULL)
+	return -1;
+
+    if (post_socket(&rt->workers[worker_idx], socket, &cbs, user) < 0) {
+	UT_PROTECT_ERRNO(xcm_close(socket));
+	return -1;
+    }
+
+    return 0;
+}
+
+int64_t xcm_rt_worker_load(struct xcm_rt *rt, int worker_idx)
+{
+    if (!is_valid_worker(rt, worker_idx)) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    return worker_load(&rt->workers[worker_idx]);
+}
+
+int xcm_rt_worker_cpu(struct xcm_rt *rt, int worker_idx)
+{
+    if (!is_valid_worker(rt, worker_idx)) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    return rt->workers[worker_idx].cpu;
+}
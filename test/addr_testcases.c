@@ -217,6 +217,50 @@ TESTCASE(addr, parse_uxf)
     return UTEST_SUCCESS;
 }
 
+TESTCASE(addr, parse_shm)
+{
+    char shm_name[128];
+    shm_name[0] = '\0';
+
+    CHKERRNO(xcm_addr_parse_shm("ux:foo", shm_name, sizeof(shm_name)),
+	     EINVAL);
+    CHKSTREQ(shm_name, "");
+
+    CHKERRNO(xcm_addr_parse_shm("shm:foo", shm_name, 3), ENAMETOOLONG);
+    CHKSTREQ(shm_name, "");
+
+    CHKERRNO(xcm_addr_parse_shm("shm:", shm_name, sizeof(shm_name)), EINVAL);
+    CHKSTREQ(shm_name, "");
+
+    CHKNOERR(xcm_addr_parse_shm("shm:foo", shm_name, sizeof(shm_name)));
+    CHKSTREQ(shm_name, "foo");
+
+    CHKNOERR(xcm_addr_parse_shm("shm::foo:", shm_name, sizeof(shm_name)));
+    CHKSTREQ(shm_name, ":foo:");
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(addr, parse_inproc)
+{
+    char inproc_name[128];
+    inproc_name[0] = '\0';
+
+    CHKERRNO(xcm_addr_parse_inproc("shm:foo", inproc_name,
+				   sizeof(inproc_name)), EINVAL);
+    CHKSTREQ(inproc_name, "");
+
+    CHKERRNO(xcm_addr_parse_inproc("inproc:", inproc_name,
+				   sizeof(inproc_name)), EINVAL);
+    CHKSTREQ(inproc_name, "");
+
+    CHKNOERR(xcm_addr_parse_inproc("inproc:foo.bar", inproc_name,
+				   sizeof(inproc_name)));
+    CHKSTREQ(inproc_name, "foo.bar");
+
+    return UTEST_SUCCESS;
+}
+
 #define GEN_DNS_BASED_MAKE_TEST(proto)					\
     char addr_s[64];							\
     struct xcm_addr_host addr4 = {					\
@@ -497,6 +541,44 @@ TESTCASE(addr, make_uxf)
     return UTEST_SUCCESS;
 }
 
+/* the SHM name is mapped to a prefixed UNIX domain socket name */
+#define SHM_NAME_MAX (UX_NAME_MAX-8)
+
+TESTCASE(addr, make_shm)
+{
+    char addr_s[1024];
+    CHKNOERR(xcm_addr_make_shm("foo", addr_s, sizeof(addr_s)));
+    CHKSTREQ(addr_s, "shm:foo");
+
+    char shm_name[SHM_NAME_MAX+2];
+    memset(shm_name, 'x', SHM_NAME_MAX);
+    shm_name[SHM_NAME_MAX] = '\0';
+    CHKNOERR(xcm_addr_make_shm(shm_name, addr_s, sizeof(addr_s)));
+    CHK(strncmp(addr_s, "shm:", 4) == 0);
+    CHK(strcmp(addr_s+4, shm_name) == 0);
+
+    memset(shm_name, 'x', SHM_NAME_MAX+1);
+    shm_name[SHM_NAME_MAX+1] = '\0';
+    CHKERRNO(xcm_addr_make_shm(shm_name, addr_s, sizeof(addr_s)), EINVAL);
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(addr, make_inproc)
+{
+    char addr_s[64];
+    CHKNOERR(xcm_addr_make_inproc("foo", addr_s, sizeof(addr_s)));
+    CHKSTREQ(addr_s, "inproc:foo");
+
+    char inproc_name[512];
+    memset(inproc_name, 'x', sizeof(inproc_name));
+    inproc_name[sizeof(inproc_name)-1] = '\0';
+    CHKERRNO(xcm_addr_make_inproc(inproc_name, addr_s, sizeof(addr_s)),
+	     EINVAL);
+
+    return UTEST_SUCCESS;
+}
+
 #define GEN_IP_BASED_MAKE_TEST(proto)				 \
     char addr_s[64];                                             \
     in_addr_t ip = inet_addr("1.2.3.4");                         \
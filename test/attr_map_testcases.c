@@ -291,3 +291,74 @@ TESTCASE(attr_map, clone)
 
     return UTEST_SUCCESS;
 }
+
+#define MANY_ATTRS (1000)
+
+static void many_attr_name(char *buf, size_t capacity, int i)
+{
+    /* make every third name too long to be stored inline */
+    if (i % 3 == 0)
+	snprintf(buf, capacity, "a.quite.long.attribute.name.number.%d", i);
+    else
+	snprintf(buf, capacity, "attr%d", i);
+}
+
+TESTCASE(attr_map, many)
+{
+    struct xcm_attr_map *attr_map = xcm_attr_map_create();
+
+    char long_value[256];
+    memset(long_value, 'x', sizeof(long_value) - 1);
+    long_value[sizeof(long_value) - 1] = '\0';
+
+    xcm_attr_map_add_str(attr_map, "first", long_value);
+    const char *first_value = xcm_attr_map_get_str(attr_map, "first");
+    xcm_attr_map_add_int64(attr_map, "second", 4711);
+    const int64_t *second_value = xcm_attr_map_get_int64(attr_map, "second");
+
+    int i;
+    for (i = 0; i < MANY_ATTRS; i++) {
+	char name[64];
+	many_attr_name(name, sizeof(name), i);
+	xcm_attr_map_add_int64(attr_map, name, i);
+    }
+
+    CHKINTEQ(xcm_attr_map_size(attr_map), MANY_ATTRS + 2);
+
+    for (i = 0; i < MANY_ATTRS; i += 2) {
+	char name[64];
+	many_attr_name(name, sizeof(name), i);
+	xcm_attr_map_del(attr_map, name);
+    }
+
+    CHKINTEQ(xcm_attr_map_size(attr_map), MANY_ATTRS / 2 + 2);
+
+    for (i = 0; i < MANY_ATTRS; i++) {
+	char name[64];
+	many_attr_name(name, sizeof(name), i);
+	if (i % 2 == 0)
+	    CHK(!xcm_attr_map_exists(attr_map, name));
+	else
+	    CHK(*xcm_attr_map_get_int64(attr_map, name) == i);
+    }
+
+    /* values must stay in place, regardless of other keys being
+       added or removed */
+    CHK(xcm_attr_map_get_str(attr_map, "first") == first_value);
+    CHK(xcm_attr_map_get_int64(attr_map, "second") == second_value);
+    CHKSTREQ(first_value, long_value);
+    CHK(*second_value == 4711);
+
+    struct xcm_attr_map *copy = xcm_attr_map_clone(attr_map);
+
+    CHK(xcm_attr_map_equal(attr_map, copy));
+
+    xcm_attr_map_add_str(copy, "first", "y");
+
+    CHK(!xcm_attr_map_equal(attr_map, copy));
+
+    xcm_attr_map_destroy(attr_map);
+    xcm_attr_map_destroy(copy);
+
+    return UTEST_SUCCESS;
+}
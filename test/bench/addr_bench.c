@@ -0,0 +1,112 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "bench.h"
+
+#include "xcm_addr.h"
+
+#include <stdlib.h>
+
+BENCH(addr, parse_proto)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	char proto[16];
+	if (xcm_addr_parse_proto("tls:192.168.1.1:4711", proto,
+				 sizeof(proto)) < 0)
+	    abort();
+	BENCH_KEEP(proto);
+    }
+}
+
+BENCH(addr, parse_tcp_ipv4)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	struct xcm_addr_host host;
+	uint16_t port;
+	if (xcm_addr_parse_tcp("tcp:192.168.1.1:4711", &host, &port) < 0)
+	    abort();
+	BENCH_KEEP(&host);
+    }
+}
+
+BENCH(addr, parse_tcp_ipv6)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	struct xcm_addr_host host;
+	uint16_t port;
+	if (xcm_addr_parse_tcp("tcp:[fe80::1:2:3]:4711", &host, &port) < 0)
+	    abort();
+	BENCH_KEEP(&host);
+    }
+}
+
+BENCH(addr, parse_tcp_name)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	struct xcm_addr_host host;
+	uint16_t port;
+	if (xcm_addr_parse_tcp("tcp:www.ericsson.com:4711", &host, &port) < 0)
+	    abort();
+	BENCH_KEEP(&host);
+    }
+}
+
+BENCH(addr, parse_ux)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	char name[64];
+	if (xcm_addr_parse_ux("ux:some-service", name, sizeof(name)) < 0)
+	    abort();
+	BENCH_KEEP(name);
+    }
+}
+
+static void *make_setup(void)
+{
+    struct xcm_addr_host *host = malloc(sizeof(struct xcm_addr_host));
+    uint16_t port;
+
+    if (xcm_addr_parse_tcp("tcp:[fe80::1:2:3]:4711", host, &port) < 0) {
+	free(host);
+	return NULL;
+    }
+
+    return host;
+}
+
+BENCH_FIXTURE(addr, make_tcp_ipv6, make_setup, free)
+{
+    const struct xcm_addr_host *host = ctx;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	char addr[64];
+	if (xcm_addr_make_tcp(host, 4711, addr, sizeof(addr)) < 0)
+	    abort();
+	BENCH_KEEP(addr);
+    }
+}
+
+BENCH(addr, make_ux)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	char addr[64];
+	if (xcm_addr_make_ux("some-service", addr, sizeof(addr)) < 0)
+	    abort();
+	BENCH_KEEP(addr);
+    }
+}
@@ -0,0 +1,93 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "bench.h"
+
+#include "xcm_attr_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_ATTRS (16)
+
+static void *populated_setup(void)
+{
+    struct xcm_attr_map *map = xcm_attr_map_create();
+    int i;
+
+    for (i = 0; i < NUM_ATTRS; i++) {
+	char name[64];
+	snprintf(name, sizeof(name), "xcm.some_attr_%d", i);
+	xcm_attr_map_add_int64(map, name, i);
+    }
+
+    xcm_attr_map_add_str(map, "tls.cert_file", "/etc/xcm/cert.pem");
+
+    return map;
+}
+
+static void populated_teardown(void *ctx)
+{
+    xcm_attr_map_destroy(ctx);
+}
+
+BENCH_FIXTURE(attr_map, get_int64, populated_setup, populated_teardown)
+{
+    const struct xcm_attr_map *map = ctx;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++)
+	BENCH_KEEP(xcm_attr_map_get_int64(map, "xcm.some_attr_7"));
+}
+
+BENCH_FIXTURE(attr_map, get_str, populated_setup, populated_teardown)
+{
+    const struct xcm_attr_map *map = ctx;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++)
+	BENCH_KEEP(xcm_attr_map_get_str(map, "tls.cert_file"));
+}
+
+BENCH_FIXTURE(attr_map, exists_miss, populated_setup, populated_teardown)
+{
+    const struct xcm_attr_map *map = ctx;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++)
+	BENCH_KEEP(xcm_attr_map_exists(map, "xcm.non_existent"));
+}
+
+BENCH_FIXTURE(attr_map, add_del, populated_setup, populated_teardown)
+{
+    struct xcm_attr_map *map = ctx;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	xcm_attr_map_add_bool(map, "xcm.blocking", true);
+	xcm_attr_map_del(map, "xcm.blocking");
+    }
+}
+
+BENCH_FIXTURE(attr_map, clone, populated_setup, populated_teardown)
+{
+    const struct xcm_attr_map *map = ctx;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++)
+	xcm_attr_map_destroy(xcm_attr_map_clone(map));
+}
+
+BENCH(attr_map, create_destroy)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	struct xcm_attr_map *map = xcm_attr_map_create();
+	xcm_attr_map_add_bool(map, "xcm.blocking", false);
+	xcm_attr_map_add_str(map, "xcm.local_addr", "tcp:127.0.0.1:0");
+	xcm_attr_map_destroy(map);
+    }
+}
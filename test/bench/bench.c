@@ -0,0 +1,390 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+/*
+ * Micro benchmark harness.
+ *
+ * Each benchmark is first calibrated, to find a number of operations
+ * which takes roughly the requested sample time to run. After a
+ * warm-up sample, a number of samples are taken, and the per-operation
+ * latency is summarized over all samples.
+ *
+ * The results may be compared with those of an earlier run, as saved
+ * from the program's output. The ratio between the current and the
+ * earlier median latency is then reported and, in case a maximum
+ * ratio is given, checked.
+ */
+
+#include "bench.h"
+
+#include <inttypes.h>
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_SAMPLES (15)
+#define DEFAULT_SAMPLE_TIME (0.02)
+#define MAX_BENCHES (256)
+#define MAX_NAME (128)
+
+struct bench
+{
+    const char *suite_name;
+    const char *name;
+    bench_setup_fun setup;
+    bench_run_fun run;
+    bench_teardown_fun teardown;
+};
+
+static struct bench benches[MAX_BENCHES];
+static int num_benches = 0;
+
+struct baseline
+{
+    char name[MAX_NAME];
+    double median;
+};
+
+static struct baseline baselines[MAX_BENCHES];
+static int num_baselines = 0;
+
+void bench_register(const char *suite_name, const char *name,
+		    bench_setup_fun setup, bench_run_fun run,
+		    bench_teardown_fun teardown)
+{
+    if (num_benches == MAX_BENCHES) {
+	fprintf(stderr, "Too many benchmarks registered.\n");
+	abort();
+    }
+
+    benches[num_benches++] = (struct bench) {
+	.suite_name = suite_name,
+	.name = name,
+	.setup = setup,
+	.run = run,
+	.teardown = teardown
+    };
+}
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double time_run(const struct bench *b, void *ctx, uint64_t num_ops)
+{
+    double start = get_time();
+    b->run(ctx, num_ops);
+    return get_time() - start;
+}
+
+static uint64_t calibrate(const struct bench *b, void *ctx,
+			  double sample_time)
+{
+    uint64_t num_ops = 1;
+
+    for (;;) {
+	double latency = time_run(b, ctx, num_ops);
+
+	if (latency > sample_time / 8) {
+	    double ops = num_ops * (sample_time / latency);
+	    return ops < 1 ? 1 : ops;
+	}
+
+	num_ops *= 4;
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+struct summary
+{
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double max;
+};
+
+static void summarize(double *values, int num_values, struct summary *s)
+{
+    qsort(values, num_values, sizeof(double), cmp_double);
+
+    double sum = 0;
+    int i;
+    for (i = 0; i < num_values; i++)
+	sum += values[i];
+
+    s->mean = sum / num_values;
+
+    double sq_sum = 0;
+    for (i = 0; i < num_values; i++)
+	sq_sum += (values[i] - s->mean) * (values[i] - s->mean);
+
+    s->stddev = num_values > 1 ? sqrt(sq_sum / (num_values - 1)) : 0;
+    s->min = values[0];
+    s->max = values[num_values - 1];
+    s->median = num_values % 2 == 1 ? values[num_values / 2] :
+	(values[num_values / 2 - 1] + values[num_values / 2]) / 2;
+}
+
+/* Lines not starting with a benchmark name and a median latency
+   (e.g., the header) are ignored. */
+static int load_baselines(const char *filename)
+{
+    FILE *f = fopen(filename, "r");
+
+    if (f == NULL) {
+	fprintf(stderr, "Unable to open \"%s\": %s.\n", filename,
+		strerror(errno));
+	return -1;
+    }
+
+    char line[256];
+    while (num_baselines < MAX_BENCHES && fgets(line, sizeof(line), f)) {
+	struct baseline *bl = &baselines[num_baselines];
+
+	if (sscanf(line, "%127s %lf", bl->name, &bl->median) == 2)
+	    num_baselines++;
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+static const struct baseline *find_baseline(const char *name)
+{
+    int i;
+    for (i = 0; i < num_baselines; i++)
+	if (strcmp(baselines[i].name, name) == 0)
+	    return &baselines[i];
+    return NULL;
+}
+
+/* Returns 1 in case the benchmark is slower than allowed. A
+   non-positive 'max_ratio' means no check is performed. */
+static int compare(const char *name, double median, double max_ratio)
+{
+    const struct baseline *bl = find_baseline(name);
+
+    if (bl == NULL || bl->median <= 0) {
+	printf(" %8s\n", "-");
+	return 0;
+    }
+
+    double ratio = median / bl->median;
+
+    printf(" %8.2f\n", ratio);
+
+    if (max_ratio > 0 && ratio > max_ratio) {
+	fflush(stdout);
+	fprintf(stderr, "%s: Median latency %.1f ns/op is %.2f times the "
+		"baseline %.1f ns/op, exceeding the limit of %.2f.\n",
+		name, median, ratio, bl->median, max_ratio);
+	return 1;
+    }
+
+    return 0;
+}
+
+/* Returns -1 on failure, 1 in case the benchmark was found to have
+   regressed, and 0 otherwise. */
+static int run_bench(const struct bench *b, int num_samples,
+		     double sample_time, double max_ratio)
+{
+    void *ctx = NULL;
+
+    if (b->setup != NULL && (ctx = b->setup()) == NULL) {
+	fprintf(stderr, "%s:%s: Setup failed.\n", b->suite_name, b->name);
+	return -1;
+    }
+
+    uint64_t num_ops = calibrate(b, ctx, sample_time);
+
+    /* warm-up */
+    time_run(b, ctx, num_ops);
+
+    double ns_per_op[num_samples];
+    int i;
+
+    for (i = 0; i < num_samples; i++)
+	ns_per_op[i] = time_run(b, ctx, num_ops) / num_ops * 1e9;
+
+    if (b->teardown != NULL)
+	b->teardown(ctx);
+
+    struct summary s;
+    summarize(ns_per_op, num_samples, &s);
+
+    char name[MAX_NAME];
+    snprintf(name, sizeof(name), "%s:%s", b->suite_name, b->name);
+
+    printf("%-36s %10.1f %10.1f %10.1f %8.1f %10.1f %12" PRIu64,
+	   name, s.median, s.min, s.mean, s.stddev, s.max, num_ops);
+
+    int rc = 0;
+
+    if (num_baselines > 0)
+	rc = compare(name, s.median, max_ratio);
+    else
+	printf("\n");
+
+    fflush(stdout);
+
+    return rc;
+}
+
+static int cmp_bench(const void *a, const void *b)
+{
+    const struct bench *ba = a;
+    const struct bench *bb = b;
+
+    int rc = strcmp(ba->suite_name, bb->suite_name);
+
+    return rc != 0 ? rc : strcmp(ba->name, bb->name);
+}
+
+static bool bench_matches(const struct bench *b, const char *filter)
+{
+    const char *colon = strchr(filter, ':');
+
+    if (colon == NULL)
+	return strcmp(b->suite_name, filter) == 0;
+
+    size_t suite_len = colon - filter;
+
+    return strlen(b->suite_name) == suite_len &&
+	strncmp(b->suite_name, filter, suite_len) == 0 &&
+	strcmp(b->name, colon + 1) == 0;
+}
+
+static bool bench_selected(const struct bench *b, int num_filters,
+			   char **filters)
+{
+    if (num_filters == 0)
+	return true;
+
+    int i;
+    for (i = 0; i < num_filters; i++)
+	if (bench_matches(b, filters[i]))
+	    return true;
+
+    return false;
+}
+
+static void usage(const char *name)
+{
+    printf("%s [-l] [-s <samples>] [-t <sample-time>] [-c <file> "
+	   "[-r <max-ratio>]]\n"
+	   "        [<suite>[:<bench>] ...]\n", name);
+    printf("Options:\n");
+    printf("  -l:                List available benchmarks.\n");
+    printf("  -s <samples>:      Take <samples> samples per benchmark "
+	   "(default %d).\n", DEFAULT_SAMPLES);
+    printf("  -t <sample-time>:  Target a sample duration of "
+	   "<sample-time> s (default %.2f).\n", DEFAULT_SAMPLE_TIME);
+    printf("  -c <file>:         Compare the median latencies with those "
+	   "of an earlier run,\n"
+	   "                     with <file> holding that run's output.\n");
+    printf("  -r <max-ratio>:    Fail if any median latency exceeds its "
+	   "earlier counterpart\n"
+	   "                     by more than a factor <max-ratio>.\n");
+    printf("All latency figures are in ns/op.\n");
+}
+
+int main(int argc, char **argv)
+{
+    bool list = false;
+    int num_samples = DEFAULT_SAMPLES;
+    double sample_time = DEFAULT_SAMPLE_TIME;
+    const char *baseline_file = NULL;
+    double max_ratio = -1;
+    int c;
+
+    while ((c = getopt(argc, argv, "ls:t:c:r:h")) != -1)
+	switch (c) {
+	case 'l':
+	    list = true;
+	    break;
+	case 's':
+	    num_samples = atoi(optarg);
+	    break;
+	case 't':
+	    sample_time = atof(optarg);
+	    break;
+	case 'c':
+	    baseline_file = optarg;
+	    break;
+	case 'r':
+	    max_ratio = atof(optarg);
+	    break;
+	case 'h':
+	    usage(argv[0]);
+	    exit(EXIT_SUCCESS);
+	default:
+	    usage(argv[0]);
+	    exit(EXIT_FAILURE);
+	}
+
+    if (num_samples < 1 || sample_time <= 0 ||
+	(max_ratio != -1 && (max_ratio <= 0 || baseline_file == NULL))) {
+	usage(argv[0]);
+	exit(EXIT_FAILURE);
+    }
+
+    if (baseline_file != NULL && load_baselines(baseline_file) < 0)
+	exit(EXIT_FAILURE);
+
+    /* registration order depends on link and constructor order */
+    qsort(benches, num_benches, sizeof(struct bench), cmp_bench);
+
+    int num_filters = argc - optind;
+    char **filters = &argv[optind];
+    int i;
+
+    if (list) {
+	for (i = 0; i < num_benches; i++)
+	    if (bench_selected(&benches[i], num_filters, filters))
+		printf("%s:%s\n", benches[i].suite_name, benches[i].name);
+	exit(EXIT_SUCCESS);
+    }
+
+    printf("%-36s %10s %10s %10s %8s %10s %12s", "Benchmark", "Median",
+	   "Min", "Mean", "Stddev", "Max", "Ops/sample");
+    if (baseline_file != NULL)
+	printf(" %8s", "Ratio");
+    printf("\n");
+
+    int failed = 0;
+    int regressed = 0;
+
+    for (i = 0; i < num_benches; i++) {
+	if (!bench_selected(&benches[i], num_filters, filters))
+	    continue;
+
+	int rc = run_bench(&benches[i], num_samples, sample_time, max_ratio);
+
+	if (rc < 0)
+	    failed++;
+	else if (rc > 0)
+	    regressed++;
+    }
+
+    exit(failed > 0 || regressed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,44 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/* Returns a benchmark-specific context, or NULL on failure. */
+typedef void *(*bench_setup_fun)(void);
+
+/* Performs 'num_ops' iterations of the operation under test. */
+typedef void (*bench_run_fun)(void *ctx, uint64_t num_ops);
+
+typedef void (*bench_teardown_fun)(void *ctx);
+
+void bench_register(const char *suite_name, const char *name,
+		    bench_setup_fun setup, bench_run_fun run,
+		    bench_teardown_fun teardown);
+
+/* Prevents the compiler from optimizing away a computation, the
+   result of which is otherwise unused. */
+#define BENCH_KEEP(value)				\
+    __asm__ volatile("" : : "g" (value) : "memory")
+
+#define BENCH_FIXTURE(suite_name, bench_name, setup, teardown)		\
+    static void bench_ ## suite_name ## _ ## bench_name ## _run		\
+    (void *ctx, uint64_t num_ops);					\
+    static __attribute__ ((constructor))				\
+    void bench_ ## suite_name ## _ ## bench_name ## _reg(void)		\
+    {									\
+	bench_register(#suite_name, #bench_name, setup,			\
+		       bench_ ## suite_name ## _ ## bench_name ## _run,	\
+		       teardown);					\
+    }									\
+    static void bench_ ## suite_name ## _ ## bench_name ## _run		\
+    (void *ctx __attribute__ ((unused)), uint64_t num_ops)
+
+#define BENCH(suite_name, bench_name)			\
+    BENCH_FIXTURE(suite_name, bench_name, NULL, NULL)
+
+#endif
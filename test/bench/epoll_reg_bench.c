@@ -0,0 +1,77 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "bench.h"
+
+#include "epoll_reg.h"
+#include "util.h"
+
+#include <sys/eventfd.h>
+
+struct epoll_ctx
+{
+    int epoll_fd;
+    int fd;
+    struct epoll_reg reg;
+};
+
+static void *epoll_setup(void)
+{
+    struct epoll_ctx *ctx = ut_malloc(sizeof(struct epoll_ctx));
+
+    ctx->epoll_fd = epoll_create1(0);
+    ctx->fd = eventfd(0, EFD_NONBLOCK);
+
+    if (ctx->epoll_fd < 0 || ctx->fd < 0) {
+	ut_free(ctx);
+	return NULL;
+    }
+
+    epoll_reg_init(&ctx->reg, ctx->epoll_fd, ctx->fd, NULL);
+
+    return ctx;
+}
+
+static void epoll_teardown(void *ptr)
+{
+    struct epoll_ctx *ctx = ptr;
+
+    epoll_reg_reset(&ctx->reg);
+    close(ctx->fd);
+    close(ctx->epoll_fd);
+    ut_free(ctx);
+}
+
+/* the common case, where the registration is already in place */
+BENCH_FIXTURE(epoll_reg, ensure_unchanged, epoll_setup, epoll_teardown)
+{
+    struct epoll_ctx *ectx = ctx;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++)
+	epoll_reg_ensure(&ectx->reg, EPOLLIN);
+}
+
+BENCH_FIXTURE(epoll_reg, ensure_toggle, epoll_setup, epoll_teardown)
+{
+    struct epoll_ctx *ectx = ctx;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++)
+	epoll_reg_ensure(&ectx->reg, i & 1 ? EPOLLIN : EPOLLOUT);
+}
+
+BENCH_FIXTURE(epoll_reg, add_del, epoll_setup, epoll_teardown)
+{
+    struct epoll_ctx *ectx = ctx;
+    uint64_t i;
+
+    epoll_reg_reset(&ectx->reg);
+
+    for (i = 0; i < num_ops; i++) {
+	epoll_reg_ensure(&ectx->reg, EPOLLIN);
+	epoll_reg_reset(&ectx->reg);
+    }
+}
@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "bench.h"
+
+#include "log_tp.h"
+
+/* The cost of logging while disabled is paid on every hot path, and
+   should remain close to zero. */
+
+BENCH(log, is_enabled)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++)
+	BENCH_KEEP(log_is_enabled(log_type_debug));
+}
+
+BENCH(log, disabled_debug)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++)
+	log_debug("Iteration %" PRIu64 " of %" PRIu64 ".", i, num_ops);
+}
+
+BENCH(log, disabled_sock_macro)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++)
+	LOG_CONN_REQ("tcp:127.0.0.1:4711");
+}
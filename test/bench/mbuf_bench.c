@@ -0,0 +1,80 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "bench.h"
+
+#include <arpa/inet.h>
+
+#include "mbuf.h"
+
+#define MSG_SIZE (100)
+
+struct mbuf_ctx
+{
+    struct mbuf buf;
+    char msg[MSG_SIZE];
+    char wire[MBUF_HDR_LEN + MSG_SIZE];
+};
+
+static void *mbuf_setup(void)
+{
+    struct mbuf_ctx *ctx = ut_calloc(sizeof(struct mbuf_ctx));
+
+    mbuf_init(&ctx->buf);
+    mbuf_set(&ctx->buf, ctx->msg, sizeof(ctx->msg));
+    memcpy(ctx->wire, mbuf_wire_start(&ctx->buf), sizeof(ctx->wire));
+
+    return ctx;
+}
+
+static void mbuf_teardown(void *ptr)
+{
+    struct mbuf_ctx *ctx = ptr;
+
+    mbuf_deinit(&ctx->buf);
+    ut_free(ctx);
+}
+
+BENCH_FIXTURE(mbuf, frame, mbuf_setup, mbuf_teardown)
+{
+    struct mbuf_ctx *mctx = ctx;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	mbuf_set(&mctx->buf, mctx->msg, sizeof(mctx->msg));
+	BENCH_KEEP(mbuf_wire_start(&mctx->buf));
+    }
+}
+
+/* mimics the receive path of the byte stream transports, with the
+   header and the payload arriving in separate segments */
+BENCH_FIXTURE(mbuf, parse, mbuf_setup, mbuf_teardown)
+{
+    struct mbuf_ctx *mctx = ctx;
+    struct mbuf *buf = &mctx->buf;
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	mbuf_reset(buf);
+
+	mbuf_wire_ensure_spare_capacity(buf, MBUF_HDR_LEN);
+	memcpy(mbuf_wire_end(buf), mctx->wire, MBUF_HDR_LEN);
+	mbuf_wire_appended(buf, MBUF_HDR_LEN);
+
+	if (!mbuf_has_complete_hdr(buf) || !mbuf_is_hdr_valid(buf))
+	    abort();
+
+	int left = mbuf_payload_left(buf);
+
+	mbuf_wire_ensure_spare_capacity(buf, left);
+	memcpy(mbuf_wire_end(buf), mctx->wire + MBUF_HDR_LEN, left);
+	mbuf_wire_appended(buf, left);
+
+	if (!mbuf_is_complete(buf))
+	    abort();
+
+	BENCH_KEEP(mbuf_payload_start(buf));
+    }
+}
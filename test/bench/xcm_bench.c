@@ -0,0 +1,166 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "bench.h"
+
+#include "util.h"
+#include "xcm.h"
+#include "xcm_attr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MSG_SIZE (100)
+
+/* A connection pair, with both ends in the benchmark process. Each
+   operation is a message sent from the client and received by the
+   server. */
+
+struct pair_ctx
+{
+    struct xcm_socket *server_sock;
+    struct xcm_socket *client_conn;
+    struct xcm_socket *server_conn;
+};
+
+static void pair_teardown(void *ptr)
+{
+    struct pair_ctx *ctx = ptr;
+
+    xcm_close(ctx->client_conn);
+    xcm_close(ctx->server_conn);
+    xcm_close(ctx->server_sock);
+    ut_free(ctx);
+}
+
+static void *pair_setup(const char *addr)
+{
+    struct pair_ctx *ctx = ut_calloc(sizeof(struct pair_ctx));
+
+    ctx->server_sock = xcm_server(addr);
+    if (ctx->server_sock == NULL)
+	goto err_free;
+
+    char actual_addr[64];
+    if (xcm_attr_get_str(ctx->server_sock, "xcm.local_addr", actual_addr,
+			 sizeof(actual_addr)) < 0)
+	goto err_close_server;
+
+    /* for TCP, the kernel completes the handshake before accept */
+    ctx->client_conn = xcm_connect(actual_addr, 0);
+    if (ctx->client_conn == NULL)
+	goto err_close_server;
+
+    ctx->server_conn = xcm_accept(ctx->server_sock);
+    if (ctx->server_conn == NULL)
+	goto err_close_client;
+
+    return ctx;
+
+err_close_client:
+    xcm_close(ctx->client_conn);
+err_close_server:
+    xcm_close(ctx->server_sock);
+err_free:
+    ut_free(ctx);
+    return NULL;
+}
+
+static void *ux_setup(void)
+{
+    char addr[64];
+    snprintf(addr, sizeof(addr), "ux:xcmbench-%d", getpid());
+
+    return pair_setup(addr);
+}
+
+static void *shm_setup(void)
+{
+    char addr[64];
+    snprintf(addr, sizeof(addr), "shm:xcmbench-%d", getpid());
+
+    return pair_setup(addr);
+}
+
+static void *inproc_setup(void)
+{
+    char addr[64];
+    snprintf(addr, sizeof(addr), "inproc:xcmbench-%d", getpid());
+
+    return pair_setup(addr);
+}
+
+static void *tcp_setup(void)
+{
+    return pair_setup("tcp:127.0.0.1:0");
+}
+
+static void pair_run(struct pair_ctx *ctx, uint64_t num_ops)
+{
+    char msg[MSG_SIZE] = {};
+    uint64_t i;
+
+    for (i = 0; i < num_ops; i++) {
+	if (xcm_send(ctx->client_conn, msg, sizeof(msg)) < 0)
+	    abort();
+	if (xcm_receive(ctx->server_conn, msg, sizeof(msg)) != sizeof(msg))
+	    abort();
+    }
+}
+
+BENCH_FIXTURE(xcm, ux_send_receive, ux_setup, pair_teardown)
+{
+    pair_run(ctx, num_ops);
+}
+
+#define BATCH_SIZE (16)
+
+/* Messages are sent in batches, and received one by one, which
+   with UX exercises both sendmmsg() and the read-ahead. */
+static void pair_run_batched(struct pair_ctx *ctx, uint64_t num_ops)
+{
+    char msg[MSG_SIZE] = {};
+    struct iovec msgs[BATCH_SIZE];
+    uint64_t i;
+
+    for (i = 0; i < BATCH_SIZE; i++)
+	msgs[i] = (struct iovec) {
+	    .iov_base = msg,
+	    .iov_len = sizeof(msg)
+	};
+
+    for (i = 0; i < num_ops; i += BATCH_SIZE) {
+	size_t batch_size = UT_MIN(BATCH_SIZE, num_ops - i);
+
+	if (xcm_send_batch(ctx->client_conn, msgs, batch_size) != batch_size)
+	    abort();
+
+	size_t j;
+	for (j = 0; j < batch_size; j++)
+	    if (xcm_receive(ctx->server_conn, msg, sizeof(msg)) !=
+		sizeof(msg))
+		abort();
+    }
+}
+
+BENCH_FIXTURE(xcm, ux_batch_send_receive, ux_setup, pair_teardown)
+{
+    pair_run_batched(ctx, num_ops);
+}
+
+BENCH_FIXTURE(xcm, shm_send_receive, shm_setup, pair_teardown)
+{
+    pair_run(ctx, num_ops);
+}
+
+BENCH_FIXTURE(xcm, inproc_send_receive, inproc_setup, pair_teardown)
+{
+    pair_run(ctx, num_ops);
+}
+
+BENCH_FIXTURE(xcm, tcp_send_receive, tcp_setup, pair_teardown)
+{
+    pair_run(ctx, num_ops);
+}
@@ -0,0 +1,541 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+/*
+ * Per-connection memory and file descriptor usage benchmark.
+ *
+ * A server process is forked, and the client establishes a number of
+ * connections to it. The resident set size (RSS) and the number of
+ * open file descriptors of both processes are sampled (via
+ * /proc/self/status and /proc/self/fd) before any connections are
+ * made, after all connections are established but before any data
+ * has been exchanged ("idle"), and after a message has been
+ * exchanged on every connection ("active"). The difference, divided
+ * by the number of connections, is reported as the per-connection
+ * cost.
+ *
+ * An address with a port number of zero (e.g., "tcp:127.0.0.1:0")
+ * is bound to an ephemeral port.
+ *
+ * A memory and/or a file descriptor budget may be given, in which
+ * case the program exits with a non-zero status if any of the
+ * per-connection costs exceed it.
+ */
+
+#include "xcm.h"
+#include "xcm_addr_limits.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DEFAULT_CONNS (500)
+#define MSG_SIZE (100)
+#define MAX_EVENTS (64)
+
+#define MEASURE_REQ 'm'
+
+static void usage(const char *name)
+{
+    printf("%s [-n <conns>] [-m <max-bytes>] [-f <max-fds>] <addr> "
+	   "[<addr> ...]\n", name);
+    printf("Options:\n");
+    printf("  -n <conns>:     Establish <conns> connections per address. "
+	   "Default is %d.\n", DEFAULT_CONNS);
+    printf("  -m <max-bytes>: Fail if the memory usage per connection "
+	   "exceeds <max-bytes>\n"
+	   "                  bytes, for either endpoint.\n");
+    printf("  -f <max-fds>:   Fail if the number of file descriptors per "
+	   "connection\n"
+	   "                  exceeds <max-fds>, for either endpoint.\n");
+}
+
+static void die(const char *msg)
+{
+    perror(msg);
+    exit(EXIT_FAILURE);
+}
+
+struct usage
+{
+    int64_t open_conns;
+    int64_t rss;
+    int64_t fds;
+};
+
+static int64_t get_rss(void)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL)
+	die("Unable to open /proc/self/status");
+
+    char line[256];
+    int64_t rss_kb = -1;
+
+    while (fgets(line, sizeof(line), f) != NULL)
+	if (sscanf(line, "VmRSS: %" SCNd64 " kB", &rss_kb) == 1)
+	    break;
+
+    fclose(f);
+
+    if (rss_kb < 0) {
+	fprintf(stderr, "Unable to find RSS in /proc/self/status.\n");
+	exit(EXIT_FAILURE);
+    }
+
+    return rss_kb * 1024;
+}
+
+static int64_t get_fds(void)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == NULL)
+	die("Unable to open /proc/self/fd");
+
+    int64_t fds = 0;
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)) != NULL)
+	if (entry->d_name[0] != '.')
+	    fds++;
+
+    closedir(dir);
+
+    /* don't count the directory fd itself */
+    return fds - 1;
+}
+
+static void get_usage(struct usage *u, int64_t open_conns)
+{
+    u->open_conns = open_conns;
+    u->rss = get_rss();
+    u->fds = get_fds();
+}
+
+static void epoll_add(int epoll_fd, int fd, void *ptr)
+{
+    struct epoll_event event = {
+	.events = EPOLLIN,
+	.data.ptr = ptr
+    };
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+	die("Unable to add fd to epoll instance");
+}
+
+static void server_accept(struct xcm_socket *server_sock, int epoll_fd,
+			  int64_t *open_conns)
+{
+    for (;;) {
+	struct xcm_socket *conn = xcm_accept(server_sock);
+
+	if (conn == NULL) {
+	    if (errno != EAGAIN)
+		die("Error accepting connection");
+	    return;
+	}
+
+	if (xcm_await(conn, XCM_SO_RECEIVABLE) < 0)
+	    die("Unable to set connection socket condition");
+
+	epoll_add(epoll_fd, xcm_fd(conn), conn);
+
+	(*open_conns)++;
+    }
+}
+
+static void server_process(struct xcm_socket *conn, int64_t *open_conns)
+{
+    char msg[MSG_SIZE];
+
+    int rc = xcm_receive(conn, msg, sizeof(msg));
+
+    if (rc < 0 && errno == EAGAIN)
+	return;
+
+    if (rc > 0) {
+	if (xcm_send(conn, msg, rc) < 0)
+	    die("Unable to send response");
+	return;
+    }
+
+    /* closing the connection also removes it from the epoll set */
+    xcm_close(conn);
+    (*open_conns)--;
+}
+
+static void write_all(int fd, const void *buf, size_t len)
+{
+    if (write(fd, buf, len) != len)
+	die("Unable to write to pipe");
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+    size_t offset = 0;
+
+    while (offset < len) {
+	ssize_t rc = read(fd, buf + offset, len - offset);
+
+	if (rc < 0 && errno == EINTR)
+	    continue;
+	if (rc < 0)
+	    die("Unable to read from pipe");
+	if (rc == 0)
+	    return false;
+
+	offset += rc;
+    }
+
+    return true;
+}
+
+static void run_server(const char *addr, int req_fd, int res_fd)
+{
+    struct xcm_socket *server_sock = xcm_server(addr);
+
+    if (server_sock == NULL)
+	die("Unable to bind server socket");
+
+    /* the actual address, in case an ephemeral port was asked for */
+    const char *local_addr = xcm_local_addr(server_sock);
+    if (local_addr == NULL)
+	die("Unable to retrieve server socket address");
+
+    char actual_addr[XCM_ADDR_MAX + 1] = { 0 };
+    strncpy(actual_addr, local_addr, XCM_ADDR_MAX);
+    write_all(res_fd, actual_addr, sizeof(actual_addr));
+
+    if (xcm_set_blocking(server_sock, false) < 0 ||
+	xcm_await(server_sock, XCM_SO_ACCEPTABLE) < 0)
+	die("Unable to configure server socket");
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0)
+	die("Unable to create epoll instance");
+
+    epoll_add(epoll_fd, xcm_fd(server_sock), NULL);
+    epoll_add(epoll_fd, req_fd, &req_fd);
+
+    int64_t open_conns = 0;
+
+    struct usage u;
+    get_usage(&u, open_conns);
+    write_all(res_fd, &u, sizeof(u));
+
+    for (;;) {
+	struct epoll_event events[MAX_EVENTS];
+
+	int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+	if (num_events < 0) {
+	    if (errno == EINTR)
+		continue;
+	    die("I/O multiplexing failure");
+	}
+
+	int i;
+	for (i = 0; i < num_events; i++) {
+	    void *ptr = events[i].data.ptr;
+
+	    if (ptr == &req_fd) {
+		char req;
+		if (!read_all(req_fd, &req, sizeof(req)))
+		    exit(EXIT_SUCCESS);
+		get_usage(&u, open_conns);
+		write_all(res_fd, &u, sizeof(u));
+	    } else if (ptr == NULL)
+		server_accept(server_sock, epoll_fd, &open_conns);
+	    else
+		server_process(ptr, &open_conns);
+	}
+    }
+}
+
+/* waits until the server has accepted (and not yet closed)
+   'open_conns' connections */
+static void get_server_usage(int req_fd, int res_fd, int64_t open_conns,
+			     struct usage *u)
+{
+    for (;;) {
+	char req = MEASURE_REQ;
+	write_all(req_fd, &req, sizeof(req));
+
+	if (!read_all(res_fd, u, sizeof(*u))) {
+	    fprintf(stderr, "Server process terminated unexpectedly.\n");
+	    exit(EXIT_FAILURE);
+	}
+
+	if (u->open_conns == open_conns)
+	    return;
+
+	usleep(10000);
+    }
+}
+
+/* a UX connection attempt fails with EAGAIN in case the server's
+   accept queue is full */
+static struct xcm_socket *connect_retry(const char *addr)
+{
+    for (;;) {
+	struct xcm_socket *conn = xcm_connect(addr, 0);
+
+	if (conn != NULL || errno != EAGAIN)
+	    return conn;
+
+	usleep(1000);
+    }
+}
+
+struct cost
+{
+    double bytes;
+    double fds;
+};
+
+static void calc_cost(const struct usage *base, const struct usage *u,
+		      int num_conns, struct cost *cost)
+{
+    cost->bytes = (double)(u->rss - base->rss) / num_conns;
+    cost->fds = (double)(u->fds - base->fds) / num_conns;
+}
+
+static bool check_budget(const char *addr, const char *what,
+			 const struct cost *cost, double max_bytes,
+			 double max_fds)
+{
+    bool ok = true;
+
+    if (max_bytes >= 0 && cost->bytes > max_bytes) {
+	fprintf(stderr, "%s: %s memory usage %.0f bytes/connection exceeds "
+		"budget of %.0f bytes/connection.\n", addr, what,
+		cost->bytes, max_bytes);
+	ok = false;
+    }
+
+    if (max_fds >= 0 && cost->fds > max_fds) {
+	fprintf(stderr, "%s: %s file descriptor usage %.2f fds/connection "
+		"exceeds budget of %.2f fds/connection.\n", addr, what,
+		cost->fds, max_fds);
+	ok = false;
+    }
+
+    return ok;
+}
+
+static void print_cost(const char *addr, const char *state,
+		       const struct cost *client, const struct cost *server)
+{
+    printf("%-24s %-6s  %12.0f  %10.2f  %12.0f  %10.2f\n", addr, state,
+	   client->bytes, client->fds, server->bytes, server->fds);
+}
+
+static bool bench_addr(const char *addr, int num_conns, double max_bytes,
+		       double max_fds)
+{
+    int req_pipe[2];
+    int res_pipe[2];
+
+    if (pipe(req_pipe) < 0 || pipe(res_pipe) < 0)
+	die("Unable to create pipe");
+
+    fflush(stdout);
+
+    pid_t server_pid = fork();
+
+    if (server_pid < 0)
+	die("Unable to fork server process");
+    else if (server_pid == 0) {
+	close(req_pipe[1]);
+	close(res_pipe[0]);
+	run_server(addr, req_pipe[0], res_pipe[1]);
+    }
+
+    close(req_pipe[0]);
+    close(res_pipe[1]);
+
+    char server_addr[XCM_ADDR_MAX + 1];
+    struct usage server_base;
+    if (!read_all(res_pipe[0], server_addr, sizeof(server_addr)) ||
+	!read_all(res_pipe[0], &server_base, sizeof(server_base))) {
+	fprintf(stderr, "Server process failed to start.\n");
+	exit(EXIT_FAILURE);
+    }
+
+    /* The first connection in a process may carry one-time costs
+       (e.g., loading TLS certificates), which should not be
+       attributed to each connection. */
+    struct xcm_socket *warmup = connect_retry(server_addr);
+    if (warmup == NULL)
+	die("Unable to establish warm-up connection");
+    get_server_usage(req_pipe[1], res_pipe[0], 1, &server_base);
+
+    struct usage client_base;
+    get_usage(&client_base, 0);
+
+    struct xcm_socket *conns[num_conns];
+    int i;
+
+    for (i = 0; i < num_conns; i++) {
+	conns[i] = connect_retry(server_addr);
+	if (conns[i] == NULL)
+	    die("Unable to connect");
+    }
+
+    struct usage client_idle;
+    struct usage server_idle;
+    get_usage(&client_idle, num_conns);
+    get_server_usage(req_pipe[1], res_pipe[0], num_conns + 1, &server_idle);
+
+    char msg[MSG_SIZE];
+    memset(msg, 0, sizeof(msg));
+
+    for (i = 0; i < num_conns; i++)
+	if (xcm_send(conns[i], msg, sizeof(msg)) < 0)
+	    die("Unable to send message");
+
+    for (i = 0; i < num_conns; i++)
+	if (xcm_receive(conns[i], msg, sizeof(msg)) != sizeof(msg))
+	    die("Unable to receive message");
+
+    struct usage client_active;
+    struct usage server_active;
+    get_usage(&client_active, num_conns);
+    get_server_usage(req_pipe[1], res_pipe[0], num_conns + 1,
+		     &server_active);
+
+    for (i = 0; i < num_conns; i++)
+	xcm_close(conns[i]);
+    xcm_close(warmup);
+
+    close(req_pipe[1]);
+    close(res_pipe[0]);
+
+    if (waitpid(server_pid, NULL, 0) < 0)
+	die("Unable to wait for server process");
+
+    struct cost client_idle_cost;
+    struct cost server_idle_cost;
+    struct cost client_active_cost;
+    struct cost server_active_cost;
+
+    calc_cost(&client_base, &client_idle, num_conns, &client_idle_cost);
+    calc_cost(&server_base, &server_idle, num_conns, &server_idle_cost);
+    calc_cost(&client_base, &client_active, num_conns, &client_active_cost);
+    calc_cost(&server_base, &server_active, num_conns, &server_active_cost);
+
+    print_cost(addr, "idle", &client_idle_cost, &server_idle_cost);
+    print_cost(addr, "active", &client_active_cost, &server_active_cost);
+    fflush(stdout);
+
+    bool ok = true;
+
+    ok = check_budget(addr, "Idle client", &client_idle_cost, max_bytes,
+		      max_fds) && ok;
+    ok = check_budget(addr, "Idle server", &server_idle_cost, max_bytes,
+		      max_fds) && ok;
+    ok = check_budget(addr, "Active client", &client_active_cost,
+		      max_bytes, max_fds) && ok;
+    ok = check_budget(addr, "Active server", &server_active_cost,
+		      max_bytes, max_fds) && ok;
+
+    return ok;
+}
+
+/* Heap memory freed is generally not returned to the OS, so each
+   address is benchmarked in a fresh client process. */
+static bool bench_addr_isolated(const char *addr, int num_conns,
+				double max_bytes, double max_fds)
+{
+    fflush(stdout);
+
+    pid_t client_pid = fork();
+
+    if (client_pid < 0)
+	die("Unable to fork client process");
+    else if (client_pid == 0) {
+	bool ok = bench_addr(addr, num_conns, max_bytes, max_fds);
+	exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status;
+    if (waitpid(client_pid, &status, 0) < 0)
+	die("Unable to wait for client process");
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static void raise_fd_limit(void)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0)
+	die("Unable to retrieve file descriptor limit");
+
+    limit.rlim_cur = limit.rlim_max;
+
+    if (setrlimit(RLIMIT_NOFILE, &limit) < 0)
+	die("Unable to raise file descriptor limit");
+}
+
+int main(int argc, char **argv)
+{
+    int num_conns = DEFAULT_CONNS;
+    double max_bytes = -1;
+    double max_fds = -1;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:m:f:h")) != -1)
+	switch (c) {
+	case 'n':
+	    num_conns = atoi(optarg);
+	    break;
+	case 'm':
+	    max_bytes = atof(optarg);
+	    break;
+	case 'f':
+	    max_fds = atof(optarg);
+	    break;
+	case 'h':
+	    usage(argv[0]);
+	    exit(EXIT_SUCCESS);
+	default:
+	    usage(argv[0]);
+	    exit(EXIT_FAILURE);
+	}
+
+    if (optind == argc || num_conns < 1) {
+	usage(argv[0]);
+	exit(EXIT_FAILURE);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    raise_fd_limit();
+
+    printf("%-24s %-6s  %12s  %10s  %12s  %10s\n", "", "", "Client",
+	   "Client", "Server", "Server");
+    printf("%-24s %-6s  %12s  %10s  %12s  %10s\n", "Address", "State",
+	   "[bytes/conn]", "[fds/conn]", "[bytes/conn]", "[fds/conn]");
+
+    bool ok = true;
+    int i;
+
+    for (i = optind; i < argc; i++)
+	ok = bench_addr_isolated(argv[i], num_conns, max_bytes, max_fds) &&
+	    ok;
+
+    exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,988 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+#include "testutil.h"
+#include "utest.h"
+#include "util.h"
+#include "xcm_loop.h"
+#include "xcm_mux.h"
+#include "xcm_rt.h"
+
+#include <arpa/inet.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+TESTSUITE(loop, NULL, NULL)
+
+#define NUM_MSGS (1000)
+#define MAX_IN_FLIGHT (8)
+
+#define DEADLINE_MS (5000)
+
+struct loop_state
+{
+    struct xcm_loop *loop;
+    struct xcm_loop_sock *server_conn;
+    int num_received;
+    int num_sent;
+    bool writable;
+    bool closed;
+    int close_errno;
+    int send_errno;
+    bool timed_out;
+};
+
+static char *gen_loop_addr(void)
+{
+    char *addr;
+    return asprintf(&addr, "ux:test-loop.%d", getpid()) < 0 ? NULL : addr;
+}
+
+static void deadline_cb(struct xcm_loop *loop, void *user)
+{
+    struct loop_state *state = user;
+
+    state->timed_out = true;
+    xcm_loop_stop(loop);
+}
+
+static void echo_message_cb(struct xcm_loop_sock *conn_lsock,
+			    const void *msg, size_t len, void *user)
+{
+    xcm_loop_send(conn_lsock, msg, len);
+}
+
+static void server_close_cb(struct xcm_loop_sock *conn_lsock,
+			    int reason_errno, void *user)
+{
+    struct loop_state *state = user;
+
+    state->closed = true;
+    state->close_errno = reason_errno;
+    xcm_loop_stop(state->loop);
+}
+
+static void accept_cb(struct xcm_loop_sock *server_lsock,
+		      struct xcm_socket *conn_socket, void *user)
+{
+    struct loop_state *state = user;
+
+    struct xcm_loop_cbs cbs = {
+	.on_message = echo_message_cb,
+	.on_close = server_close_cb
+    };
+
+    state->server_conn = xcm_loop_add(state->loop, conn_socket, &cbs, user);
+}
+
+static void send_next(struct xcm_loop_sock *conn_lsock,
+		      struct loop_state *state)
+{
+    /* limit the number of messages in flight, so the echo server
+       never has to drop a message */
+    while (state->num_sent < NUM_MSGS &&
+	   state->num_sent - state->num_received < MAX_IN_FLIGHT) {
+	if (xcm_loop_send(conn_lsock, &state->num_sent,
+			  sizeof(state->num_sent)) < 0)
+	    return;
+	state->num_sent++;
+    }
+}
+
+static void client_message_cb(struct xcm_loop_sock *conn_lsock,
+			      const void *msg, size_t len, void *user)
+{
+    struct loop_state *state = user;
+
+    int seq;
+    memcpy(&seq, msg, sizeof(seq));
+
+    if (len != sizeof(seq) || seq != state->num_received)
+	return;
+
+    state->num_received++;
+
+    if (state->num_received == NUM_MSGS)
+	xcm_loop_stop(state->loop);
+    else
+	send_next(conn_lsock, state);
+}
+
+static void client_writable_cb(struct xcm_loop_sock *conn_lsock, void *user)
+{
+    struct loop_state *state = user;
+
+    state->writable = true;
+
+    send_next(conn_lsock, state);
+}
+
+static struct xcm_loop_sock *add_server(struct loop_state *state,
+					const char *addr)
+{
+    struct xcm_socket *server_sock = xcm_server(addr);
+
+    if (server_sock == NULL)
+	return NULL;
+
+    struct xcm_loop_cbs cbs = {
+	.on_accept = accept_cb
+    };
+
+    return xcm_loop_add(state->loop, server_sock, &cbs, state);
+}
+
+static struct xcm_loop_sock *add_client(struct loop_state *state,
+					const char *addr,
+					const struct xcm_loop_cbs *cbs)
+{
+    struct xcm_socket *conn = xcm_connect(addr, XCM_NONBLOCK);
+
+    if (conn == NULL)
+	return NULL;
+
+    return xcm_loop_add(state->loop, conn, cbs, state);
+}
+
+TESTCASE(loop, echo)
+{
+    char *addr = gen_loop_addr();
+
+    struct loop_state state = {
+	.loop = xcm_loop_create()
+    };
+    CHK(state.loop);
+
+    CHK(add_server(&state, addr));
+
+    struct xcm_loop_cbs client_cbs = {
+	.on_message = client_message_cb,
+	.on_writable = client_writable_cb
+    };
+    struct xcm_loop_sock *client = add_client(&state, addr, &client_cbs);
+    CHK(client);
+
+    send_next(client, &state);
+
+    struct xcm_loop_timer *deadline =
+	xcm_loop_timer_add(state.loop, DEADLINE_MS, deadline_cb, &state);
+
+    CHKNOERR(xcm_loop_run(state.loop));
+
+    CHK(!state.timed_out);
+    CHKINTEQ(state.num_received, NUM_MSGS);
+
+    /* the server side is notified when the client goes away */
+    xcm_loop_remove(client);
+
+    CHKNOERR(xcm_loop_run(state.loop));
+
+    CHK(!state.timed_out);
+    CHK(state.closed);
+    CHKINTEQ(state.close_errno, 0);
+
+    xcm_loop_timer_cancel(deadline);
+
+    xcm_loop_destroy(state.loop);
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+static void stop_when_writable_cb(struct xcm_loop_sock *conn_lsock,
+				  void *user)
+{
+    struct loop_state *state = user;
+
+    state->writable = true;
+    xcm_loop_stop(state->loop);
+}
+
+TESTCASE(loop, writable)
+{
+    char *addr = gen_loop_addr();
+
+    struct loop_state state = {
+	.loop = xcm_loop_create()
+    };
+    CHK(state.loop);
+
+    CHK(add_server(&state, addr));
+
+    struct xcm_loop_cbs client_cbs = {
+	.on_writable = stop_when_writable_cb
+    };
+    struct xcm_loop_sock *client = add_client(&state, addr, &client_cbs);
+    CHK(client);
+
+    while (state.server_conn == NULL)
+	CHKNOERR(xcm_loop_run_once(state.loop, 10));
+
+    /* fill the connection, without running the loop */
+    char msg[1024] = { 0 };
+    int rc;
+    while ((rc = xcm_loop_send(client, msg, sizeof(msg))) == 0)
+	state.num_sent++;
+    CHKERRNOEQ(EAGAIN);
+    CHK(state.num_sent > 0);
+
+    struct xcm_loop_timer *deadline =
+	xcm_loop_timer_add(state.loop, DEADLINE_MS, deadline_cb, &state);
+
+    CHKNOERR(xcm_loop_run(state.loop));
+
+    CHK(!state.timed_out);
+    CHK(state.writable);
+
+    xcm_loop_timer_cancel(deadline);
+
+    xcm_loop_destroy(state.loop);
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+static void remove_and_send_cb(struct xcm_loop_sock *conn_lsock,
+			       const void *msg, size_t len, void *user)
+{
+    struct loop_state *state = user;
+
+    xcm_loop_remove(conn_lsock);
+
+    if (xcm_loop_send(conn_lsock, msg, len) < 0)
+	state->send_errno = errno;
+
+    xcm_loop_stop(state->loop);
+}
+
+TESTCASE(loop, send_on_removed)
+{
+    char *addr = gen_loop_addr();
+
+    struct loop_state state = {
+	.loop = xcm_loop_create()
+    };
+    CHK(state.loop);
+
+    CHK(add_server(&state, addr));
+
+    struct xcm_loop_cbs client_cbs = {
+	.on_message = remove_and_send_cb
+    };
+    struct xcm_loop_sock *client = add_client(&state, addr, &client_cbs);
+    CHK(client);
+
+    int seq = 0;
+    CHKNOERR(xcm_loop_send(client, &seq, sizeof(seq)));
+
+    struct xcm_loop_timer *deadline =
+	xcm_loop_timer_add(state.loop, DEADLINE_MS, deadline_cb, &state);
+
+    CHKNOERR(xcm_loop_run(state.loop));
+
+    CHK(!state.timed_out);
+    CHKINTEQ(state.send_errno, EBADF);
+
+    xcm_loop_timer_cancel(deadline);
+
+    xcm_loop_destroy(state.loop);
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+#define NUM_TIMERS (5)
+
+struct timer_state
+{
+    int fired[NUM_TIMERS];
+    int num_fired;
+    double fire_times[NUM_TIMERS];
+};
+
+struct timer_arg
+{
+    struct timer_state *state;
+    int idx;
+};
+
+static void record_cb(struct xcm_loop *loop, void *user)
+{
+    struct timer_arg *arg = user;
+    struct timer_state *state = arg->state;
+
+    state->fired[state->num_fired++] = arg->idx;
+    state->fire_times[arg->idx] = tu_ftime();
+}
+
+TESTCASE(loop, timers)
+{
+    struct xcm_loop *loop = xcm_loop_create();
+    CHK(loop);
+
+    struct timer_state state = { .num_fired = 0 };
+    struct timer_arg args[NUM_TIMERS];
+
+    /* the last timer is further away than one revolution of the
+       timer wheel */
+    int64_t timeouts[NUM_TIMERS] = { 50, 10, 30, 20, 700 };
+    struct xcm_loop_timer *timers[NUM_TIMERS];
+
+    double start = tu_ftime();
+
+    int i;
+    for (i = 0; i < NUM_TIMERS; i++) {
+	args[i] = (struct timer_arg) { .state = &state, .idx = i };
+	timers[i] = xcm_loop_timer_add(loop, timeouts[i], record_cb,
+				       &args[i]);
+    }
+
+    xcm_loop_timer_cancel(timers[2]);
+
+    while (state.num_fired < NUM_TIMERS - 1)
+	CHKNOERR(xcm_loop_run_once(loop, -1));
+
+    CHKINTEQ(state.fired[0], 1);
+    CHKINTEQ(state.fired[1], 3);
+    CHKINTEQ(state.fired[2], 0);
+    CHKINTEQ(state.fired[3], 4);
+
+    for (i = 0; i < NUM_TIMERS; i++)
+	if (i != 2) {
+	    double latency = state.fire_times[i] - start;
+	    CHK(latency >= timeouts[i] / 1e3);
+	    CHK(latency < timeouts[i] / 1e3 + 0.5);
+	}
+
+    /* a timer which is never run is cleaned up with the loop */
+    xcm_loop_timer_add(loop, 1000, record_cb, &args[0]);
+
+    xcm_loop_destroy(loop);
+
+    return UTEST_SUCCESS;
+}
+
+#define NUM_RT_WORKERS (2)
+#define NUM_RT_CONNS (4)
+
+#define MIGRATE_MSG "migrate"
+
+static void rt_message_cb(struct xcm_loop_sock *conn_lsock,
+			  const void *msg, size_t len, void *user)
+{
+    struct xcm_rt *rt = user;
+
+    int worker_idx = xcm_rt_current_worker(rt);
+
+    xcm_loop_send(conn_lsock, &worker_idx, sizeof(worker_idx));
+
+    if (len == strlen(MIGRATE_MSG) && memcmp(msg, MIGRATE_MSG, len) == 0)
+	xcm_rt_migrate(rt, conn_lsock,
+		       (worker_idx + 1) % xcm_rt_num_workers(rt));
+}
+
+static int rt_request(struct xcm_socket *conn, const char *msg)
+{
+    if (xcm_send(conn, msg, strlen(msg)) < 0)
+	return -1;
+
+    int worker_idx;
+    if (xcm_receive(conn, &worker_idx, sizeof(worker_idx)) !=
+	sizeof(worker_idx))
+	return -1;
+
+    return worker_idx;
+}
+
+TESTCASE(loop, rt)
+{
+    char *addr = gen_loop_addr();
+
+    struct xcm_rt *rt = xcm_rt_create(NUM_RT_WORKERS,
+				      xcm_rt_policy_least_loaded);
+    CHK(rt);
+    CHKINTEQ(xcm_rt_num_workers(rt), NUM_RT_WORKERS);
+
+    CHKINTEQ(xcm_rt_current_worker(rt), -1);
+    CHKINTEQ(xcm_rt_worker_load(rt, NUM_RT_WORKERS), -1);
+    CHKERRNOEQ(EINVAL);
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    struct xcm_loop_cbs conn_cbs = {
+	.on_message = rt_message_cb
+    };
+    CHKNOERR(xcm_rt_add_server(rt, server_sock, &conn_cbs, rt));
+
+    struct xcm_socket *conns[NUM_RT_CONNS];
+    int workers[NUM_RT_CONNS];
+
+    int i;
+    for (i = 0; i < NUM_RT_CONNS; i++) {
+	conns[i] = xcm_connect(addr, 0);
+	CHK(conns[i]);
+
+	workers[i] = rt_request(conns[i], "hello");
+	CHK(workers[i] >= 0 && workers[i] < NUM_RT_WORKERS);
+    }
+
+    /* connections are spread evenly among the workers */
+    for (i = 0; i < NUM_RT_WORKERS; i++)
+	CHKINTEQ(xcm_rt_worker_load(rt, i), NUM_RT_CONNS / NUM_RT_WORKERS);
+
+    /* messages already sent when the migration happens are delivered
+       by the new worker */
+    CHKNOERR(xcm_send(conns[0], MIGRATE_MSG, strlen(MIGRATE_MSG)));
+    for (i = 0; i < 3; i++)
+	CHKNOERR(xcm_send(conns[0], "hello", strlen("hello")));
+
+    int worker_idx;
+    CHKINTEQ(xcm_receive(conns[0], &worker_idx, sizeof(worker_idx)),
+	     sizeof(worker_idx));
+    CHKINTEQ(worker_idx, workers[0]);
+
+    int new_worker_idx = (workers[0] + 1) % NUM_RT_WORKERS;
+    for (i = 0; i < 3; i++) {
+	CHKINTEQ(xcm_receive(conns[0], &worker_idx, sizeof(worker_idx)),
+		 sizeof(worker_idx));
+	CHKINTEQ(worker_idx, new_worker_idx);
+    }
+
+    CHKINTEQ(xcm_rt_worker_load(rt, workers[0]),
+	     NUM_RT_CONNS / NUM_RT_WORKERS - 1);
+    CHKINTEQ(xcm_rt_worker_load(rt, new_worker_idx),
+	     NUM_RT_CONNS / NUM_RT_WORKERS + 1);
+
+    for (i = 0; i < NUM_RT_CONNS; i++)
+	CHKNOERR(xcm_close(conns[i]));
+
+    xcm_rt_destroy(rt);
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(loop, rt_round_robin)
+{
+    char *addr = gen_loop_addr();
+
+    struct xcm_rt *rt = xcm_rt_create(NUM_RT_WORKERS,
+				      xcm_rt_policy_round_robin);
+    CHK(rt);
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    struct xcm_loop_cbs conn_cbs = {
+	.on_message = rt_message_cb
+    };
+    CHKNOERR(xcm_rt_add_server(rt, server_sock, &conn_cbs, rt));
+
+    struct xcm_socket *conns[NUM_RT_CONNS];
+
+    int i;
+    for (i = 0; i < NUM_RT_CONNS; i++) {
+	conns[i] = xcm_connect(addr, 0);
+	CHK(conns[i]);
+
+	/* connections are accepted one at a time, and thus assigned
+	   in order */
+	CHKINTEQ(rt_request(conns[i], "hello"), i % NUM_RT_WORKERS);
+    }
+
+    for (i = 0; i < NUM_RT_CONNS; i++)
+	CHKNOERR(xcm_close(conns[i]));
+
+    xcm_rt_destroy(rt);
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+struct rt_placement
+{
+    int worker_idx;
+    int64_t incoming_cpu;
+};
+
+static void rt_placement_cb(struct xcm_loop_sock *conn_lsock,
+			    const void *msg, size_t len, void *user)
+{
+    struct xcm_rt *rt = user;
+
+    struct rt_placement placement = {
+	.worker_idx = xcm_rt_current_worker(rt),
+	.incoming_cpu = -1
+    };
+
+    xcm_attr_get_int64(xcm_loop_socket(conn_lsock), "tcp.incoming_cpu",
+		       &placement.incoming_cpu);
+
+    xcm_loop_send(conn_lsock, &placement, sizeof(placement));
+}
+
+TESTCASE(loop, rt_incoming_cpu)
+{
+    /* one worker per allowed CPU core, so any incoming CPU has a
+       worker pinned to it */
+    struct xcm_rt *rt = xcm_rt_create(0, xcm_rt_policy_incoming_cpu);
+    CHK(rt);
+
+    int num_workers = xcm_rt_num_workers(rt);
+
+    struct xcm_socket *server_sock = xcm_server("tcp:127.0.0.1:0");
+    CHK(server_sock);
+
+    char addr[64];
+    CHK(xcm_attr_get_str(server_sock, "xcm.local_addr", addr,
+			 sizeof(addr)) > 0);
+
+    struct xcm_loop_cbs conn_cbs = {
+	.on_message = rt_placement_cb
+    };
+    CHKNOERR(xcm_rt_add_server(rt, server_sock, &conn_cbs, rt));
+
+    /* loopback traffic is processed by the kernel on the sending
+       thread's core, which is fixed by pinning the test thread */
+    cpu_set_t orig_cpus;
+    CHKNOERR(sched_getaffinity(0, sizeof(orig_cpus), &orig_cpus));
+
+    int pinned_worker = num_workers - 1;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(xcm_rt_worker_cpu(rt, pinned_worker), &cpus);
+    CHKNOERR(sched_setaffinity(0, sizeof(cpus), &cpus));
+
+    struct xcm_socket *conns[NUM_RT_CONNS];
+
+    int i;
+    for (i = 0; i < NUM_RT_CONNS; i++) {
+	conns[i] = xcm_connect(addr, 0);
+	CHK(conns[i]);
+
+	CHKINTEQ(xcm_send(conns[i], "hello", strlen("hello")), 0);
+
+	struct rt_placement placement;
+	CHKINTEQ(xcm_receive(conns[i], &placement, sizeof(placement)),
+		 sizeof(placement));
+
+	CHK(placement.worker_idx >= 0 && placement.worker_idx < num_workers);
+	CHKINTEQ(xcm_rt_worker_cpu(rt, placement.worker_idx),
+		 placement.incoming_cpu);
+    }
+
+    CHKNOERR(sched_setaffinity(0, sizeof(orig_cpus), &orig_cpus));
+
+    for (i = 0; i < NUM_RT_CONNS; i++)
+	CHKNOERR(xcm_close(conns[i]));
+
+    xcm_rt_destroy(rt);
+
+    return UTEST_SUCCESS;
+}
+
+#define NUM_MUX_CHANS (100)
+#define NUM_MUX_MSGS (50)
+
+#define MUX_WINDOW (32)
+
+struct mux_chan_state
+{
+    struct mux_state *state;
+    struct xcm_mux_chan *chan;
+    int num_sent;
+    int num_received;
+};
+
+struct mux_state
+{
+    struct xcm_loop *loop;
+    struct xcm_mux *server_mux;
+    int num_accepted;
+    int num_server_chans_opened;
+    int num_server_chans_closed;
+    bool server_closed;
+    struct mux_chan_state chans[NUM_MUX_CHANS];
+    int total_received;
+    bool writable;
+    bool timed_out;
+};
+
+static void mux_deadline_cb(struct xcm_loop *loop, void *user)
+{
+    struct mux_state *state = user;
+
+    state->timed_out = true;
+    xcm_loop_stop(loop);
+}
+
+static void mux_server_chan_open_cb(struct xcm_mux *mux,
+				    struct xcm_mux_chan *chan, void *user)
+{
+    struct mux_state *state = user;
+
+    state->num_server_chans_opened++;
+}
+
+static void mux_echo_cb(struct xcm_mux_chan *chan, const void *msg,
+			size_t len, void *user)
+{
+    xcm_mux_send(chan, msg, len);
+}
+
+static void mux_server_chan_close_cb(struct xcm_mux_chan *chan, void *user)
+{
+    struct mux_state *state = user;
+
+    state->num_server_chans_closed++;
+    xcm_loop_stop(state->loop);
+}
+
+static void mux_server_close_cb(struct xcm_mux *mux, int reason_errno,
+				void *user)
+{
+    struct mux_state *state = user;
+
+    state->server_closed = true;
+    xcm_mux_destroy(mux);
+    xcm_loop_stop(state->loop);
+}
+
+static void mux_accept_cb(struct xcm_loop_sock *server_lsock,
+			  struct xcm_socket *conn_socket, void *user)
+{
+    struct mux_state *state = user;
+
+    struct xcm_mux_cbs cbs = {
+	.on_chan_open = mux_server_chan_open_cb,
+	.on_message = mux_echo_cb,
+	.on_chan_close = mux_server_chan_close_cb,
+	.on_close = mux_server_close_cb
+    };
+
+    state->server_mux = xcm_mux_create(state->loop, conn_socket, &cbs, state);
+    state->num_accepted++;
+}
+
+static void mux_send_next(struct mux_chan_state *cstate)
+{
+    while (cstate->num_sent < NUM_MUX_MSGS &&
+	   cstate->num_sent - cstate->num_received < MAX_IN_FLIGHT) {
+	if (xcm_mux_send(cstate->chan, &cstate->num_sent,
+			 sizeof(cstate->num_sent)) < 0)
+	    return;
+	cstate->num_sent++;
+    }
+}
+
+static void mux_client_message_cb(struct xcm_mux_chan *chan, const void *msg,
+				  size_t len, void *user)
+{
+    struct mux_chan_state *cstate = user;
+    struct mux_state *state = cstate->state;
+
+    int seq;
+    memcpy(&seq, msg, sizeof(seq));
+
+    if (len != sizeof(seq) || seq != cstate->num_received)
+	return;
+
+    cstate->num_received++;
+    state->total_received++;
+
+    if (state->total_received == NUM_MUX_CHANS * NUM_MUX_MSGS)
+	xcm_loop_stop(state->loop);
+    else
+	mux_send_next(cstate);
+}
+
+static void mux_client_writable_cb(struct xcm_mux_chan *chan, void *user)
+{
+    struct mux_chan_state *cstate = user;
+
+    cstate->state->writable = true;
+    xcm_loop_stop(cstate->state->loop);
+}
+
+TESTCASE(loop, mux)
+{
+    char *addr = gen_loop_addr();
+
+    struct mux_state state = {
+	.loop = xcm_loop_create()
+    };
+    CHK(state.loop);
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    struct xcm_loop_cbs server_cbs = {
+	.on_accept = mux_accept_cb
+    };
+    CHK(xcm_loop_add(state.loop, server_sock, &server_cbs, &state));
+
+    struct xcm_mux_cbs client_cbs = {
+	.on_message = mux_client_message_cb,
+	.on_writable = mux_client_writable_cb
+    };
+    struct xcm_mux_pool *pool =
+	xcm_mux_pool_create(state.loop, &client_cbs, &state);
+
+    int i;
+    for (i = 0; i < NUM_MUX_CHANS; i++) {
+	struct mux_chan_state *cstate = &state.chans[i];
+
+	cstate->state = &state;
+	cstate->chan = xcm_mux_pool_open(pool, addr, cstate);
+	CHK(cstate->chan);
+
+	/* data may be sent before the connection is established */
+	mux_send_next(cstate);
+    }
+
+    struct xcm_loop_timer *deadline =
+	xcm_loop_timer_add(state.loop, DEADLINE_MS, mux_deadline_cb, &state);
+
+    CHKNOERR(xcm_loop_run(state.loop));
+
+    CHK(!state.timed_out);
+    CHKINTEQ(state.total_received, NUM_MUX_CHANS * NUM_MUX_MSGS);
+
+    /* all channels share one connection */
+    CHKINTEQ(xcm_mux_pool_num_conns(pool), 1);
+    CHKINTEQ(state.num_accepted, 1);
+    CHKINTEQ(state.num_server_chans_opened, NUM_MUX_CHANS);
+    CHKINTEQ(xcm_mux_num_chans(state.server_mux), NUM_MUX_CHANS);
+
+    /* a channel is limited by its credit */
+    struct mux_chan_state flood = { .state = &state };
+    flood.chan = xcm_mux_pool_open(pool, addr, &flood);
+    CHK(flood.chan);
+
+    char msg[100] = { 0 };
+    while (xcm_mux_send(flood.chan, msg, sizeof(msg)) == 0)
+	flood.num_sent++;
+    CHKERRNOEQ(EAGAIN);
+    CHKINTEQ(flood.num_sent, MUX_WINDOW);
+
+    CHKERRNO(xcm_mux_send(flood.chan, msg, 0), EINVAL);
+
+    /* once the server has consumed the messages, credit is returned */
+    CHKNOERR(xcm_loop_run(state.loop));
+    CHK(!state.timed_out);
+    CHK(state.writable);
+
+    /* closing a channel notifies the server side */
+    xcm_mux_close(flood.chan);
+
+    while (state.num_server_chans_closed == 0 && !state.timed_out)
+	CHKNOERR(xcm_loop_run_once(state.loop, 10));
+    CHKINTEQ(state.num_server_chans_closed, 1);
+    CHKINTEQ(xcm_mux_num_chans(state.server_mux), NUM_MUX_CHANS);
+
+    /* tearing down the pool closes the connection */
+    xcm_mux_pool_destroy(pool);
+
+    CHKNOERR(xcm_loop_run(state.loop));
+    CHK(!state.timed_out);
+    CHK(state.server_closed);
+
+    xcm_loop_timer_cancel(deadline);
+
+    xcm_loop_destroy(state.loop);
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+struct mux_fail_state
+{
+    struct xcm_loop *loop;
+    int num_chans_closed;
+    bool closed;
+    bool timed_out;
+};
+
+static void mux_fail_deadline_cb(struct xcm_loop *loop, void *user)
+{
+    struct mux_fail_state *state = user;
+
+    state->timed_out = true;
+    xcm_loop_stop(loop);
+}
+
+static void mux_fail_chan_close_cb(struct xcm_mux_chan *chan, void *user)
+{
+    struct mux_fail_state *state = user;
+
+    state->num_chans_closed++;
+}
+
+static void mux_fail_close_cb(struct xcm_mux *mux, int reason_errno,
+			      void *user)
+{
+    struct mux_fail_state *state = user;
+
+    state->closed = true;
+    xcm_loop_stop(state->loop);
+}
+
+TESTCASE(loop, mux_send_failure)
+{
+    char *addr = gen_loop_addr();
+
+    struct mux_fail_state state = {
+	.loop = xcm_loop_create()
+    };
+    CHK(state.loop);
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    struct xcm_socket *client_conn = xcm_connect(addr, 0);
+    CHK(client_conn);
+
+    struct xcm_socket *server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+
+    struct xcm_mux_cbs cbs = {
+	.on_chan_close = mux_fail_chan_close_cb,
+	.on_close = mux_fail_close_cb
+    };
+    struct xcm_mux *mux = xcm_mux_create(state.loop, client_conn, &cbs,
+					 &state);
+    CHK(mux);
+
+    CHKNOERR(xcm_close(server_conn));
+
+    /* the open message fails to be sent, and the connection is
+       considered dead from this point */
+    struct xcm_mux_chan *chan = xcm_mux_open(mux, &state);
+    CHK(chan);
+
+    char msg[100] = { 0 };
+    CHKERRNO(xcm_mux_send(chan, msg, sizeof(msg)), EPIPE);
+    CHKNULLERRNO(xcm_mux_open(mux, &state), EPIPE);
+
+    /* the failure is reported from the event loop */
+    CHKINTEQ(state.num_chans_closed, 0);
+    CHK(!state.closed);
+
+    struct xcm_loop_timer *deadline =
+	xcm_loop_timer_add(state.loop, DEADLINE_MS, mux_fail_deadline_cb,
+			   &state);
+
+    CHKNOERR(xcm_loop_run(state.loop));
+
+    CHK(!state.timed_out);
+    CHK(state.closed);
+    CHKINTEQ(state.num_chans_closed, 1);
+
+    xcm_loop_timer_cancel(deadline);
+
+    xcm_mux_destroy(mux);
+
+    CHKNOERR(xcm_close(server_sock));
+
+    xcm_loop_destroy(state.loop);
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(loop, mux_max_chans)
+{
+    char *addr = gen_loop_addr();
+
+    struct mux_state state = {
+	.loop = xcm_loop_create()
+    };
+    CHK(state.loop);
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    struct xcm_socket *client_conn = xcm_connect(addr, 0);
+    CHK(client_conn);
+
+    struct xcm_socket *server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+
+    struct xcm_mux_cbs cbs = {
+	.on_chan_open = mux_server_chan_open_cb
+    };
+    struct xcm_mux *mux = xcm_mux_create(state.loop, server_conn, &cbs,
+					 &state);
+    CHK(mux);
+
+    int i;
+    for (i = 0; i < XCM_MUX_MAX_CHANS; i++)
+	CHK(xcm_mux_open(mux, &state));
+
+    CHKNULLERRNO(xcm_mux_open(mux, &state), EMFILE);
+
+    xcm_mux_destroy(mux);
+    CHKNOERR(xcm_close(client_conn));
+
+    client_conn = xcm_connect(addr, 0);
+    CHK(client_conn);
+
+    server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+
+    mux = xcm_mux_create(state.loop, server_conn, &cbs, &state);
+    CHK(mux);
+
+    /* a peer opening more channels than allowed has the excess
+       channels rejected */
+    uint8_t open_msg[8] = { 1, 1 };
+    for (i = 0; i <= XCM_MUX_MAX_CHANS; i++) {
+	uint32_t nchan_id = htonl(i);
+	memcpy(open_msg + 4, &nchan_id, sizeof(nchan_id));
+	CHKNOERR(xcm_send(client_conn, open_msg, sizeof(open_msg)));
+
+	while (state.num_server_chans_opened < i)
+	    CHKNOERR(xcm_loop_run_once(state.loop, 10));
+    }
+
+    CHKNOERR(xcm_set_blocking(client_conn, false));
+
+    uint8_t close_msg[8];
+    do
+	CHKNOERR(xcm_loop_run_once(state.loop, 10));
+    while (xcm_receive(client_conn, close_msg, sizeof(close_msg)) < 0 &&
+	   errno == EAGAIN);
+
+    uint32_t nchan_id;
+    memcpy(&nchan_id, close_msg + 4, sizeof(nchan_id));
+
+    CHKINTEQ(close_msg[0], 4);
+    CHKINTEQ(ntohl(nchan_id), XCM_MUX_MAX_CHANS);
+
+    CHKINTEQ(state.num_server_chans_opened, XCM_MUX_MAX_CHANS);
+    CHKINTEQ(xcm_mux_num_chans(mux), XCM_MUX_MAX_CHANS);
+
+    CHKNOERR(xcm_close(client_conn));
+    xcm_mux_destroy(mux);
+
+    CHKNOERR(xcm_close(server_sock));
+
+    xcm_loop_destroy(state.loop);
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
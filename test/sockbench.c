@@ -0,0 +1,195 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+/*
+ * Multi-threaded socket create/destroy micro benchmark.
+ *
+ * A number of threads repeatedly create and close non-blocking XCM
+ * connection sockets, in parallel. The socket creation path
+ * allocates a process-unique socket id, and for TCP-based transports
+ * also takes a reference to the process-wide always-active event fd,
+ * so the benchmark exposes any contention on those shared
+ * resources. The benchmark is run for 1, 2, 4, ... up to the maximum
+ * number of threads, and the aggregate create/destroy rate is
+ * reported for each thread count.
+ *
+ * By default, connections are attempted to a TCP socket on the
+ * loopback interface, which listens but never accepts. Once its
+ * (minimal) backlog is full, incoming SYNs are dropped, so the
+ * connection attempts stay in progress until the socket is closed,
+ * and do not leave any ephemeral ports in TIME-WAIT.
+ */
+
+#include "xcm.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERATIONS (20000)
+
+static void usage(const char *name)
+{
+    printf("%s [-t <max-threads>] [-n <iterations>] [<addr>]\n", name);
+    printf("Options:\n");
+    printf("  -t <max-threads>: Run with up to <max-threads> threads. "
+	   "Default is the\n"
+	   "                    number of online CPUs.\n");
+    printf("  -n <iterations>:  Create and destroy <iterations> sockets "
+	   "per thread.\n"
+	   "                    Default is %d.\n", DEFAULT_ITERATIONS);
+    printf("<addr> is the address to connect to. Default is a local "
+	   "non-accepting\nTCP socket.\n");
+}
+
+struct bench_thread
+{
+    pthread_t thread;
+    const char *addr;
+    int iterations;
+    int failures;
+};
+
+static void *bench_thread_run(void *arg)
+{
+    struct bench_thread *t = arg;
+    int i;
+
+    for (i = 0; i < t->iterations; i++) {
+	struct xcm_socket *conn = xcm_connect(t->addr, XCM_NONBLOCK);
+
+	if (conn == NULL) {
+	    t->failures++;
+	    continue;
+	}
+
+	xcm_close(conn);
+    }
+
+    return NULL;
+}
+
+static int create_blackhole(char *addr, size_t capacity)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+	return -1;
+
+    struct sockaddr_in sin = {
+	.sin_family = AF_INET,
+	.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    socklen_t sin_len = sizeof(sin);
+
+    if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+	listen(fd, 0) < 0 ||
+	getsockname(fd, (struct sockaddr *)&sin, &sin_len) < 0) {
+	close(fd);
+	return -1;
+    }
+
+    snprintf(addr, capacity, "tcp:127.0.0.1:%d", ntohs(sin.sin_port));
+
+    return fd;
+}
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run_bench(const char *addr, int num_threads, int iterations)
+{
+    struct bench_thread threads[num_threads];
+    int i;
+
+    double start = get_time();
+
+    for (i = 0; i < num_threads; i++) {
+	threads[i] = (struct bench_thread) {
+	    .addr = addr,
+	    .iterations = iterations
+	};
+	if (pthread_create(&threads[i].thread, NULL, bench_thread_run,
+			   &threads[i]) != 0) {
+	    perror("pthread_create");
+	    return -1;
+	}
+    }
+
+    int failures = 0;
+    for (i = 0; i < num_threads; i++) {
+	pthread_join(threads[i].thread, NULL);
+	failures += threads[i].failures;
+    }
+
+    double latency = get_time() - start;
+
+    int total = num_threads * iterations;
+
+    printf("%7d  %12.0f  %15.0f  %8d\n", num_threads, total / latency,
+	   total / latency / num_threads, failures);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int iterations = DEFAULT_ITERATIONS;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:n:h")) != -1)
+	switch (c) {
+	case 't':
+	    max_threads = atoi(optarg);
+	    break;
+	case 'n':
+	    iterations = atoi(optarg);
+	    break;
+	case 'h':
+	    usage(argv[0]);
+	    exit(EXIT_SUCCESS);
+	default:
+	    usage(argv[0]);
+	    exit(EXIT_FAILURE);
+	}
+
+    int num_args = argc - optind;
+
+    if (num_args > 1 || max_threads < 1 || iterations < 1) {
+	usage(argv[0]);
+	exit(EXIT_FAILURE);
+    }
+
+    char default_addr[64];
+    const char *addr;
+
+    if (num_args == 1)
+	addr = argv[optind];
+    else {
+	if (create_blackhole(default_addr, sizeof(default_addr)) < 0) {
+	    perror("Unable to create local TCP socket");
+	    exit(EXIT_FAILURE);
+	}
+	addr = default_addr;
+    }
+
+    printf("Threads  Total [ops/s]  Per-thread [ops/s]  Failures\n");
+
+    int num_threads;
+    for (num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+	if (run_bench(addr, num_threads, iterations) < 0)
+	    exit(EXIT_FAILURE);
+
+    exit(EXIT_SUCCESS);
+}
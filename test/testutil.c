@@ -299,6 +299,22 @@ int tu_assure_str_attr(struct xcm_socket *s, const char *attr_name,
     return 0;
 }
 
+/* for attributes reflecting asynchronous events (e.g., the arrival
+   of a packet) */
+int tu_wait_for_str_attr(struct xcm_socket *s, const char *attr_name,
+			 const char *expected_value, int timeout_ms)
+{
+    double deadline = tu_ftime() + timeout_ms / 1e3;
+
+    while (tu_assure_str_attr(s, attr_name, expected_value) < 0) {
+	if (tu_ftime() > deadline)
+	    return -1;
+	tu_msleep(10);
+    }
+
+    return 0;
+}
+
 int tu_assure_bool_attr(struct xcm_socket *s, const char *attr_name,
 			bool value)
 {
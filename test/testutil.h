@@ -47,5 +47,7 @@ int tu_assure_int64_attr(struct xcm_socket *s, const char *attr_name,
 
 int tu_assure_str_attr(struct xcm_socket *s, const char *attr_name,
 		       const char *expected_value);
+int tu_wait_for_str_attr(struct xcm_socket *s, const char *attr_name,
+			 const char *expected_value, int timeout_ms);
 
 #endif
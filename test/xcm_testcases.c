@@ -4,6 +4,7 @@
  */
 
 #include "config.h"
+#include "ctl_proto.h"
 #include "pingpong.h"
 #include "testutil.h"
 #include "utest.h"
@@ -11,15 +12,18 @@
 #include "xcm.h"
 #include "xcm_addr.h"
 #include "xcm_attr.h"
+#include "xcm_rconn.h"
 #include "xcmc.h"
 
 #include <arpa/inet.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <poll.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -85,6 +89,12 @@ static char *gen_uxf_addr(void)
 		    getpid()) < 0 ? NULL : addr;
 }
 
+static char *gen_shm_addr(void)
+{
+    char *addr;
+    return asprintf(&addr, "shm:test-shm.%d", getpid()) < 0 ? NULL : addr;
+}
+
 static uint16_t gen_tcp_port(void)
 {
     return 15000+random()%10000;
@@ -258,6 +268,7 @@ static int gen_test_addrs(char ***addrs) {
     int len = 0;
     add_addr(addrs, &len, gen_ux_addr());
     add_addr(addrs, &len, gen_uxf_addr());
+    add_addr(addrs, &len, gen_shm_addr());
     add_addr(addrs, &len, gen_ip4_port_addr("tcp"));
     add_addr(addrs, &len, gen_ip6_port_addr("tcp"));
 #ifdef XCM_SCTP
@@ -528,6 +539,11 @@ TESTCASE(xcm, basic)
 	bool v;
 	CHKERRNO(xcm_attr_get_bool(client_conn, "xcm.type", &v), ENOENT);
 
+	int64_t i64;
+	CHKERRNO(xcm_attr_get_int64(client_conn, "xcm.type", &i64), ENOENT);
+	CHKERRNO(xcm_attr_get_int64(client_conn, "xcm.nonexistent", &i64),
+		 ENOENT);
+
 	CHKNOERR(tu_assure_int64_attr(client_conn, "xcm.max_msg_size",
 				      cmp_type_equal, MAX_MSG_SIZE));
 	if (is_utls)
@@ -595,6 +611,10 @@ TESTCASE(xcm, basic)
 				       cmp_type_none, 0));
 	    CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.total_retrans", 
 				       cmp_type_none, 0));
+	    /* the server has closed its end, although for TLS, the
+	       TCP FIN may arrive after the TLS-level close */
+	    CHKNOERR(tu_wait_for_str_attr(client_conn, "tcp.state",
+					  "close-wait", 2000));
 	    if (kernel_has_tcp_info_segs()) {
 		CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.segs_in",
 					      cmp_type_greater_than, 0));
@@ -1515,6 +1535,8 @@ TESTCASE(xcm, connection_refused)
 
     CHKNULLERRNO(xcm_connect("ux:does-not-exist", 0), ECONNREFUSED);
 
+    CHKNULLERRNO(xcm_connect("inproc:does-not-exist", 0), ECONNREFUSED);
+
     return UTEST_SUCCESS;
 }
 
@@ -1552,6 +1574,149 @@ TESTCASE(xcm, undersized_receive_buffer)
     return UTEST_SUCCESS;
 }
 
+#define BATCH_NUM_MSGS (1000)
+#define BATCH_MAX_MSGS (16)
+
+static size_t batch_msg_len(int msg_idx)
+{
+    return 1 + (msg_idx * 37) % 200;
+}
+
+static void batch_msg_fill(int msg_idx, char *buf)
+{
+    memset(buf, msg_idx, batch_msg_len(msg_idx));
+}
+
+static pid_t batch_echo_server(const char *addr)
+{
+    pid_t p = fork();
+    if (p < 0)
+	return -1;
+    else if (p > 0)
+	return p;
+
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    if (!server_sock)
+	exit(EXIT_FAILURE);
+
+    struct xcm_socket *conn = xcm_accept(server_sock);
+    if (!conn)
+	exit(EXIT_FAILURE);
+
+    char bufs[BATCH_MAX_MSGS][256];
+    struct iovec iovs[BATCH_MAX_MSGS];
+
+    for (;;) {
+	int i;
+	for (i = 0; i < BATCH_MAX_MSGS; i++)
+	    iovs[i] = (struct iovec) {
+		.iov_base = bufs[i],
+		.iov_len = sizeof(bufs[i])
+	    };
+
+	int num_received = xcm_receive_batch(conn, iovs, BATCH_MAX_MSGS);
+
+	if (num_received == 0)
+	    break;
+	if (num_received < 0)
+	    exit(EXIT_FAILURE);
+
+	if (xcm_send_batch(conn, iovs, num_received) != num_received)
+	    exit(EXIT_FAILURE);
+    }
+
+    xcm_close(conn);
+    xcm_close(server_sock);
+
+    exit(EXIT_SUCCESS);
+}
+
+TESTCASE(xcm, batch)
+{
+    int i;
+    for (i = 0; i < test_addrs_len; i++) {
+	pid_t server_pid = batch_echo_server(test_addrs[i]);
+	CHKNOERR(server_pid);
+
+	struct xcm_socket *conn = tu_connect_retry(test_addrs[i], 0);
+	CHK(conn);
+
+	CHKERRNO(xcm_send_batch(conn, NULL, 0), EINVAL);
+	CHKERRNO(xcm_receive_batch(conn, NULL, 0), EINVAL);
+
+	/* read-ahead is only available in the UX and UXF transports */
+	if (xcm_attr_set_bool(conn, "ux.read_ahead", true) < 0)
+	    CHKERRNOEQ(ENOENT);
+
+	char msgs[BATCH_MAX_MSGS][256];
+	struct iovec iovs[BATCH_MAX_MSGS];
+
+	int num_sent = 0;
+	int num_received = 0;
+
+	while (num_received < BATCH_NUM_MSGS) {
+	    /* the number of messages in flight is bounded, or else
+	       both client and echo server may end up blocking in send,
+	       with all socket buffers full */
+	    int in_flight = num_sent - num_received;
+
+	    if (num_sent < BATCH_NUM_MSGS && in_flight < BATCH_MAX_MSGS) {
+		int batch_size = UT_MIN(1 + num_sent % BATCH_MAX_MSGS,
+					BATCH_NUM_MSGS - num_sent);
+		batch_size = UT_MIN(batch_size, BATCH_MAX_MSGS - in_flight);
+		int j;
+		for (j = 0; j < batch_size; j++) {
+		    batch_msg_fill(num_sent + j, msgs[j]);
+		    iovs[j] = (struct iovec) {
+			.iov_base = msgs[j],
+			.iov_len = batch_msg_len(num_sent + j)
+		    };
+		}
+		CHKINTEQ(xcm_send_batch(conn, iovs, batch_size), batch_size);
+		num_sent += batch_size;
+	    }
+
+	    char expected[256];
+
+	    /* alternate between single-message and batch receive,
+	       to exercise the read-ahead path */
+	    if (num_received % 2 == 0) {
+		char buf[256];
+		int rc = xcm_receive(conn, buf, sizeof(buf));
+		CHKINTEQ(rc, batch_msg_len(num_received));
+		batch_msg_fill(num_received, expected);
+		CHK(memcmp(buf, expected, rc) == 0);
+		num_received++;
+	    } else {
+		int j;
+		for (j = 0; j < BATCH_MAX_MSGS; j++)
+		    iovs[j] = (struct iovec) {
+			.iov_base = msgs[j],
+			.iov_len = sizeof(msgs[j])
+		    };
+
+		int rc = xcm_receive_batch(conn, iovs, BATCH_MAX_MSGS);
+		CHK(rc > 0);
+
+		for (j = 0; j < rc; j++) {
+		    CHKINTEQ(iovs[j].iov_len, batch_msg_len(num_received));
+		    batch_msg_fill(num_received, expected);
+		    CHK(memcmp(msgs[j], expected, iovs[j].iov_len) == 0);
+		    num_received++;
+		}
+	    }
+	}
+
+	CHKNOERR(xcm_close(conn));
+
+	CHKNOERR(tu_wait(server_pid));
+    }
+
+    return UTEST_SUCCESS;
+}
+
 TESTCASE(xcm, oversized_send)
 {
     /* change this when some transport support even-larger messages */
@@ -1828,6 +1993,66 @@ TESTCASE_TIMEOUT(xcm, tls_dead_peer_detection, 60.0)
 
 #endif
 
+static int run_shm_dead_peer_detection(bool blocking)
+{
+    char *addr = gen_shm_addr();
+
+    pid_t server_pid = fork();
+
+    if (server_pid == 0) {
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+	struct xcm_socket *server_sock = xcm_server(addr);
+	if (!server_sock)
+	    exit(EXIT_FAILURE);
+
+	struct xcm_socket *conn_sock = xcm_accept(server_sock);
+	if (!conn_sock)
+	    exit(EXIT_FAILURE);
+
+	/* give the client time to start waiting */
+	tu_msleep(200);
+
+	/* die without closing the connection */
+	raise(SIGKILL);
+    }
+
+    CHKNOERR(server_pid);
+
+    struct xcm_socket *conn_sock = tu_connect_retry(addr, 0);
+    CHK(conn_sock);
+
+    /* a non-blocking receive on a connection which has not been
+       updated since the peer died must not report EAGAIN */
+    if (!blocking) {
+	CHKNOERR(xcm_set_blocking(conn_sock, false));
+	tu_wait(server_pid);
+    }
+
+    char buf[16];
+    CHKINTEQ(xcm_receive(conn_sock, buf, sizeof(buf)), 0);
+
+    CHKERRNO(xcm_send(conn_sock, buf, sizeof(buf)), EPIPE);
+
+    CHKNOERR(xcm_close(conn_sock));
+
+    if (blocking)
+	tu_wait(server_pid);
+
+    ut_free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(xcm, shm_dead_peer_detection)
+{
+    if (run_shm_dead_peer_detection(true) < 0)
+	return UTEST_FAIL;
+    if (run_shm_dead_peer_detection(false) < 0)
+	return UTEST_FAIL;
+    return UTEST_SUCCESS;
+}
+
 #define DETECTION_TIME (2.5)
 
 static int run_keepalive_attr(const char *proto, sa_family_t ip_version)
@@ -1944,6 +2169,233 @@ TESTCASE(xcm, tls_keepalive_attr)
 }
 #endif
 
+static int run_tcp_perf_attrs(const char *proto)
+{
+    char *addr = gen_ip4_port_addr(proto);
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    CHKNOERR(set_blocking(server_sock, false));
+
+    struct xcm_attr_map *attrs = xcm_attr_map_create();
+    xcm_attr_map_add_bool(attrs, "xcm.blocking", false);
+    xcm_attr_map_add_int64(attrs, "tcp.sndbuf", 65536);
+    xcm_attr_map_add_int64(attrs, "tcp.rcvbuf", 65536);
+    xcm_attr_map_add_int64(attrs, "tcp.notsent_lowat", 16384);
+    xcm_attr_map_add_bool(attrs, "tcp.quickack", true);
+    xcm_attr_map_add_str(attrs, "tcp.congestion_control", "reno");
+    xcm_attr_map_add_int64(attrs, "ip.dscp", 10);
+
+    struct xcm_socket *client_conn = xcm_connect_a(addr, attrs);
+    CHK(client_conn);
+
+    struct xcm_socket *server_conn;
+    do {
+	server_conn = xcm_accept(server_sock);
+    } while (!server_conn || xcm_finish(client_conn) < 0 ||
+	     xcm_finish(server_conn) < 0);
+
+    CHKNOERR(set_blocking(client_conn, true));
+    CHKNOERR(set_blocking(server_conn, true));
+
+    CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.sndbuf",
+				  cmp_type_equal, 65536));
+    CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.rcvbuf",
+				  cmp_type_equal, 65536));
+    CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.notsent_lowat",
+				  cmp_type_equal, 16384));
+    CHKNOERR(tu_assure_bool_attr(client_conn, "tcp.quickack", true));
+    CHKNOERR(tu_assure_str_attr(client_conn, "tcp.congestion_control",
+				"reno"));
+    CHKNOERR(tu_assure_int64_attr(client_conn, "ip.dscp",
+				  cmp_type_equal, 10));
+
+    /* defaults */
+    CHKNOERR(tu_assure_int64_attr(server_conn, "tcp.sndbuf",
+				  cmp_type_equal, 0));
+    CHKNOERR(tu_assure_bool_attr(server_conn, "tcp.quickack", false));
+    CHKNOERR(tu_assure_int64_attr(server_conn, "ip.dscp",
+				  cmp_type_equal, 40));
+
+    CHKNOERR(xcm_attr_set_int64(server_conn, "ip.dscp", 0));
+    CHKNOERR(tu_assure_int64_attr(server_conn, "ip.dscp",
+				  cmp_type_equal, 0));
+    CHKERRNO(xcm_attr_set_int64(server_conn, "ip.dscp", 64), EINVAL);
+    CHKERRNO(xcm_attr_set_int64(server_conn, "tcp.sndbuf", -1), EINVAL);
+    CHKNOERR(xcm_attr_set_int64(server_conn, "tcp.rcvbuf", 1 << 20));
+    CHKNOERR(xcm_attr_set_bool(server_conn, "tcp.quickack", true));
+    CHKNOERR(xcm_attr_set_str(server_conn, "tcp.congestion_control",
+			      "reno"));
+    CHKNOERR(tu_assure_str_attr(server_conn, "tcp.congestion_control",
+				"reno"));
+    CHKERRNO(xcm_attr_set_str(server_conn, "tcp.congestion_control",
+			      "nonexistent"), ENOENT);
+
+    const char *msg = "hello";
+    CHKNOERR(xcm_send(client_conn, msg, strlen(msg)));
+
+    char buf[16];
+    CHKINTEQ(xcm_receive(server_conn, buf, sizeof(buf)), strlen(msg));
+
+    CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.cwnd",
+				  cmp_type_greater_than, 0));
+    CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.pacing_rate",
+				  cmp_type_none, 0));
+    CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.delivery_rate",
+				  cmp_type_none, 0));
+    CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.unacked",
+				  cmp_type_none, 0));
+    CHKNOERR(tu_assure_int64_attr(client_conn, "tcp.notsent_bytes",
+				  cmp_type_none, 0));
+
+    CHKERRNO(xcm_attr_set_int64(client_conn, "tcp.cwnd", 10), EACCES);
+
+    xcm_attr_map_destroy(attrs);
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    ut_free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(xcm, tcp_perf_attrs)
+{
+    if (run_tcp_perf_attrs("tcp") < 0)
+	return UTEST_FAIL;
+
+#ifdef XCM_TLS
+    if (run_tcp_perf_attrs("tls") < 0)
+	return UTEST_FAIL;
+#endif
+
+    return UTEST_SUCCESS;
+}
+
+#define TFO_SYSCTL "/proc/sys/net/ipv4/tcp_fastopen"
+#define TFO_CLIENT_AND_SERVER (0x3)
+
+static bool tfo_enabled(void)
+{
+    FILE *f = fopen(TFO_SYSCTL, "r");
+    if (f == NULL)
+	return false;
+
+    int value = 0;
+    if (fscanf(f, "%d", &value) != 1)
+	value = 0;
+
+    fclose(f);
+
+    return (value & TFO_CLIENT_AND_SERVER) == TFO_CLIENT_AND_SERVER;
+}
+
+#define TFO_EXCHANGE_TIMEOUT (5.0)
+
+static int tfo_exchange(const char *addr, struct xcm_socket *server_sock,
+			bool *tfo_used)
+{
+    struct xcm_attr_map *attrs = xcm_attr_map_create();
+    xcm_attr_map_add_bool(attrs, "xcm.blocking", false);
+    xcm_attr_map_add_bool(attrs, "tcp.fastopen", true);
+
+    struct xcm_socket *client_conn = xcm_connect_a(addr, attrs);
+    CHK(client_conn);
+
+    xcm_attr_map_destroy(attrs);
+
+    CHKNOERR(tu_assure_bool_attr(client_conn, "tcp.fastopen", true));
+
+    /* with a deferred (Fast Open) connect, the connection request
+       won't reach the server until there is data to send */
+    const char *msg = "hello";
+    bool sent = false;
+    struct xcm_socket *server_conn = NULL;
+    char buf[16];
+    int rc = -1;
+
+    double deadline = tu_ftime() + TFO_EXCHANGE_TIMEOUT;
+    while (rc < 0 && tu_ftime() < deadline) {
+	if (!sent) {
+	    if (xcm_send(client_conn, msg, strlen(msg)) == 0)
+		sent = true;
+	    else
+		CHKERRNOEQ(EAGAIN);
+	} else
+	    xcm_finish(client_conn);
+
+	if (server_conn == NULL)
+	    server_conn = xcm_accept(server_sock);
+
+	if (server_conn != NULL) {
+	    rc = xcm_receive(server_conn, buf, sizeof(buf));
+	    if (rc < 0)
+		CHKERRNOEQ(EAGAIN);
+	}
+    }
+
+    CHKINTEQ(rc, strlen(msg));
+
+    CHKERRNO(xcm_attr_set_bool(client_conn, "tcp.fastopen", false), EACCES);
+
+    CHKNOERR(xcm_attr_get_bool(client_conn, "tcp.fastopen_used", tfo_used));
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
+
+    return UTEST_SUCCESS;
+}
+
+static int run_tcp_fastopen(const char *proto)
+{
+    char *addr = gen_ip4_port_addr(proto);
+
+    struct xcm_attr_map *attrs = xcm_attr_map_create();
+    xcm_attr_map_add_bool(attrs, "tcp.fastopen", true);
+
+    struct xcm_socket *server_sock = xcm_server_a(addr, attrs);
+    CHK(server_sock);
+
+    xcm_attr_map_destroy(attrs);
+
+    CHKNOERR(tu_assure_bool_attr(server_sock, "tcp.fastopen", true));
+    CHKERRNO(xcm_attr_set_bool(server_sock, "tcp.fastopen", false), EACCES);
+
+    CHKNOERR(set_blocking(server_sock, false));
+
+    bool tfo_used;
+
+    /* the first connection retrieves the Fast Open cookie, unless
+       one is already cached for this destination */
+    CHKNOERR(tfo_exchange(addr, server_sock, &tfo_used));
+
+    CHKNOERR(tfo_exchange(addr, server_sock, &tfo_used));
+    if (tfo_enabled())
+	CHK(tfo_used);
+
+    CHKNOERR(xcm_close(server_sock));
+
+    ut_free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(xcm, tcp_fastopen)
+{
+    if (run_tcp_fastopen("tcp") < 0)
+	return UTEST_FAIL;
+
+#ifdef XCM_TLS
+    if (run_tcp_fastopen("tls") < 0)
+	return UTEST_FAIL;
+#endif
+
+    return UTEST_SUCCESS;
+}
+
 #define SHORT_HICKUP_DURATION (1700) /* ms */
 #define TOO_LONG_HICKUP_DURATION (3500) /* ms */
 #define ALLOWED_HICKUP_ERROR (100)
@@ -2445,61 +2897,196 @@ int test_sctp_dynamic_port_allocation(void)
 }
 #endif
 
-#ifdef XCM_TLS
+#ifdef XCM_SCTP
 
-TESTCASE(xcm, tls_dynamic_port_allocation)
-{
-    GEN_PORT_TEST(tls);
-}
+#define SCTP_TEST_STREAMS (4)
+#define SCTP_TEST_MSGS (100)
 
-TESTCASE(xcm, utls_dynamic_port_allocation)
+TESTCASE(xcm, sctp_multi_stream)
 {
-    GEN_PORT_TEST(utls);
-}
+    char *addr = gen_ip4_port_addr("sctp");
 
-TESTCASE(xcm, utls_dynamic_local_is_unix)
-{
-    const char *utls_addr = "utls:127.0.0.1:0";
+    struct xcm_attr_map *server_attrs = xcm_attr_map_create();
+    xcm_attr_map_add_int64(server_attrs, "sctp.streams", SCTP_TEST_STREAMS);
 
-    struct xcm_socket *server_socket = xcm_server(utls_addr);
+    struct xcm_socket *server_sock = xcm_server_a(addr, server_attrs);
+    CHK(server_sock);
 
-    CHK(server_socket);
+    struct xcm_attr_map *conn_attrs = xcm_attr_map_create();
+    xcm_attr_map_add_int64(conn_attrs, "sctp.streams", SCTP_TEST_STREAMS);
+    xcm_attr_map_add_int64(conn_attrs, "sctp.send_stream", -1);
+    xcm_attr_map_add_bool(conn_attrs, "sctp.unordered", true);
 
-    CHKNOERR(set_blocking(server_socket, false));
+    struct xcm_socket *client_conn = xcm_connect_a(addr, conn_attrs);
+    CHK(client_conn);
 
-    const char *actual_addr = xcm_local_addr(server_socket);
-    CHK(actual_addr);
-    CHK(strcmp(actual_addr, utls_addr) != 0);
+    struct xcm_socket *server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
 
-    tu_msleep(300);
+    int64_t streams;
+    CHKNOERR(xcm_attr_get_int64(client_conn, "sctp.streams", &streams));
+    CHKINTEQ(streams, SCTP_TEST_STREAMS);
 
-    struct xcm_socket *client_conn = xcm_connect(actual_addr, XCM_NONBLOCK);
+    CHKERRNO(xcm_attr_set_int64(client_conn, "sctp.streams", 2), EACCES);
+    CHKERRNO(xcm_attr_set_int64(client_conn, "sctp.send_stream",
+				SCTP_TEST_STREAMS), EINVAL);
 
-    CHK(client_conn);
+    bool received[SCTP_TEST_MSGS] = { false };
+    int i;
 
-    struct xcm_socket *server_conn = NULL;
-    for (;;) {
-	int c_rc = xcm_finish(client_conn);
-	if (c_rc < 0)
-	    CHKERRNOEQ(EAGAIN);
-	if (server_conn != NULL) {
-	    int s_rc = xcm_finish(server_conn);
-	    if (s_rc < 0)
-		CHKERRNOEQ(EAGAIN);
-	    if (s_rc == 0 && c_rc == 0)
-		break;
-	} else {
-	    server_conn = xcm_accept(server_socket);
-	    if (server_conn == NULL)
-		CHKERRNOEQ(EAGAIN);
-	}
+    for (i = 0; i < SCTP_TEST_MSGS; i++)
+	CHKNOERR(xcm_send(client_conn, &i, sizeof(i)));
+
+    /* with unordered delivery, any order is legal */
+    for (i = 0; i < SCTP_TEST_MSGS; i++) {
+	int msg;
+	CHKINTEQ(xcm_receive(server_conn, &msg, sizeof(msg)), sizeof(msg));
+	CHK(msg >= 0 && msg < SCTP_TEST_MSGS && !received[msg]);
+	received[msg] = true;
     }
 
-    CHKNOERR(tu_assure_str_attr(client_conn, "xcm.transport", "ux"));
-    CHKNOERR(tu_assure_str_attr(server_conn, "xcm.transport", "ux"));
+    /* a fixed stream */
+    CHKNOERR(xcm_attr_set_int64(client_conn, "sctp.send_stream", 1));
+    CHKNOERR(xcm_attr_set_bool(client_conn, "sctp.unordered", false));
 
-    CHKNOERR(xcm_close(client_conn));
-    CHKNOERR(xcm_close(server_conn));
+    for (i = 0; i < SCTP_TEST_MSGS; i++)
+	CHKNOERR(xcm_send(client_conn, &i, sizeof(i)));
+
+    for (i = 0; i < SCTP_TEST_MSGS; i++) {
+	int msg;
+	CHKINTEQ(xcm_receive(server_conn, &msg, sizeof(msg)), sizeof(msg));
+	CHKINTEQ(msg, i);
+    }
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    xcm_attr_map_destroy(server_attrs);
+    xcm_attr_map_destroy(conn_attrs);
+    ut_free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(xcm, sctp_attrs)
+{
+    char *addr = gen_ip4_port_addr("sctp");
+
+    struct xcm_attr_map *server_attrs = xcm_attr_map_create();
+    xcm_attr_map_add_int64(server_attrs, "sctp.streams", 0);
+    CHKNULLERRNO(xcm_server_a(addr, server_attrs), EINVAL);
+    xcm_attr_map_destroy(server_attrs);
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    CHKNOERR(tu_assure_int64_attr(server_sock, "sctp.streams",
+				  cmp_type_equal, 10));
+    CHKERRNO(xcm_attr_set_int64(server_sock, "sctp.streams", 2), EACCES);
+
+    /* a send stream beyond what is negotiated is clamped once the
+       association is up */
+    struct xcm_attr_map *conn_attrs = xcm_attr_map_create();
+    xcm_attr_map_add_int64(conn_attrs, "sctp.streams", 2);
+    xcm_attr_map_add_int64(conn_attrs, "sctp.send_stream", 7);
+
+    struct xcm_socket *client_conn = xcm_connect_a(addr, conn_attrs);
+    CHK(client_conn);
+
+    struct xcm_socket *server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+
+    CHKNOERR(tu_assure_int64_attr(client_conn, "sctp.streams",
+				  cmp_type_equal, 2));
+    CHKNOERR(tu_assure_int64_attr(client_conn, "sctp.send_stream",
+				  cmp_type_equal, 1));
+    CHKNOERR(tu_assure_bool_attr(client_conn, "sctp.unordered", false));
+
+    CHKNOERR(tu_assure_int64_attr(server_conn, "sctp.send_stream",
+				  cmp_type_equal, 0));
+
+    CHKERRNO(xcm_attr_set_int64(client_conn, "sctp.send_stream", 2), EINVAL);
+    CHKERRNO(xcm_attr_set_int64(client_conn, "sctp.send_stream", -2),
+	     EINVAL);
+    CHKNOERR(xcm_attr_set_int64(client_conn, "sctp.send_stream", -1));
+    CHKNOERR(tu_assure_int64_attr(client_conn, "sctp.send_stream",
+				  cmp_type_equal, -1));
+
+    CHKNOERR(xcm_attr_set_bool(client_conn, "sctp.unordered", true));
+    CHKNOERR(tu_assure_bool_attr(client_conn, "sctp.unordered", true));
+
+    int msg = 4711;
+    CHKNOERR(xcm_send(client_conn, &msg, sizeof(msg)));
+    CHKINTEQ(xcm_receive(server_conn, &msg, sizeof(msg)), sizeof(msg));
+    CHKINTEQ(msg, 4711);
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    xcm_attr_map_destroy(conn_attrs);
+    ut_free(addr);
+
+    return UTEST_SUCCESS;
+}
+#endif
+
+#ifdef XCM_TLS
+
+TESTCASE(xcm, tls_dynamic_port_allocation)
+{
+    GEN_PORT_TEST(tls);
+}
+
+TESTCASE(xcm, utls_dynamic_port_allocation)
+{
+    GEN_PORT_TEST(utls);
+}
+
+TESTCASE(xcm, utls_dynamic_local_is_unix)
+{
+    const char *utls_addr = "utls:127.0.0.1:0";
+
+    struct xcm_socket *server_socket = xcm_server(utls_addr);
+
+    CHK(server_socket);
+
+    CHKNOERR(set_blocking(server_socket, false));
+
+    const char *actual_addr = xcm_local_addr(server_socket);
+    CHK(actual_addr);
+    CHK(strcmp(actual_addr, utls_addr) != 0);
+
+    tu_msleep(300);
+
+    struct xcm_socket *client_conn = xcm_connect(actual_addr, XCM_NONBLOCK);
+
+    CHK(client_conn);
+
+    struct xcm_socket *server_conn = NULL;
+    for (;;) {
+	int c_rc = xcm_finish(client_conn);
+	if (c_rc < 0)
+	    CHKERRNOEQ(EAGAIN);
+	if (server_conn != NULL) {
+	    int s_rc = xcm_finish(server_conn);
+	    if (s_rc < 0)
+		CHKERRNOEQ(EAGAIN);
+	    if (s_rc == 0 && c_rc == 0)
+		break;
+	} else {
+	    server_conn = xcm_accept(server_socket);
+	    if (server_conn == NULL)
+		CHKERRNOEQ(EAGAIN);
+	}
+    }
+
+    CHKNOERR(tu_assure_str_attr(client_conn, "xcm.transport", "ux"));
+    CHKNOERR(tu_assure_str_attr(server_conn, "xcm.transport", "ux"));
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
     CHKNOERR(xcm_close(server_socket));
 
     return UTEST_SUCCESS;
@@ -2552,6 +3139,37 @@ TESTCASE(xcm, tls_missing_certificate)
     return UTEST_SUCCESS;
 }
 
+TESTCASE(xcm, tls_prewarm)
+{
+    CHKERRNO(xcm_prewarm("nonexistent"), ENOPROTOOPT);
+    CHKNOERR(xcm_prewarm("tcp"));
+
+    const char *cert_dir = getenv("XCM_TLS_CERT");
+
+    setenv("XCM_TLS_CERT", "/tmp", 1);
+    CHKERRNO(xcm_prewarm("tls"), EPROTO);
+    setenv("XCM_TLS_CERT", cert_dir, 1);
+
+    CHKNOERR(xcm_prewarm("tls"));
+    CHKNOERR(xcm_prewarm("tls"));
+    CHKNOERR(xcm_prewarm("utls"));
+
+    char *addr = gen_ip4_port_addr("tls");
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    struct xcm_socket *conn = xcm_connect(addr, XCM_NONBLOCK);
+    CHK(conn);
+
+    CHKNOERR(xcm_close(conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
 TESTCASE_SERIALIZED(xcm, utls_remote_addr)
 {
     const char *client_msg = "greetings";
@@ -3315,151 +3933,1067 @@ TESTCASE(xcm, uxf_existing_non_socket_file)
     return UTEST_SUCCESS;
 }
 
-static int run_lossy(const char *proto)
+static int ux_pair(const char *addr, struct xcm_socket **server_sock,
+		   struct xcm_socket **client_conn,
+		   struct xcm_socket **server_conn)
 {
-    char addr[64];
+    *server_sock = xcm_server(addr);
+    if (*server_sock == NULL)
+	return -1;
 
-    int tcp_port = 26645;
-    snprintf(addr, sizeof(addr), "%s:127.0.0.1:%d", proto, tcp_port);
+    /* UX connection establishment completes without the server
+       process' involvement */
+    *client_conn = xcm_connect(addr, 0);
+    if (*client_conn == NULL)
+	return -1;
 
-    const int num_pings = 250;
+    *server_conn = xcm_accept(*server_sock);
+    if (*server_conn == NULL)
+	return -1;
 
-    pid_t server_pid = pingpong_run_forking_server(addr, num_pings, 0, 1);
-    CHKNOERR(server_pid);
+    return 0;
+}
 
-    struct xcm_socket *conn = tu_connect_retry(addr, 0);
+static int check_pipe_fd(int write_fd, int read_fd)
+{
+    CHKINTEQ(write(write_fd, "x", 1), 1);
 
-    char msg[1024];
-    memset(msg, 0, sizeof(msg));
+    char c;
+    CHKINTEQ(read(read_fd, &c, 1), 1);
+    CHKINTEQ(c, 'x');
 
-    char droprule[1024];
-    snprintf(droprule, sizeof(droprule), "INPUT -m statistic --mode random "
-	     "--probability 0.05 -p tcp --sport %d -i lo -j DROP", tcp_port);
-    tu_executef("%s -A %s", IPT_CMD, droprule);
+    return UTEST_SUCCESS;
+}
 
+static int run_fd_passing(const char *addr)
+{
+    struct xcm_socket *server_sock;
+    struct xcm_socket *client_conn;
+    struct xcm_socket *server_conn;
 
-    bool failed = false;
-    int i;
-    for (i=0; i<num_pings && !failed; i++)  {
-	/* we take some care to clean up the iptables rules, even in the
-	   face of a test case failure */
-	if (xcm_send(conn, msg, sizeof(msg)) < 0 ||
-	    xcm_receive(conn, msg, sizeof(msg)) != sizeof(msg))
-	    failed = true;
-    }
+    CHKNOERR(ux_pair(addr, &server_sock, &client_conn, &server_conn));
 
-    tu_executef("%s -D %s", IPT_CMD, droprule);
-    CHK(!failed);
+    int pipe_fds[2];
+    CHKNOERR(pipe(pipe_fds));
 
-    CHKNOERR(tu_assure_int64_attr(conn, "tcp.total_retrans",
-				  cmp_type_greater_than, 0));
-    if (kernel_has_tcp_info_segs()) {
-	CHKNOERR(tu_assure_int64_attr(conn, "tcp.segs_in",
-				      cmp_type_greater_than, num_pings));
-	CHKNOERR(tu_assure_int64_attr(conn, "tcp.segs_out",
-				      cmp_type_greater_than, num_pings));
-    }
+    int too_many_fds[XCM_MAX_FDS + 1];
+    int i;
+    for (i = 0; i < XCM_MAX_FDS + 1; i++)
+	too_many_fds[i] = pipe_fds[0];
+    CHKERRNO(xcm_send_fds(client_conn, "foo", 3, too_many_fds,
+			  XCM_MAX_FDS + 1), EINVAL);
+
+    CHKNOERR(xcm_send_fds(client_conn, "foo", 3, &pipe_fds[0], 1));
+
+    char buf[16];
+    int fds[XCM_MAX_FDS];
+    size_t num_fds = XCM_MAX_FDS;
+
+    CHKINTEQ(xcm_receive_fds(server_conn, buf, sizeof(buf), fds, &num_fds),
+	     3);
+    CHKINTEQ(num_fds, 1);
+    CHK(fds[0] != pipe_fds[0]);
+    CHK(fcntl(fds[0], F_GETFD) & FD_CLOEXEC);
+
+    CHKNOERR(check_pipe_fd(pipe_fds[1], fds[0]));
+    CHKNOERR(close(fds[0]));
+
+    bool read_ahead;
+    CHKNOERR(xcm_attr_get_bool(server_conn, "ux.read_ahead", &read_ahead));
+    CHK(!read_ahead);
+    CHKNOERR(xcm_attr_set_bool(server_conn, "ux.read_ahead", true));
+
+    /* attachments to messages held in the read-ahead buffer must be
+       preserved */
+    CHKNOERR(xcm_send(client_conn, "bar", 3));
+    CHKNOERR(xcm_send_fds(client_conn, "foobar", 6, pipe_fds, 2));
+    CHKNOERR(xcm_send_fds(client_conn, "foo", 3, pipe_fds, 2));
+
+    CHKINTEQ(xcm_receive(server_conn, buf, sizeof(buf)), 3);
+
+    num_fds = XCM_MAX_FDS;
+    CHKINTEQ(xcm_receive_fds(server_conn, buf, sizeof(buf), fds, &num_fds),
+	     6);
+    CHKINTEQ(num_fds, 2);
+    CHKNOERR(check_pipe_fd(fds[1], fds[0]));
+    CHKNOERR(close(fds[0]));
+    CHKNOERR(close(fds[1]));
+
+    /* a too-small array means the excess descriptors are closed */
+    num_fds = 1;
+    CHKINTEQ(xcm_receive_fds(server_conn, buf, sizeof(buf), fds, &num_fds),
+	     3);
+    CHKINTEQ(num_fds, 1);
+    CHKNOERR(close(fds[0]));
+
+    /* plain messages may be received with xcm_receive_fds() */
+    CHKNOERR(xcm_send(client_conn, "bar", 3));
+    num_fds = XCM_MAX_FDS;
+    CHKINTEQ(xcm_receive_fds(server_conn, buf, sizeof(buf), fds, &num_fds),
+	     3);
+    CHKINTEQ(num_fds, 0);
+
+    /* descriptors attached to messages received in a batch are
+       closed */
+    CHKNOERR(xcm_send_fds(client_conn, "foo", 3, pipe_fds, 2));
+    CHKNOERR(xcm_send_fds(client_conn, "bar", 3, pipe_fds, 1));
+
+    char batch_bufs[2][16];
+    struct iovec iovs[] = {
+	{ .iov_base = batch_bufs[0], .iov_len = sizeof(batch_bufs[0]) },
+	{ .iov_base = batch_bufs[1], .iov_len = sizeof(batch_bufs[1]) }
+    };
+    CHKINTEQ(xcm_receive_batch(server_conn, iovs, 2), 2);
+    CHKINTEQ(iovs[0].iov_len, 3);
+    CHK(memcmp(batch_bufs[1], "bar", 3) == 0);
 
-    CHKNOERR(xcm_close(conn));
+    CHKNOERR(close(pipe_fds[0]));
+    CHKNOERR(close(pipe_fds[1]));
 
-    CHKNOERR(tu_wait(server_pid));
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
 
     return UTEST_SUCCESS;
 }
 
-TESTCASE(xcm, lossy_network)
+TESTCASE(xcm, ux_fd_passing)
 {
-    REQUIRE_ROOT;
-
-    if (run_lossy("tcp") < 0)
-	return UTEST_FAIL;
-
-#ifdef XCM_TLS
-    if (run_lossy("tls") < 0)
-	return UTEST_FAIL;
-#endif
-
-    return UTEST_SUCCESS;
+    char *addr = gen_ux_addr();
+    int rc = run_fd_passing(addr);
+    free(addr);
+    return rc;
 }
 
-TESTCASE(xcm, null_close)
+TESTCASE(xcm, uxf_fd_passing)
 {
-    CHKNOERR(xcm_close(NULL));
-    return UTEST_SUCCESS;
+    char *addr = gen_uxf_addr();
+    int rc = run_fd_passing(addr);
+    free(addr);
+    return rc;
 }
 
-#ifdef XCM_CTL
+#define MEMFD_PAYLOAD_SIZE (4*1024*1024+17)
 
-TESTCASE(xcm, basic_with_incorrect_ctl_dir)
+TESTCASE(xcm, ux_memfd)
 {
-    if (setenv("XCM_CTL", "/does/not/exist", 1) < 0)
-	return UTEST_FAIL;
-
-    return testcase_xcm_basic();
-}
+    char *addr = gen_ux_addr();
 
-#define MAX_SOCKETS (16)
+    struct xcm_socket *server_sock;
+    struct xcm_socket *client_conn;
+    struct xcm_socket *server_conn;
 
-struct ctl_ary
-{
-    pid_t creator_pids[MAX_SOCKETS];
-    int64_t sock_refs[MAX_SOCKETS];
-    int num_ctls;
-};
+    CHKNOERR(ux_pair(addr, &server_sock, &client_conn, &server_conn));
 
-static int creator_occurs(struct ctl_ary *d, pid_t creator_pid)
-{
-    int occurs = 0;
+    char *payload = ut_malloc(MEMFD_PAYLOAD_SIZE);
     int i;
+    for (i = 0; i < MEMFD_PAYLOAD_SIZE; i++)
+	payload[i] = (char)i;
 
-    for (i=0; i<d->num_ctls; i++) {
-	if (d->creator_pids[i] == creator_pid)
-	    occurs++;
-    }
-    return occurs;
-}
+    CHKERRNO(xcm_send_memfd(client_conn, payload, 0), EINVAL);
 
-static void log_ctl_cb(pid_t creator_pid, int64_t sock_ref, void *cb_data)
-{
-    struct ctl_ary *d = cb_data;
-    d->creator_pids[d->num_ctls] = creator_pid;
-    d->sock_refs[d->num_ctls] = sock_ref;
-    d->num_ctls++;
-}
+    CHKNOERR(xcm_send_memfd(client_conn, payload, MEMFD_PAYLOAD_SIZE));
 
-static int test_attr_get(struct xcmc_session *s)
-{
-    char value[256];
-    value[0] = '\0';
-    enum xcm_attr_type type;
-    if (xcmc_attr_get(s, "xcm.transport", &type, value,
-		      sizeof(value)) < 0) {
-	perror("xcmc_attr_get");
-	return -1;
-    }
-    if (type != xcm_attr_type_str)
-	return -1;
-    if (strlen(value) == 0)
-	return -1;
-    return 0;
+    void *data;
+    size_t len;
+    CHKNOERR(xcm_receive_memfd(server_conn, &data, &len));
+
+    CHKINTEQ(len, MEMFD_PAYLOAD_SIZE);
+    CHK(memcmp(data, payload, len) == 0);
+    CHKNOERR(munmap(data, len));
+
+    /* an ordinary message isn't a valid memory file message */
+    CHKNOERR(xcm_send(client_conn, "foo", 3));
+    CHKERRNO(xcm_receive_memfd(server_conn, &data, &len), EBADMSG);
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKERRNO(xcm_receive_memfd(server_conn, &data, &len), EPIPE);
+
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    /* a non-blocking sender with a full socket buffer is told to
+       retry */
+    CHKNOERR(ux_pair(addr, &server_sock, &client_conn, &server_conn));
+
+    CHKNOERR(xcm_set_blocking(client_conn, false));
+
+    while (xcm_send(client_conn, "foo", 3) == 0)
+	;
+    CHKERRNOEQ(EAGAIN);
+
+    CHKERRNO(xcm_send_memfd(client_conn, payload, MEMFD_PAYLOAD_SIZE),
+	     EAGAIN);
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    ut_free(payload);
+    free(addr);
+
+    return UTEST_SUCCESS;
 }
 
-static void count_cb(const char *attr_name, enum xcm_attr_type type,
-		     void *attr_value, size_t attr_len, void *cb_data)
+/* the in-process transport can't be used across fork(), and thus
+   isn't among the generic test addresses */
+static char *gen_inproc_addr(void)
 {
-    int *count = cb_data;
-    (*count)++;
+    static int seq = 0;
+    char *addr;
+    return asprintf(&addr, "inproc:test-inproc.%d.%d", getpid(), seq++) < 0 ?
+	NULL : addr;
 }
 
-static int test_attr_get_all(struct xcmc_session *s)
+TESTCASE(xcm, inproc_basic)
 {
-    int count = 0;
-    if (xcmc_attr_get_all(s, count_cb, &count) < 0) {
-	perror("attr_get_all");
-	return -1;
+    char *addr = gen_inproc_addr();
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+    CHKSTREQ(xcm_local_addr(server_sock), addr);
+
+    CHKNOERR(xcm_set_blocking(server_sock, false));
+    CHKNULLERRNO(xcm_accept(server_sock), EAGAIN);
+
+    struct xcm_socket *client_conn = xcm_connect(addr, XCM_NONBLOCK);
+    CHK(client_conn);
+    CHKSTREQ(xcm_remote_addr(client_conn), addr);
+
+    struct xcm_socket *server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+    CHKSTREQ(xcm_local_addr(server_conn), addr);
+    CHKSTREQ(xcm_remote_addr(server_conn), xcm_local_addr(client_conn));
+
+    CHKNOERR(xcm_set_blocking(server_conn, false));
+
+    char buf[1024];
+    CHKERRNO(xcm_receive(server_conn, buf, sizeof(buf)), EAGAIN);
+
+    CHKNOERR(xcm_send(client_conn, "foo", 3));
+    CHKNOERR(xcm_send(client_conn, "foobar", 6));
+
+    CHKINTEQ(xcm_receive(server_conn, buf, sizeof(buf)), 3);
+    CHK(memcmp(buf, "foo", 3) == 0);
+    CHKINTEQ(xcm_receive(server_conn, buf, sizeof(buf)), 6);
+    CHK(memcmp(buf, "foobar", 6) == 0);
+
+    CHKNOERR(xcm_send(server_conn, "bar", 3));
+    CHKINTEQ(xcm_receive(client_conn, buf, sizeof(buf)), 3);
+    CHK(memcmp(buf, "bar", 3) == 0);
+
+    /* the in-process transport can't pass file descriptors */
+    int fd = STDIN_FILENO;
+    CHKERRNO(xcm_send_fds(client_conn, "foo", 3, &fd, 1), EOPNOTSUPP);
+
+    CHKNOERR(xcm_send_fds(server_conn, "bar", 3, NULL, 0));
+    size_t num_fds = 1;
+    CHKINTEQ(xcm_receive_fds(client_conn, buf, sizeof(buf), &fd, &num_fds),
+	     3);
+    CHKINTEQ(num_fds, 0);
+
+    /* messages sent before the close are still delivered */
+    CHKNOERR(xcm_send(client_conn, "last", 4));
+    CHKNOERR(xcm_close(client_conn));
+
+    CHKINTEQ(xcm_receive(server_conn, buf, sizeof(buf)), 4);
+    CHKINTEQ(xcm_receive(server_conn, buf, sizeof(buf)), 0);
+    CHKERRNO(xcm_send(server_conn, "bar", 3), EPIPE);
+
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(xcm, inproc_name_in_use)
+{
+    char *addr = gen_inproc_addr();
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    CHKNULLERRNO(xcm_server(addr), EADDRINUSE);
+
+    CHKNOERR(xcm_close(server_sock));
+
+    server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    CHKNOERR(xcm_close(server_sock));
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(xcm, inproc_server_close_with_pending)
+{
+    char *addr = gen_inproc_addr();
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    struct xcm_socket *client_conn = xcm_connect(addr, 0);
+    CHK(client_conn);
+
+    CHKNOERR(xcm_close(server_sock));
+
+    char buf[16];
+    CHKINTEQ(xcm_receive(client_conn, buf, sizeof(buf)), 0);
+    CHKERRNO(xcm_send(client_conn, "foo", 3), EPIPE);
+
+    CHKNOERR(xcm_close(client_conn));
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+#define INPROC_ECHO_MSGS (2000)
+#define INPROC_ECHO_MSG_SIZE (8192)
+
+static void *inproc_echo_server_thread(void *arg)
+{
+    struct server_info *info = arg;
+
+    struct xcm_socket *server_sock = xcm_server(info->addr);
+    if (!server_sock)
+	goto err;
+
+    info->success = true;
+
+    struct xcm_socket *conn = xcm_accept(server_sock);
+    if (!conn)
+	goto err_close_server;
+
+    char buf[INPROC_ECHO_MSG_SIZE];
+    int rc;
+    while ((rc = xcm_receive(conn, buf, sizeof(buf))) > 0)
+	if (xcm_send(conn, buf, rc) < 0)
+	    goto err_close_conn;
+
+    if (rc < 0)
+	goto err_close_conn;
+
+    if (xcm_close(conn) < 0 || xcm_close(server_sock) < 0)
+	goto err;
+
+    return NULL;
+
+err_close_conn:
+    xcm_close(conn);
+err_close_server:
+    xcm_close(server_sock);
+err:
+    info->success = false;
+    return NULL;
+}
+
+static int inproc_wait(struct xcm_socket *conn, int condition)
+{
+    if (xcm_await(conn, condition) < 0)
+	return -1;
+
+    struct pollfd pfd = {
+	.fd = xcm_fd(conn),
+	.events = POLLIN
+    };
+
+    return poll(&pfd, 1, -1);
+}
+
+TESTCASE(xcm, inproc_threaded_echo)
+{
+    char *addr = gen_inproc_addr();
+
+    struct server_info info = {
+	.addr = addr,
+	.success = false
+    };
+
+    pthread_t server_thread;
+    CHK(pthread_create(&server_thread, NULL, inproc_echo_server_thread, &info)
+	== 0);
+
+    struct xcm_socket *conn;
+    while ((conn = xcm_connect(addr, XCM_NONBLOCK)) == NULL) {
+	CHKERRNOEQ(ECONNREFUSED);
+	tu_msleep(10);
+    }
+
+    char msg[INPROC_ECHO_MSG_SIZE];
+    int num_sent = 0;
+    int num_received = 0;
+
+    /* the client is event-driven, and keeps many messages in flight,
+       to exercise both the receiver and the sender wakeup paths */
+    while (num_received < INPROC_ECHO_MSGS) {
+	int condition = XCM_SO_RECEIVABLE;
+
+	while (num_sent < INPROC_ECHO_MSGS) {
+	    memset(msg, num_sent, sizeof(msg));
+	    if (xcm_send(conn, msg, sizeof(msg)) < 0) {
+		CHKERRNOEQ(EAGAIN);
+		condition |= XCM_SO_SENDABLE;
+		break;
+	    }
+	    num_sent++;
+	}
+
+	char buf[INPROC_ECHO_MSG_SIZE];
+	int rc;
+	while ((rc = xcm_receive(conn, buf, sizeof(buf))) > 0) {
+	    CHKINTEQ(rc, INPROC_ECHO_MSG_SIZE);
+	    CHKINTEQ(buf[0], (char)num_received);
+	    num_received++;
+	}
+	CHK(rc < 0);
+	CHKERRNOEQ(EAGAIN);
+
+	if (num_received < INPROC_ECHO_MSGS)
+	    CHK(inproc_wait(conn, condition) > 0);
+    }
+
+    CHKNOERR(xcm_close(conn));
+
+    CHK(pthread_join(server_thread, NULL) == 0);
+    CHK(info.success);
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+struct delayed_sender_info
+{
+    struct xcm_socket *conn;
+    int delay_ms;
+};
+
+static void *delayed_sender_thread(void *arg)
+{
+    struct delayed_sender_info *info = arg;
+
+    tu_msleep(info->delay_ms);
+
+    if (xcm_send(info->conn, "hello", 5) < 0)
+	return NULL;
+
+    return info;
+}
+
+static int delayed_receive(struct xcm_socket *client_conn,
+			   struct xcm_socket *server_conn, int delay_ms)
+{
+    struct delayed_sender_info info = {
+	.conn = client_conn,
+	.delay_ms = delay_ms
+    };
+
+    pthread_t sender_thread;
+    if (pthread_create(&sender_thread, NULL, delayed_sender_thread,
+		       &info) != 0)
+	return -1;
+
+    char buf[16];
+    int rc = xcm_receive(server_conn, buf, sizeof(buf));
+
+    void *sender_rc;
+    if (pthread_join(sender_thread, &sender_rc) != 0 || sender_rc == NULL)
+	return -1;
+
+    return rc;
+}
+
+TESTCASE(xcm, busy_poll)
+{
+    char *addr = gen_inproc_addr();
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    struct xcm_socket *client_conn = xcm_connect(addr, XCM_NONBLOCK);
+    CHK(client_conn);
+
+    struct xcm_socket *server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+
+    int64_t value;
+    CHKNOERR(xcm_attr_get_int64(server_conn, "xcm.busy_poll_us", &value));
+    CHKINTEQ(value, 0);
+    CHKERRNO(xcm_attr_set_int64(server_conn, "xcm.busy_poll_us", -1), EINVAL);
+    CHKERRNO(xcm_attr_set_int64(server_conn, "xcm.busy_poll_hits", 1),
+	     EACCES);
+
+    /* the message arrives well within the spin period */
+    CHKNOERR(xcm_attr_set_int64(server_conn, "xcm.busy_poll_us", 2000000));
+    CHKINTEQ(delayed_receive(client_conn, server_conn, 10), 5);
+
+    /* each blocking receive which had to wait is counted once */
+    CHKNOERR(xcm_attr_get_int64(server_conn, "xcm.busy_poll_hits", &value));
+    CHKINTEQ(value, 1);
+    CHKNOERR(xcm_attr_get_int64(server_conn, "xcm.busy_poll_misses", &value));
+    CHKINTEQ(value, 0);
+
+    /* the spin period expires, and the thread falls back to sleeping */
+    CHKNOERR(xcm_attr_set_int64(server_conn, "xcm.busy_poll_us", 1000));
+    CHKINTEQ(delayed_receive(client_conn, server_conn, 100), 5);
+
+    CHKNOERR(xcm_attr_get_int64(server_conn, "xcm.busy_poll_hits", &value));
+    CHKINTEQ(value, 1);
+    CHKNOERR(xcm_attr_get_int64(server_conn, "xcm.busy_poll_misses", &value));
+    CHKINTEQ(value, 1);
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+#define TIMEOUT_MS (50)
+
+static bool timed_out_in_time(double start)
+{
+    double latency = tu_ftime() - start;
+
+    return errno == ETIMEDOUT && latency >= TIMEOUT_MS / 1e3 &&
+	latency < 1.0;
+}
+
+TESTCASE(xcm, timeouts)
+{
+    char *addr = gen_inproc_addr();
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    CHKERRNO(xcm_attr_set_int64(server_sock, "xcm.accept_timeout", -1),
+	     EINVAL);
+    CHKNOERR(xcm_attr_set_int64(server_sock, "xcm.accept_timeout",
+				TIMEOUT_MS));
+
+    double start = tu_ftime();
+    CHK(xcm_accept(server_sock) == NULL);
+    CHK(timed_out_in_time(start));
+
+    struct xcm_socket *client_conn = xcm_connect(addr, XCM_NONBLOCK);
+    CHK(client_conn);
+
+    struct xcm_socket *server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+
+    /* a timed out receive leaves the connection usable */
+    CHKNOERR(xcm_attr_set_int64(server_conn, "xcm.receive_timeout",
+				TIMEOUT_MS));
+    char buf[16];
+    start = tu_ftime();
+    CHKERRNO(xcm_receive(server_conn, buf, sizeof(buf)), ETIMEDOUT);
+    CHK(timed_out_in_time(start));
+
+    CHKNOERR(xcm_send(client_conn, "foo", 3));
+    CHKINTEQ(xcm_receive(server_conn, buf, sizeof(buf)), 3);
+
+    /* timeouts beyond what poll() can express are valid */
+    CHKNOERR(xcm_attr_set_int64(server_conn, "xcm.receive_timeout",
+				(int64_t)INT_MAX + 1));
+    CHKINTEQ(delayed_receive(client_conn, server_conn, 10), 5);
+    CHKNOERR(xcm_attr_set_int64(server_conn, "xcm.receive_timeout",
+				INT64_MAX));
+    CHKINTEQ(delayed_receive(client_conn, server_conn, 10), 5);
+
+    /* fill the connection until the sender times out */
+    CHKNOERR(xcm_attr_set_int64(server_conn, "xcm.send_timeout",
+				TIMEOUT_MS));
+    int rc;
+    while ((rc = xcm_send(server_conn, "foo", 3)) == 0)
+	;
+    CHKERRNOEQ(ETIMEDOUT);
+
+    /* non-blocking sockets may wait with a timeout */
+    CHKERRNO(xcm_await_timeout(server_conn, XCM_SO_RECEIVABLE, TIMEOUT_MS),
+	     EINVAL);
+    CHKINTEQ(xcm_await_timeout(client_conn, XCM_SO_SENDABLE, -2), -1);
+    CHKERRNOEQ(EINVAL);
+
+    CHKINTEQ(xcm_await_timeout(client_conn, XCM_SO_RECEIVABLE, TIMEOUT_MS),
+	     1);
+    CHKNOERR(xcm_receive(client_conn, buf, sizeof(buf)));
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    free(addr);
+
+    /* a TLS server which never accepts never completes the handshake */
+    char *tls_addr = gen_ip4_port_addr("tls");
+
+    server_sock = xcm_server(tls_addr);
+    CHK(server_sock);
+
+    struct xcm_attr_map *attrs = xcm_attr_map_create();
+    xcm_attr_map_add_int64(attrs, "xcm.connect_timeout", TIMEOUT_MS);
+
+    start = tu_ftime();
+    CHK(xcm_connect_a(tls_addr, attrs) == NULL);
+    CHK(timed_out_in_time(start));
+
+    xcm_attr_map_destroy(attrs);
+
+    CHKNOERR(xcm_close(server_sock));
+
+    free(tls_addr);
+
+    return UTEST_SUCCESS;
+}
+
+#define SEND_TIMEOUT_MSG_SIZE (65535)
+
+TESTCASE(xcm, send_timeout_delivers_accepted)
+{
+    char *addr = gen_ip4_port_addr("tcp");
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    struct xcm_socket *client_conn = xcm_connect(addr, 0);
+    CHK(client_conn);
+
+    struct xcm_socket *server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+
+    CHKNOERR(set_blocking(server_conn, false));
+
+    CHKNOERR(xcm_attr_set_int64(client_conn, "xcm.send_timeout",
+				TIMEOUT_MS));
+    CHKNOERR(xcm_attr_set_int64(client_conn, "xcm.receive_timeout", 10));
+
+    char *buf = ut_calloc(SEND_TIMEOUT_MSG_SIZE);
+
+    /* only messages for which xcm_send() succeeded are delivered,
+       including any not yet handed over to the kernel at the time the
+       timeout expired */
+    int num_accepted = 0;
+    while (xcm_send(client_conn, buf, SEND_TIMEOUT_MSG_SIZE) == 0)
+	num_accepted++;
+    CHKERRNOEQ(ETIMEDOUT);
+
+    int num_received = 0;
+    while (num_received < num_accepted) {
+	int rc = xcm_receive(server_conn, buf, SEND_TIMEOUT_MSG_SIZE);
+
+	if (rc < 0) {
+	    CHKERRNOEQ(EAGAIN);
+	    /* a blocking operation allows the client to make progress
+	       on any message still not handed over to the kernel */
+	    CHKERRNO(xcm_receive(client_conn, buf, SEND_TIMEOUT_MSG_SIZE),
+		     ETIMEDOUT);
+	} else {
+	    CHKINTEQ(rc, SEND_TIMEOUT_MSG_SIZE);
+	    num_received++;
+	}
+    }
+
+    CHKERRNO(xcm_receive(client_conn, buf, SEND_TIMEOUT_MSG_SIZE),
+	     ETIMEDOUT);
+    CHKERRNO(xcm_receive(server_conn, buf, SEND_TIMEOUT_MSG_SIZE), EAGAIN);
+
+    CHKNOERR(xcm_close(client_conn));
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    ut_free(buf);
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+static int run_poll(void)
+{
+    char *addr = gen_inproc_addr();
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+    CHKNOERR(xcm_set_blocking(server_sock, false));
+
+    struct xcm_socket *client_conns[2];
+    struct xcm_socket *server_conns[2];
+    int i;
+    for (i = 0; i < 2; i++) {
+	client_conns[i] = xcm_connect(addr, XCM_NONBLOCK);
+	CHK(client_conns[i]);
+
+	struct xcm_socket *sockets[] = { server_sock };
+	int conditions[] = { XCM_SO_ACCEPTABLE };
+	int ready[1];
+	CHKINTEQ(xcm_poll(sockets, conditions, ready, 1, -1), 1);
+	CHKINTEQ(ready[0], XCM_SO_ACCEPTABLE);
+
+	server_conns[i] = xcm_accept(server_sock);
+	CHK(server_conns[i]);
+    }
+
+    struct xcm_socket *sockets[] = {
+	server_sock, server_conns[0], server_conns[1]
+    };
+    int conditions[] = {
+	XCM_SO_ACCEPTABLE, XCM_SO_RECEIVABLE, XCM_SO_RECEIVABLE
+    };
+    int ready[3];
+
+    CHKINTEQ(xcm_poll(sockets, conditions, ready, 3, 50), 0);
+    CHKINTEQ(ready[0] | ready[1] | ready[2], 0);
+
+    CHKNOERR(xcm_send(client_conns[1], "foo", 3));
+
+    CHKINTEQ(xcm_poll(sockets, conditions, ready, 3, -1), 1);
+    CHKINTEQ(ready[0], 0);
+    CHKINTEQ(ready[1], 0);
+    CHKINTEQ(ready[2], XCM_SO_RECEIVABLE);
+
+    /* sockets with no conditions are never reported as ready */
+    int no_conditions[] = { 0, 0, 0 };
+    CHKINTEQ(xcm_poll(sockets, no_conditions, ready, 3, 50), 0);
+
+    /* a smaller set of sockets, in a different order */
+    struct xcm_socket *subset[] = { server_conns[1], server_conns[0] };
+    CHKINTEQ(xcm_poll(subset, conditions + 1, ready, 2, 0), 1);
+    CHKINTEQ(ready[0], XCM_SO_RECEIVABLE);
+    CHKINTEQ(ready[1], 0);
+
+    char buf[16];
+    CHKINTEQ(xcm_receive(server_conns[1], buf, sizeof(buf)), 3);
+
+    struct xcm_socket *duplicates[] = { server_conns[0], server_conns[0] };
+    CHKERRNO(xcm_poll(duplicates, conditions + 1, ready, 2, 0), EINVAL);
+
+    int invalid_conditions[] = { XCM_SO_RECEIVABLE, XCM_SO_RECEIVABLE,
+				 XCM_SO_RECEIVABLE };
+    CHKERRNO(xcm_poll(sockets, invalid_conditions, ready, 3, 0), EINVAL);
+    CHKERRNO(xcm_poll(sockets, conditions, ready, 0, 0), EINVAL);
+
+    /* sockets may be closed, and their fd numbers reused, between
+       calls */
+    CHKNOERR(xcm_close(client_conns[0]));
+    CHKNOERR(xcm_close(server_conns[0]));
+
+    client_conns[0] = xcm_connect(addr, XCM_NONBLOCK);
+    CHK(client_conns[0]);
+    server_conns[0] = xcm_accept(server_sock);
+    CHK(server_conns[0]);
+    sockets[1] = server_conns[0];
+
+    CHKNOERR(xcm_send(client_conns[0], "bar", 3));
+
+    CHKINTEQ(xcm_poll(sockets, conditions, ready, 3, -1), 1);
+    CHKINTEQ(ready[1], XCM_SO_RECEIVABLE);
+
+    for (i = 0; i < 2; i++) {
+	CHKNOERR(xcm_close(client_conns[i]));
+	CHKNOERR(xcm_close(server_conns[i]));
+    }
+    CHKNOERR(xcm_close(server_sock));
+
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+static void *poll_thread(void *arg)
+{
+    int *rc = arg;
+
+    *rc = run_poll();
+
+    return NULL;
+}
+
+TESTCASE(xcm, poll)
+{
+    /* xcm_poll()'s per-thread state is released at thread exit, and
+       thus won't show up as a leaked fd */
+    int rc = UTEST_FAIL;
+    pthread_t thread;
+    CHK(pthread_create(&thread, NULL, poll_thread, &rc) == 0);
+    CHK(pthread_join(thread, NULL) == 0);
+
+    return rc;
+}
+
+static int wait_rconn_state(struct xcm_rconn *rconn,
+			    enum xcm_rconn_state state)
+{
+    double deadline = tu_ftime() + 5;
+
+    while (xcm_rconn_state(rconn) != state) {
+	if (tu_ftime() > deadline)
+	    return -1;
+
+	struct pollfd pfd = {
+	    .fd = xcm_rconn_fd(rconn),
+	    .events = POLLIN
+	};
+	poll(&pfd, 1, 100);
+
+	/* a lost connection is detected when receiving */
+	char buf[16];
+	xcm_rconn_receive(rconn, buf, sizeof(buf));
+    }
+
+    return 0;
+}
+
+static int rconn_receive_retry(struct xcm_rconn *rconn, void *buf,
+			       size_t capacity)
+{
+    double deadline = tu_ftime() + 5;
+    int rc;
+
+    while ((rc = xcm_rconn_receive(rconn, buf, capacity)) < 0 &&
+	   errno == EAGAIN && tu_ftime() < deadline) {
+	struct pollfd pfd = {
+	    .fd = xcm_rconn_fd(rconn),
+	    .events = POLLIN
+	};
+	poll(&pfd, 1, 100);
+    }
+
+    return rc;
+}
+
+TESTCASE(xcm, rconn)
+{
+    char *addr = gen_inproc_addr();
+    char *unreachable_addr = gen_inproc_addr();
+
+    const char *addrs[] = { unreachable_addr, addr };
+
+    CHKNULLERRNO(xcm_rconn_create(addrs, 0, NULL), EINVAL);
+
+    struct xcm_attr_map *attrs = xcm_attr_map_create();
+
+    xcm_attr_map_add_int64(attrs, "rconn.backoff_min", 0);
+    CHKNULLERRNO(xcm_rconn_create(addrs, 2, attrs), EINVAL);
+
+    xcm_attr_map_add_int64(attrs, "rconn.backoff_min", 10);
+    xcm_attr_map_add_int64(attrs, "rconn.backoff_max", 40);
+    xcm_attr_map_add_int64(attrs, "rconn.max_buffered", 4);
+
+    struct xcm_rconn *rconn = xcm_rconn_create(addrs, 2, attrs);
+    CHK(rconn);
+
+    /* no server is available */
+    CHKNOERR(wait_rconn_state(rconn, xcm_rconn_state_backoff));
+    CHK(xcm_rconn_socket(rconn) == NULL);
+
+    int i;
+    for (i = 0; i < 4; i++)
+	CHKNOERR(xcm_rconn_send(rconn, &i, sizeof(i)));
+    CHKERRNO(xcm_rconn_send(rconn, &i, sizeof(i)), EAGAIN);
+
+    struct xcm_socket *server_sock = xcm_server(addr);
+    CHK(server_sock);
+
+    CHKNOERR(wait_rconn_state(rconn, xcm_rconn_state_connected));
+    CHK(xcm_rconn_socket(rconn) != NULL);
+
+    struct xcm_socket *server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+
+    /* buffered messages are sent, in order, on the new connection */
+    for (i = 0; i < 4; i++) {
+	int seq;
+	CHKINTEQ(xcm_receive(server_conn, &seq, sizeof(seq)), sizeof(seq));
+	CHKINTEQ(seq, i);
+    }
+
+    char buf[16];
+    CHKNOERR(xcm_send(server_conn, "hello", 5));
+    CHKINTEQ(rconn_receive_retry(rconn, buf, sizeof(buf)), 5);
+
+    /* the connection is replaced after it is closed by the server */
+    CHKNOERR(xcm_close(server_conn));
+
+    CHKNOERR(wait_rconn_state(rconn, xcm_rconn_state_backoff));
+
+    CHKNOERR(xcm_rconn_send(rconn, "world", 5));
+
+    CHKNOERR(wait_rconn_state(rconn, xcm_rconn_state_connected));
+
+    server_conn = xcm_accept(server_sock);
+    CHK(server_conn);
+
+    CHKINTEQ(xcm_receive(server_conn, buf, sizeof(buf)), 5);
+    CHK(memcmp(buf, "world", 5) == 0);
+
+    xcm_rconn_destroy(rconn);
+
+    CHKNOERR(xcm_close(server_conn));
+    CHKNOERR(xcm_close(server_sock));
+
+    xcm_attr_map_destroy(attrs);
+
+    free(unreachable_addr);
+    free(addr);
+
+    return UTEST_SUCCESS;
+}
+
+static int run_lossy(const char *proto)
+{
+    char addr[64];
+
+    int tcp_port = 26645;
+    snprintf(addr, sizeof(addr), "%s:127.0.0.1:%d", proto, tcp_port);
+
+    const int num_pings = 250;
+
+    pid_t server_pid = pingpong_run_forking_server(addr, num_pings, 0, 1);
+    CHKNOERR(server_pid);
+
+    struct xcm_socket *conn = tu_connect_retry(addr, 0);
+
+    char msg[1024];
+    memset(msg, 0, sizeof(msg));
+
+    char droprule[1024];
+    snprintf(droprule, sizeof(droprule), "INPUT -m statistic --mode random "
+	     "--probability 0.05 -p tcp --sport %d -i lo -j DROP", tcp_port);
+    tu_executef("%s -A %s", IPT_CMD, droprule);
+
+
+    bool failed = false;
+    int i;
+    for (i=0; i<num_pings && !failed; i++)  {
+	/* we take some care to clean up the iptables rules, even in the
+	   face of a test case failure */
+	if (xcm_send(conn, msg, sizeof(msg)) < 0 ||
+	    xcm_receive(conn, msg, sizeof(msg)) != sizeof(msg))
+	    failed = true;
+    }
+
+    tu_executef("%s -D %s", IPT_CMD, droprule);
+    CHK(!failed);
+
+    CHKNOERR(tu_assure_int64_attr(conn, "tcp.total_retrans",
+				  cmp_type_greater_than, 0));
+    if (kernel_has_tcp_info_segs()) {
+	CHKNOERR(tu_assure_int64_attr(conn, "tcp.segs_in",
+				      cmp_type_greater_than, num_pings));
+	CHKNOERR(tu_assure_int64_attr(conn, "tcp.segs_out",
+				      cmp_type_greater_than, num_pings));
+    }
+
+    CHKNOERR(xcm_close(conn));
+
+    CHKNOERR(tu_wait(server_pid));
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(xcm, lossy_network)
+{
+    REQUIRE_ROOT;
+
+    if (run_lossy("tcp") < 0)
+	return UTEST_FAIL;
+
+#ifdef XCM_TLS
+    if (run_lossy("tls") < 0)
+	return UTEST_FAIL;
+#endif
+
+    return UTEST_SUCCESS;
+}
+
+TESTCASE(xcm, null_close)
+{
+    CHKNOERR(xcm_close(NULL));
+    return UTEST_SUCCESS;
+}
+
+#ifdef XCM_CTL
+
+TESTCASE(xcm, basic_with_incorrect_ctl_dir)
+{
+    if (setenv("XCM_CTL", "/does/not/exist", 1) < 0)
+	return UTEST_FAIL;
+
+    return testcase_xcm_basic();
+}
+
+#define MAX_SOCKETS (16)
+
+struct ctl_ary
+{
+    pid_t creator_pids[MAX_SOCKETS];
+    int64_t sock_refs[MAX_SOCKETS];
+    int num_ctls;
+};
+
+static int creator_occurs(struct ctl_ary *d, pid_t creator_pid)
+{
+    int occurs = 0;
+    int i;
+
+    for (i=0; i<d->num_ctls; i++) {
+	if (d->creator_pids[i] == creator_pid)
+	    occurs++;
+    }
+    return occurs;
+}
+
+static void log_ctl_cb(pid_t creator_pid, int64_t sock_ref, void *cb_data)
+{
+    struct ctl_ary *d = cb_data;
+    d->creator_pids[d->num_ctls] = creator_pid;
+    d->sock_refs[d->num_ctls] = sock_ref;
+    d->num_ctls++;
+}
+
+static int test_attr_get(struct xcmc_session *s)
+{
+    char value[256];
+    value[0] = '\0';
+    enum xcm_attr_type type;
+    if (xcmc_attr_get(s, "xcm.transport", &type, value,
+		      sizeof(value)) < 0) {
+	perror("xcmc_attr_get");
+	return -1;
+    }
+    if (type != xcm_attr_type_str)
+	return -1;
+    if (strlen(value) == 0)
+	return -1;
+    return 0;
+}
+
+static void count_cb(const char *attr_name, enum xcm_attr_type type,
+		     void *attr_value, size_t attr_len, void *cb_data)
+{
+    int *count = cb_data;
+    (*count)++;
+}
+
+static int test_attr_get_all(struct xcmc_session *s)
+{
+    int count = 0;
+    int rc = xcmc_attr_get_all(s, count_cb, &count);
+    if (rc < 0) {
+	perror("attr_get_all");
+	return -1;
     }
     if (count == 0)
 	return -1;
+    /* a partial response is always full */
+    if (rc > 0 && count != CTL_PROTO_MAX_ATTRS)
+	return -1;
     return 0;
 }
 
@@ -3559,6 +5093,89 @@ TESTCASE(xcm, ctl_iter)
     return UTEST_SUCCESS;
 }
 
+struct dump_stats
+{
+    pid_t creator_pid;
+    int num_attrs;
+    int num_transport_attrs;
+    bool foreign_pid;
+};
+
+static void dump_cb(pid_t creator_pid, int64_t sock_ref,
+		    const char *attr_name, enum xcm_attr_type type,
+		    void *attr_value, size_t attr_len, void *cb_data)
+{
+    struct dump_stats *stats = cb_data;
+
+    if (creator_pid != stats->creator_pid)
+	stats->foreign_pid = true;
+
+    stats->num_attrs++;
+
+    if (strcmp(attr_name, "xcm.transport") == 0 &&
+	type == xcm_attr_type_str && attr_len == strlen(attr_value) + 1)
+	stats->num_transport_attrs++;
+}
+
+static int wait_dump(pid_t server_pid, int num_sockets,
+		     struct dump_stats *stats)
+{
+    double deadline = tu_ftime() + 5;
+
+    for (;;) {
+	*stats = (struct dump_stats) {
+	    .creator_pid = server_pid
+	};
+
+	int rc = xcmc_dump(server_pid, dump_cb, stats);
+
+	if ((rc == num_sockets &&
+	     stats->num_transport_attrs == num_sockets) ||
+	    tu_ftime() > deadline)
+	    return rc;
+
+	tu_msleep(10);
+    }
+}
+
+TESTCASE(xcm, ctl_dump)
+{
+    int i;
+    for (i=0; i<test_addrs_len; i++) {
+	pid_t server_pid =
+	    pingpong_run_async_server(test_addrs[i], 1, true);
+
+	struct xcm_socket *client_conn = tu_connect_retry(test_addrs[i], 0);
+	CHK(client_conn);
+
+	const int ctls_per_server_socket =
+	    strncmp(test_addrs[i], "utls", 3) == 0 ? 3 : 1;
+
+	struct dump_stats stats;
+
+	/* the server's connection socket may not yet exist */
+	CHKINTEQ(wait_dump(server_pid, 1+ctls_per_server_socket, &stats),
+		 1+ctls_per_server_socket);
+	CHK(!stats.foreign_pid);
+	CHKINTEQ(stats.num_transport_attrs, 1+ctls_per_server_socket);
+	CHK(stats.num_attrs > stats.num_transport_attrs);
+
+	const char *msg = "hello";
+	CHKNOERR(xcm_send(client_conn, msg, strlen(msg)));
+
+	char buf[1024];
+	CHK(xcm_receive(client_conn, buf, sizeof(buf)) == strlen(msg));
+
+	CHKNOERR(xcm_close(client_conn));
+
+	tu_wait(server_pid);
+
+	CHKINTEQ(xcmc_dump(server_pid, dump_cb, &stats), 0);
+    }
+
+    return UTEST_SUCCESS;
+}
+
 TESTCASE(xcm, ctl_open_nonexisting)
 {
     CHKNULLERRNO(xcmc_open(4711, 23423472847), ENOENT);
@@ -0,0 +1,441 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2020 Ericsson AB
+ */
+
+/*
+ * Connection setup/teardown rate benchmark.
+ *
+ * For every address given, a server process is forked, which accepts
+ * connections as fast as it can, and the client keeps a window of
+ * non-blocking connection attempts in progress. As soon as a
+ * connection is fully established (including any TLS handshake), the
+ * server closes it. The client waits for the close before initiating a
+ * new connection in its place, so that the window also bounds the
+ * server's accept queue.
+ */
+
+#include "hist.h"
+#include "util.h"
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <xcm.h>
+
+#define DEFAULT_CONNS (10000)
+#define DEFAULT_WINDOW (16)
+#define MAX_EVENTS (64)
+
+static void usage(const char *name)
+{
+    printf("%s [-n <conns>] [-w <window>] <addr> [<addr> ...]\n", name);
+    printf("Options:\n");
+    printf("  -n <conns>:  Establish and tear down <conns> connections per "
+	   "address.\n"
+	   "               Default is %d.\n", DEFAULT_CONNS);
+    printf("  -w <window>: Keep up to <window> connection attempts in "
+	   "progress\n"
+	   "               concurrently. Default is %d.\n", DEFAULT_WINDOW);
+    printf("For each <addr>, a local server is started, and connect and "
+	   "accept rates,\nhandshake latency, and CPU usage per connection "
+	   "are reported.\n");
+}
+
+static uint64_t timespec_to_ns(struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static uint64_t get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_to_ns(&ts);
+}
+
+static uint64_t get_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return timespec_to_ns(&ts);
+}
+
+static void epoll_add(int epoll_fd, int fd, void *ptr)
+{
+    struct epoll_event event = {
+	.events = EPOLLIN,
+	.data.ptr = ptr
+    };
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+	ut_die("Unable to add fd to epoll instance");
+}
+
+static void epoll_del(int epoll_fd, int fd)
+{
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0)
+	ut_die("Unable to remove fd from epoll instance");
+}
+
+struct server_result
+{
+    uint64_t accepts;
+    uint64_t accept_time;
+    uint64_t cpu;
+};
+
+/* the server socket is marked with a NULL epoll user data pointer */
+static void server_accept(struct xcm_socket *server_sock, int epoll_fd,
+			  struct server_result *result, uint64_t *first_accept)
+{
+    for (;;) {
+	struct xcm_socket *conn = xcm_accept(server_sock);
+
+	if (conn == NULL) {
+	    if (errno != EAGAIN)
+		perror("Error accepting connection");
+	    return;
+	}
+
+	uint64_t now = get_time_ns();
+
+	if (result->accepts++ == 0)
+	    *first_accept = now;
+	result->accept_time = now - *first_accept;
+
+	if (xcm_finish(conn) < 0 && errno == EAGAIN)
+	    epoll_add(epoll_fd, xcm_fd(conn), conn);
+	else
+	    xcm_close(conn);
+    }
+}
+
+static void server_process(struct xcm_socket *conn, int epoll_fd)
+{
+    /* drives the server side of the handshake */
+    if (xcm_finish(conn) < 0 && errno == EAGAIN)
+	return;
+
+    epoll_del(epoll_fd, xcm_fd(conn));
+    xcm_close(conn);
+}
+
+static void run_server(const char *addr, int ctl_fd, int result_fd)
+{
+    struct xcm_socket *server_sock = xcm_server(addr);
+
+    if (server_sock == NULL)
+	ut_die("Unable to bind server socket");
+
+    if (xcm_set_blocking(server_sock, false) < 0 ||
+	xcm_await(server_sock, XCM_SO_ACCEPTABLE) < 0)
+	ut_die("Unable to configure server socket");
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0)
+	ut_die("Unable to create epoll instance");
+
+    epoll_add(epoll_fd, xcm_fd(server_sock), NULL);
+    epoll_add(epoll_fd, ctl_fd, &ctl_fd);
+
+    struct server_result result = {};
+    uint64_t first_accept = 0;
+    uint64_t start_cpu = get_cpu_ns();
+
+    char ready = 0;
+    if (write(result_fd, &ready, sizeof(ready)) != sizeof(ready))
+	ut_die("Unable to signal server readiness");
+
+    for (;;) {
+	struct epoll_event events[MAX_EVENTS];
+
+	int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+	if (num_events < 0) {
+	    if (errno == EINTR)
+		continue;
+	    ut_die("I/O multiplexing failure");
+	}
+
+	int i;
+	for (i = 0; i < num_events; i++) {
+	    void *ptr = events[i].data.ptr;
+
+	    if (ptr == &ctl_fd) {
+		/* client is done */
+		result.cpu = get_cpu_ns() - start_cpu;
+		if (write(result_fd, &result, sizeof(result)) !=
+		    sizeof(result))
+		    ut_die("Unable to report server result");
+		exit(EXIT_SUCCESS);
+	    } else if (ptr == NULL)
+		server_accept(server_sock, epoll_fd, &result, &first_accept);
+	    else
+		server_process(ptr, epoll_fd);
+	}
+    }
+}
+
+struct pending_conn
+{
+    struct xcm_socket *conn;
+    bool established;
+    uint64_t start;
+};
+
+struct client_result
+{
+    uint64_t connects;
+    uint64_t failures;
+    uint64_t time;
+    uint64_t cpu;
+    struct hist handshake_latency;
+};
+
+static bool pending_initiate(struct pending_conn *pc, const char *addr,
+			     int epoll_fd)
+{
+    pc->start = get_time_ns();
+    pc->conn = xcm_connect(addr, XCM_NONBLOCK);
+    pc->established = false;
+
+    if (pc->conn == NULL)
+	return false;
+
+    epoll_add(epoll_fd, xcm_fd(pc->conn), pc);
+
+    return true;
+}
+
+static void pending_close(struct pending_conn *pc, int epoll_fd)
+{
+    epoll_del(epoll_fd, xcm_fd(pc->conn));
+    xcm_close(pc->conn);
+    pc->conn = NULL;
+}
+
+/* returns true in case the connection has terminated */
+static bool pending_process(struct pending_conn *pc, int epoll_fd,
+			    struct client_result *result)
+{
+    if (!pc->established) {
+	if (xcm_finish(pc->conn) < 0) {
+	    if (errno == EAGAIN)
+		return false;
+	    result->failures++;
+	    pending_close(pc, epoll_fd);
+	    return true;
+	}
+
+	hist_record(&result->handshake_latency, get_time_ns() - pc->start);
+	result->connects++;
+	pc->established = true;
+
+	if (xcm_await(pc->conn, XCM_SO_RECEIVABLE) < 0)
+	    ut_die("Unable to set connection socket condition");
+    }
+
+    char buf[256];
+    if (xcm_receive(pc->conn, buf, sizeof(buf)) < 0 && errno == EAGAIN)
+	return false;
+
+    /* server closed the connection */
+    pending_close(pc, epoll_fd);
+
+    return true;
+}
+
+static void run_client(const char *addr, int num_conns, int window,
+		       struct client_result *result)
+{
+    struct pending_conn pcs[window];
+    int epoll_fd = epoll_create1(0);
+    int initiated = 0;
+    int in_progress = 0;
+    int i;
+
+    if (epoll_fd < 0)
+	ut_die("Unable to create epoll instance");
+
+    memset(pcs, 0, sizeof(pcs));
+    hist_init(&result->handshake_latency);
+
+    uint64_t start_cpu = get_cpu_ns();
+    uint64_t start = get_time_ns();
+
+    for (;;) {
+	for (i = 0; i < window && initiated < num_conns; i++) {
+	    struct pending_conn *pc = &pcs[i];
+
+	    if (pc->conn != NULL)
+		continue;
+
+	    initiated++;
+
+	    if (!pending_initiate(pc, addr, epoll_fd)) {
+		result->failures++;
+		continue;
+	    }
+
+	    in_progress++;
+
+	    /* UX connections may be established immediately */
+	    if (pending_process(pc, epoll_fd, result))
+		in_progress--;
+	}
+
+	if (in_progress == 0) {
+	    if (initiated == num_conns)
+		break;
+	    continue;
+	}
+
+	struct epoll_event events[MAX_EVENTS];
+	int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+	if (num_events < 0) {
+	    if (errno == EINTR)
+		continue;
+	    ut_die("I/O multiplexing failure");
+	}
+
+	for (i = 0; i < num_events; i++) {
+	    struct pending_conn *pc = events[i].data.ptr;
+
+	    /* may have been closed earlier in this batch */
+	    if (pc->conn != NULL && pending_process(pc, epoll_fd, result))
+		in_progress--;
+	}
+    }
+
+    result->time = get_time_ns() - start;
+    result->cpu = get_cpu_ns() - start_cpu;
+
+    close(epoll_fd);
+}
+
+static void read_all(int fd, void *buf, size_t len)
+{
+    size_t offset = 0;
+
+    while (offset < len) {
+	ssize_t rc = read(fd, buf + offset, len - offset);
+
+	if (rc < 0 && errno == EINTR)
+	    continue;
+	if (rc == 0) {
+	    fprintf(stderr, "Server process terminated unexpectedly.\n");
+	    exit(EXIT_FAILURE);
+	} else if (rc < 0)
+	    ut_die("Unable to read from server process");
+
+	offset += rc;
+    }
+}
+
+static void bench_addr(const char *addr, int num_conns, int window)
+{
+    int ctl_pipe[2];
+    int result_pipe[2];
+
+    if (pipe(ctl_pipe) < 0 || pipe(result_pipe) < 0)
+	ut_die("Unable to create pipe");
+
+    /* avoid duplicate output from the child */
+    fflush(stdout);
+
+    pid_t server_pid = fork();
+
+    if (server_pid < 0)
+	ut_die("Unable to fork server process");
+    else if (server_pid == 0) {
+	close(ctl_pipe[1]);
+	close(result_pipe[0]);
+	run_server(addr, ctl_pipe[0], result_pipe[1]);
+    }
+
+    close(ctl_pipe[0]);
+    close(result_pipe[1]);
+
+    char ready;
+    read_all(result_pipe[0], &ready, sizeof(ready));
+
+    struct client_result client;
+    memset(&client, 0, sizeof(client));
+    run_client(addr, num_conns, window, &client);
+
+    close(ctl_pipe[1]);
+
+    struct server_result server;
+    read_all(result_pipe[0], &server, sizeof(server));
+    close(result_pipe[0]);
+
+    if (waitpid(server_pid, NULL, 0) < 0)
+	ut_die("Unable to wait for server process");
+
+    double connect_rate = client.connects / (client.time / 1e9);
+    double accept_rate = server.accept_time > 0 ?
+	(server.accepts - 1) / (server.accept_time / 1e9) : 0;
+    uint64_t conns = UT_MAX(client.connects, 1);
+    const struct hist *h = &client.handshake_latency;
+
+    printf("%-24s %8" PRIu64 " %8" PRIu64 " %10.0f %10.0f %8.1f %8.1f "
+	   "%8.1f %8.1f %9.1f %9.1f\n", addr, client.connects,
+	   client.failures, connect_rate, accept_rate,
+	   hist_percentile(h, 50) / 1e3, hist_percentile(h, 90) / 1e3,
+	   hist_percentile(h, 99) / 1e3, h->max / 1e3,
+	   (double)client.cpu / conns / 1e3,
+	   (double)server.cpu / conns / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    int num_conns = DEFAULT_CONNS;
+    int window = DEFAULT_WINDOW;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:w:h")) != -1)
+	switch (c) {
+	case 'n':
+	    num_conns = atoi(optarg);
+	    break;
+	case 'w':
+	    window = atoi(optarg);
+	    break;
+	case 'h':
+	    usage(argv[0]);
+	    exit(EXIT_SUCCESS);
+	default:
+	    usage(argv[0]);
+	    exit(EXIT_FAILURE);
+	}
+
+    if (optind == argc || num_conns < 1 || window < 1) {
+	usage(argv[0]);
+	exit(EXIT_FAILURE);
+    }
+
+    /* a connection may be closed by the server before the client's
+       handshake is completed */
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%-24s %8s %8s %10s %10s %8s %8s %8s %8s %9s %9s\n", "",
+	   "", "", "Connects", "Accepts", "p50", "p90", "p99", "Max",
+	   "Client", "Server");
+    printf("%-24s %8s %8s %10s %10s %8s %8s %8s %8s %9s %9s\n", "Address",
+	   "Conns", "Failed", "[conn/s]", "[conn/s]", "[us]", "[us]",
+	   "[us]", "[us]", "[us/conn]", "[us/conn]");
+
+    int i;
+    for (i = optind; i < argc; i++)
+	bench_addr(argv[i], num_conns, window);
+
+    exit(EXIT_SUCCESS);
+}
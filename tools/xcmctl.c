@@ -13,12 +13,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_TOP_INTERVAL (2)
 
 static void usage(const char *name)
 {
     printf("%s list\n", name);
     printf("%s get <cpid> <sref> [<attr-name0> ... <attr-nameN>]\n", name);
+    printf("%s dump [<cpid>]\n", name);
+    printf("%s [-i <interval>] [-n <iterations>] top [<cpid>]\n", name);
     printf("%s -h\n", name);
+    printf("Options:\n");
+    printf(" -i <interval>    Seconds between top updates. Default is %d s.\n",
+	   DEFAULT_TOP_INTERVAL);
+    printf(" -n <iterations>  Exit after this many (>= 1) top updates.\n");
 }
 
 static void attr_get_str(struct xcmc_session *session,
@@ -123,8 +133,12 @@ static int cmd_get(pid_t creator_pid, int64_t sock_ref,
 	return -1;
 
     if (len == 0) {
-	if (xcmc_attr_get_all(session, print_attr_cb, NULL) < 0)
+	int rc = xcmc_attr_get_all(session, print_attr_cb, NULL);
+	if (rc < 0)
 	    return -1;
+	if (rc > 0)
+	    fprintf(stderr, "Not all attributes fit into the response. Use "
+		    "the \"dump\" command to list all attributes.\n");
     } else {
 	size_t i;
 	for (i=0; i<len; i++) {
@@ -143,6 +157,362 @@ static int cmd_get(pid_t creator_pid, int64_t sock_ref,
     return xcmc_close(session);
 }
 
+static void print_dump_cb(pid_t creator_pid, int64_t sock_ref,
+			  const char *attr_name, enum xcm_attr_type type,
+			  void *attr_value, size_t attr_len, void *cb_data)
+{
+    printf("%d %" PRId64 " ", creator_pid, sock_ref);
+    print_attr(attr_name, type, attr_value, attr_len);
+}
+
+static int cmd_dump(pid_t creator_pid)
+{
+    return xcmc_dump(creator_pid, print_dump_cb, NULL) < 0 ? -1 : 0;
+}
+
+enum top_counter {
+    top_counter_to_app_msgs,
+    top_counter_to_app_bytes,
+    top_counter_from_app_msgs,
+    top_counter_from_app_bytes,
+    top_counter_to_lower_msgs,
+    top_counter_from_lower_msgs,
+    top_counter_tcp_rtt,
+    top_counter_tcp_total_retrans,
+    top_counter_max
+};
+
+static const char *top_counter_names[] = {
+    [top_counter_to_app_msgs] = XCM_ATTR_XCM_TO_APP_MSGS,
+    [top_counter_to_app_bytes] = XCM_ATTR_XCM_TO_APP_BYTES,
+    [top_counter_from_app_msgs] = XCM_ATTR_XCM_FROM_APP_MSGS,
+    [top_counter_from_app_bytes] = XCM_ATTR_XCM_FROM_APP_BYTES,
+    [top_counter_to_lower_msgs] = XCM_ATTR_XCM_TO_LOWER_MSGS,
+    [top_counter_from_lower_msgs] = XCM_ATTR_XCM_FROM_LOWER_MSGS,
+    [top_counter_tcp_rtt] = XCM_ATTR_TCP_RTT,
+    [top_counter_tcp_total_retrans] = XCM_ATTR_TCP_TOTAL_RETRANS
+};
+
+struct top_sock
+{
+    pid_t creator_pid;
+    int64_t sock_ref;
+    char transport[16];
+    char conn_state[16];
+    int64_t counters[top_counter_max];
+    bool has_counter[top_counter_max];
+
+    /* derived from the previous sample */
+    bool has_rates;
+    double in_msg_rate;
+    double in_byte_rate;
+    double out_msg_rate;
+    double out_byte_rate;
+    double drain_msg_rate;
+    int64_t new_retrans;
+};
+
+struct top_sample
+{
+    struct top_sock *socks;
+    size_t len;
+    size_t capacity;
+};
+
+static struct top_sock *top_get_sock(struct top_sample *sample,
+				     pid_t creator_pid, int64_t sock_ref)
+{
+    /* the dump callbacks for a particular socket are made in
+       sequence, so only the last socket needs to be checked */
+    if (sample->len > 0) {
+	struct top_sock *last = &sample->socks[sample->len - 1];
+	if (last->creator_pid == creator_pid && last->sock_ref == sock_ref)
+	    return last;
+    }
+
+    if (sample->len == sample->capacity) {
+	sample->capacity = sample->capacity == 0 ? 64 : 2 * sample->capacity;
+	sample->socks = realloc(sample->socks,
+				sample->capacity * sizeof(struct top_sock));
+	if (!sample->socks) {
+	    perror("realloc");
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    struct top_sock *sock = &sample->socks[sample->len];
+    sample->len++;
+
+    *sock = (struct top_sock) {
+	.creator_pid = creator_pid,
+	.sock_ref = sock_ref
+    };
+
+    return sock;
+}
+
+static void top_sample_cb(pid_t creator_pid, int64_t sock_ref,
+			  const char *attr_name, enum xcm_attr_type type,
+			  void *attr_value, size_t attr_len, void *cb_data)
+{
+    struct top_sock *sock = top_get_sock(cb_data, creator_pid, sock_ref);
+
+    if (type == xcm_attr_type_str &&
+	strcmp(attr_name, XCM_ATTR_XCM_TRANSPORT) == 0) {
+	snprintf(sock->transport, sizeof(sock->transport), "%s",
+		 (char *)attr_value);
+	return;
+    }
+
+    if (type == xcm_attr_type_str &&
+	strcmp(attr_name, XCM_ATTR_TCP_STATE) == 0) {
+	snprintf(sock->conn_state, sizeof(sock->conn_state), "%s",
+		 (char *)attr_value);
+	return;
+    }
+
+    if (type != xcm_attr_type_int64)
+	return;
+
+    enum top_counter c;
+    for (c = 0; c < top_counter_max; c++)
+	if (strcmp(attr_name, top_counter_names[c]) == 0) {
+	    memcpy(&sock->counters[c], attr_value, sizeof(int64_t));
+	    sock->has_counter[c] = true;
+	    return;
+	}
+}
+
+static int top_sock_id_cmp(const void *a, const void *b)
+{
+    const struct top_sock *sock_a = a;
+    const struct top_sock *sock_b = b;
+
+    if (sock_a->creator_pid != sock_b->creator_pid)
+	return sock_a->creator_pid < sock_b->creator_pid ? -1 : 1;
+    if (sock_a->sock_ref != sock_b->sock_ref)
+	return sock_a->sock_ref < sock_b->sock_ref ? -1 : 1;
+    return 0;
+}
+
+static double top_sock_load(const struct top_sock *sock)
+{
+    return sock->in_byte_rate + sock->out_byte_rate;
+}
+
+static int top_sock_load_cmp(const void *a, const void *b)
+{
+    double load_a = top_sock_load(a);
+    double load_b = top_sock_load(b);
+
+    if (load_a != load_b)
+	return load_a > load_b ? -1 : 1;
+    return top_sock_id_cmp(a, b);
+}
+
+static double counter_rate(const struct top_sock *sock,
+			   const struct top_sock *prev,
+			   enum top_counter c, double interval)
+{
+    if (!sock->has_counter[c] || !prev->has_counter[c])
+	return 0;
+    return (sock->counters[c] - prev->counters[c]) / interval;
+}
+
+static int64_t counter_diff(const struct top_sock *sock, enum top_counter a,
+			    enum top_counter b)
+{
+    if (!sock->has_counter[a] || !sock->has_counter[b])
+	return -1;
+    return sock->counters[a] - sock->counters[b];
+}
+
+static void top_derive_rates(struct top_sample *sample,
+			     const struct top_sample *prev, double interval)
+{
+    size_t i;
+    for (i = 0; i < sample->len; i++) {
+	struct top_sock *sock = &sample->socks[i];
+
+	const struct top_sock *prev_sock =
+	    bsearch(sock, prev->socks, prev->len, sizeof(struct top_sock),
+		    top_sock_id_cmp);
+
+	if (!prev_sock)
+	    continue;
+
+	sock->has_rates = true;
+	sock->in_msg_rate =
+	    counter_rate(sock, prev_sock, top_counter_to_app_msgs, interval);
+	sock->in_byte_rate =
+	    counter_rate(sock, prev_sock, top_counter_to_app_bytes, interval);
+	sock->out_msg_rate =
+	    counter_rate(sock, prev_sock, top_counter_from_app_msgs, interval);
+	sock->out_byte_rate =
+	    counter_rate(sock, prev_sock, top_counter_from_app_bytes,
+			 interval);
+	sock->drain_msg_rate =
+	    counter_rate(sock, prev_sock, top_counter_to_lower_msgs, interval);
+
+	if (sock->has_counter[top_counter_tcp_total_retrans] &&
+	    prev_sock->has_counter[top_counter_tcp_total_retrans])
+	    sock->new_retrans =
+		sock->counters[top_counter_tcp_total_retrans] -
+		prev_sock->counters[top_counter_tcp_total_retrans];
+    }
+}
+
+static void print_optional_int64(int64_t value)
+{
+    if (value >= 0)
+	printf(" %7" PRId64, value);
+    else
+	printf(" %7s", "-");
+}
+
+static const char *top_sock_state(const struct top_sock *sock,
+				  int64_t tx_queue)
+{
+    if (!sock->has_counter[top_counter_to_app_msgs])
+	return "server";
+    if (!sock->has_rates)
+	return "new";
+    /* messages queued, but none handed to the lower layer */
+    if (tx_queue > 0 && sock->drain_msg_rate == 0)
+	return "stalled";
+    if (sock->new_retrans > 0)
+	return "retrans";
+    return "ok";
+}
+
+static void top_print(struct top_sample *sample, size_t num_unresponsive)
+{
+    if (isatty(STDOUT_FILENO))
+	printf("\033[H\033[2J");
+
+    printf("%zu sockets, %zu unresponsive\n\n", sample->len,
+	   num_unresponsive);
+
+    printf("Create PID  Sockref  Transport  In msg/s  In B/s     "
+	   "Out msg/s Out B/s     TxQueue RxQueue  RTT us  Retr  "
+	   "Conn State   State\n");
+
+    size_t i;
+    for (i = 0; i < sample->len; i++) {
+	const struct top_sock *sock = &sample->socks[i];
+
+	int64_t tx_queue = counter_diff(sock, top_counter_from_app_msgs,
+					top_counter_to_lower_msgs);
+	int64_t rx_queue = counter_diff(sock, top_counter_from_lower_msgs,
+					top_counter_to_app_msgs);
+	int64_t rtt = sock->has_counter[top_counter_tcp_rtt] ?
+	    sock->counters[top_counter_tcp_rtt] : -1;
+
+	printf("%10d   %6" PRId64 "  %-9s  %8.0f  %-10.0f %9.0f %-10.0f ",
+	       sock->creator_pid, sock->sock_ref, sock->transport,
+	       sock->in_msg_rate, sock->in_byte_rate, sock->out_msg_rate,
+	       sock->out_byte_rate);
+	print_optional_int64(tx_queue);
+	print_optional_int64(rx_queue);
+	print_optional_int64(rtt);
+	printf(" %5" PRId64 "  %-12s %s\n", sock->new_retrans,
+	       strlen(sock->conn_state) > 0 ? sock->conn_state : "-",
+	       top_sock_state(sock, tx_queue));
+    }
+
+    fflush(stdout);
+}
+
+struct top_count
+{
+    pid_t creator_pid;
+    size_t count;
+};
+
+static void count_cb(pid_t creator_pid, int64_t sock_ref, void *cb_data)
+{
+    struct top_count *count = cb_data;
+
+    if (count->creator_pid == -1 || count->creator_pid == creator_pid)
+	count->count++;
+}
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int top_take_sample(pid_t creator_pid, struct top_sample *sample,
+			   size_t *num_unresponsive)
+{
+    struct top_count listed = {
+	.creator_pid = creator_pid
+    };
+    if (xcmc_list(count_cb, &listed) < 0)
+	return -1;
+
+    sample->len = 0;
+    int num_dumped = xcmc_dump(creator_pid, top_sample_cb, sample);
+    if (num_dumped < 0)
+	return -1;
+
+    /* sockets which are listed but did not respond are either
+       closed, or owned by busy or hung threads */
+    *num_unresponsive = listed.count > sample->len ?
+	listed.count - sample->len : 0;
+
+    qsort(sample->socks, sample->len, sizeof(struct top_sock),
+	  top_sock_id_cmp);
+
+    return 0;
+}
+
+static int cmd_top(pid_t creator_pid, int interval, int iterations)
+{
+    struct top_sample samples[2] = {};
+    struct top_sample *prev = &samples[0];
+    struct top_sample *cur = &samples[1];
+    size_t num_unresponsive;
+
+    if (top_take_sample(creator_pid, prev, &num_unresponsive) < 0)
+	return -1;
+
+    double prev_time = get_time();
+
+    int i;
+    for (i = 0; iterations < 0 || i < iterations; i++) {
+	sleep(interval);
+
+	if (top_take_sample(creator_pid, cur, &num_unresponsive) < 0)
+	    return -1;
+
+	double now = get_time();
+
+	top_derive_rates(cur, prev, now - prev_time);
+
+	qsort(cur->socks, cur->len, sizeof(struct top_sock),
+	      top_sock_load_cmp);
+
+	top_print(cur, num_unresponsive);
+
+	/* restore id order, for the next round of rate calculations */
+	qsort(cur->socks, cur->len, sizeof(struct top_sock),
+	      top_sock_id_cmp);
+
+	struct top_sample *tmp = prev;
+	prev = cur;
+	cur = tmp;
+	prev_time = now;
+    }
+
+    free(samples[0].socks);
+    free(samples[1].socks);
+
+    return 0;
+}
+
 static int64_t parse_int64(const char *str)
 {
     char *end;
@@ -160,12 +530,35 @@ int main(int argc, char **argv)
 {
     int c;
 
-    while ((c = getopt(argc, argv, "h")) != -1)
+    int interval = DEFAULT_TOP_INTERVAL;
+    int iterations = -1;
+
+    while ((c = getopt(argc, argv, "i:n:h")) != -1)
     switch (c) {
+    case 'i': {
+	char *end;
+	interval = strtol(optarg, &end, 10);
+	if (end == optarg || *end != '\0' || interval <= 0) {
+	    usage(argv[0]);
+	    exit(EXIT_FAILURE);
+	}
+	break;
+    }
+    case 'n': {
+	char *end;
+	iterations = strtol(optarg, &end, 10);
+	if (end == optarg || *end != '\0' || iterations < 1) {
+	    usage(argv[0]);
+	    exit(EXIT_FAILURE);
+	}
+	break;
+    }
     case 'h':
 	usage(argv[0]);
 	exit(EXIT_SUCCESS);
 	break;
+    default:
+	exit(EXIT_FAILURE);
     }
 
     int num_args = argc-optind;
@@ -177,7 +570,15 @@ int main(int argc, char **argv)
 	pid_t creator_pid = parse_int64(argv[optind+1]);
 	int64_t sock_ref = parse_int64(argv[optind+2]);
 	rc = cmd_get(creator_pid, sock_ref, &argv[optind+3], num_args-3);
-    } else {
+    } else if (num_args == 1 && strcmp(argv[optind], "dump") == 0)
+	rc = cmd_dump(-1);
+    else if (num_args == 2 && strcmp(argv[optind], "dump") == 0)
+	rc = cmd_dump(parse_int64(argv[optind+1]));
+    else if (num_args == 1 && strcmp(argv[optind], "top") == 0)
+	rc = cmd_top(-1, interval, iterations);
+    else if (num_args == 2 && strcmp(argv[optind], "top") == 0)
+	rc = cmd_top(parse_int64(argv[optind+1]), interval, iterations);
+    else {
 	usage(argv[0]);
 	rc = -1;
     }
@@ -3,11 +3,14 @@
  * Copyright(c) 2020 Ericsson AB
  */
 
+#include "hist.h"
 #include "util.h"
 
 #include <endian.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,6 +30,7 @@
 #define DEFAULT_MSG_SIZE (100)
 #define DEFAULT_BATCH_SIZE (1)
 #define DEFAULT_INTERVAL (1.0)
+#define DEFAULT_LOAD_MSGS (10000)
 
 static void usage(const char *name)
 {
@@ -34,7 +38,11 @@ static void usage(const char *name)
 	   "[-m <msg-size>] [-n <roundtrips>] <addr>\n", name);
     printf("%s [-b <batch-size>] [-c] [-b <batch-size>] [-m <msg-size>] "
 	   "[-n <roundtrips>] <addr>\n", name);
-    printf("%s -s <addr>\n", name);
+    printf("%s -C <num-conns> [-c] [-T <num-threads>] [-r <rate> [-o]] "
+	   "[-b <batch-size>]\n"
+	   "       [-m <msg-size>|-d <size-dist>] [-n <msgs>] "
+	   "[-f <format>] <addr>\n", name);
+    printf("%s -s [-e] <addr>\n", name);
     printf("Options:\n");
     printf("  -s:              Start server and bind to <addr>. Default is "
 	   "to run both a \n"
@@ -55,8 +63,37 @@ static void usage(const char *name)
 	   "Default is to run\n"
 	   "                   indefinitely for latency mode, and %d "
 	   "roundtrips for\n"
-	   "                   throughput mode.\n",
-	   DEFAULT_THROUGHPUT_ROUNDTRIPS);
+	   "                   throughput mode. In load mode, <roundtrips> "
+	   "is the number\n"
+	   "                   of messages per connection (default %d).\n",
+	   DEFAULT_THROUGHPUT_ROUNDTRIPS, DEFAULT_LOAD_MSGS);
+    printf("  -e:              Run an event-driven server, which serves all "
+	   "connections\n"
+	   "                   from a single process. Default is to fork one "
+	   "process per\n"
+	   "                   connection.\n");
+    printf("  -C <num-conns>:  Run in load mode, using <num-conns> "
+	   "concurrent connections.\n"
+	   "                   A stand-alone server must be run with -e.\n");
+    printf("  -T <num-threads>: Spread the load mode connections over "
+	   "<num-threads> client\n"
+	   "                   threads, each with its own event loop "
+	   "(default is 1).\n");
+    printf("  -r <rate>:       Limit the load mode aggregate request rate "
+	   "to <rate> msg/s.\n"
+	   "                   Default is to send as fast as possible.\n");
+    printf("  -d <size-dist>:  Draw load mode message sizes from a "
+	   "distribution. <size-dist>\n"
+	   "                   is either \"uniform:<min>:<max>\" or "
+	   "\"exp:<mean>\".\n");
+    printf("  -o:              Run load mode open-loop, sending on the "
+	   "-r rate schedule\n"
+	   "                   regardless of outstanding requests. Latency "
+	   "is measured from\n"
+	   "                   the scheduled send time.\n");
+    printf("  -f <format>:     Report load mode results in the \"human\" "
+	   "(default), \"json\"\n"
+	   "                   or \"csv\" format.\n");
 }
 
 #define REFLECT_REQ (1)
@@ -119,6 +156,7 @@ static void socket_wait(int epoll_fd, struct xcm_socket *conn_socket)
 }
 
 #define MAX_SERVER_BATCH (64)
+#define MAX_SERVER_MSG (65535)
 
 static void handle_client(struct xcm_socket *conn)
 {
@@ -231,7 +269,132 @@ static void stop_server(int signo, siginfo_t *siginfo, void *context)
     server_should_exit = 1;
 }
 
-static pid_t run_server(const char *server_addr)
+struct event_conn
+{
+    struct xcm_socket *conn;
+    char *pending;
+    size_t pending_len;
+    bool has_pending;
+};
+
+static void event_conn_close(struct event_conn *ec)
+{
+    xcm_close(ec->conn);
+    free(ec->pending);
+    free(ec);
+}
+
+/* returns false if the connection should be closed */
+static bool event_conn_process(struct event_conn *ec, uint64_t start_cpu)
+{
+    for (;;) {
+	if (ec->has_pending) {
+	    int s_rc = xcm_send(ec->conn, ec->pending, ec->pending_len);
+	    if (s_rc < 0 && errno == EAGAIN) {
+		socket_await(ec->conn, XCM_SO_SENDABLE);
+		return true;
+	    } else if (s_rc < 0)
+		return false;
+	    ec->has_pending = false;
+	}
+
+	int r_rc = xcm_receive(ec->conn, ec->pending, MAX_SERVER_MSG);
+
+	if (r_rc < 0 && errno == EAGAIN) {
+	    socket_await(ec->conn, XCM_SO_RECEIVABLE);
+	    return true;
+	} else if (r_rc <= 0)
+	    return false;
+
+	uint64_t cpu_ns;
+
+	switch (ec->pending[0]) {
+	case REFLECT_REQ:
+	    ec->pending_len = r_rc;
+	    break;
+	case CPU_USAGE_REQ:
+	    cpu_ns = htobe64(get_cpu_ns() - start_cpu);
+	    memcpy(ec->pending, &cpu_ns, sizeof(cpu_ns));
+	    ec->pending_len = sizeof(cpu_ns);
+	    break;
+	case TERM_REQ:
+	    return false;
+	default:
+	    fprintf(stderr, "Received unknown request type.\n");
+	    exit(EXIT_FAILURE);
+	}
+	ec->has_pending = true;
+    }
+}
+
+#define MAX_EVENTS (64)
+
+static void run_event_server(struct xcm_socket *server_sock)
+{
+    const uint64_t start_cpu = get_cpu_ns();
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0)
+	ut_die("Error creating epoll instance");
+
+    if (xcm_set_blocking(server_sock, false) < 0)
+	ut_die("Failed to set non-blocking mode");
+
+    socket_await(server_sock, XCM_SO_ACCEPTABLE);
+
+    struct epoll_event nevent = {
+	.events = EPOLLIN,
+	.data.ptr = NULL
+    };
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, xcm_fd(server_sock), &nevent) < 0)
+	ut_die("Error adding fd to epoll instance");
+
+    while (!server_should_exit) {
+	struct epoll_event events[MAX_EVENTS];
+
+	int num = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+	if (num < 0) {
+	    if (errno == EINTR)
+		continue;
+	    ut_die("I/O multiplexing failure");
+	}
+
+	int i;
+	for (i = 0; i < num; i++) {
+	    struct event_conn *ec = events[i].data.ptr;
+
+	    if (ec == NULL) {
+		struct xcm_socket *conn;
+		while ((conn = xcm_accept(server_sock)) != NULL) {
+		    if (xcm_set_blocking(conn, false) < 0)
+			ut_die("Failed to set non-blocking mode");
+
+		    ec = ut_calloc(sizeof(struct event_conn));
+		    ec->conn = conn;
+		    ec->pending = ut_malloc(MAX_SERVER_MSG);
+
+		    struct epoll_event cevent = {
+			.events = EPOLLIN,
+			.data.ptr = ec
+		    };
+		    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, xcm_fd(conn),
+				  &cevent) < 0)
+			ut_die("Error adding fd to epoll instance");
+
+		    if (!event_conn_process(ec, start_cpu))
+			event_conn_close(ec);
+		}
+	    } else if (!event_conn_process(ec, start_cpu))
+		event_conn_close(ec);
+	}
+    }
+
+    close(epoll_fd);
+}
+
+static pid_t run_server(const char *server_addr, bool event_driven)
 {
     pid_t p = fork_noerr();
     if (p > 0)
@@ -250,6 +413,9 @@ static pid_t run_server(const char *server_addr)
     if (!server_sock)
 	ut_die("Unable to create server socket");
 
+    if (event_driven)
+	run_event_server(server_sock);
+
     while (!server_should_exit) {
 	struct xcm_socket *conn = xcm_accept(server_sock);
 
@@ -440,20 +606,81 @@ static void run_latency_client(struct xcm_socket *conn, int num_rt,
     printf("Average: %.3f ms\n", (double)total_latency/(rt*batch_size)/1e6);
 }
 
-enum client_mode { client_mode_latency, client_mode_throughput };
+enum size_dist_type {
+    size_dist_type_fixed,
+    size_dist_type_uniform,
+    size_dist_type_exp
+};
 
-static pid_t run_client(const char *server_addr, enum client_mode mode,
-			int num_rt, int msg_size, int batch_size,
-			double interval)
+struct size_dist
 {
-    pid_t p = fork_noerr();
-    if (p > 0)
-	return p;
+    enum size_dist_type type;
+    int min;
+    int max;
+    double mean;
+};
 
-    /* wait a little in an attempt to avoid the race between UTLS XCM
-       client and server socket creation */
-    usleep(100*1000);
+static int size_dist_draw(const struct size_dist *dist, unsigned int *seed)
+{
+    switch (dist->type) {
+    case size_dist_type_uniform:
+	return dist->min + rand_r(seed) % (dist->max - dist->min + 1);
+    case size_dist_type_exp: {
+	double u = (rand_r(seed) + 1.0) / ((double)RAND_MAX + 2.0);
+	int size = -dist->mean * log(u);
+	return UT_MAX(UT_MIN(size, dist->max), dist->min);
+    }
+    default:
+	return dist->min;
+    }
+}
+
+/* load mode requests carry a type byte and a send timestamp */
+#define LOAD_MSG_MIN ((int)(1 + sizeof(uint64_t)))
+
+enum output_format {
+    output_format_human,
+    output_format_json,
+    output_format_csv
+};
 
+struct load_conf
+{
+    const char *addr;
+    int num_conns;
+    int num_threads;
+    int num_msgs;
+    int batch_size;
+    double rate;
+    bool open_loop;
+    struct size_dist size_dist;
+    enum output_format output_format;
+};
+
+struct load_conn
+{
+    struct xcm_socket *conn;
+    int condition;
+    int sent;
+    int in_flight;
+    uint64_t next_send;
+};
+
+struct load_thread
+{
+    pthread_t thread;
+    const struct load_conf *conf;
+    struct load_conn *conns;
+    int num_conns;
+    int first_conn_idx;
+
+    uint64_t msgs;
+    uint64_t bytes;
+    struct hist latency;
+};
+
+static struct xcm_socket *connect_retry(const char *server_addr)
+{
     struct xcm_socket *conn;
     do {
 	conn = xcm_connect(server_addr, 0);
@@ -464,6 +691,356 @@ static pid_t run_client(const char *server_addr, enum client_mode mode,
 		usleep(10*1000);
 	}
     } while (!conn);
+    return conn;
+}
+
+static void load_conn_await(struct load_conn *lc, int condition)
+{
+    if (condition != lc->condition) {
+	socket_await(lc->conn, condition);
+	lc->condition = condition;
+    }
+}
+
+/* returns true if all messages have been sent and responded to */
+static bool load_conn_process(struct load_thread *t, struct load_conn *lc,
+			      char *msg, unsigned int *seed, uint64_t now,
+			      uint64_t send_interval)
+{
+    const struct load_conf *conf = t->conf;
+
+    while (lc->in_flight > 0) {
+	int rc = xcm_receive(lc->conn, msg, MAX_SERVER_MSG);
+	if (rc >= LOAD_MSG_MIN) {
+	    uint64_t send_time;
+	    memcpy(&send_time, msg + 1, sizeof(send_time));
+	    hist_record(&t->latency, get_time_ns() - send_time);
+	    lc->in_flight--;
+	    t->msgs++;
+	    t->bytes += rc;
+	} else if (rc > 0) {
+	    fprintf(stderr, "Invalid message length.\n");
+	    exit(EXIT_FAILURE);
+	} else if (rc == 0) {
+	    fprintf(stderr, "Server unexpectedly closed the connection.\n");
+	    exit(EXIT_FAILURE);
+	} else if (errno == EAGAIN)
+	    break;
+	else
+	    ut_die("Error receiving message from server");
+    }
+
+    bool blocked = false;
+
+    while (lc->sent < conf->num_msgs &&
+	   (conf->open_loop || lc->in_flight < conf->batch_size) &&
+	   lc->next_send <= now) {
+	int msg_size = UT_MAX(size_dist_draw(&conf->size_dist, seed),
+			      LOAD_MSG_MIN);
+	msg[0] = REFLECT_REQ;
+
+	/* In open-loop mode, latency is measured from the time the
+	   message was scheduled to be sent, rather than when it
+	   actually was sent, so that any stalls in the sender are
+	   accounted for (i.e., avoiding coordinated omission). */
+	uint64_t send_time = conf->open_loop ? lc->next_send : get_time_ns();
+	memcpy(msg + 1, &send_time, sizeof(send_time));
+
+	int rc = xcm_send(lc->conn, msg, msg_size);
+	if (rc == 0) {
+	    lc->sent++;
+	    lc->in_flight++;
+	    lc->next_send += send_interval;
+	} else if (errno == EAGAIN) {
+	    blocked = true;
+	    break;
+	} else
+	    ut_die("Error sending reflection message to server");
+    }
+
+    bool done = lc->sent == conf->num_msgs && lc->in_flight == 0;
+
+    if (done)
+	load_conn_await(lc, 0);
+    else
+	load_conn_await(lc, XCM_SO_RECEIVABLE | (blocked ? XCM_SO_SENDABLE : 0));
+
+    return done;
+}
+
+static void *load_thread_run(void *arg)
+{
+    struct load_thread *t = arg;
+    const struct load_conf *conf = t->conf;
+
+    unsigned int seed = t->first_conn_idx;
+
+    char *msg = ut_calloc(MAX_SERVER_MSG);
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0)
+	ut_die("Error creating epoll instance");
+
+    /* the per-connection inter-message time needed to reach the
+       target aggregate rate */
+    uint64_t send_interval = conf->rate > 0 ?
+	1e9 * conf->num_conns / conf->rate : 0;
+
+    hist_init(&t->latency);
+
+    uint64_t start = get_time_ns();
+
+    int i;
+    for (i = 0; i < t->num_conns; i++) {
+	struct load_conn *lc = &t->conns[i];
+
+	struct epoll_event event = {
+	    .events = EPOLLIN,
+	    .data.ptr = lc
+	};
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, xcm_fd(lc->conn), &event) < 0)
+	    ut_die("Error adding fd to epoll instance");
+
+	/* spread the connections' send times evenly over the interval */
+	lc->next_send = start + (send_interval * (t->first_conn_idx + i)) /
+	    conf->num_conns;
+    }
+
+    int num_active = t->num_conns;
+    bool *done = ut_calloc(sizeof(bool) * t->num_conns);
+
+    /* kick off all connections */
+    for (i = 0; i < t->num_conns; i++)
+	if (load_conn_process(t, &t->conns[i], msg, &seed, start,
+			      send_interval)) {
+	    done[i] = true;
+	    num_active--;
+	}
+
+    while (num_active > 0) {
+	int tmo = -1;
+	uint64_t now = get_time_ns();
+
+	if (send_interval > 0) {
+	    uint64_t next = UINT64_MAX;
+	    for (i = 0; i < t->num_conns; i++) {
+		struct load_conn *lc = &t->conns[i];
+		if (!done[i] && lc->sent < conf->num_msgs &&
+		    (conf->open_loop || lc->in_flight < conf->batch_size))
+		    next = UT_MIN(next, lc->next_send);
+	    }
+	    if (next != UINT64_MAX)
+		/* round up, to avoid busy-waiting */
+		tmo = next > now ? (next - now + 999999) / 1000000 : 0;
+	}
+
+	struct epoll_event events[MAX_EVENTS];
+	int num = epoll_wait(epoll_fd, events, MAX_EVENTS, tmo);
+	if (num < 0)
+	    ut_die("I/O multiplexing failure");
+
+	now = get_time_ns();
+
+	for (i = 0; i < num; i++) {
+	    struct load_conn *lc = events[i].data.ptr;
+	    int idx = lc - t->conns;
+	    if (!done[idx] &&
+		load_conn_process(t, lc, msg, &seed, now, send_interval)) {
+		done[idx] = true;
+		num_active--;
+	    }
+	}
+
+	if (send_interval > 0)
+	    for (i = 0; i < t->num_conns; i++) {
+		struct load_conn *lc = &t->conns[i];
+		if (!done[i] && lc->next_send <= now &&
+		    load_conn_process(t, lc, msg, &seed, now, send_interval)) {
+		    done[i] = true;
+		    num_active--;
+		}
+	    }
+    }
+
+    ut_free(done);
+    close(epoll_fd);
+    ut_free(msg);
+
+    return NULL;
+}
+
+struct load_result
+{
+    const struct load_conf *conf;
+    uint64_t msgs;
+    uint64_t bytes;
+    double wall_time;
+    uint64_t client_cpu;
+    uint64_t server_cpu;
+    struct hist latency;
+};
+
+static const double report_percentiles[] = { 50, 90, 99, 99.9, 99.99 };
+
+static void print_load_result(const struct load_result *r)
+{
+    const struct load_conf *conf = r->conf;
+    double rate = r->msgs / r->wall_time;
+    double throughput = r->bytes / r->wall_time;
+    double client_cpu = (double)r->client_cpu / r->msgs / 1e3;
+    double server_cpu = (double)r->server_cpu / r->msgs / 1e3;
+    double min = r->msgs > 0 ? r->latency.min / 1e3 : 0;
+    double max = r->latency.max / 1e3;
+    size_t i;
+
+    switch (conf->output_format) {
+    case output_format_human:
+	printf("Connections: %d\n", conf->num_conns);
+	printf("Client threads: %d\n", conf->num_threads);
+	printf("Mode: %s\n", conf->open_loop ? "open-loop" : "closed-loop");
+	printf("Round-trips: %" PRIu64 "\n", r->msgs);
+	printf("Duration: %.3f s\n", r->wall_time);
+	printf("Request rate: %.0f msg/s\n", rate);
+	printf("Request throughput: %.0f bytes/s\n", throughput);
+	printf("Client CPU usage (rx+tx): %.2f us/msg\n", client_cpu);
+	printf("Server CPU usage (rx+tx): %.2f us/msg\n", server_cpu);
+	printf("Round-trip latency:\n");
+	printf("  Min:      %10.1f us\n", min);
+	for (i = 0; i < UT_ARRAY_LEN(report_percentiles); i++)
+	    printf("  P%-7g  %10.1f us\n", report_percentiles[i],
+		   hist_percentile(&r->latency, report_percentiles[i]) / 1e3);
+	printf("  Max:      %10.1f us\n", max);
+	break;
+    case output_format_json:
+	printf("{\"connections\": %d, \"threads\": %d, \"open_loop\": %s, "
+	       "\"round_trips\": %" PRIu64 ", \"duration_s\": %.6f, "
+	       "\"rate_msg_per_s\": %.1f, \"throughput_bytes_per_s\": %.1f, "
+	       "\"client_cpu_us_per_msg\": %.3f, "
+	       "\"server_cpu_us_per_msg\": %.3f, \"latency_us\": "
+	       "{\"min\": %.3f", conf->num_conns, conf->num_threads,
+	       conf->open_loop ? "true" : "false", r->msgs, r->wall_time,
+	       rate, throughput, client_cpu, server_cpu, min);
+	for (i = 0; i < UT_ARRAY_LEN(report_percentiles); i++)
+	    printf(", \"p%g\": %.3f", report_percentiles[i],
+		   hist_percentile(&r->latency, report_percentiles[i]) / 1e3);
+	printf(", \"max\": %.3f}}\n", max);
+	break;
+    case output_format_csv:
+	printf("connections,threads,open_loop,round_trips,duration_s,"
+	       "rate_msg_per_s,throughput_bytes_per_s,client_cpu_us_per_msg,"
+	       "server_cpu_us_per_msg,latency_min_us");
+	for (i = 0; i < UT_ARRAY_LEN(report_percentiles); i++)
+	    printf(",latency_p%g_us", report_percentiles[i]);
+	printf(",latency_max_us\n");
+	printf("%d,%d,%d,%" PRIu64 ",%.6f,%.1f,%.1f,%.3f,%.3f,%.3f",
+	       conf->num_conns, conf->num_threads, conf->open_loop, r->msgs,
+	       r->wall_time, rate, throughput, client_cpu, server_cpu, min);
+	for (i = 0; i < UT_ARRAY_LEN(report_percentiles); i++)
+	    printf(",%.3f",
+		   hist_percentile(&r->latency, report_percentiles[i]) / 1e3);
+	printf(",%.3f\n", max);
+	break;
+    }
+}
+
+static void run_load_client(const struct load_conf *conf)
+{
+    struct load_conn *conns =
+	ut_calloc(sizeof(struct load_conn) * conf->num_conns);
+
+    int i;
+    for (i = 0; i < conf->num_conns; i++) {
+	struct load_conn *lc = &conns[i];
+	lc->conn = connect_retry(conf->addr);
+
+	if (xcm_set_blocking(lc->conn, false) < 0)
+	    ut_die("Failed to set non-blocking mode");
+	lc->condition = -1;
+    }
+
+    struct load_thread threads[conf->num_threads];
+
+    uint64_t start_cpu = get_cpu_ns();
+    uint64_t start_time = get_time_ns();
+
+    int first_conn_idx = 0;
+    for (i = 0; i < conf->num_threads; i++) {
+	struct load_thread *t = &threads[i];
+
+	int num_conns = conf->num_conns / conf->num_threads +
+	    (i < conf->num_conns % conf->num_threads ? 1 : 0);
+
+	*t = (struct load_thread) {
+	    .conf = conf,
+	    .conns = &conns[first_conn_idx],
+	    .num_conns = num_conns,
+	    .first_conn_idx = first_conn_idx
+	};
+
+	first_conn_idx += num_conns;
+
+	if (pthread_create(&t->thread, NULL, load_thread_run, t) != 0)
+	    ut_die("Unable to create client thread");
+    }
+
+    struct load_result result = {
+	.conf = conf
+    };
+    hist_init(&result.latency);
+
+    for (i = 0; i < conf->num_threads; i++) {
+	pthread_join(threads[i].thread, NULL);
+	result.msgs += threads[i].msgs;
+	result.bytes += threads[i].bytes;
+	hist_merge(&result.latency, &threads[i].latency);
+    }
+
+    result.wall_time = (get_time_ns() - start_time) / 1e9;
+    result.client_cpu = get_cpu_ns() - start_cpu;
+    result.server_cpu = query_cpu(conns[0].conn);
+
+    print_load_result(&result);
+
+    for (i = 0; i < conf->num_conns; i++)
+	if (xcm_close(conns[i].conn) < 0)
+	    ut_die("Error closing connection");
+
+    ut_free(conns);
+}
+
+enum client_mode {
+    client_mode_latency,
+    client_mode_throughput,
+    client_mode_load
+};
+
+static pid_t run_load(const struct load_conf *conf)
+{
+    pid_t p = fork_noerr();
+    if (p > 0)
+	return p;
+
+    usleep(100*1000);
+
+    run_load_client(conf);
+
+    exit(EXIT_SUCCESS);
+}
+
+static pid_t run_client(const char *server_addr, enum client_mode mode,
+			int num_rt, int msg_size, int batch_size,
+			double interval)
+{
+    pid_t p = fork_noerr();
+    if (p > 0)
+	return p;
+
+    /* wait a little in an attempt to avoid the race between UTLS XCM
+       client and server socket creation */
+    usleep(100*1000);
+
+    struct xcm_socket *conn = connect_retry(server_addr);
 
     if (mode == client_mode_throughput)
 	run_throughput_client(conn, num_rt, msg_size, batch_size);
@@ -535,6 +1112,46 @@ static double parse_float(char* float_str) {
     }
 }
 
+static void parse_size_dist(char *dist_str, struct size_dist *dist)
+{
+    char *params = strchr(dist_str, ':');
+
+    if (params == NULL)
+	goto err;
+
+    *params = '\0';
+    params++;
+
+    if (strcmp(dist_str, "uniform") == 0) {
+	char *max_str = strchr(params, ':');
+	if (max_str == NULL)
+	    goto err;
+	*max_str = '\0';
+	max_str++;
+	dist->type = size_dist_type_uniform;
+	dist->min = parse_int(params);
+	dist->max = parse_int(max_str);
+    } else if (strcmp(dist_str, "exp") == 0) {
+	dist->type = size_dist_type_exp;
+	dist->mean = parse_float(params);
+	dist->min = 1;
+	dist->max = MAX_SERVER_MSG;
+    } else
+	goto err;
+
+    if (dist->min < 1 || dist->max < dist->min || dist->max > MAX_SERVER_MSG) {
+	fprintf(stderr, "Message sizes must be in the range 1-%d bytes.\n",
+		MAX_SERVER_MSG);
+	exit(EXIT_FAILURE);
+    }
+
+    return;
+
+err:
+    fprintf(stderr, "Invalid message size distribution.\n");
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char **argv)
 {
     int c;
@@ -545,8 +1162,14 @@ int main(int argc, char **argv)
     int msg_size = DEFAULT_MSG_SIZE;
     int batch_size = DEFAULT_BATCH_SIZE;
     double interval = -1;
+    bool event_server = false;
+    bool num_rt_set = false;
+    struct load_conf load_conf = {
+	.num_threads = 1,
+	.size_dist.type = size_dist_type_fixed
+    };
 
-    while ((c = getopt (argc, argv, "cspn:m:b:i:h")) != -1)
+    while ((c = getopt (argc, argv, "cspn:m:b:i:eC:T:r:od:f:h")) != -1)
     switch (c) {
     case 'c':
 	client = true;
@@ -560,6 +1183,7 @@ int main(int argc, char **argv)
 	    num_rt = DEFAULT_LATENCY_ROUNDTRIPS;
 	break;
     case 'n':
+	num_rt_set = true;
 	num_rt = parse_int(optarg);
 	if (num_rt <= 0) {
 	    fprintf(stderr, "The number of roundtrips must be at least 1.\n");
@@ -587,10 +1211,55 @@ int main(int argc, char **argv)
 	    exit(EXIT_FAILURE);
 	}
 	break;
+    case 'e':
+	event_server = true;
+	break;
+    case 'C':
+	client_mode = client_mode_load;
+	load_conf.num_conns = parse_int(optarg);
+	if (load_conf.num_conns < 1) {
+	    fprintf(stderr, "The number of connections must be at least 1.\n");
+	    exit(EXIT_FAILURE);
+	}
+	break;
+    case 'T':
+	load_conf.num_threads = parse_int(optarg);
+	if (load_conf.num_threads < 1) {
+	    fprintf(stderr, "The number of threads must be at least 1.\n");
+	    exit(EXIT_FAILURE);
+	}
+	break;
+    case 'r':
+	load_conf.rate = parse_float(optarg);
+	if (load_conf.rate <= 0) {
+	    fprintf(stderr, "Rate must be positive.\n");
+	    exit(EXIT_FAILURE);
+	}
+	break;
+    case 'o':
+	load_conf.open_loop = true;
+	break;
+    case 'd':
+	parse_size_dist(optarg, &load_conf.size_dist);
+	break;
+    case 'f':
+	if (strcmp(optarg, "human") == 0)
+	    load_conf.output_format = output_format_human;
+	else if (strcmp(optarg, "json") == 0)
+	    load_conf.output_format = output_format_json;
+	else if (strcmp(optarg, "csv") == 0)
+	    load_conf.output_format = output_format_csv;
+	else {
+	    fprintf(stderr, "Unknown output format \"%s\".\n", optarg);
+	    exit(EXIT_FAILURE);
+	}
+	break;
     case 'h':
 	usage(argv[0]);
 	exit(EXIT_SUCCESS);
 	break;
+    default:
+	exit(EXIT_FAILURE);
     }
 
     /* if neither client nor server is specified, we will run both */
@@ -616,12 +1285,33 @@ int main(int argc, char **argv)
 
     const char *addr = argv[optind];
 
+    if (client_mode == client_mode_load) {
+	load_conf.addr = addr;
+	load_conf.num_msgs = num_rt_set ? num_rt : DEFAULT_LOAD_MSGS;
+	load_conf.batch_size = batch_size;
+	load_conf.num_threads = UT_MIN(load_conf.num_threads,
+				       load_conf.num_conns);
+	if (load_conf.size_dist.type == size_dist_type_fixed) {
+	    load_conf.size_dist.min = msg_size;
+	    load_conf.size_dist.max = msg_size;
+	}
+	/* fan-in is only meaningful with a single-process server */
+	event_server = true;
+
+	if (load_conf.open_loop && load_conf.rate == 0) {
+	    fprintf(stderr, "Open-loop mode requires a target rate.\n");
+	    exit(EXIT_FAILURE);
+	}
+    }
+
     pid_t server_pid = -1;
     if (server)
-	server_pid = run_server(addr);
+	server_pid = run_server(addr, event_server);
 
     pid_t client_pid = -1;
-    if (client)
+    if (client && client_mode == client_mode_load)
+	client_pid = run_load(&load_conf);
+    else if (client)
 	client_pid = run_client(addr, client_mode, num_rt, msg_size,
 				batch_size, interval);
 